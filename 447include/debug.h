@@ -0,0 +1,77 @@
+/**
+ * debug.h
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the definition of the debugging state of a processor,
+ * which holds the breakpoints, the instruction profile, the memory heat map,
+ * the basic block counts, the recording for reverse execution, and the per-hart
+ * state of the instrumentation plugins.
+ *
+ * The debugging features are implemented by the execution engine, which has a
+ * specialized variant of its run loop for each combination of features. When
+ * none of the features are enabled, the run loop has no debugging code in it.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+#ifndef DEBUG_H_
+#define DEBUG_H_
+
+// Standard Includes
+#include <stdbool.h>                // Boolean type and definitions
+#include <stdint.h>                 // Fixed-size integral types
+
+// Local Includes
+#include "riscv_isa.h"              // Number of opcodes
+#include "plugin.h"                 // Kinds of plugin counters
+
+/*----------------------------------------------------------------------------
+ * Definitions
+ *----------------------------------------------------------------------------*/
+
+/* Forward declarations of a hart's memory heat map, block counts, undo log,
+ * and statistics. */
+struct heatmap;
+struct hotblocks;
+struct undo_log;
+struct stats_hart;
+
+// The maximum number of breakpoints that can be set on a processor
+#define DEBUG_MAX_BREAKPOINTS       16
+
+// The breakpoints, profiling, heat map, and plugin state of a processor
+typedef struct debug_state {
+    bool profile_mode;              // Indicates if profiling is active
+    bool verbose_delta;             // Verbose mode only shows the registers
+                                    // and memory that each cycle changed
+    bool breakpoint_hit;            // Stopped at a breakpoint, which is
+                                    // skipped when execution resumes
+    int num_breakpoints;            // Number of breakpoints set
+    uint32_t breakpoints[DEBUG_MAX_BREAKPOINTS];    // Breakpoint addresses
+    uint64_t opcode_counts[RISCV_NUM_OPCODES];      // Instructions run with
+                                                    // each opcode
+    bool in_block;                  // The next instruction continues the
+                                    // current basic block
+    uint64_t plugin_counts[SIM_PLUGIN_NUM_COUNTS];  // Events counted for the
+                                                    // plugins' counters
+    struct heatmap *heatmap;        // Memory heat map, if one was started
+    struct hotblocks *hotblocks;    // Basic block counts, if started
+    uint32_t block_next;            // PC that continues the current block
+    uint32_t block_last;            // PC of the current block's last
+                                    // instruction
+    struct undo_log *undo;          // Undo log, if recording is on
+    struct stats_hart *stats;       // Memory access and halt counts, if the
+                                    // statistics were started
+} debug_state_t;
+
+#endif /* DEBUG_H_ */
@@ -29,17 +29,36 @@
 #define MEMORY_H_
 
 // Standard Includes
+#include <stdbool.h>            // Boolean type and definitions
 #include <stdint.h>             // Fixed-size integral types
 
 // Local Includes
 #include "riscv_abi.h"          // Definition of the number of memory regions
+#include "riscv_isa.h"          // Atomic memory operation function codes
 
 /*----------------------------------------------------------------------------
  * Definitions
  *----------------------------------------------------------------------------*/
 
-// Forward declaration of the CPU state struct
+/* Forward declarations of the CPU state struct, the program's symbol table and
+ * cached image, and the contents of a shared text segment. */
 struct cpu_state;
+struct symbol_table;
+struct program_image;
+struct shared_text;
+
+// The permissions that a segment of memory can have
+#define MEM_PERM_READ           0x1     // Loads are permitted
+#define MEM_PERM_WRITE          0x2     // Stores are permitted
+#define MEM_PERM_EXEC           0x4     // Instruction fetches are permitted
+
+// The ways that the contents of a memory segment can be provided
+typedef enum mem_backing {
+    MEM_BACKING_FILE,           // Loaded from the program's files
+    MEM_BACKING_ZERO,           // Zero-filled memory
+    MEM_BACKING_STACK,          // Zero-filled memory, holding the stack
+    MEM_BACKING_MMIO,           // Registers of a memory-mapped device
+} mem_backing_t;
 
 // The representation of a segment in memory
 typedef struct {
@@ -47,14 +66,41 @@ typedef struct {
     uint32_t max_size;          // Maximum permitted size for the memory segment
     uint32_t size;              // Size of the memory segment in bytes
     uint8_t *mem;               // Actual memory buffer for the segment
+    uint32_t mapped_size;       // Size of the mapping, if the buffer was
+                                // mapped with mmap instead of allocated
+    struct shared_text *shared; // Owner of the buffer, if the segment shares
+                                // it with other instances
+    bool executable;            // Indicates if the segment holds code
+    uint8_t perms;              // Permissions of the segment (MEM_PERM_*)
+    mem_backing_t backing;      // What provides the segment's contents
+    uint64_t *page_writes;      // Number of writes to each page, allocated
+                                // once an executable segment is written
     const char *extension;      // File extension for the segment's data file
     const char *name;           // Name of the segment, for debugging purposes
 } mem_segment_t;
 
+/* The reservation held by a hart after a load-reserved instruction. When other
+ * harts share the memory, the generation of the word's reservation granule is
+ * kept, which every store to the granule advances. The store-conditional then
+ * fails if any hart has stored to the word in between, even if it stored the
+ * value that was loaded. */
+typedef struct mem_reservation {
+    bool valid;                 // Indicates if a reservation is held
+    uint32_t addr;              // Address of the reserved word
+    uint32_t generation;        // Generation of the word's granule when it
+                                // was reserved
+} mem_reservation_t;
+
 // The representation for all the memory in the processor
 typedef struct memory {
     int num_segments;           // Number of memory segments
     mem_segment_t *segments;    // Memory segments in the CPU
+    mem_reservation_t reservation;  // This hart's load reservation
+    bool shared;                // Indicates if other harts share the memory
+    struct symbol_table *symbols;   // Symbols of the program, if it was loaded
+                                    // from an ELF file that has them
+    struct program_image *image;    // Cached image the program was loaded
+                                    // from, which this hart holds
 } memory_t;
 
 /*----------------------------------------------------------------------------
@@ -65,9 +111,12 @@ typedef struct memory {
  * Reads the value at the specified address in the processor's memory.
  *
  * This function ensures that the value is read in little-endian order from the
- * address. If the address is invalid or it is not aligned to a 4-byte boundary,
- * then this function will mark the CPU as halted, and print out an error
- * message.
+ * address. If the address is invalid, then this function raises a load
+ * exception. If no trap handler is installed, it will instead mark the CPU as
+ * halted, and print out an error message. If the address is not aligned to a
+ * 4-byte boundary, it is handled according to the alignment policy: a load
+ * exception is raised as above (the default), the load is emulated byte by
+ * byte, or the CPU is halted.
  *
  * Inputs:
  *  - cpu_state     The CPU state structure for the processor.
@@ -75,18 +124,38 @@ typedef struct memory {
  *
  * Outputs:
  *  - cpu_state     If the address is misaligned or invalid, the halted field
- *                  will be set to true.
+ *                  will be set to true, unless a trap handler is installed.
  *  - return        The value at the given address in the CPU's memory.
  **/
 uint32_t mem_read32(struct cpu_state *cpu_state, uint32_t addr);
 
+/**
+ * Fetches the instruction at the specified address in the processor's memory.
+ *
+ * This behaves like mem_read32, except that a misaligned or invalid address
+ * raises an instruction fetch exception instead of a load exception.
+ *
+ * Inputs:
+ *  - cpu_state     The CPU state structure for the processor.
+ *  - addr          The address from which to fetch the instruction.
+ *
+ * Outputs:
+ *  - cpu_state     If the address is misaligned or invalid, the halted field
+ *                  will be set to true, unless a trap handler is installed.
+ *  - return        The instruction at the given address, or 0 on failure.
+ **/
+uint32_t mem_fetch32(struct cpu_state *cpu_state, uint32_t addr);
+
 /**
  * Writes the specified value to the given address in the processor's memory.
  *
  * The function ensures that the value is written in little-endian order to the
- * address. If the address is invalid or it is not aligned to a 4-byte boundary,
- * then this function will mark the CPU as halted, and no update to memory
- * happens.
+ * address. If the address is invalid, then this function raises a store
+ * exception, and no update to memory happens. If no trap handler is installed,
+ * it will instead mark the CPU as halted. If the address is not aligned to a
+ * 4-byte boundary, it is handled according to the alignment policy: a store
+ * exception is raised as above (the default), the store is emulated byte by
+ * byte, or the CPU is halted.
  *
  * Inputs:
  *  - cpu_state     The CPU state structure for the processor.
@@ -95,9 +164,42 @@ uint32_t mem_read32(struct cpu_state *cpu_state, uint32_t addr);
  *
  * Outputs:
  *  - cpu_state     If the address is misaligned or invalid, the halted field
- *                  will be set to true. The processor memory is also
- *                  appropriately updated.
+ *                  will be set to true, unless a trap handler is installed.
+ *                  The processor memory is also appropriately updated.
  **/
 void mem_write32(struct cpu_state *cpu_state, uint32_t addr, uint32_t value);
 
+/**
+ * Atomically loads the word at the specified address, and places a reservation
+ * on it for a subsequent store-conditional (the LR.W instruction).
+ *
+ * Errors are handled in the same way as mem_read32.
+ **/
+uint32_t mem_load_reserved32(struct cpu_state *cpu_state, uint32_t addr);
+
+/**
+ * Atomically stores the value to the specified address if the hart still holds
+ * a reservation on it (the SC.W instruction). The reservation is released.
+ *
+ * The store succeeds only if no hart has stored to the word since the
+ * reservation was made. Returns true if the store succeeded. Errors are
+ * handled in the same way as mem_write32, in which case false is returned.
+ **/
+bool mem_store_conditional32(struct cpu_state *cpu_state, uint32_t addr,
+        uint32_t value);
+
+/**
+ * Performs the atomic memory operation on the word at the specified address,
+ * combining it with the given value (the AMO*.W instructions). Returns the
+ * original value of the word.
+ *
+ * The operation is carried out with a single atomic instruction on the host
+ * where possible, so it is atomic with respect to all other harts. Like a
+ * store, it makes any store-conditional to the word that is pending fail.
+ * Errors are handled in the same way as mem_write32, in which case 0 is
+ * returned.
+ **/
+uint32_t mem_amo32(struct cpu_state *cpu_state, uint32_t addr,
+        amo_funct5_t op, uint32_t value);
+
 #endif /* MEMORY_H_ */
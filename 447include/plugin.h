@@ -0,0 +1,134 @@
+/**
+ * plugin.h
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the interface for instrumentation plugins, which are
+ * shared objects that the simulator loads at startup with the -p flag.
+ *
+ * A plugin exports a function named sim_plugin_init, with the type
+ * sim_plugin_init_t. The simulator calls it once when the plugin is loaded,
+ * and the plugin fills in its name and the callbacks for the events it wants
+ * to observe. Callbacks that are left NULL cost nothing. For the cheapest
+ * analyses, the plugin can instead register counters, which the simulator
+ * increments inline for each event of the counter's kind.
+ *
+ * When no plugin subscribes to instruction, block, ECALL, or halt events, and
+ * no counters are registered, the simulator runs a variant of its run loop that
+ * has no plugin code in it.
+ *
+ * With multiple harts running on separate host threads, callbacks for
+ * different harts may be called concurrently. The counters are kept per hart,
+ * so they never need synchronization.
+ *
+ * A plugin is built as a shared object against this directory, for example:
+ *      gcc -shared -fPIC -I 447include my_plugin.c -o my_plugin.so
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+#ifndef PLUGIN_H_
+#define PLUGIN_H_
+
+// Standard Includes
+#include <stdbool.h>                // Boolean type and definitions
+#include <stdint.h>                 // Fixed-size integral types
+
+/*----------------------------------------------------------------------------
+ * Definitions
+ *----------------------------------------------------------------------------*/
+
+/* The version of the plugin interface, which a plugin must be built against.
+ * It is incremented whenever the plugin or host structures change, since a
+ * plugin built against another version would use the wrong layout. */
+#define SIM_PLUGIN_API_VERSION      2
+
+// The name of the function that each plugin must export
+#define SIM_PLUGIN_INIT_SYMBOL      "sim_plugin_init"
+
+// Forward declaration of the CPU state struct
+struct cpu_state;
+
+// The kinds of events that can be counted by inline counters
+typedef enum sim_plugin_count {
+    SIM_PLUGIN_COUNT_INSTRUCTIONS,  // Instructions executed
+    SIM_PLUGIN_COUNT_BLOCKS,        // Basic blocks entered
+    SIM_PLUGIN_COUNT_LOADS,         // Word loads, from mem_read32
+    SIM_PLUGIN_COUNT_STORES,        // Word stores, from mem_write32
+    SIM_PLUGIN_COUNT_ECALLS,        // ECALL instructions executed
+    SIM_PLUGIN_NUM_COUNTS,          // Number of kinds of counters
+} sim_plugin_count_t;
+
+/* The callbacks for the events a plugin subscribes to. Each one is passed the
+ * plugin's data pointer, and the hart that the event happened on. */
+typedef struct sim_plugin_callbacks {
+    // Called before each instruction is executed, with the instruction
+    void (*instruction)(void *data, const struct cpu_state *cpu_state,
+            uint32_t instr);
+
+    /* Called before the first instruction of each basic block is executed,
+     * which is any instruction that is not reached by falling through from the
+     * previous one. */
+    void (*block)(void *data, const struct cpu_state *cpu_state);
+
+    // Called after each word load or store, with the value loaded or stored
+    void (*mem_access)(void *data, const struct cpu_state *cpu_state,
+            uint32_t addr, uint32_t value, bool is_store);
+
+    // Called before each ECALL instruction is executed
+    void (*ecall)(void *data, const struct cpu_state *cpu_state);
+
+    // Called when the hart halts
+    void (*halt)(void *data, const struct cpu_state *cpu_state);
+
+    // Called when the simulator exits, after which the plugin is unloaded
+    void (*unload)(void *data);
+} sim_plugin_callbacks_t;
+
+// The description of a plugin, which the plugin fills in when it is loaded
+typedef struct sim_plugin {
+    int api_version;                // Must be set to SIM_PLUGIN_API_VERSION
+    const char *name;               // Name of the plugin, for messages
+    void *data;                     // Passed to each of the callbacks
+    sim_plugin_callbacks_t callbacks;   // Callbacks for subscribed events
+} sim_plugin_t;
+
+// The services the simulator provides to a plugin
+typedef struct sim_plugin_host {
+    int api_version;                // The simulator's SIM_PLUGIN_API_VERSION
+    int num_harts;                  // Number of harts being simulated
+
+    /* Registers a counter for the given kind of event, which must be done
+     * while the plugin is being initialized. Returns a handle for the counter,
+     * or a negative error code on failure. */
+    int (*counter_register)(sim_plugin_count_t kind);
+
+    // Reads the total value of the counter across all of the harts
+    uint64_t (*counter_read)(int counter);
+
+    /* Reads the word at the given address in the hart's memory, without
+     * raising any exceptions. Returns false if the address is invalid. */
+    bool (*mem_peek32)(const struct cpu_state *cpu_state, uint32_t addr,
+            uint32_t *value);
+
+    /* Disassembles the instruction at the given PC into a buffer belonging to
+     * the calling thread, which is overwritten by its next call. */
+    const char *(*disassemble)(uint32_t pc, uint32_t instr);
+} sim_plugin_host_t;
+
+/* The type of the function each plugin exports, which is passed the arguments
+ * given after the colon in the -p flag, or an empty string. Returns 0 on
+ * success, or a negative error code if the plugin could not be initialized. */
+typedef int (*sim_plugin_init_t)(const sim_plugin_host_t *host,
+        sim_plugin_t *plugin, const char *args);
+
+#endif /* PLUGIN_H_ */
@@ -9,7 +9,8 @@
  * This file contains the interface to the processor's register file.
  *
  * This handles abstracting the register file to the core simulator functions.
- * These functions should be used to read and write register values.
+ * These functions should be used to read and write register values. They are
+ * called for nearly every instruction, so they are defined inline here.
  *
  * Authors:
  *  - 2017: Brandon Perez
@@ -48,7 +49,14 @@
  * Outputs:
  *  - return        The value of register rs in the register file.
  **/
-uint32_t register_read(const cpu_state_t *cpu_state, riscv_isa_reg_t rs);
+static inline uint32_t register_read(const cpu_state_t *cpu_state,
+        riscv_isa_reg_t rs)
+{
+    assert((riscv_isa_reg_t)0 <= rs);
+    assert(rs <= (riscv_isa_reg_t)(RISCV_NUM_REGS - 1));
+
+    return cpu_state->registers[rs];
+}
 
 /**
  * Updates the destination register rd with the given value.
@@ -66,6 +74,17 @@ uint32_t register_read(const cpu_state_t *cpu_state, riscv_isa_reg_t rs);
  *  - cpu_state     If rd is not 0, then the appropriate entry in the registers
  *                  array is updated.
  **/
-void register_write(cpu_state_t *cpu_state, riscv_isa_reg_t rd, uint32_t value);
+static inline void register_write(cpu_state_t *cpu_state, riscv_isa_reg_t rd,
+        uint32_t value)
+{
+    assert((riscv_isa_reg_t)0 <= rd);
+    assert(rd <= (riscv_isa_reg_t)(RISCV_NUM_REGS - 1));
+
+    /* Instead of branching on rd, always write the register, and then clear
+     * register 0 again, which discards any write to it. */
+    cpu_state->registers[rd] = value;
+    cpu_state->registers[0] = 0;
+    return;
+}
 
 #endif /* REGISTER_FILE_H_ */
@@ -60,8 +60,29 @@ typedef enum opcode {
 
     // Opcode that indicates a special system instruction (I-type)
     OP_SYSTEM               = 0x73,
+
+    // Opcode that indicates an atomic memory operation (R-type)
+    OP_AMO                  = 0x2F,
 } opcode_t;
 
+// The number of possible opcodes, which are 7 bits wide
+#define RISCV_NUM_OPCODES       (1 << 7)
+
+/* The list of opcodes and their names, for tables indexed by the opcode. Each
+ * entry is X(opcode, name). */
+#define RISCV_OPCODE_LIST(X) \
+    X(OP_OP,                "op")       \
+    X(OP_IMM,               "op-imm")   \
+    X(OP_LOAD,              "load")     \
+    X(OP_STORE,             "store")    \
+    X(OP_LUI,               "lui")      \
+    X(OP_AUIPC,             "auipc")    \
+    X(OP_JAL,               "jal")      \
+    X(OP_JALR,              "jalr")     \
+    X(OP_BRANCH,            "branch")   \
+    X(OP_SYSTEM,            "system")   \
+    X(OP_AMO,               "amo")
+
 /*----------------------------------------------------------------------------
  * 7-bit Function Codes (R-type and I-type Instructions)
  *----------------------------------------------------------------------------*/
@@ -116,8 +137,22 @@ typedef enum riscv_itype_load_funct3 {
 // 12-bit function codes for special system instructions (I-type)
 typedef enum riscv_itype_funct12 {
     FUNCT12_ECALL           = 0x000,    // Environment call
+    FUNCT12_EBREAK          = 0x001,    // Environment breakpoint
+    FUNCT12_WFI             = 0x105,    // Wait for interrupt
+    FUNCT12_MRET            = 0x302,    // Return from a machine-mode trap
 } itype_funct12_t;
 
+// 3-bit function codes for system instructions (I-type)
+typedef enum riscv_itype_sys_funct3 {
+    FUNCT3_PRIV             = 0x0,      // ECALL, EBREAK, MRET, and WFI
+    FUNCT3_CSRRW            = 0x1,      // Atomic CSR read and write
+    FUNCT3_CSRRS            = 0x2,      // Atomic CSR read and set bits
+    FUNCT3_CSRRC            = 0x3,      // Atomic CSR read and clear bits
+    FUNCT3_CSRRWI           = 0x5,      // CSR read and write immediate
+    FUNCT3_CSRRSI           = 0x6,      // CSR read and set bits immediate
+    FUNCT3_CSRRCI           = 0x7,      // CSR read and clear bits immediate
+} itype_sys_funct3_t;
+
 /*----------------------------------------------------------------------------
  * S-type Function Codes
  *----------------------------------------------------------------------------*/
@@ -143,6 +178,89 @@ typedef enum riscv_sbtype_funct3 {
     FUNCT3_BGEU             = 0x7,      // Branch if greater than or equal
 } sbtype_funct3_t;
 
+/*----------------------------------------------------------------------------
+ * Atomic Memory Operation Function Codes
+ *----------------------------------------------------------------------------*/
+
+// 3-bit function codes for atomic memory operations (R-type)
+typedef enum riscv_amo_funct3 {
+    FUNCT3_AMO_W            = 0x2,      // Atomic operation on a word
+} amo_funct3_t;
+
+/* 5-bit function codes for atomic memory operations, in the highest 5 bits of
+ * the instruction. The two bits below them are the acquire and release bits. */
+typedef enum riscv_amo_funct5 {
+    FUNCT5_AMOADD           = 0x00,     // Atomic add
+    FUNCT5_AMOSWAP          = 0x01,     // Atomic swap
+    FUNCT5_LR               = 0x02,     // Load reserved
+    FUNCT5_SC               = 0x03,     // Store conditional
+    FUNCT5_AMOXOR           = 0x04,     // Atomic bit-wise xor
+    FUNCT5_AMOOR            = 0x08,     // Atomic bit-wise or
+    FUNCT5_AMOAND           = 0x0C,     // Atomic bit-wise and
+    FUNCT5_AMOMIN           = 0x10,     // Atomic minimum (signed)
+    FUNCT5_AMOMAX           = 0x14,     // Atomic maximum (signed)
+    FUNCT5_AMOMINU          = 0x18,     // Atomic minimum (unsigned)
+    FUNCT5_AMOMAXU          = 0x1C,     // Atomic maximum (unsigned)
+} amo_funct5_t;
+
+/*----------------------------------------------------------------------------
+ * Control and Status Registers (Machine Mode)
+ *----------------------------------------------------------------------------*/
+
+/* The 12-bit addresses of the control and status registers (CSRs) that are
+ * supported by the processor. Only machine mode is implemented. The machine
+ * timer compare register is normally memory-mapped, but since the simulator has
+ * no device memory, it is exposed in the custom machine-mode CSR space. */
+typedef enum riscv_csr {
+    CSR_MSTATUS             = 0x300,    // Machine status (interrupt enable)
+    CSR_MISA                = 0x301,    // ISA and extensions (read-only)
+    CSR_MIE                 = 0x304,    // Machine interrupt enable
+    CSR_MTVEC               = 0x305,    // Machine trap handler base address
+    CSR_MSCRATCH            = 0x340,    // Scratch register for trap handlers
+    CSR_MEPC                = 0x341,    // Machine exception program counter
+    CSR_MCAUSE              = 0x342,    // Machine trap cause
+    CSR_MTVAL               = 0x343,    // Machine bad address or instruction
+    CSR_MIP                 = 0x344,    // Machine interrupt pending
+    CSR_MTIMECMP            = 0x7C0,    // Machine timer compare (low 32 bits)
+    CSR_MTIMECMPH           = 0x7C1,    // Machine timer compare (high 32 bits)
+    CSR_MCYCLE              = 0xB00,    // Machine cycle counter (low 32 bits)
+    CSR_MINSTRET            = 0xB02,    // Machine instructions retired (low)
+    CSR_MCYCLEH             = 0xB80,    // Machine cycle counter (high 32 bits)
+    CSR_MINSTRETH           = 0xB82,    // Machine instructions retired (high)
+    CSR_CYCLE               = 0xC00,    // Cycle counter (read-only, low)
+    CSR_TIME                = 0xC01,    // Timer (read-only, low)
+    CSR_INSTRET             = 0xC02,    // Instruction counter (read-only, low)
+    CSR_CYCLEH              = 0xC80,    // Cycle counter (read-only, high)
+    CSR_TIMEH               = 0xC81,    // Timer (read-only, high)
+    CSR_INSTRETH            = 0xC82,    // Instruction counter (read-only, high)
+    CSR_MHARTID             = 0xF14,    // Hardware thread ID (read-only)
+} riscv_csr_t;
+
+// Bits in the mstatus CSR
+#define MSTATUS_MIE         (1U << 3)   // Machine interrupts enabled
+#define MSTATUS_MPIE        (1U << 7)   // Interrupts enabled before the trap
+#define MSTATUS_MPP         (3U << 11)  // Privilege mode before trap (always M)
+
+// The interrupt numbers, which are their bit positions in mie and mip
+#define IRQ_MACHINE_TIMER   7           // Machine timer interrupt
+#define MIP_MTIP            (1U << IRQ_MACHINE_TIMER)
+
+// Bit in the mcause CSR that indicates the trap was an interrupt
+#define MCAUSE_INTERRUPT    (1U << 31)
+
+// The trap causes reported in the mcause CSR
+typedef enum riscv_trap_cause {
+    CAUSE_MISALIGNED_FETCH  = 0,        // Instruction address misaligned
+    CAUSE_FETCH_ACCESS      = 1,        // Instruction access fault
+    CAUSE_ILLEGAL_INSTRUCTION = 2,      // Illegal instruction
+    CAUSE_BREAKPOINT        = 3,        // Breakpoint (EBREAK)
+    CAUSE_MISALIGNED_LOAD   = 4,        // Load address misaligned
+    CAUSE_LOAD_ACCESS       = 5,        // Load access fault
+    CAUSE_MISALIGNED_STORE  = 6,        // Store/AMO address misaligned
+    CAUSE_STORE_ACCESS      = 7,        // Store/AMO access fault
+    CAUSE_ECALL_M           = 11,       // Environment call from machine mode
+} riscv_trap_cause_t;
+
 /*----------------------------------------------------------------------------
  * ISA Register Names
  *----------------------------------------------------------------------------*/
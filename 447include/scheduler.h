@@ -0,0 +1,151 @@
+/**
+ * scheduler.h
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the interface to the discrete-event scheduler.
+ *
+ * The scheduler lets devices and timers post events that should happen at some
+ * future processor cycle, instead of being ticked every cycle. Events are kept
+ * in a hierarchical timing wheel keyed on the cycle counter. The run loop asks
+ * the scheduler for the distance to the next pending event once, runs a whole
+ * batch of instructions up to that point, and then fires the events that are
+ * due.
+ *
+ * Events are allocated by their owner (typically embedded in a device
+ * structure), so posting and cancelling events never allocates memory.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+// Standard Includes
+#include <stdbool.h>                // Boolean type and definitions
+#include <stdint.h>                 // Fixed-size integral types
+#include <stddef.h>                 // Definition of NULL
+
+/*----------------------------------------------------------------------------
+ * Definitions
+ *----------------------------------------------------------------------------*/
+
+// The number of bits of the cycle count covered by each level of the wheel
+#define SCHED_WHEEL_BITS        6
+
+// The number of slots in each level of the wheel, and the number of levels
+#define SCHED_WHEEL_SLOTS       (1 << SCHED_WHEEL_BITS)
+#define SCHED_WHEEL_LEVELS      4
+
+// The cycle value used to indicate that there is no pending event
+#define SCHED_NEVER             UINT64_MAX
+
+// Forward declaration of the event struct
+struct sched_event;
+
+/**
+ * The callback invoked when an event fires. The callback receives the event
+ * that fired and the current cycle, and may re-post the event (e.g. for a
+ * periodic timer) or post other events.
+ **/
+typedef void (*sched_callback_t)(struct sched_event *event, uint64_t now);
+
+// An event that can be posted to fire at a future cycle
+typedef struct sched_event {
+    uint64_t when;                  // The cycle at which the event fires
+    sched_callback_t callback;      // Function invoked when the event fires
+    void *arg;                      // Argument for the callback's use
+    struct sched_event *next;       // Next event in the same wheel slot
+    struct sched_event **prev_next; // Link pointing to this event, or NULL
+    int level;                      // Wheel level holding the event, or -1
+} sched_event_t;
+
+// The representation of a hierarchical timing wheel
+typedef struct scheduler {
+    uint64_t now;                   // Cycle the wheel has been advanced to
+    uint64_t horizon;               // Cycle at which the current batch ends
+    uint64_t next_deadline;         // Cached earliest pending event cycle
+    bool deadline_valid;            // Indicates if next_deadline is current
+    uint64_t occupied[SCHED_WHEEL_LEVELS];  // Bitmap of non-empty slots
+    sched_event_t *slots[SCHED_WHEEL_LEVELS][SCHED_WHEEL_SLOTS];
+    sched_event_t *overflow;        // Events beyond the range of the wheel
+    sched_event_t *firing;          // Due events whose callbacks are running
+} scheduler_t;
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Initializes the scheduler, dropping any events that were pending.
+ *
+ * The wheel starts at the given cycle, which is normally 0 for a freshly
+ * loaded program.
+ **/
+void sched_init(scheduler_t *scheduler, uint64_t now);
+
+/**
+ * Initializes an event with the given callback and argument.
+ *
+ * This must be called once before the event is posted for the first time.
+ **/
+void sched_event_init(sched_event_t *event, sched_callback_t callback,
+        void *arg);
+
+/**
+ * Posts an event to fire at the specified cycle.
+ *
+ * If the event is already pending, it is moved to the new cycle. Events in the
+ * past fire at the next batch boundary. If the event falls before the end of
+ * the batch that is currently running, the batch is cut short so that the event
+ * fires on time.
+ **/
+void sched_post(scheduler_t *scheduler, sched_event_t *event, uint64_t when);
+
+/**
+ * Cancels a pending event. Cancelling an event that is not pending does
+ * nothing.
+ **/
+void sched_cancel(scheduler_t *scheduler, sched_event_t *event);
+
+/**
+ * Indicates if the given event is currently pending.
+ **/
+static inline bool sched_event_pending(const sched_event_t *event)
+{
+    return event->prev_next != NULL;
+}
+
+/**
+ * Returns the cycle of the earliest pending event, or SCHED_NEVER if there are
+ * no pending events.
+ **/
+uint64_t sched_next_deadline(scheduler_t *scheduler);
+
+/**
+ * Advances the scheduler to the given cycle, firing all events that are due at
+ * or before it in cycle order.
+ **/
+void sched_run_due(scheduler_t *scheduler, uint64_t now);
+
+/**
+ * Ends the batch that is currently running after the current instruction.
+ *
+ * This is used by anything that changes the processor state in a way that the
+ * run loop must look at before continuing (e.g. a trap or a halt request).
+ **/
+static inline void sched_end_batch(scheduler_t *scheduler)
+{
+    scheduler->horizon = 0;
+}
+
+#endif /* SCHEDULER_H_ */
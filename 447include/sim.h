@@ -28,20 +28,45 @@
 // Local Includes
 #include "riscv_isa.h"                  // RISC-V ISA, the number of registers
 #include "memory.h"                     // Interface to the processor memory
+#include "scheduler.h"                  // Discrete-event scheduler
+#include "trap.h"                       // Control and status registers
+#include "debug.h"                      // Breakpoints and profiling state
 
 /*----------------------------------------------------------------------------
  * Definitions
  *----------------------------------------------------------------------------*/
 
-// A structure representing all of the state in a processor.
+// Forward declaration of the machine struct
+struct machine;
+
+// The size of a host cache line, which the hot CPU state is aligned to
+#define CPU_CACHE_LINE_SIZE             64
+
+/* A structure representing all of the state in a processor.
+ *
+ * The state used by every instruction is kept together at the start of the
+ * structure, aligned to a cache line, so that the run loop only touches three
+ * cache lines. The register file fills two of them. The rest of the state is
+ * only used by the shell, or by less frequent instructions. */
 typedef struct cpu_state {
+    struct {
+        _Alignas(CPU_CACHE_LINE_SIZE)
+        uint32_t registers[RISCV_NUM_REGS]; // CPU register file
+        uint32_t pc;                    // Current program counter
+        bool halted;                    // Indicates if the CPU is halted
+        uint64_t cycle;                 // Number of processor cycles
+        mem_segment_t *fetch_segment;   // Segment of the last fetch, if any
+        mem_segment_t *load_segment;    // Segment of the last load, if any
+        mem_segment_t *store_segment;   // Segment of the last store or AMO
+    };
+
     bool verbose_mode;                  // Indicates if verbose mode is active
-    bool halted;                        // Indicates if the CPU is halted
-    int cycle;                          // Number of processor cycles
-    uint32_t pc;                        // Current program counter
     char *program;                      // Name of the currently loaded program
     memory_t memory;                    // Processor memory segments
-    uint32_t registers[RISCV_NUM_REGS]; // CPU register file
+    scheduler_t scheduler;              // Pending device and timer events
+    csr_file_t csr;                     // Machine-mode CSRs and trap state
+    debug_state_t debug;                // Breakpoints and profiling state
+    struct machine *machine;            // Machine this CPU is a hart of
 } cpu_state_t;
 
 /*----------------------------------------------------------------------------
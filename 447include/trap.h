@@ -0,0 +1,135 @@
+/**
+ * trap.h
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the interface to the machine-mode trap support, which
+ * includes the control and status registers (CSRs), exceptions, and the
+ * machine timer interrupt.
+ *
+ * When a program has kernel text, the trap vector (mtvec) initially points at
+ * the start of the Kernel Text segment, so exceptions and interrupts transfer
+ * control to the kernel's handler. If no trap handler is installed (mtvec is
+ * 0), then exceptions halt the simulation, as they always have.
+ *
+ * Exceptions raised while an instruction is executing are recorded, and the
+ * trap is entered once the instruction completes, so the instruction does not
+ * need to unwind. Interrupts are only checked between batches of instructions,
+ * which end at scheduled events, or when a CSR write may have enabled one.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+#ifndef TRAP_H_
+#define TRAP_H_
+
+// Standard Includes
+#include <stdbool.h>                // Boolean type and definitions
+#include <stdint.h>                 // Fixed-size integral types
+
+// Local Includes
+#include "riscv_isa.h"              // Definition of CSRs and trap causes
+#include "scheduler.h"              // Definition of scheduler events
+
+/*----------------------------------------------------------------------------
+ * Definitions
+ *----------------------------------------------------------------------------*/
+
+// Forward declaration of the CPU state struct
+struct cpu_state;
+
+// The machine-mode control and status registers, and the trap state
+typedef struct csr_file {
+    uint32_t mstatus;               // Machine status (interrupt enable bits)
+    uint32_t mie;                   // Machine interrupt enable
+    uint32_t mip;                   // Machine interrupt pending
+    uint32_t mtvec;                 // Machine trap handler base address
+    uint32_t mscratch;              // Scratch register for trap handlers
+    uint32_t mepc;                  // Machine exception program counter
+    uint32_t mcause;                // Machine trap cause
+    uint32_t mtval;                 // Machine bad address or instruction
+    uint32_t mhartid;               // Hardware thread ID of this hart
+    uint64_t mtimecmp;              // Machine timer compare value
+    sched_event_t timer_event;      // Event for when the timer goes off
+    bool trap_pending;              // The current instruction raised a trap
+} csr_file_t;
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Resets the CSRs and the machine timer for a newly loaded program.
+ *
+ * The trap vector points at the start of the Kernel Text segment if the
+ * program has kernel text, and is 0 (no handler) otherwise.
+ **/
+void trap_reset(struct cpu_state *cpu_state);
+
+/**
+ * Restores the CSRs from a copy saved earlier, such as by a checkpoint, and
+ * posts the timer event again for the restored mtimecmp. The scheduler must
+ * not have the timer event pending.
+ **/
+void trap_restore(struct cpu_state *cpu_state, const csr_file_t *saved);
+
+/**
+ * Raises an exception with the given cause for the current instruction.
+ *
+ * The trap CSRs are updated immediately, with mepc set to the current PC, and
+ * the PC is redirected to the trap handler once the current instruction has
+ * completed. Only the first exception raised by an instruction is taken.
+ *
+ * Returns true if the trap will be taken. If no trap handler is installed, then
+ * nothing is changed, and false is returned, in which case the caller should
+ * halt the processor.
+ **/
+bool trap_raise(struct cpu_state *cpu_state, riscv_trap_cause_t cause,
+        uint32_t tval);
+
+/**
+ * Completes entry into a trap raised by the last instruction, redirecting the
+ * PC to the trap handler. This is invoked by the run loop after an instruction
+ * raises a trap.
+ **/
+void trap_commit(struct cpu_state *cpu_state);
+
+/**
+ * Returns from a trap handler (the MRET instruction), restoring the interrupt
+ * enable bit and jumping to the address in mepc.
+ **/
+void trap_return(struct cpu_state *cpu_state);
+
+/**
+ * Takes any pending and enabled interrupt, redirecting the PC to the trap
+ * handler. This must only be invoked between instructions. Returns true if an
+ * interrupt was taken.
+ **/
+bool trap_check_interrupts(struct cpu_state *cpu_state);
+
+/**
+ * Reads the specified CSR into value.
+ *
+ * Returns 0 on success, or a negative error code if the CSR does not exist, in
+ * which case the instruction accessing it is illegal.
+ **/
+int csr_read(struct cpu_state *cpu_state, uint32_t csr, uint32_t *value);
+
+/**
+ * Writes the value to the specified CSR.
+ *
+ * Returns 0 on success, or a negative error code if the CSR does not exist or
+ * is read-only, in which case the instruction accessing it is illegal.
+ **/
+int csr_write(struct cpu_state *cpu_state, uint32_t csr, uint32_t value);
+
+#endif /* TRAP_H_ */
@@ -0,0 +1,233 @@
+/**
+ * code_watch.c
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the code write tracker, which counts the writes to each
+ * page of the text segments, and notifies its subscribers of them.
+ *
+ * The counters of a segment are allocated the first time the segment is
+ * written, and are updated with relaxed atomic adds, since the harts sharing a
+ * segment may run on different host threads. The subscribers are kept in a
+ * fixed table, which is read without a lock when a write is made.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+// Standard Includes
+#include <stdlib.h>                 // Calloc and free functions
+#include <stdio.h>                  // Printf and related functions
+#include <stdint.h>                 // Fixed-size integral types
+#include <inttypes.h>               // Format specifiers for fixed-size types
+
+// Standard Includes
+#include <errno.h>                  // Error codes
+#include <pthread.h>                // Mutex for the subscriber table
+
+// 18-447 Simulator Includes
+#include <sim.h>                    // Definition of cpu_state_t
+#include <memory.h>                 // Definition of mem_segment_t
+
+// Local Includes
+#include "memory_map.h"             // Permissions of the pages written
+#include "shared_text.h"            // Unsharing text before it is written
+#include "code_watch.h"             // This file's interface
+
+/*----------------------------------------------------------------------------
+ * Internal Definitions
+ *----------------------------------------------------------------------------*/
+
+// A subscriber to the code writes
+typedef struct code_watch_subscriber {
+    code_write_callback_t callback; // Callback, or NULL if the slot is free
+    void *data;                     // Data passed to the callback
+} code_watch_subscriber_t;
+
+// The lock for adding and removing subscribers
+static pthread_mutex_t SUBSCRIBER_LOCK = PTHREAD_MUTEX_INITIALIZER;
+
+// The table of subscribers
+static code_watch_subscriber_t SUBSCRIBERS[CODE_WATCH_MAX_SUBSCRIBERS];
+
+/*----------------------------------------------------------------------------
+ * Helper Functions
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Returns the number of pages that the segment spans.
+ **/
+static uint32_t num_pages(const mem_segment_t *segment)
+{
+    return (segment->size + CODE_WATCH_PAGE_SIZE - 1) >> CODE_WATCH_PAGE_SHIFT;
+}
+
+/**
+ * Returns the write counters of the segment, allocating them if the segment
+ * hasn't been written before. Returns NULL if they can't be allocated.
+ **/
+static uint64_t *page_counters(mem_segment_t *segment)
+{
+    uint64_t *counters = __atomic_load_n(&segment->page_writes,
+            __ATOMIC_ACQUIRE);
+    if (counters != NULL) {
+        return counters;
+    }
+
+    // Another hart may install the counters first, and then theirs are used
+    uint64_t *new_counters = calloc(num_pages(segment), sizeof(counters[0]));
+    if (new_counters == NULL) {
+        return NULL;
+    } else if (!__atomic_compare_exchange_n(&segment->page_writes, &counters,
+                new_counters, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        free(new_counters);
+        return counters;
+    }
+    return new_counters;
+}
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Subscribes the callback to the writes to every text segment. Returns the
+ * subscription's identifier on success, or a negative error code on failure.
+ **/
+int code_watch_subscribe(code_write_callback_t callback, void *data)
+{
+    pthread_mutex_lock(&SUBSCRIBER_LOCK);
+    for (int i = 0; i < CODE_WATCH_MAX_SUBSCRIBERS; i++)
+    {
+        if (SUBSCRIBERS[i].callback == NULL) {
+            SUBSCRIBERS[i].data = data;
+            __atomic_store_n(&SUBSCRIBERS[i].callback, callback,
+                    __ATOMIC_RELEASE);
+            pthread_mutex_unlock(&SUBSCRIBER_LOCK);
+            return i;
+        }
+    }
+
+    pthread_mutex_unlock(&SUBSCRIBER_LOCK);
+    fprintf(stderr, "Error: Too many code write subscribers, at most %d are "
+            "allowed.\n", CODE_WATCH_MAX_SUBSCRIBERS);
+    return -ENOSPC;
+}
+
+/**
+ * Removes the subscription with the given identifier.
+ **/
+void code_watch_unsubscribe(int id)
+{
+    pthread_mutex_lock(&SUBSCRIBER_LOCK);
+    __atomic_store_n(&SUBSCRIBERS[id].callback, NULL, __ATOMIC_RELEASE);
+    SUBSCRIBERS[id].data = NULL;
+    pthread_mutex_unlock(&SUBSCRIBER_LOCK);
+    return;
+}
+
+/**
+ * Handles a write to the word at the address in the text segment, which is
+ * about to be made. If the segment is shared, it is given a private copy. If
+ * the page is executable, the write is counted against it, and the subscribers
+ * are notified. Pages that can't be executed hold no code to invalidate.
+ **/
+void code_watch_write(mem_segment_t *segment, uint32_t addr)
+{
+    if (segment->shared != NULL) {
+        text_unshare(segment);
+    }
+    if (!(mem_map_page_perms(addr) & MEM_PERM_EXEC)) {
+        return;
+    }
+
+    uint64_t *counters = page_counters(segment);
+    if (counters != NULL) {
+        uint32_t page = (addr - segment->base_addr) >> CODE_WATCH_PAGE_SHIFT;
+        __atomic_fetch_add(&counters[page], 1, __ATOMIC_RELAXED);
+    }
+
+    for (int i = 0; i < CODE_WATCH_MAX_SUBSCRIBERS; i++)
+    {
+        code_write_callback_t callback = __atomic_load_n(
+                &SUBSCRIBERS[i].callback, __ATOMIC_ACQUIRE);
+        if (callback != NULL) {
+            callback(SUBSCRIBERS[i].data, segment, addr);
+        }
+    }
+    return;
+}
+
+/**
+ * Returns the number of writes made to the page containing the address in the
+ * text segment.
+ **/
+uint64_t code_watch_page_writes(const mem_segment_t *segment, uint32_t addr)
+{
+    const uint64_t *counters = __atomic_load_n(&segment->page_writes,
+            __ATOMIC_ACQUIRE);
+    if (counters == NULL) {
+        return 0;
+    }
+
+    uint32_t page = (addr - segment->base_addr) >> CODE_WATCH_PAGE_SHIFT;
+    return __atomic_load_n(&counters[page], __ATOMIC_RELAXED);
+}
+
+/**
+ * Frees the write counters of the segment.
+ **/
+void code_watch_release(mem_segment_t *segment)
+{
+    free(segment->page_writes);
+    segment->page_writes = NULL;
+    return;
+}
+
+/**
+ * Prints the number of writes to each page of the text segments that has been
+ * written, and the totals.
+ **/
+void code_watch_print(const cpu_state_t *cpu_state, FILE *file)
+{
+    uint64_t total_writes = 0;
+    uint32_t total_pages = 0;
+    fprintf(file, "%-12s %-12s %s\n", "Page", "Segment", "Writes");
+    for (int i = 0; i < cpu_state->memory.num_segments; i++)
+    {
+        const mem_segment_t *segment = &cpu_state->memory.segments[i];
+        if (!segment->executable || segment->page_writes == NULL) {
+            continue;
+        }
+
+        for (uint32_t page = 0; page < num_pages(segment); page++)
+        {
+            uint32_t page_addr = segment->base_addr +
+                    (page << CODE_WATCH_PAGE_SHIFT);
+            uint64_t writes = code_watch_page_writes(segment, page_addr);
+            if (writes != 0) {
+                fprintf(file, "0x%08x   %-12s %" PRIu64 "\n", page_addr,
+                        segment->name, writes);
+                total_writes += writes;
+                total_pages += 1;
+            }
+        }
+    }
+
+    int num_subscribers = 0;
+    for (int i = 0; i < CODE_WATCH_MAX_SUBSCRIBERS; i++)
+    {
+        num_subscribers += (SUBSCRIBERS[i].callback != NULL);
+    }
+    fprintf(file, "Total: %" PRIu64 " writes to %" PRIu32 " pages, %d "
+            "subscribers.\n", total_writes, total_pages, num_subscribers);
+    return;
+}
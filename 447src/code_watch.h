@@ -0,0 +1,96 @@
+/**
+ * code_watch.h
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the interface to the code write tracker, which lets
+ * anything that caches information derived from the program's code find out
+ * when that code is changed.
+ *
+ * Writes to the executable (text) segments take a slow path, which counts the
+ * writes to each page of the segment, and notifies the subscribers before the
+ * write is made. Subscribers should only invalidate what they derived from the
+ * page, and rebuild it lazily. Writes to every other segment are unaffected,
+ * as are writes to pages of a text segment that aren't executable, since no
+ * instructions can have been fetched from them.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+#ifndef CODE_WATCH_H_
+#define CODE_WATCH_H_
+
+// Standard Includes
+#include <stdint.h>             // Fixed-size integral types
+#include <stdio.h>              // Definition of the FILE type
+
+// 18-447 Simulator Includes
+#include <sim.h>                // Definition of cpu_state_t
+#include <memory.h>             // Definition of mem_segment_t
+
+/*----------------------------------------------------------------------------
+ * Definitions
+ *----------------------------------------------------------------------------*/
+
+// The base-2 logarithm of the size of the pages that writes are tracked by
+#define CODE_WATCH_PAGE_SHIFT       12
+#define CODE_WATCH_PAGE_SIZE        (1 << CODE_WATCH_PAGE_SHIFT)
+
+// The maximum number of subscribers that can be notified of code writes
+#define CODE_WATCH_MAX_SUBSCRIBERS  8
+
+/* A subscriber's callback, which is called with its data, the text segment,
+ * and the address of the word about to be written. */
+typedef void (*code_write_callback_t)(void *data, const mem_segment_t *segment,
+        uint32_t addr);
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Subscribes the callback to the writes to every text segment. Returns the
+ * subscription's identifier on success, or a negative error code on failure.
+ **/
+int code_watch_subscribe(code_write_callback_t callback, void *data);
+
+/**
+ * Removes the subscription with the given identifier.
+ **/
+void code_watch_unsubscribe(int id);
+
+/**
+ * Handles a write to the word at the address in the text segment, which is
+ * about to be made. If the segment is shared, it is given a private copy. If
+ * the page is executable, the write is counted against it, and the subscribers
+ * are notified. Pages that can't be executed hold no code to invalidate.
+ **/
+void code_watch_write(mem_segment_t *segment, uint32_t addr);
+
+/**
+ * Returns the number of writes made to the page containing the address in the
+ * text segment.
+ **/
+uint64_t code_watch_page_writes(const mem_segment_t *segment, uint32_t addr);
+
+/**
+ * Frees the write counters of the segment.
+ **/
+void code_watch_release(mem_segment_t *segment);
+
+/**
+ * Prints the number of writes to each page of the text segments that has been
+ * written, and the totals.
+ **/
+void code_watch_print(const cpu_state_t *cpu_state, FILE *file);
+
+#endif /* CODE_WATCH_H_ */
@@ -26,20 +26,35 @@
 #include <stdio.h>                  // Printf and related functions
 #include <stdbool.h>                // Definition of the boolean type
 #include <stdint.h>                 // Fixed-size integral types
+#include <inttypes.h>               // Format specifiers for fixed-size types
 
 // Standard Includes
 #include <limits.h>                 // Limits for integer types
 #include <assert.h>                 // Assert macro
 #include <errno.h>                  // Error codes and perror
+#include <string.h>                 // String comparison and memset
 
 // 18-447 Simulator Includes
 #include <sim.h>                    // Definition of cpu_state_t
 #include <register_file.h>          // Interface to the register file
+#include <trap.h>                   // Reset of the CSRs and trap state
 
 // Local Includes
 #include "memory_shell.h"           // Interface to the processor memory
 #include "libc_extensions.h"        // Parsing functions, array_len, Snprintf
 #include "riscv_register_names.h"   // Names for the RISC-V registers
+#include "machine.h"                // Interface to the machine's harts
+#include "lockstep.h"               // Lockstep engine for input sweeps
+#include "heatmap.h"                // Memory access heat map
+#include "hotblocks.h"              // Hot basic blocks and loops
+#include "stats.h"                  // Statistics registry and export
+#include "disasm.h"                 // Disassembly of instructions
+#include "code_watch.h"             // Writes to the text segments
+#include "memory_map.h"             // Regions of the memory map
+#include "huge_pages.h"             // Huge page coverage of the segments
+#include "snapshot.h"               // Forked snapshots of the simulation
+#include "reverse.h"                // Reverse execution of a hart
+#include "elf_loader.h"             // Symbols of the loaded program
 #include "commands.h"               // This file's interface
 
 /*----------------------------------------------------------------------------
@@ -102,22 +117,63 @@ static const int STEP_MAX_NUM_ARGS      = 1;
 // The expected number of arguments for the go command
 static const int GO_NUM_ARGS            = 0;
 
+/* The number of cycles the go command runs between checks for a keyboard
+ * interrupt from the user. */
+static const uint64_t GO_INTERRUPT_CHECK_CYCLES = 1 << 16;
+
 /**
- * Run the simulator for a single cycle, incrementing the instruction count.
+ * Prints the symbol containing the address, and the address's offset from it,
+ * if the program has such a symbol.
  **/
-static void run_simulator(cpu_state_t *cpu_state)
+static void print_symbol(FILE *file, const cpu_state_t *cpu_state,
+        uint32_t addr)
 {
-    // Run the simulator for a cycle, then the increment instruction count
-    process_instruction(cpu_state);
-    cpu_state->cycle += 1;
-
-    // If the user has activated verbose mode, then perform a register dump
-    if (cpu_state->verbose_mode) {
-        command_rdump(cpu_state, NULL, 0);
+    const symbol_t *symbol = elf_find_symbol(cpu_state, addr);
+    if (symbol == NULL) {
+        return;
+    } else if (addr == symbol->addr) {
+        fprintf(file, " <%s>", symbol->name);
+    } else {
+        fprintf(file, " <%s+0x%x>", symbol->name, addr - symbol->addr);
     }
     return;
 }
 
+/**
+ * Parses the string as an address, which is either the name of one of the
+ * program's symbols, or a 32-bit integer.
+ **/
+static int parse_address(const cpu_state_t *cpu_state, const char *string,
+        uint32_t *addr)
+{
+    const symbol_t *symbol = elf_lookup_symbol(cpu_state, string);
+    if (symbol != NULL) {
+        *addr = symbol->addr;
+        return 0;
+    }
+    return parse_int32(string, (int32_t *)addr);
+}
+
+/**
+ * Reports the hart that stopped at a breakpoint, if any. Returns true if a
+ * hart is stopped at a breakpoint.
+ **/
+static bool report_breakpoint(const machine_t *machine)
+{
+    for (int i = 0; i < machine->num_harts; i++)
+    {
+        const cpu_state_t *hart = &machine->harts[i];
+        if (hart->debug.breakpoint_hit) {
+            fprintf(stdout, "Hart %d stopped at breakpoint 0x%08x", i,
+                    hart->pc);
+            print_symbol(stdout, hart, hart->pc);
+            fprintf(stdout, ".\n");
+            return true;
+        }
+    }
+    return false;
+}
+
 /**
  * Runs the simulator for a specified number of cycles or until a halt.
  *
@@ -142,23 +198,25 @@ void command_step(cpu_state_t *cpu_state, char *args[], int num_args)
     }
 
     // If the processor is halted, then we don't do anything.
-    if (cpu_state->halted) {
+    machine_t *machine = cpu_state->machine;
+    if (machine_halted(machine)) {
         fprintf(stdout, "Processor is halted, cannot run the simulator.\n");
         return;
     }
 
-    /* Run the simulator for the specified number of cycles, or until the
+    /* Run each hart for the specified number of cycles, or until the
      * processor is halted. */
-    for (int i = 0; i < num_cycles && !cpu_state->halted; i++)
-    {
-        run_simulator(cpu_state);
+    if (num_cycles > 0) {
+        machine_run(machine, num_cycles);
+        report_breakpoint(machine);
     }
 
     return;
 }
 
 /**
- * Runs the simulator until program completion or an exception is encountered.
+ * Runs the simulator until program completion, an exception, or a breakpoint is
+ * encountered.
  *
  * In the case of an infinite running program because of a bug in the
  * implementation, the user can interrupt execution with a keyboard interrupt.
@@ -176,17 +234,21 @@ void command_go(cpu_state_t *cpu_state, char *args[], int num_args)
     }
 
     // If the processor is halted, then we don't do anything.
-    if (cpu_state->halted) {
+    machine_t *machine = cpu_state->machine;
+    if (machine_halted(machine)) {
         fprintf(stdout, "Processor is halted, cannot run the simulator.\n");
         return;
     }
 
-    /* Run the simulator until the processor is halted or the user tells us to
+    /* Run the simulator until every hart is halted or the user tells us to
      * stop with a keyboard interrupt (SIGINT). */
     SIGINT_RECEIVED = false;
-    while (!cpu_state->halted && !SIGINT_RECEIVED)
+    while (!machine_halted(machine) && !SIGINT_RECEIVED)
     {
-        run_simulator(cpu_state);
+        machine_run(machine, GO_INTERRUPT_CHECK_CYCLES);
+        if (report_breakpoint(machine)) {
+            break;
+        }
     }
 
     // Tell the user if they interrupted execution, and reset the received flag
@@ -267,33 +329,102 @@ static void print_register_header(FILE* file)
     return;
 }
 
+/* The length of a line of a register dump, which has the columns separated by
+ * spaces, an equals sign after the names, and a newline at the end. */
+static const size_t REG_LINE_LEN        = ISA_NAME_COL_LEN + string_len(" ") +
+        ABI_NAME_COL_LEN + string_len(" = ") + REG_HEX_COL_LEN +
+        string_len(" ") + REG_UINT_COL_LEN + string_len(" ") +
+        REG_INT_COL_LEN + string_len("\n");
+
 /**
- * Prints out the information for a given register on one line to the file.
+ * Copies the string into the buffer, returning the position after it. The
+ * string is not null-terminated in the buffer.
+ **/
+static char *format_string(char *buffer, const char *string)
+{
+    while (*string != '\0') {
+        *buffer++ = *string++;
+    }
+    return buffer;
+}
+
+/**
+ * Formats the value in decimal, surrounded with parenthesis, into the buffer,
+ * with a minus sign if it is negative. Returns the position after it.
+ **/
+static char *format_decimal(char *buffer, uint32_t magnitude, bool negative)
+{
+    // Produce the digits from least to most significant, then reverse them
+    char digits[INT32_MAX_DIGITS];
+    int num_digits = 0;
+    do {
+        digits[num_digits++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude != 0);
+
+    *buffer++ = '(';
+    if (negative) {
+        *buffer++ = '-';
+    }
+    while (num_digits > 0) {
+        *buffer++ = digits[--num_digits];
+    }
+    *buffer++ = ')';
+    return buffer;
+}
+
+/**
+ * Formats the line of a register dump for the given register into the buffer,
+ * which must hold REG_LINE_LEN characters. The line is not null-terminated.
+ *
+ * This produces the same text as formatting each column with printf, but it is
+ * much faster, since register dumps are made after every cycle in verbose mode.
  **/
-static void print_register(cpu_state_t *cpu_state, riscv_isa_reg_t reg_num,
-        FILE *file)
+static void format_register(const cpu_state_t *cpu_state,
+        riscv_isa_reg_t reg_num, char *line)
 {
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+
     // Get the register value, and its register name struct
     const register_name_t *reg_name = &RISCV_REGISTER_NAMES[reg_num];
     uint32_t reg_value = register_read(cpu_state, reg_num);
 
-    // Format the ABI alias name for the register surrounded with parenthesis
-    char abi_name[ABI_NAME_COL_LEN+1];
-    Snprintf(abi_name, sizeof(abi_name), "(%s)", reg_name->abi_name);
+    // The columns are padded with spaces, so start from a blank line
+    memset(line, ' ', REG_LINE_LEN);
+    char *column = line;
+    format_string(column, reg_name->isa_name);
+    column += ISA_NAME_COL_LEN + string_len(" ");
 
-    // Format the hexadecimal, signed, and unsigned views of the register
-    char reg_hex_value[REG_HEX_COL_LEN+1];
-    char reg_uint_value[REG_UINT_COL_LEN+1];
-    char reg_int_value[REG_INT_COL_LEN+1];
-    Snprintf(reg_hex_value, sizeof(reg_hex_value), "0x%08x", reg_value);
-    Snprintf(reg_uint_value, sizeof(reg_uint_value), "(%u)", reg_value);
-    Snprintf(reg_int_value, sizeof(reg_int_value), "(%d)", (int32_t)reg_value);
+    // Format the ABI alias name for the register surrounded with parenthesis
+    char *end = format_string(column, "(");
+    end = format_string(end, reg_name->abi_name);
+    format_string(end, ")");
+    column += ABI_NAME_COL_LEN;
+    column = format_string(column, " = ");
+
+    // Format the hexadecimal, unsigned, and signed views of the register
+    column = format_string(column, "0x");
+    for (int shift = 28; shift >= 0; shift -= 4) {
+        *column++ = HEX_DIGITS[(reg_value >> shift) & 0xF];
+    }
+    column += string_len(" ");
+    format_decimal(column, reg_value, false);
+    column += REG_UINT_COL_LEN + string_len(" ");
+    bool negative = (int32_t)reg_value < 0;
+    format_decimal(column, negative ? -reg_value : reg_value, negative);
+    line[REG_LINE_LEN - 1] = '\n';
+    return;
+}
 
-    // Print out the register names and its values
-    fprintf(file, "%-*s %-*s = %-*s %-*s %-*s\n", (int)ISA_NAME_COL_LEN,
-            reg_name->isa_name, (int)ABI_NAME_COL_LEN, abi_name,
-            (int)REG_HEX_COL_LEN, reg_hex_value, (int)REG_UINT_COL_LEN,
-            reg_uint_value, (int)REG_INT_COL_LEN, reg_int_value);
+/**
+ * Prints out the information for a given register on one line to the file.
+ **/
+static void print_register(const cpu_state_t *cpu_state,
+        riscv_isa_reg_t reg_num, FILE *file)
+{
+    char line[REG_LINE_LEN];
+    format_register(cpu_state, reg_num, line);
+    fwrite(line, sizeof(line[0]), REG_LINE_LEN, file);
     return;
 }
 
@@ -304,11 +435,33 @@ static void print_cpu_state(const cpu_state_t *cpu_state, FILE* file)
 {
     ssize_t width = fprintf(file, "Current CPU State and Register Values:\n");
     print_separator('-', width-1, file);
-    fprintf(file, "%-20s = %d\n", "Cycle", cpu_state->cycle);
+    if (cpu_state->machine != NULL && cpu_state->machine->num_harts > 1) {
+        fprintf(file, "%-20s = %" PRIu32 "\n", "Hart", cpu_state->csr.mhartid);
+    }
+    fprintf(file, "%-20s = %" PRIu64 "\n", "Cycle", cpu_state->cycle);
     fprintf(file, "%-20s = 0x%08x\n", "Program Counter (PC)", cpu_state->pc);
     return;
 }
 
+/**
+ * Prints the header for the registers, followed by the values of all of the
+ * general purpose registers, to the given file.
+ **/
+static void print_registers(const cpu_state_t *cpu_state, FILE *file)
+{
+    print_register_header(file);
+
+    /* Format all of the general purpose register values, and print them out
+     * with a single write. */
+    char table[array_len(cpu_state->registers) * REG_LINE_LEN];
+    for (int i = 0; i < (int)array_len(cpu_state->registers); i++)
+    {
+        format_register(cpu_state, i, &table[i * REG_LINE_LEN]);
+    }
+    fwrite(table, sizeof(table[0]), array_len(table), file);
+    return;
+}
+
 /**
  * Display the value of the specified register to the user.
  *
@@ -360,8 +513,9 @@ void command_reg(cpu_state_t *cpu_state, char *args[], int num_args)
         return;
     }
 
-    // Update the register with the new value
+    // Update the register with the new value, which can't be recorded
     register_write(cpu_state, (riscv_isa_reg_t)reg_num, reg_value);
+    reverse_reset(cpu_state);
     return;
 }
 
@@ -393,13 +547,7 @@ void command_rdump(cpu_state_t *cpu_state, char *args[], int num_args)
         print_cpu_state(cpu_state, dump_file);
         fprintf(dump_file, "\n");
     }
-    print_register_header(dump_file);
-
-    // Print out all of the general purpose register values
-    for (int i = 0; i < (int)array_len(cpu_state->registers); i++)
-    {
-        print_register(cpu_state, i, dump_file);
-    }
+    print_registers(cpu_state, dump_file);
 
     // Close the dump file if it was specified by the user
     close_dump_file(dump_file);
@@ -500,6 +648,10 @@ void command_mem(cpu_state_t *cpu_state, char *args[], int num_args)
         fprintf(stderr, "Error: mem: Invalid memory address 0x%08x "
                 "specified.\n", addr);
         return;
+    } else if (segment->backing == MEM_BACKING_MMIO) {
+        fprintf(stderr, "Error: mem: Address 0x%08x is a device register.\n",
+                addr);
+        return;
     }
 
     // If the user didn't specify a value, then we print the value
@@ -519,8 +671,9 @@ void command_mem(cpu_state_t *cpu_state, char *args[], int num_args)
         return;
     }
 
-    // Update the memory location with the new value
+    // Update the memory location with the new value, which can't be recorded
     mem_write_word(segment, addr, mem_value);
+    reverse_reset(cpu_state);
     return;
 }
 
@@ -575,7 +728,12 @@ void command_mdump(cpu_state_t *cpu_state, char *args[], int num_args)
     // Find the memory segment to which the range belongs, and print it out
     const mem_segment_t *segment = mem_find_segment(cpu_state, start_addr);
     assert(segment != NULL);
-    print_memory_range(segment, start_addr, end_addr, dump_file);
+    if (segment->backing == MEM_BACKING_MMIO) {
+        fprintf(stderr, "Error: mdump: Address range 0x%08x - 0x%08x holds "
+                "device registers.\n", start_addr, end_addr);
+    } else {
+        print_memory_range(segment, start_addr, end_addr, dump_file);
+    }
 
     // Close the dump file if was specified by the user (not stdout)
     if (dump_file != stdout) {
@@ -584,6 +742,76 @@ void command_mdump(cpu_state_t *cpu_state, char *args[], int num_args)
     return;
 }
 
+/*----------------------------------------------------------------------------
+ * Disasm Command
+ *----------------------------------------------------------------------------*/
+
+// The minimum and maximum expected number of arguments for the disasm command
+static const int DISASM_MIN_NUM_ARGS    = 1;
+static const int DISASM_MAX_NUM_ARGS    = 2;
+
+// The default number of instructions disassembled by the disasm command
+static const int DISASM_DEFAULT_COUNT   = 10;
+
+/**
+ * Disassembles the instructions starting at the specified address, which can
+ * also be given as the name of one of the program's symbols.
+ *
+ * The user can optionally specify the number of instructions to disassemble,
+ * otherwise 10 are shown. Each symbol that starts an instruction is shown as a
+ * label above it.
+ **/
+void command_disasm(cpu_state_t *cpu_state, char *args[], int num_args)
+{
+    if (num_args < DISASM_MIN_NUM_ARGS) {
+        fprintf(stderr, "Error: disasm: Too few arguments specified.\n");
+        return;
+    } else if (num_args > DISASM_MAX_NUM_ARGS) {
+        fprintf(stderr, "Error: disasm: Too many arguments specified.\n");
+        return;
+    }
+
+    // Parse the starting address, and the number of instructions, if given
+    uint32_t addr;
+    if (parse_address(cpu_state, args[0], &addr) < 0) {
+        fprintf(stderr, "Error: disasm: Unable to parse '%s' as a symbol or "
+                "32-bit integer.\n", args[0]);
+        return;
+    } else if (addr % sizeof(uint32_t) != 0) {
+        fprintf(stderr, "Error: disasm: Address 0x%08x is not aligned to a "
+                "word.\n", addr);
+        return;
+    }
+
+    int32_t count = DISASM_DEFAULT_COUNT;
+    if (num_args == DISASM_MAX_NUM_ARGS && (parse_int32(args[1], &count) < 0
+                || count <= 0)) {
+        fprintf(stderr, "Error: disasm: Unable to parse '%s' as a positive "
+                "32-bit integer.\n", args[1]);
+        return;
+    }
+
+    // Print each instruction, stopping at the end of the readable memory
+    for (int32_t i = 0; i < count; i++, addr += sizeof(uint32_t))
+    {
+        uint32_t instr;
+        if (!mem_peek32(cpu_state, addr, &instr)) {
+            fprintf(stderr, "Error: disasm: Unable to read an instruction at "
+                    "address 0x%08x.\n", addr);
+            return;
+        }
+
+        const symbol_t *symbol = elf_find_symbol(cpu_state, addr);
+        if (symbol != NULL && symbol->addr == addr) {
+            printf("<%s>:\n", symbol->name);
+        }
+        printf("0x%08x: 0x%08x  %s\n", addr, instr,
+                disasm_instruction(addr, instr));
+    }
+
+    return;
+}
+
 /*----------------------------------------------------------------------------
  * Restart and Load Commands
  *----------------------------------------------------------------------------*/
@@ -606,6 +834,7 @@ int init_cpu_state(cpu_state_t *cpu_state, char *program_path)
     // Clear out the CPU state, and initialize the CPU state fields
     cpu_state->cycle = 0;
     memset(cpu_state->registers, 0, sizeof(cpu_state->registers));
+    sched_init(&cpu_state->scheduler, cpu_state->cycle);
 
     // Strip the extension from the program path, if there is one
     char *extension_start = strrchr(program_path, '.');
@@ -620,6 +849,11 @@ int init_cpu_state(cpu_state_t *cpu_state, char *program_path)
         return rc;
     }
 
+    // Reset the CSRs, pointing the trap vector at the kernel text, if any
+    trap_reset(cpu_state);
+    cpu_state->debug.in_block = false;
+    reverse_reset(cpu_state);
+
     // Mark the CPU as running, and save the name of the loaded program
     cpu_state->halted = false;
     cpu_state->program = program_path;
@@ -646,10 +880,11 @@ void command_restart(cpu_state_t *cpu_state, char *args[], int num_args)
     }
 
     // Unload the program on the processor
-    mem_unload_program(cpu_state);
+    machine_t *machine = cpu_state->machine;
+    machine_unload(machine);
 
-    // Reinitialize the CPU state and reload the program, exit on failure
-    int rc = init_cpu_state(cpu_state, cpu_state->program);
+    // Reinitialize the harts and reload the program, exit on failure
+    int rc = machine_load(machine, cpu_state->program);
     if (rc < 0) {
         fprintf(stderr, "Error: restart: Unable to restart program. Exiting "
                 "the simulator.\n");
@@ -677,12 +912,12 @@ void command_load(cpu_state_t *cpu_state, char *args[], int num_args)
     }
 
     // Unload the current program on the processor
-    mem_unload_program(cpu_state);
+    machine_t *machine = cpu_state->machine;
+    machine_unload(machine);
 
-    // Re-initialize the CPU state, and load the new program
-    // Re-initialize the CPU state
+    // Re-initialize the harts, and load the new program
     char *new_program = args[0];
-    int rc = init_cpu_state(cpu_state, new_program);
+    int rc = machine_load(machine, new_program);
     if (rc < 0) {
         fprintf(stderr, "Error: load: Unable to load program. Halting the "
                 "simulator.\n");
@@ -692,107 +927,1260 @@ void command_load(cpu_state_t *cpu_state, char *args[], int num_args)
 }
 
 /*----------------------------------------------------------------------------
- * Verbose and Quit Commands
+ * Hart Command
  *----------------------------------------------------------------------------*/
 
-// The expected number of arguments for the verbose command
-static const int VERBOSE_NUM_ARGS       = 0;
+// The maximum number of arguments that can be specified to the hart command
+static const int HART_MAX_NUM_ARGS      = 1;
 
-// The expected number of arguments for the quit command
-static const int QUIT_NUM_ARGS          = 0;
+/**
+ * Selects the hart that the other commands display and modify.
+ *
+ * If no hart is specified, then the state of each hart in the machine is
+ * listed instead, with the currently selected hart marked.
+ **/
+void command_hart(cpu_state_t *cpu_state, char *args[], int num_args)
+{
+    // Check that the appropriate number of arguments was specified
+    if (num_args > HART_MAX_NUM_ARGS) {
+        fprintf(stderr, "Error: hart: Too many arguments specified.\n");
+        return;
+    }
+
+    // If no hart was specified, list the harts and their state
+    machine_t *machine = cpu_state->machine;
+    if (num_args == 0) {
+        fprintf(stdout, "Harts: %d (%s mode, quantum %" PRIu64 " cycles)\n",
+                machine->num_harts, hart_mode_name(machine->mode),
+                machine->quantum);
+        for (int i = 0; i < machine->num_harts; i++)
+        {
+            const cpu_state_t *hart = &machine->harts[i];
+            fprintf(stdout, "%c %-4d PC = 0x%08x  Cycle = %-12" PRIu64 " %s\n",
+                    (i == machine->current) ? '*' : ' ', i, hart->pc,
+                    hart->cycle, hart->halted ? "halted" : "running");
+        }
+        return;
+    }
+
+    // Otherwise, parse the hart number and select it
+    int hartid;
+    if (parse_int(args[0], &hartid) < 0) {
+        fprintf(stderr, "Error: hart: Unable to parse '%s' as an int.\n",
+                args[0]);
+        return;
+    } else if (hartid < 0 || hartid >= machine->num_harts) {
+        fprintf(stderr, "Error: hart: Invalid hart %d specified.\n", hartid);
+        return;
+    }
+
+    machine->current = hartid;
+    return;
+}
+
+/*----------------------------------------------------------------------------
+ * Break, Delete, and Profile Commands
+ *----------------------------------------------------------------------------*/
+
+// The maximum number of arguments for the break and profile commands
+static const int BREAK_MAX_NUM_ARGS     = 1;
+static const int PROFILE_MAX_NUM_ARGS   = 1;
+
+// The expected number of arguments for the delete command
+static const int DELETE_NUM_ARGS        = 1;
 
 /**
- * Toggles verbose mode for the simulator.
+ * Sets a breakpoint at the specified address, on every hart. The address can
+ * also be given as the name of one of the program's symbols.
  *
- * If verbose mode is active, then the simulator performs a register dump after
- * every cycle that the CPU runs. This can be useful to do a cycle-by-cycle
- * diff between a reference implementation and this implementation.
+ * If no address is specified, then the breakpoints are listed instead.
+ * Execution stops before the instruction at a breakpoint is run.
  **/
-void command_verbose(cpu_state_t *cpu_state, char *args[], int num_args)
+void command_break(cpu_state_t *cpu_state, char *args[], int num_args)
 {
-    // Silence unused variable warnings from the compiler
-    (void)args;
+    // Check that the appropriate number of arguments was specified
+    if (num_args > BREAK_MAX_NUM_ARGS) {
+        fprintf(stderr, "Error: break: Too many arguments specified.\n");
+        return;
+    }
+
+    // If no address was specified, list the breakpoints
+    const debug_state_t *debug = &cpu_state->debug;
+    if (num_args == 0) {
+        for (int i = 0; i < debug->num_breakpoints; i++)
+        {
+            fprintf(stdout, "Breakpoint %d at 0x%08x", i,
+                    debug->breakpoints[i]);
+            print_symbol(stdout, cpu_state, debug->breakpoints[i]);
+            fprintf(stdout, "\n");
+        }
+        return;
+    }
+
+    // Otherwise, parse the address, and check it isn't already a breakpoint
+    uint32_t addr;
+    if (parse_address(cpu_state, args[0], &addr) < 0) {
+        fprintf(stderr, "Error: break: Unable to parse '%s' as a symbol or "
+                "32-bit integer.\n", args[0]);
+        return;
+    } else if (addr % sizeof(uint32_t) != 0) {
+        fprintf(stderr, "Error: break: Address 0x%08x is not aligned to an "
+                "instruction.\n", addr);
+        return;
+    } else if (debug->num_breakpoints == DEBUG_MAX_BREAKPOINTS) {
+        fprintf(stderr, "Error: break: Too many breakpoints, at most %d can "
+                "be set.\n", DEBUG_MAX_BREAKPOINTS);
+        return;
+    }
+    for (int i = 0; i < debug->num_breakpoints; i++)
+    {
+        if (debug->breakpoints[i] == addr) {
+            fprintf(stderr, "Error: break: There is already a breakpoint at "
+                    "0x%08x.\n", addr);
+            return;
+        }
+    }
+
+    // Add the breakpoint to every hart
+    machine_t *machine = cpu_state->machine;
+    for (int i = 0; i < machine->num_harts; i++)
+    {
+        debug_state_t *hart_debug = &machine->harts[i].debug;
+        hart_debug->breakpoints[hart_debug->num_breakpoints] = addr;
+        hart_debug->num_breakpoints += 1;
+    }
 
+    return;
+}
+
+/**
+ * Removes the breakpoint at the specified address or symbol, from every hart.
+ **/
+void command_delete(cpu_state_t *cpu_state, char *args[], int num_args)
+{
     // Check that the appropriate number of arguments was specified
-    if (num_args != VERBOSE_NUM_ARGS) {
-        fprintf(stderr, "Error: Improper number of arguments specified to "
-                "'verbose' command.\n");
+    if (num_args != DELETE_NUM_ARGS) {
+        fprintf(stderr, "Error: delete: Improper number of arguments "
+                "specified.\n");
+        return;
+    }
+
+    uint32_t addr;
+    if (parse_address(cpu_state, args[0], &addr) < 0) {
+        fprintf(stderr, "Error: delete: Unable to parse '%s' as a symbol or "
+                "32-bit integer.\n", args[0]);
         return;
     }
 
-    // Toggle the verbose mode for the processor
-    cpu_state->verbose_mode = !cpu_state->verbose_mode;
+    // Remove the breakpoint from each hart, keeping the rest in order
+    bool found = false;
+    machine_t *machine = cpu_state->machine;
+    for (int i = 0; i < machine->num_harts; i++)
+    {
+        debug_state_t *debug = &machine->harts[i].debug;
+        int kept = 0;
+        for (int j = 0; j < debug->num_breakpoints; j++)
+        {
+            if (debug->breakpoints[j] == addr) {
+                found = true;
+                continue;
+            }
+            debug->breakpoints[kept] = debug->breakpoints[j];
+            kept += 1;
+        }
+        debug->num_breakpoints = kept;
+    }
+
+    if (!found) {
+        fprintf(stderr, "Error: delete: There is no breakpoint at 0x%08x.\n",
+                addr);
+    }
     return;
 }
 
+// The names of the opcodes, for the profile
+static const char *const OPCODE_NAMES[RISCV_NUM_OPCODES] = {
+#define OPCODE_NAME_ENTRY(opcode, name) \
+    [opcode] = name,
+    RISCV_OPCODE_LIST(OPCODE_NAME_ENTRY)
+#undef OPCODE_NAME_ENTRY
+};
+
 /**
- * Quits the simulator.
+ * Prints the instruction profile, totalled across all of the harts.
  **/
-bool command_quit(cpu_state_t *cpu_state, char *args[], int num_args)
+static void print_profile(const machine_t *machine)
 {
-    // Silence unused variable warnings from the compiler
-    (void)args;
+    uint64_t counts[RISCV_NUM_OPCODES] = {0};
+    uint64_t total = 0;
+    for (int i = 0; i < machine->num_harts; i++)
+    {
+        const debug_state_t *debug = &machine->harts[i].debug;
+        for (int opcode = 0; opcode < RISCV_NUM_OPCODES; opcode++)
+        {
+            counts[opcode] += debug->opcode_counts[opcode];
+            total += debug->opcode_counts[opcode];
+        }
+    }
 
-    if (num_args != QUIT_NUM_ARGS) {
-        fprintf(stderr, "Error: quit: Improper number of arguments "
-                "specified.\n");
-        return false;
+    fprintf(stdout, "%-12s %-16s %s\n", "Opcode", "Instructions", "Percent");
+    for (int opcode = 0; opcode < RISCV_NUM_OPCODES; opcode++)
+    {
+        if (counts[opcode] == 0) {
+            continue;
+        }
+
+        char unknown_name[sizeof("0x00")];
+        const char *name = OPCODE_NAMES[opcode];
+        if (name == NULL) {
+            snprintf(unknown_name, sizeof(unknown_name), "0x%02x", opcode);
+            name = unknown_name;
+        }
+        fprintf(stdout, "%-12s %-16" PRIu64 " %6.2f%%\n", name,
+                counts[opcode], 100.0 * counts[opcode] / total);
     }
+    fprintf(stdout, "%-12s %" PRIu64 "\n", "total", total);
+    return;
+}
 
-    // Indicate that we should quit
-    cpu_state->halted = true;
-    return true;
+/**
+ * Controls the instruction profile, which counts the instructions run on every
+ * hart by their opcode.
+ *
+ * The argument 'on' or 'off' starts or stops profiling, and 'reset' clears the
+ * counts. With no argument, the profile is displayed.
+ **/
+void command_profile(cpu_state_t *cpu_state, char *args[], int num_args)
+{
+    // Check that the appropriate number of arguments was specified
+    if (num_args > PROFILE_MAX_NUM_ARGS) {
+        fprintf(stderr, "Error: profile: Too many arguments specified.\n");
+        return;
+    }
+
+    machine_t *machine = cpu_state->machine;
+    if (num_args == 0) {
+        print_profile(machine);
+        return;
+    }
+
+    // Apply the action to every hart
+    const char *action = args[0];
+    if (strcmp(action, "on") != 0 && strcmp(action, "off") != 0 &&
+            strcmp(action, "reset") != 0) {
+        fprintf(stderr, "Error: profile: Invalid action '%s' specified.\n",
+                action);
+        return;
+    }
+    for (int i = 0; i < machine->num_harts; i++)
+    {
+        debug_state_t *debug = &machine->harts[i].debug;
+        if (strcmp(action, "reset") == 0) {
+            memset(debug->opcode_counts, 0, sizeof(debug->opcode_counts));
+        } else {
+            debug->profile_mode = (strcmp(action, "on") == 0);
+        }
+    }
+
+    return;
 }
 
 /*----------------------------------------------------------------------------
- * Help Command
+ * Heatmap Command
  *----------------------------------------------------------------------------*/
 
-// The expected number of arguments for the help command
-static const int HELP_NUM_ARGS          = 0;
+// The maximum number of arguments for the heatmap command
+static const int HEATMAP_MAX_NUM_ARGS   = 3;
 
 /**
- * Prints out the header lines for the help message for the RISC-V simulator.
+ * Controls the memory heat map, which counts the data accesses to each cache
+ * line or page, and tracks the working set and reuse distances.
+ *
+ * The action 'on' starts collecting, counting by 'line' or 'page' (the
+ * default), with working set windows of the given number of instructions. The
+ * actions 'off' and 'reset' stop collecting, and 'reset' also discards the
+ * data. The action 'csv' writes the per-block counts to a file. With no
+ * action, a summary is displayed.
  **/
-static void print_help_header()
+void command_heatmap(cpu_state_t *cpu_state, char *args[], int num_args)
 {
-    ssize_t line_width = fprintf(stdout, "\nRISC-V Simulator Help:\n");
-    print_separator('-', line_width-2, stdout);
+    // Check that the appropriate number of arguments was specified
+    if (num_args > HEATMAP_MAX_NUM_ARGS) {
+        fprintf(stderr, "Error: heatmap: Too many arguments specified.\n");
+        return;
+    }
+
+    machine_t *machine = cpu_state->machine;
+    if (num_args == 0) {
+        heatmap_print_summary(machine, stdout);
+        return;
+    }
+
+    const char *action = args[0];
+    if (strcmp(action, "off") == 0 && num_args == 1) {
+        heatmap_stop(machine);
+    } else if (strcmp(action, "reset") == 0 && num_args == 1) {
+        heatmap_free(machine);
+    } else if (strcmp(action, "csv") == 0 && num_args == 2) {
+        heatmap_write_csv(machine, args[1]);
+    } else if (strcmp(action, "on") == 0) {
+        // Parse the block size and window, if they were specified
+        unsigned int block_shift = HEATMAP_PAGE_SHIFT;
+        if (num_args >= 2 && strcmp(args[1], "line") == 0) {
+            block_shift = HEATMAP_LINE_SHIFT;
+        } else if (num_args >= 2 && strcmp(args[1], "page") != 0) {
+            fprintf(stderr, "Error: heatmap: Invalid block size '%s' "
+                    "specified.\n", args[1]);
+            return;
+        }
+
+        int window = HEATMAP_DEFAULT_WINDOW;
+        if (num_args == 3 && (parse_int(args[2], &window) < 0 ||
+                    window <= 0)) {
+            fprintf(stderr, "Error: heatmap: Invalid window '%s' specified.\n",
+                    args[2]);
+            return;
+        }
+
+        heatmap_start(machine, block_shift, window);
+    } else {
+        fprintf(stderr, "Error: heatmap: Invalid action '%s' specified.\n",
+                action);
+    }
+
     return;
 }
 
+/*----------------------------------------------------------------------------
+ * Hot Blocks Command
+ *----------------------------------------------------------------------------*/
+
+// The maximum number of arguments for the hotblocks command
+static const int HOTBLOCKS_MAX_NUM_ARGS = 1;
+
 /**
- * Prints out the help message for the specified command, giving its usage and
- * the description for how the command is used.
+ * Controls the basic block counts, which count the executions of each basic
+ * block, and the iterations of the loops they form.
+ *
+ * The action 'on' starts counting, 'off' stops counting, and 'reset' also
+ * discards the counts. With no action, or a number, the report of that many
+ * of the hottest blocks and loops is displayed.
  **/
-static void print_help(const char *cmd_usage, const char *help_message)
+void command_hotblocks(cpu_state_t *cpu_state, char *args[], int num_args)
 {
-    fprintf(stdout, "%-37s - %s\n", cmd_usage, help_message);
+    // Check that the appropriate number of arguments was specified
+    if (num_args > HOTBLOCKS_MAX_NUM_ARGS) {
+        fprintf(stderr, "Error: hotblocks: Too many arguments specified.\n");
+        return;
+    }
+
+    machine_t *machine = cpu_state->machine;
+    int num_top = HOTBLOCKS_DEFAULT_TOP;
+    if (num_args == 0) {
+        hotblocks_print(machine, num_top, stdout);
+    } else if (strcmp(args[0], "on") == 0) {
+        hotblocks_start(machine);
+    } else if (strcmp(args[0], "off") == 0) {
+        hotblocks_stop(machine);
+    } else if (strcmp(args[0], "reset") == 0) {
+        hotblocks_free(machine);
+    } else if (parse_int(args[0], &num_top) == 0 && num_top > 0) {
+        hotblocks_print(machine, num_top, stdout);
+    } else {
+        fprintf(stderr, "Error: hotblocks: Invalid action '%s' specified.\n",
+                args[0]);
+    }
+
+    return;
 }
 
+/*----------------------------------------------------------------------------
+ * Stats Command
+ *----------------------------------------------------------------------------*/
+
+// The maximum number of arguments for the stats command
+static const int STATS_MAX_NUM_ARGS     = 4;
+
 /**
- * Displays a help message to the user.
+ * Controls the statistics, and exports their counters.
  *
- * The message explains the commands available in the simulator and how to use
- * them.
+ * The action 'on' starts counting the memory accesses and halts, 'off' stops
+ * counting them, and 'reset' also discards their counts. The actions 'json'
+ * and 'csv' write the counters in that format, to stdout or the given file.
+ * The action 'log' opens a log that gets a record in the given format each
+ * time the machine halts, and every given number of cycles, and 'log off'
+ * closes it. With no action, the counters are displayed as JSON.
  **/
-void command_help(cpu_state_t *cpu_state, char *args[], int num_args)
+void command_stats(cpu_state_t *cpu_state, char *args[], int num_args)
 {
-    // Silence unused variable warnings from the compiler
-    (void)cpu_state;
-    (void)args;
+    // Check that the appropriate number of arguments was specified
+    if (num_args > STATS_MAX_NUM_ARGS) {
+        fprintf(stderr, "Error: stats: Too many arguments specified.\n");
+        return;
+    }
 
-    // Check that the proper number of command line arguments were specified
-    if (num_args != HELP_NUM_ARGS) {
-        fprintf(stderr, "Error: help: Improper number of arguments "
-                "specified.\n");
+    machine_t *machine = cpu_state->machine;
+    if (num_args == 0) {
+        stats_write(machine, STATS_FORMAT_JSON, stdout);
         return;
     }
 
-    // Print the header and help message for the simulator commands
-    print_help_header();
-    print_help("s[tep] [cycles]", "Run the processor for one or the specified "
-            "number of cycles, or until it is halted.");
+    const char *action = args[0];
+    stats_format_t format;
+    if (strcmp(action, "on") == 0 && num_args == 1) {
+        stats_start(machine);
+    } else if (strcmp(action, "off") == 0 && num_args == 1) {
+        stats_stop(machine);
+    } else if (strcmp(action, "reset") == 0 && num_args == 1) {
+        stats_free(machine);
+    } else if (stats_parse_format(action, &format) == 0 && num_args <= 2) {
+        FILE *dump_file = open_dump_file(args, num_args, 1, "stats");
+        if (dump_file == NULL) {
+            return;
+        }
+        stats_write(machine, format, dump_file);
+        close_dump_file(dump_file);
+    } else if (strcmp(action, "log") == 0 && num_args == 2 &&
+            strcmp(args[1], "off") == 0) {
+        stats_log_close();
+    } else if (strcmp(action, "log") == 0 && num_args >= 3) {
+        if (stats_parse_format(args[1], &format) < 0) {
+            fprintf(stderr, "Error: stats: Invalid format '%s' specified.\n",
+                    args[1]);
+            return;
+        }
+
+        // Parse the interval between the records, if it was specified
+        int interval = 0;
+        if (num_args == 4 && (parse_int(args[3], &interval) < 0 ||
+                    interval <= 0)) {
+            fprintf(stderr, "Error: stats: Invalid interval '%s' "
+                    "specified.\n", args[3]);
+            return;
+        }
+
+        stats_log_open(machine, args[2], format, interval);
+    } else {
+        fprintf(stderr, "Error: stats: Invalid action '%s' specified.\n",
+                action);
+    }
+
+    return;
+}
+
+/*----------------------------------------------------------------------------
+ * Code Writes Command
+ *----------------------------------------------------------------------------*/
+
+// The number of arguments for the codewrites command
+static const int CODEWRITES_NUM_ARGS    = 0;
+
+/**
+ * Displays the number of writes the program has made to each page of its text
+ * segments since it was loaded.
+ **/
+void command_codewrites(cpu_state_t *cpu_state, char *args[], int num_args)
+{
+    (void)args;
+
+    // Check that the appropriate number of arguments was specified
+    if (num_args != CODEWRITES_NUM_ARGS) {
+        fprintf(stderr, "Error: codewrites: Too many arguments specified.\n");
+        return;
+    }
+
+    code_watch_print(cpu_state, stdout);
+    return;
+}
+
+/*----------------------------------------------------------------------------
+ * Huge Pages Command
+ *----------------------------------------------------------------------------*/
+
+// The number of arguments for the hugepages command
+static const int HUGEPAGES_NUM_ARGS     = 0;
+
+/**
+ * Displays how much of each memory segment is backed by host huge pages.
+ **/
+void command_hugepages(cpu_state_t *cpu_state, char *args[], int num_args)
+{
+    (void)args;
+
+    // Check that the appropriate number of arguments was specified
+    if (num_args != HUGEPAGES_NUM_ARGS) {
+        fprintf(stderr, "Error: hugepages: Too many arguments specified.\n");
+        return;
+    }
+
+    huge_pages_print(cpu_state, stdout);
+    return;
+}
+
+/*----------------------------------------------------------------------------
+ * Align Command
+ *----------------------------------------------------------------------------*/
+
+// The maximum number of arguments for the align command
+static const int ALIGN_MAX_NUM_ARGS     = 1;
+
+// The names of the alignment policies, indexed by policy
+static const char *const ALIGN_POLICY_NAMES[] = {
+    [MEM_ALIGN_TRAP] = "trap",
+    [MEM_ALIGN_EMULATE] = "emulate",
+    [MEM_ALIGN_HALT] = "halt",
+};
+
+/**
+ * Sets how misaligned loads and stores are handled: 'trap' raises a misaligned
+ * exception (the default), 'emulate' splits the access into bytes, and 'halt'
+ * halts the processor. With no policy, the current one is displayed, along with
+ * the number of accesses that have been emulated.
+ **/
+void command_align(cpu_state_t *cpu_state, char *args[], int num_args)
+{
+    // Check that the appropriate number of arguments was specified
+    if (num_args > ALIGN_MAX_NUM_ARGS) {
+        fprintf(stderr, "Error: align: Too many arguments specified.\n");
+        return;
+    } else if (num_args == 0) {
+        fprintf(stdout, "Alignment policy: %s (%" PRIu64 " misaligned "
+                "accesses emulated).\n", ALIGN_POLICY_NAMES[MEM_ALIGN_POLICY],
+                __atomic_load_n(&MEM_SPLIT_ACCESSES, __ATOMIC_RELAXED));
+        return;
+    }
+
+    for (int i = 0; i < (int)array_len(ALIGN_POLICY_NAMES); i++)
+    {
+        if (strcmp(args[0], ALIGN_POLICY_NAMES[i]) == 0) {
+            MEM_ALIGN_POLICY = (mem_align_policy_t)i;
+            reverse_reset(cpu_state);
+            return;
+        }
+    }
+
+    fprintf(stderr, "Error: align: Invalid policy '%s' specified.\n", args[0]);
+    return;
+}
+
+/*----------------------------------------------------------------------------
+ * Memory Map Command
+ *----------------------------------------------------------------------------*/
+
+// The number of arguments for the memmap command
+static const int MEMMAP_NUM_ARGS        = 0;
+
+/**
+ * Displays the regions of the memory map, with their permissions and backing.
+ **/
+void command_memmap(cpu_state_t *cpu_state, char *args[], int num_args)
+{
+    (void)cpu_state;
+    (void)args;
+
+    // Check that the appropriate number of arguments was specified
+    if (num_args != MEMMAP_NUM_ARGS) {
+        fprintf(stderr, "Error: memmap: Too many arguments specified.\n");
+        return;
+    }
+
+    mem_map_print(stdout);
+    return;
+}
+
+/*----------------------------------------------------------------------------
+ * Protect Command
+ *----------------------------------------------------------------------------*/
+
+// The number of arguments for the protect command
+static const int PROTECT_NUM_ARGS       = 3;
+
+/**
+ * Sets the permissions of the pages in the given address range, for every
+ * hart. The permissions are a combination of r, w, and x, or '-' for none.
+ **/
+void command_protect(cpu_state_t *cpu_state, char *args[], int num_args)
+{
+    // Check that the appropriate number of arguments was specified
+    if (num_args < PROTECT_NUM_ARGS) {
+        fprintf(stderr, "Error: protect: Too few arguments specified.\n");
+        return;
+    } else if (num_args > PROTECT_NUM_ARGS) {
+        fprintf(stderr, "Error: protect: Too many arguments specified.\n");
+        return;
+    }
+
+    // Parse the starting and ending addresses, and the permissions
+    uint32_t start_addr, end_addr;
+    uint8_t perms;
+    for (int i = 0; i < 2; i++)
+    {
+        if (parse_uint32_hex(args[i], (i == 0) ? &start_addr : &end_addr) < 0) {
+            fprintf(stderr, "Error: protect: Unable to parse '%s' as a 32-bit "
+                    "unsigned hexadecimal integer.\n", args[i]);
+            return;
+        }
+    }
+    if (mem_map_parse_perms(args[2], &perms) < 0) {
+        fprintf(stderr, "Error: protect: Invalid permissions '%s' specified.\n",
+                args[2]);
+        return;
+    } else if (!(start_addr < end_addr)) {
+        fprintf(stderr, "Error: protect: End address is not larger than the "
+                "start address.\n");
+        return;
+    } else if (mem_map_protect(start_addr, end_addr, perms) < 0) {
+        return;
+    }
+
+    // The harts may have cached segments that no longer allow their accesses
+    machine_t *machine = cpu_state->machine;
+    for (int i = 0; i < machine->num_harts; i++)
+    {
+        mem_update_permissions(&machine->harts[i]);
+        reverse_reset(&machine->harts[i]);
+    }
+    return;
+}
+
+/*----------------------------------------------------------------------------
+ * Fork Command
+ *----------------------------------------------------------------------------*/
+
+// The minimum number of arguments for the fork command, and the most changes
+static const int FORK_MIN_NUM_ARGS      = 1;
+#define FORK_MAX_CHANGES                16
+
+// The maximum number of snapshots that can run in the background at once
+#define FORK_MAX_PENDING                16
+
+// The snapshots running in the background, in the order they were taken
+static snapshot_t PENDING_FORKS[FORK_MAX_PENDING];
+static int NUM_PENDING_FORKS            = 0;
+
+/**
+ * Parses a change to a snapshot, which has the form '<target>=<value>' to set
+ * the target, or '<target>^=<mask>' to flip the bits of the target set in the
+ * mask. The target is a register, 'pc', or the address of a word of memory.
+ * Returns 0 on success, or a negative error code on failure.
+ **/
+static int parse_fork_change(char *string, snapshot_change_t *change)
+{
+    char *equals = strchr(string, '=');
+    if (equals == NULL || equals == string) {
+        fprintf(stderr, "Error: fork: Change '%s' is not of the form "
+                "'<target>=<value>' or '<target>^=<mask>'.\n", string);
+        return -EINVAL;
+    }
+
+    // Split the change into its target and value, noting if it's a flip
+    bool flip = (equals[-1] == '^');
+    equals[flip ? -1 : 0] = '\0';
+    const char *value_string = &equals[1];
+    int32_t value;
+    if (parse_int32(value_string, &value) < 0) {
+        fprintf(stderr, "Error: fork: Unable to parse '%s' as a 32-bit "
+                "integer.\n", value_string);
+        return -EINVAL;
+    }
+    change->value = value;
+
+    int reg_num = find_register(string);
+    int32_t addr;
+    if (reg_num >= 0) {
+        change->kind = flip ? SNAPSHOT_FLIP_REG : SNAPSHOT_SET_REG;
+        change->target = reg_num;
+    } else if (strcmp(string, "pc") == 0 && !flip) {
+        change->kind = SNAPSHOT_SET_PC;
+        change->target = 0;
+    } else if (parse_int32(string, &addr) == 0) {
+        change->kind = flip ? SNAPSHOT_FLIP_MEM : SNAPSHOT_SET_MEM;
+        change->target = addr;
+    } else {
+        fprintf(stderr, "Error: fork: Invalid target '%s' specified.\n",
+                string);
+        return -EINVAL;
+    }
+    return 0;
+}
+
+/**
+ * Waits for the snapshot to finish, and prints its result: how it stopped,
+ * and the registers of the current hart that differ from when it was taken.
+ **/
+static void report_fork(snapshot_t *snapshot)
+{
+    snapshot_result_t result;
+    int pid = snapshot->pid;
+    if (snapshot_wait(snapshot, &result) < 0) {
+        return;
+    } else if (!result.applied) {
+        fprintf(stdout, "Fork %d: A memory change has an invalid address, the "
+                "snapshot was not run.\n", pid);
+        return;
+    }
+
+    const char *status = result.halted ? "halted" : result.breakpoint ?
+            "stopped at a breakpoint" : "still running";
+    fprintf(stdout, "Fork %d: %s after %" PRIu64 " cycles, PC 0x%08x -> "
+            "0x%08x.\n", pid, status, result.cycle - snapshot->cycle,
+            snapshot->pc, result.pc);
+    for (int i = 0; i < RISCV_NUM_REGS; i++)
+    {
+        if (result.registers[i] != snapshot->registers[i]) {
+            fprintf(stdout, "    %-5s 0x%08x -> 0x%08x\n",
+                    RISCV_REGISTER_NAMES[i].abi_name, snapshot->registers[i],
+                    result.registers[i]);
+        }
+    }
+    return;
+}
+
+/**
+ * Takes a snapshot of the simulation in a child process, which makes the given
+ * changes to the current hart, and runs for up to the given number of cycles.
+ * By default, the shell waits for the snapshot, and prints its result. With
+ * '-b', the snapshot runs in the background while the shell carries on, and
+ * 'fork wait' waits for every background snapshot and prints their results.
+ **/
+void command_fork(cpu_state_t *cpu_state, char *args[], int num_args)
+{
+    // Collect the background snapshots, if requested
+    if (num_args == 1 && strcmp(args[0], "wait") == 0) {
+        for (int i = 0; i < NUM_PENDING_FORKS; i++)
+        {
+            report_fork(&PENDING_FORKS[i]);
+        }
+        NUM_PENDING_FORKS = 0;
+        return;
+    }
+
+    // Check that the appropriate number of arguments was specified
+    bool background = (num_args > 0 && strcmp(args[0], "-b") == 0);
+    args += background;
+    num_args -= background;
+    if (num_args < FORK_MIN_NUM_ARGS) {
+        fprintf(stderr, "Error: fork: Too few arguments specified.\n");
+        return;
+    } else if (num_args - FORK_MIN_NUM_ARGS > FORK_MAX_CHANGES) {
+        fprintf(stderr, "Error: fork: Too many changes specified, at most %d "
+                "are allowed.\n", FORK_MAX_CHANGES);
+        return;
+    } else if (background && NUM_PENDING_FORKS == FORK_MAX_PENDING) {
+        fprintf(stderr, "Error: fork: Too many snapshots are running, use "
+                "'fork wait' to collect them.\n");
+        return;
+    }
+
+    // Parse the number of cycles, and the changes to make
+    int num_cycles;
+    snapshot_change_t changes[FORK_MAX_CHANGES];
+    int num_changes = num_args - FORK_MIN_NUM_ARGS;
+    if (parse_int(args[0], &num_cycles) < 0 || num_cycles < 0) {
+        fprintf(stderr, "Error: fork: Unable to parse '%s' as a number of "
+                "cycles.\n", args[0]);
+        return;
+    }
+    for (int i = 0; i < num_changes; i++)
+    {
+        if (parse_fork_change(args[FORK_MIN_NUM_ARGS + i], &changes[i]) < 0) {
+            return;
+        }
+    }
+
+    // Take the snapshot, and wait for it unless it runs in the background
+    snapshot_t snapshot;
+    if (snapshot_fork(cpu_state->machine, changes, num_changes, num_cycles,
+                &snapshot) < 0) {
+        return;
+    } else if (background) {
+        PENDING_FORKS[NUM_PENDING_FORKS] = snapshot;
+        NUM_PENDING_FORKS += 1;
+        fprintf(stdout, "Fork %d started in the background.\n",
+                (int)snapshot.pid);
+        return;
+    }
+
+    report_fork(&snapshot);
+    return;
+}
+
+/*----------------------------------------------------------------------------
+ * Sweep Command
+ *----------------------------------------------------------------------------*/
+
+// The minimum and maximum expected number of arguments for the sweep command
+static const int SWEEP_MIN_NUM_ARGS     = 3;
+static const int SWEEP_MAX_NUM_ARGS     = 5;
+
+/**
+ * Runs a batch of instances of the template program to completion in lockstep,
+ * with the input register of each set to the next value in the sweep, and
+ * prints out the result of each instance. If dump_file is not NULL, the CPU
+ * state and registers of each instance are dumped to it, in the same format as
+ * the rdump command. Returns 0 on success, or a negative error code on failure.
+ **/
+static int run_sweep_batch(const cpu_state_t *template, int first,
+        int num_instances, riscv_isa_reg_t input_reg, int32_t start,
+        int32_t step, FILE *dump_file, lockstep_stats_t *stats)
+{
+    // Create the instances, each with its own copy of memory
+    int num_segments = template->memory.num_segments;
+    cpu_state_t states[LOCKSTEP_LANES];
+    cpu_state_t *instances[LOCKSTEP_LANES];
+    mem_segment_t segments[LOCKSTEP_LANES][num_segments];
+    for (int i = 0; i < num_instances; i++)
+    {
+        int rc = lockstep_instance_init(&states[i], segments[i], template);
+        if (rc < 0) {
+            for (int j = 0; j < i; j++)
+            {
+                lockstep_instance_free(&states[j]);
+            }
+            return rc;
+        }
+
+        int32_t input = start + (int32_t)((uint32_t)step * (first + i));
+        register_write(&states[i], input_reg, input);
+        instances[i] = &states[i];
+    }
+
+    // Run the instances until they have all halted or the user interrupts us
+    bool halted = false;
+    while (!halted && !SIGINT_RECEIVED)
+    {
+        lockstep_run(instances, num_instances, GO_INTERRUPT_CHECK_CYCLES,
+                stats);
+
+        halted = true;
+        for (int i = 0; i < num_instances; i++)
+        {
+            halted = halted && states[i].halted;
+        }
+    }
+
+    // Report the result of each instance, then free them
+    for (int i = 0; i < num_instances; i++)
+    {
+        const cpu_state_t *instance = &states[i];
+        int32_t input = start + (int32_t)((uint32_t)step * (first + i));
+        fprintf(stdout, "%-9d %-12" PRId32 " %-12" PRIu64 " 0x%08x  %s\n",
+                first + i, input, instance->cycle,
+                instance->registers[REG_SP],
+                instance->halted ? "halted" : "interrupted");
+        if (dump_file != NULL) {
+            print_cpu_state(instance, dump_file);
+            fprintf(dump_file, "\n");
+            print_registers(instance, dump_file);
+        }
+        lockstep_instance_free(&states[i]);
+    }
+
+    return 0;
+}
+
+/**
+ * Runs the loaded program once for each of a range of inputs, and reports the
+ * result of each run.
+ *
+ * Every run starts from a fresh copy of the program, with the input register
+ * set to start + i * step for the i-th run, and the result is the value the
+ * program returns in x2. The runs are executed in groups on the lockstep
+ * engine, so that runs that follow the same path through the program share
+ * their instructions. The user can optionally specify a file to which to dump
+ * the final CPU state and registers of every run.
+ **/
+void command_sweep(cpu_state_t *cpu_state, char *args[], int num_args)
+{
+    // Check that the appropriate number of arguments was specified
+    if (num_args < SWEEP_MIN_NUM_ARGS) {
+        fprintf(stderr, "Error: sweep: Too few arguments specified.\n");
+        return;
+    } else if (num_args > SWEEP_MAX_NUM_ARGS) {
+        fprintf(stderr, "Error: sweep: Too many arguments specified.\n");
+        return;
+    }
+
+    // Parse the number of runs, the input register, and the range of inputs
+    int count;
+    if (parse_int(args[0], &count) < 0 || count <= 0) {
+        fprintf(stderr, "Error: sweep: Invalid count '%s' specified.\n",
+                args[0]);
+        return;
+    }
+
+    int reg_num = -ENOENT;
+    if (parse_int(args[1], &reg_num) < 0) {
+        reg_num = find_register(args[1]);
+    }
+    if (reg_num < 0 || reg_num >= (int)array_len(cpu_state->registers)) {
+        fprintf(stderr, "Error: sweep: Invalid register '%s' specified.\n",
+                args[1]);
+        return;
+    }
+
+    int32_t start;
+    int32_t step = 1;
+    if (parse_int32(args[2], &start) < 0) {
+        fprintf(stderr, "Error: sweep: Unable to parse '%s' as a 32-bit "
+                "integer.\n", args[2]);
+        return;
+    } else if (num_args >= 4 && parse_int32(args[3], &step) < 0) {
+        fprintf(stderr, "Error: sweep: Unable to parse '%s' as a 32-bit "
+                "integer.\n", args[3]);
+        return;
+    }
+
+    // Open the dump file, if one was specified
+    FILE *dump_file = NULL;
+    if (num_args == SWEEP_MAX_NUM_ARGS) {
+        dump_file = open_dump_file(args, num_args, SWEEP_MAX_NUM_ARGS - 1,
+                "sweep");
+        if (dump_file == NULL) {
+            return;
+        }
+    }
+
+    /* Load a fresh copy of the program to serve as the template for the
+     * instances, using a private copy of the segment table. */
+    int num_segments = cpu_state->memory.num_segments;
+    mem_segment_t template_segments[num_segments];
+    for (int i = 0; i < num_segments; i++)
+    {
+        template_segments[i] = cpu_state->memory.segments[i];
+        template_segments[i].mem = NULL;
+        template_segments[i].size = 0;
+        template_segments[i].mapped_size = 0;
+        template_segments[i].shared = NULL;
+        template_segments[i].page_writes = NULL;
+    }
+
+    cpu_state_t template = {
+        .memory = {
+            .num_segments = num_segments,
+            .segments = template_segments,
+        },
+    };
+    if (init_cpu_state(&template, cpu_state->program) < 0) {
+        fprintf(stderr, "Error: sweep: Unable to load program.\n");
+        if (dump_file != NULL) {
+            close_dump_file(dump_file);
+        }
+        return;
+    }
+
+    // Run the instances in batches, one instance per lane
+    fprintf(stdout, "%-9s %-12s %-12s %-10s  %s\n", "Instance", "Input",
+            "Cycles", "Result", "Status");
+    lockstep_stats_t stats = {0};
+    SIGINT_RECEIVED = false;
+    for (int first = 0; first < count && !SIGINT_RECEIVED;
+            first += LOCKSTEP_LANES)
+    {
+        int num_instances = min(count - first, LOCKSTEP_LANES);
+        int rc = run_sweep_batch(&template, first, num_instances, reg_num,
+                start, step, dump_file, &stats);
+        if (rc < 0) {
+            fprintf(stderr, "Error: sweep: Unable to create instances.\n");
+            break;
+        }
+    }
+
+    // Tell the user if they interrupted execution, and reset the received flag
+    if (SIGINT_RECEIVED) {
+        fprintf(stdout, "\nExecution interrupted by the user, stopping.\n");
+    }
+    SIGINT_RECEIVED = false;
+
+    fprintf(stdout, "Lockstep: %" PRIu64 " vector instructions, %" PRIu64
+            " scalar instructions, %" PRIu64 " lanes peeled.\n",
+            stats.vector_instrs, stats.scalar_instrs, stats.peeled_lanes);
+    mem_unload_program(&template);
+    if (dump_file != NULL) {
+        close_dump_file(dump_file);
+    }
+    return;
+}
+
+/*----------------------------------------------------------------------------
+ * Record, Rstep, and Rgo-until Commands
+ *----------------------------------------------------------------------------*/
+
+// The number of arguments for the record, rstep, and rgo-until commands
+static const int RECORD_MAX_NUM_ARGS    = 2;
+static const int RSTEP_MAX_NUM_ARGS     = 1;
+static const int RGO_UNTIL_NUM_ARGS     = 2;
+
+/**
+ * Controls the recording of the current hart's instructions, which allows it
+ * to be stepped backwards.
+ *
+ * The action 'on' starts recording, keeping at least the given number of the
+ * most recent instructions. The action 'off' stops recording, and discards it.
+ * With no action, the status of the recording is displayed.
+ **/
+void command_record(cpu_state_t *cpu_state, char *args[], int num_args)
+{
+    // Check that the appropriate number of arguments was specified
+    if (num_args > RECORD_MAX_NUM_ARGS) {
+        fprintf(stderr, "Error: record: Too many arguments specified.\n");
+        return;
+    } else if (num_args == 0) {
+        reverse_print_status(cpu_state, stdout);
+        return;
+    }
+
+    const char *action = args[0];
+    if (strcmp(action, "off") == 0 && num_args == 1) {
+        reverse_stop(cpu_state);
+        return;
+    } else if (strcmp(action, "on") != 0) {
+        fprintf(stderr, "Error: record: Invalid action '%s' specified.\n",
+                action);
+        return;
+    }
+
+    // Other harts would change shared memory that can't be rewound
+    int num_records = REVERSE_DEFAULT_RECORDS;
+    if (cpu_state->machine->num_harts > 1) {
+        fprintf(stderr, "Error: record: Recording is only supported with a "
+                "single hart.\n");
+        return;
+    } else if (num_args == 2 && (parse_int(args[1], &num_records) < 0 ||
+                num_records <= 0)) {
+        fprintf(stderr, "Error: record: Invalid number of records '%s' "
+                "specified.\n", args[1]);
+        return;
+    }
+
+    reverse_start(cpu_state, num_records);
+    return;
+}
+
+/**
+ * Runs the current hart backwards by the specified number of cycles, which is
+ * 1 by default. The hart must be recording, and the recording must go back
+ * that far.
+ **/
+void command_rstep(cpu_state_t *cpu_state, char *args[], int num_args)
+{
+    // Check that the appropriate number of arguments was specified
+    if (num_args > RSTEP_MAX_NUM_ARGS) {
+        fprintf(stderr, "Error: rstep: Too many arguments specified.\n");
+        return;
+    }
+
+    // If a number of cycles was specified, then attempt to parse it
+    int num_cycles = 1;
+    if (num_args != 0 && (parse_int(args[0], &num_cycles) < 0 ||
+                num_cycles < 0)) {
+        fprintf(stderr, "Error: rstep: Invalid number of cycles '%s' "
+                "specified.\n", args[0]);
+        return;
+    } else if (cpu_state->debug.undo == NULL) {
+        fprintf(stderr, "Error: rstep: Recording is off, use 'record on' to "
+                "start it.\n");
+        return;
+    }
+
+    uint64_t recorded = cpu_state->cycle - reverse_first_cycle(cpu_state);
+    if ((uint64_t)num_cycles > recorded) {
+        fprintf(stderr, "Error: rstep: Only %" PRIu64 " cycles are recorded.\n",
+                recorded);
+        return;
+    }
+
+    reverse_to_cycle(cpu_state, cpu_state->cycle - num_cycles);
+    return;
+}
+
+/**
+ * Runs the current hart backwards until the last time the condition held. The
+ * condition 'pc' stops before the last instruction at the address, while 'reg'
+ * and 'mem' stop before the last instruction that changed the register or the
+ * word of memory.
+ **/
+void command_rgo_until(cpu_state_t *cpu_state, char *args[], int num_args)
+{
+    // Check that the appropriate number of arguments was specified
+    if (num_args != RGO_UNTIL_NUM_ARGS) {
+        fprintf(stderr, "Error: rgo-until: Improper number of arguments "
+                "specified.\n");
+        return;
+    } else if (cpu_state->debug.undo == NULL) {
+        fprintf(stderr, "Error: rgo-until: Recording is off, use 'record on' "
+                "to start it.\n");
+        return;
+    }
+
+    // Parse the condition, and its address or register
+    reverse_cond_t cond;
+    uint32_t target;
+    const char *kind = args[0];
+    if (strcmp(kind, "reg") == 0) {
+        int reg_num = -ENOENT;
+        if (parse_int(args[1], &reg_num) < 0) {
+            reg_num = find_register(args[1]);
+        }
+        if (reg_num < 0 || reg_num >= RISCV_NUM_REGS) {
+            fprintf(stderr, "Error: rgo-until: Invalid register '%s' "
+                    "specified.\n", args[1]);
+            return;
+        }
+        cond = REVERSE_UNTIL_REG;
+        target = reg_num;
+    } else if (strcmp(kind, "pc") == 0 || strcmp(kind, "mem") == 0) {
+        if (parse_address(cpu_state, args[1], &target) < 0) {
+            fprintf(stderr, "Error: rgo-until: Unable to parse '%s' as a "
+                    "symbol or 32-bit integer.\n", args[1]);
+            return;
+        } else if (target % sizeof(uint32_t) != 0) {
+            fprintf(stderr, "Error: rgo-until: Address 0x%08x is not aligned "
+                    "to a word.\n", target);
+            return;
+        }
+        cond = (strcmp(kind, "pc") == 0) ? REVERSE_UNTIL_PC : REVERSE_UNTIL_MEM;
+    } else {
+        fprintf(stderr, "Error: rgo-until: Invalid condition '%s' specified.\n",
+                kind);
+        return;
+    }
+
+    // Find the last time the condition held, and go back to it
+    uint64_t cycle;
+    if (reverse_find(cpu_state, cond, target, &cycle) < 0) {
+        fprintf(stdout, "No recorded instruction matches, not moving.\n");
+        return;
+    } else if (reverse_to_cycle(cpu_state, cycle) < 0) {
+        return;
+    }
+
+    fprintf(stdout, "Stopped at cycle %" PRIu64 " with the PC at 0x%08x",
+            cpu_state->cycle, cpu_state->pc);
+    print_symbol(stdout, cpu_state, cpu_state->pc);
+    fprintf(stdout, ".\n");
+    return;
+}
+
+/*----------------------------------------------------------------------------
+ * Verbose and Quit Commands
+ *----------------------------------------------------------------------------*/
+
+// The maximum expected number of arguments for the verbose command
+static const int VERBOSE_MAX_NUM_ARGS   = 1;
+
+// The expected number of arguments for the quit command
+static const int QUIT_NUM_ARGS          = 0;
+
+/**
+ * Toggles verbose mode for the simulator.
+ *
+ * If verbose mode is active, then the simulator shows the disassembly of each
+ * instruction that the CPU runs, and performs a register dump after it. This
+ * can be useful to do a cycle-by-cycle diff between a reference implementation
+ * and this implementation.
+ *
+ * The style 'delta' turns on verbose mode showing only the registers and
+ * memory words that each instruction changed, while 'full' turns it on with
+ * the full register dumps.
+ **/
+void command_verbose(cpu_state_t *cpu_state, char *args[], int num_args)
+{
+    // Check that the appropriate number of arguments was specified
+    if (num_args > VERBOSE_MAX_NUM_ARGS) {
+        fprintf(stderr, "Error: Improper number of arguments specified to "
+                "'verbose' command.\n");
+        return;
+    }
+
+    // With no style, toggle the verbose mode for the processor
+    if (num_args == 0) {
+        cpu_state->verbose_mode = !cpu_state->verbose_mode;
+        return;
+    }
+
+    const char *style = args[0];
+    if (strcmp(style, "full") == 0) {
+        cpu_state->debug.verbose_delta = false;
+    } else if (strcmp(style, "delta") == 0) {
+        cpu_state->debug.verbose_delta = true;
+    } else {
+        fprintf(stderr, "Error: verbose: Invalid style '%s' specified.\n",
+                style);
+        return;
+    }
+    cpu_state->verbose_mode = true;
+    return;
+}
+
+/**
+ * Quits the simulator.
+ **/
+bool command_quit(cpu_state_t *cpu_state, char *args[], int num_args)
+{
+    // Silence unused variable warnings from the compiler
+    (void)args;
+
+    if (num_args != QUIT_NUM_ARGS) {
+        fprintf(stderr, "Error: quit: Improper number of arguments "
+                "specified.\n");
+        return false;
+    }
+
+    // Indicate that we should quit
+    cpu_state->halted = true;
+    return true;
+}
+
+/*----------------------------------------------------------------------------
+ * Help Command
+ *----------------------------------------------------------------------------*/
+
+// The expected number of arguments for the help command
+static const int HELP_NUM_ARGS          = 0;
+
+/**
+ * Prints out the header lines for the help message for the RISC-V simulator.
+ **/
+static void print_help_header()
+{
+    ssize_t line_width = fprintf(stdout, "\nRISC-V Simulator Help:\n");
+    print_separator('-', line_width-2, stdout);
+    return;
+}
+
+/**
+ * Prints out the help message for the specified command, giving its usage and
+ * the description for how the command is used.
+ **/
+static void print_help(const char *cmd_usage, const char *help_message)
+{
+    fprintf(stdout, "%-37s - %s\n", cmd_usage, help_message);
+}
+
+/**
+ * Displays a help message to the user.
+ *
+ * The message explains the commands available in the simulator and how to use
+ * them.
+ **/
+void command_help(cpu_state_t *cpu_state, char *args[], int num_args)
+{
+    // Silence unused variable warnings from the compiler
+    (void)cpu_state;
+    (void)args;
+
+    // Check that the proper number of command line arguments were specified
+    if (num_args != HELP_NUM_ARGS) {
+        fprintf(stderr, "Error: help: Improper number of arguments "
+                "specified.\n");
+        return;
+    }
+
+    // Print the header and help message for the simulator commands
+    print_help_header();
+    print_help("s[tep] [cycles]", "Run the processor for one or the specified "
+            "number of cycles, or until it is halted.");
     print_help("go", "Run the simulator until the processor is halted.");
 
     // Print help messages for register commands
@@ -807,6 +2195,8 @@ void command_help(cpu_state_t *cpu_state, char *args[], int num_args)
     print_help("mdump <start> <end> [dump_file]", "Display the memory values "
             "across the range [start, end), optionally dumping it to the "
             "file.");
+    print_help("disasm <addr|symbol> [count]", "Disassemble count "
+            "instructions (default 10) starting at the address.");
 
     // Print help messages for the load and restart commands
     print_help("restart", "Reset the processor and restart the program from "
@@ -814,9 +2204,56 @@ void command_help(cpu_state_t *cpu_state, char *args[], int num_args)
     print_help("load <program>", "Reset the processor and load the new program "
             "into memory for execution.");
 
+    // Print help message for the hart command
+    print_help("hart [hart]", "List the harts, or select the hart that the "
+            "register and dump commands apply to.");
+
+    // Print help messages for the debugging commands
+    print_help("b[reak] [addr|symbol]", "Set a breakpoint at the address or "
+            "symbol, or list the breakpoints.");
+    print_help("delete <addr|symbol>", "Remove the breakpoint at the address "
+            "or symbol.");
+    print_help("profile [on|off|reset]", "Start, stop, or clear the "
+            "instruction profile, or display it.");
+
+    print_help("heatmap [on [line|page] [window]|off|reset|csv <file>]",
+            "Control the memory heat map, or display its summary.");
+    print_help("hotblocks [on|off|reset|count]", "Control the basic block "
+            "counts, or display the hottest blocks and loops.");
+    print_help("stats [on|off|reset|json|csv [file]]", "Control the "
+            "statistics, or write their counters as JSON or CSV.");
+    print_help("stats log <json|csv> <file> [cycles]|off", "Log the "
+            "statistics when halted, and every cycles, or stop logging.");
+    print_help("codewrites", "Display the number of writes to each page of "
+            "the text segments.");
+    print_help("hugepages", "Display how much of each memory segment is "
+            "backed by host huge pages.");
+    print_help("align [trap|emulate|halt]", "Set how misaligned loads and "
+            "stores are handled, or display the policy.");
+    print_help("memmap", "Display the regions of the memory map.");
+    print_help("protect <start> <end> <perms>", "Set the permissions (r, w, "
+            "x, or -) of the pages from start up to end.");
+
+    // Print help message for the sweep command
+    print_help("sweep <count> <reg> <start> [step] [dump_file]", "Run the "
+            "program count times in lockstep, setting reg to start + i * step "
+            "for run i, optionally dumping each run's registers to the file.");
+    print_help("fork [-b] <cycles> [target[^]=value ...]", "Run a copy of the "
+            "simulation for cycles with registers, pc, or memory changed.");
+    print_help("fork wait", "Wait for the background forks, and display their "
+            "results.");
+
+    // Print help messages for the reverse execution commands
+    print_help("record [on [records]|off]", "Record the hart's instructions, "
+            "so it can run backwards, or display the recording.");
+    print_help("rstep [n]", "Run the hart backwards n cycles (default 1).");
+    print_help("rgo-until <pc|reg|mem> <value>", "Run the hart backwards "
+            "until the pc was value, or reg or mem was last changed.");
+
     // Print help message for the verbose, quit, and help commands
-    print_help("v[erbose]", "Toggles verbose mode for the simulator. When "
-            "active, the simulator dumps the registers after each cycle.");
+    print_help("v[erbose] [full|delta]", "Toggles verbose mode, or turns it "
+            "on. When active, the simulator shows each instruction, and dumps "
+            "the registers after it, or only what it changed with delta.");
     print_help("q[uit]", "Quit the simulator. Can also be done with an EOF "
             "(CTRL-D).");
     print_help("h[elp]|?", "Display this help message.");
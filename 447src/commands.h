@@ -102,6 +102,14 @@ void command_rdump(cpu_state_t *cpu_state, char *args[], int num_args);
  **/
 void command_mdump(cpu_state_t *cpu_state, char *args[], int num_args);
 
+/**
+ * Disassembles the instructions starting at the specified address, which can
+ * also be given as the name of one of the program's symbols.
+ *
+ * The user can optionally specify the number of instructions to disassemble.
+ **/
+void command_disasm(cpu_state_t *cpu_state, char *args[], int num_args);
+
 /**
  * Resets the processor and restarts the currently loaded program.
  *
@@ -120,12 +128,151 @@ void command_restart(cpu_state_t *cpu_state, char *args[], int num_args);
  **/
 void command_load(cpu_state_t *cpu_state, char *args[], int num_args);
 
+/**
+ * Selects the hart that the other commands display and modify.
+ *
+ * If no hart is specified, then the state of each hart in the machine is
+ * listed instead, with the currently selected hart marked.
+ **/
+void command_hart(cpu_state_t *cpu_state, char *args[], int num_args);
+
+/**
+ * Sets a breakpoint at the specified address, on every hart.
+ *
+ * If no address is specified, then the breakpoints are listed instead.
+ * Execution stops before the instruction at a breakpoint is run.
+ **/
+void command_break(cpu_state_t *cpu_state, char *args[], int num_args);
+
+/**
+ * Removes the breakpoint at the specified address, from every hart.
+ **/
+void command_delete(cpu_state_t *cpu_state, char *args[], int num_args);
+
+/**
+ * Controls the instruction profile, which counts the instructions run on every
+ * hart by their opcode.
+ *
+ * The argument 'on' or 'off' starts or stops profiling, and 'reset' clears the
+ * counts. With no argument, the profile is displayed.
+ **/
+void command_profile(cpu_state_t *cpu_state, char *args[], int num_args);
+
+/**
+ * Controls the memory heat map, which counts the data accesses to each cache
+ * line or page, and tracks the working set and reuse distances.
+ *
+ * The action 'on' starts collecting, counting by 'line' or 'page' (the
+ * default), with working set windows of the given number of instructions. The
+ * actions 'off' and 'reset' stop collecting, and 'reset' also discards the
+ * data. The action 'csv' writes the per-block counts to a file. With no
+ * action, a summary is displayed.
+ **/
+void command_heatmap(cpu_state_t *cpu_state, char *args[], int num_args);
+
+/**
+ * Controls the basic block counts, which count the executions of each basic
+ * block, and the iterations of the loops they form. The action 'on' starts
+ * counting, 'off' stops counting, and 'reset' also discards the counts. With
+ * no action, or a number, the report of that many of the hottest blocks and
+ * loops is displayed.
+ **/
+void command_hotblocks(cpu_state_t *cpu_state, char *args[], int num_args);
+
+/**
+ * Controls the statistics, and exports their counters. The action 'on' starts
+ * counting the memory accesses and halts, 'off' stops counting them, and
+ * 'reset' also discards their counts. The actions 'json' and 'csv' write the
+ * counters to stdout or a file, and 'log' logs them to a file each time the
+ * machine halts, and every given number of cycles. With no action, the
+ * counters are displayed as JSON.
+ **/
+void command_stats(cpu_state_t *cpu_state, char *args[], int num_args);
+
+/**
+ * Displays the number of writes the program has made to each page of its text
+ * segments since it was loaded.
+ **/
+void command_codewrites(cpu_state_t *cpu_state, char *args[], int num_args);
+
+/**
+ * Displays how much of each memory segment is backed by host huge pages.
+ **/
+void command_hugepages(cpu_state_t *cpu_state, char *args[], int num_args);
+
+/**
+ * Sets how misaligned loads and stores are handled: 'trap' raises a misaligned
+ * exception (the default), 'emulate' splits the access into bytes, and 'halt'
+ * halts the processor. With no policy, the current one is displayed, along with
+ * the number of accesses that have been emulated.
+ **/
+void command_align(cpu_state_t *cpu_state, char *args[], int num_args);
+
+/**
+ * Displays the regions of the memory map, with their permissions and backing.
+ **/
+void command_memmap(cpu_state_t *cpu_state, char *args[], int num_args);
+
+/**
+ * Sets the permissions of the pages in the given address range, for every
+ * hart. The permissions are a combination of r, w, and x, or '-' for none.
+ **/
+void command_protect(cpu_state_t *cpu_state, char *args[], int num_args);
+
+/**
+ * Takes a snapshot of the simulation in a child process, which makes the given
+ * changes to the current hart, and runs for up to the given number of cycles.
+ * By default, the shell waits for the snapshot, and prints its result. With
+ * '-b', the snapshot runs in the background while the shell carries on, and
+ * 'fork wait' waits for every background snapshot and prints their results.
+ **/
+void command_fork(cpu_state_t *cpu_state, char *args[], int num_args);
+
+/**
+ * Runs the loaded program once for each of a range of inputs, and reports the
+ * result of each run.
+ *
+ * Every run starts from a fresh copy of the program, with the input register
+ * set to start + i * step for the i-th run. The runs are executed in groups on
+ * the lockstep engine. The final CPU state and registers of every run can
+ * optionally be dumped to a file.
+ **/
+void command_sweep(cpu_state_t *cpu_state, char *args[], int num_args);
+
+/**
+ * Controls the recording of the current hart's instructions, which allows it
+ * to be stepped backwards. The action 'on' starts recording, keeping at least
+ * the given number of the most recent instructions, and 'off' stops it. With
+ * no action, the status of the recording is displayed.
+ **/
+void command_record(cpu_state_t *cpu_state, char *args[], int num_args);
+
+/**
+ * Runs the current hart backwards by the specified number of cycles, which is
+ * 1 by default. The hart must be recording, and the recording must go back
+ * that far.
+ **/
+void command_rstep(cpu_state_t *cpu_state, char *args[], int num_args);
+
+/**
+ * Runs the current hart backwards until the last time the condition held. The
+ * condition 'pc' stops before the last instruction at the address, while 'reg'
+ * and 'mem' stop before the last instruction that changed the register or the
+ * word of memory.
+ **/
+void command_rgo_until(cpu_state_t *cpu_state, char *args[], int num_args);
+
 /**
  * Toggles verbose mode for the simulator.
  *
- * If verbose mode is active, then the simulator performs a register dump after
- * every cycle that the CPU runs. This can be useful to do a cycle-by-cycle
- * diff between a reference implementation and this implementation.
+ * If verbose mode is active, then the simulator shows the disassembly of each
+ * instruction that the CPU runs, and performs a register dump after it. This
+ * can be useful to do a cycle-by-cycle diff between a reference implementation
+ * and this implementation.
+ *
+ * The style 'delta' turns on verbose mode showing only the registers and
+ * memory words that each instruction changed, while 'full' turns it on with
+ * the full register dumps.
  **/
 void command_verbose(cpu_state_t *cpu_state, char *args[], int num_args);
 
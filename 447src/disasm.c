@@ -0,0 +1,404 @@
+/**
+ * disasm.c
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the disassembler, which formats instructions as assembly.
+ *
+ * Each opcode has its own table of instructions, and each entry gives the bits
+ * of the instruction that identify it within the opcode (its function codes),
+ * their values, and the format of its operands. An instruction is found by
+ * indexing the tables by its opcode, then comparing it against the few
+ * entries in that table.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+// Standard Includes
+#include <stdio.h>                  // Snprintf function
+#include <stdint.h>                 // Fixed-size integral types
+#include <stddef.h>                 // Definition of NULL
+
+// 18-447 Simulator Includes
+#include <riscv_isa.h>              // Opcodes, function codes, and CSRs
+
+// Local Includes
+#include "libc_extensions.h"        // Array length macro
+#include "disasm.h"                 // This file's interface
+
+/*----------------------------------------------------------------------------
+ * Internal Definitions
+ *----------------------------------------------------------------------------*/
+
+// The formats of the operands of an instruction
+typedef enum disasm_format {
+    FORMAT_NONE,                    // No operands (ecall)
+    FORMAT_R,                       // rd, rs1, rs2
+    FORMAT_I,                       // rd, rs1, imm
+    FORMAT_SHIFT,                   // rd, rs1, shamt
+    FORMAT_LOAD,                    // rd, imm(rs1)
+    FORMAT_STORE,                   // rs2, imm(rs1)
+    FORMAT_BRANCH,                  // rs1, rs2, target
+    FORMAT_U,                       // rd, imm (upper 20 bits)
+    FORMAT_JAL,                     // rd, target
+    FORMAT_JALR,                    // rd, imm(rs1)
+    FORMAT_CSR,                     // rd, csr, rs1
+    FORMAT_CSRI,                    // rd, csr, uimm
+    FORMAT_AMO,                     // rd, rs2, (rs1)
+    FORMAT_LR,                      // rd, (rs1)
+} disasm_format_t;
+
+// An instruction in an opcode's table
+typedef struct disasm_entry {
+    uint32_t mask;                  // Bits that identify the instruction
+    uint32_t match;                 // Values of the identifying bits
+    const char *name;               // Mnemonic of the instruction
+    disasm_format_t format;         // Format of its operands
+} disasm_entry_t;
+
+// The instructions of an opcode
+typedef struct disasm_table {
+    const disasm_entry_t *entries;  // Instructions with the opcode
+    int num_entries;                // Number of instructions
+} disasm_table_t;
+
+// The masks for the function codes that identify an instruction
+#define MASK_NONE                   0x00000000U
+#define MASK_FUNCT3                 0x00007000U
+#define MASK_FUNCT7_FUNCT3          0xFE007000U
+#define MASK_FUNCT5_FUNCT3          0xF8007000U
+#define MASK_FUNCT12                0xFFFFFF80U
+
+// The function codes, shifted into their places in the instruction
+#define FUNCT3(funct3)              ((uint32_t)(funct3) << 12)
+#define FUNCT7(funct7)              ((uint32_t)(funct7) << 25)
+#define FUNCT5(funct5)              ((uint32_t)(funct5) << 27)
+#define FUNCT12(funct12)            ((uint32_t)(funct12) << 20)
+
+// The instructions with the register-register opcode
+static const disasm_entry_t OP_ENTRIES[] = {
+    { MASK_FUNCT7_FUNCT3, FUNCT7(FUNCT7_INT) | FUNCT3(FUNCT3_ADD_SUB),
+        "add", FORMAT_R },
+    { MASK_FUNCT7_FUNCT3, FUNCT7(FUNCT7_ALT_INT) | FUNCT3(FUNCT3_ADD_SUB),
+        "sub", FORMAT_R },
+    { MASK_FUNCT7_FUNCT3, FUNCT7(FUNCT7_INT) | FUNCT3(FUNCT3_SLL),
+        "sll", FORMAT_R },
+    { MASK_FUNCT7_FUNCT3, FUNCT7(FUNCT7_INT) | FUNCT3(FUNCT3_SLT),
+        "slt", FORMAT_R },
+    { MASK_FUNCT7_FUNCT3, FUNCT7(FUNCT7_INT) | FUNCT3(FUNCT3_SLTU),
+        "sltu", FORMAT_R },
+    { MASK_FUNCT7_FUNCT3, FUNCT7(FUNCT7_INT) | FUNCT3(FUNCT3_XOR),
+        "xor", FORMAT_R },
+    { MASK_FUNCT7_FUNCT3, FUNCT7(FUNCT7_INT) | FUNCT3(FUNCT3_SRL_SRA),
+        "srl", FORMAT_R },
+    { MASK_FUNCT7_FUNCT3, FUNCT7(FUNCT7_ALT_INT) | FUNCT3(FUNCT3_SRL_SRA),
+        "sra", FORMAT_R },
+    { MASK_FUNCT7_FUNCT3, FUNCT7(FUNCT7_INT) | FUNCT3(FUNCT3_OR),
+        "or", FORMAT_R },
+    { MASK_FUNCT7_FUNCT3, FUNCT7(FUNCT7_INT) | FUNCT3(FUNCT3_AND),
+        "and", FORMAT_R },
+};
+
+// The instructions with the register-immediate opcode
+static const disasm_entry_t OP_IMM_ENTRIES[] = {
+    { MASK_FUNCT3, FUNCT3(FUNCT3_ADDI), "addi", FORMAT_I },
+    { MASK_FUNCT3, FUNCT3(FUNCT3_SLTI), "slti", FORMAT_I },
+    { MASK_FUNCT3, FUNCT3(FUNCT3_SLTIU), "sltiu", FORMAT_I },
+    { MASK_FUNCT3, FUNCT3(FUNCT3_XORI), "xori", FORMAT_I },
+    { MASK_FUNCT3, FUNCT3(FUNCT3_ORI), "ori", FORMAT_I },
+    { MASK_FUNCT3, FUNCT3(FUNCT3_ANDI), "andi", FORMAT_I },
+    { MASK_FUNCT7_FUNCT3, FUNCT7(FUNCT7_INT) | FUNCT3(FUNCT3_SLLI),
+        "slli", FORMAT_SHIFT },
+    { MASK_FUNCT7_FUNCT3, FUNCT7(FUNCT7_INT) | FUNCT3(FUNCT3_SRLI_SRAI),
+        "srli", FORMAT_SHIFT },
+    { MASK_FUNCT7_FUNCT3, FUNCT7(FUNCT7_ALT_INT) | FUNCT3(FUNCT3_SRLI_SRAI),
+        "srai", FORMAT_SHIFT },
+};
+
+// The instructions with the load opcode
+static const disasm_entry_t LOAD_ENTRIES[] = {
+    { MASK_FUNCT3, FUNCT3(FUNCT3_LB), "lb", FORMAT_LOAD },
+    { MASK_FUNCT3, FUNCT3(FUNCT3_LH), "lh", FORMAT_LOAD },
+    { MASK_FUNCT3, FUNCT3(FUNCT3_LW), "lw", FORMAT_LOAD },
+    { MASK_FUNCT3, FUNCT3(FUNCT3_LBU), "lbu", FORMAT_LOAD },
+    { MASK_FUNCT3, FUNCT3(FUNCT3_LHU), "lhu", FORMAT_LOAD },
+};
+
+// The instructions with the store opcode
+static const disasm_entry_t STORE_ENTRIES[] = {
+    { MASK_FUNCT3, FUNCT3(FUNCT3_SB), "sb", FORMAT_STORE },
+    { MASK_FUNCT3, FUNCT3(FUNCT3_SH), "sh", FORMAT_STORE },
+    { MASK_FUNCT3, FUNCT3(FUNCT3_SW), "sw", FORMAT_STORE },
+};
+
+// The instructions with the branch opcode
+static const disasm_entry_t BRANCH_ENTRIES[] = {
+    { MASK_FUNCT3, FUNCT3(FUNCT3_BEQ), "beq", FORMAT_BRANCH },
+    { MASK_FUNCT3, FUNCT3(FUNCT3_BNE), "bne", FORMAT_BRANCH },
+    { MASK_FUNCT3, FUNCT3(FUNCT3_BLT), "blt", FORMAT_BRANCH },
+    { MASK_FUNCT3, FUNCT3(FUNCT3_BGE), "bge", FORMAT_BRANCH },
+    { MASK_FUNCT3, FUNCT3(FUNCT3_BLTU), "bltu", FORMAT_BRANCH },
+    { MASK_FUNCT3, FUNCT3(FUNCT3_BGEU), "bgeu", FORMAT_BRANCH },
+};
+
+// The instructions with the upper immediate and jump opcodes
+static const disasm_entry_t LUI_ENTRIES[] = {
+    { MASK_NONE, 0, "lui", FORMAT_U },
+};
+static const disasm_entry_t AUIPC_ENTRIES[] = {
+    { MASK_NONE, 0, "auipc", FORMAT_U },
+};
+static const disasm_entry_t JAL_ENTRIES[] = {
+    { MASK_NONE, 0, "jal", FORMAT_JAL },
+};
+static const disasm_entry_t JALR_ENTRIES[] = {
+    { MASK_FUNCT3, FUNCT3(0), "jalr", FORMAT_JALR },
+};
+
+// The instructions with the system opcode
+static const disasm_entry_t SYSTEM_ENTRIES[] = {
+    { MASK_FUNCT12, FUNCT12(FUNCT12_ECALL), "ecall", FORMAT_NONE },
+    { MASK_FUNCT12, FUNCT12(FUNCT12_EBREAK), "ebreak", FORMAT_NONE },
+    { MASK_FUNCT12, FUNCT12(FUNCT12_WFI), "wfi", FORMAT_NONE },
+    { MASK_FUNCT12, FUNCT12(FUNCT12_MRET), "mret", FORMAT_NONE },
+    { MASK_FUNCT3, FUNCT3(FUNCT3_CSRRW), "csrrw", FORMAT_CSR },
+    { MASK_FUNCT3, FUNCT3(FUNCT3_CSRRS), "csrrs", FORMAT_CSR },
+    { MASK_FUNCT3, FUNCT3(FUNCT3_CSRRC), "csrrc", FORMAT_CSR },
+    { MASK_FUNCT3, FUNCT3(FUNCT3_CSRRWI), "csrrwi", FORMAT_CSRI },
+    { MASK_FUNCT3, FUNCT3(FUNCT3_CSRRSI), "csrrsi", FORMAT_CSRI },
+    { MASK_FUNCT3, FUNCT3(FUNCT3_CSRRCI), "csrrci", FORMAT_CSRI },
+};
+
+// The instructions with the atomic memory operation opcode
+static const disasm_entry_t AMO_ENTRIES[] = {
+    { MASK_FUNCT5_FUNCT3, FUNCT5(FUNCT5_LR) | FUNCT3(FUNCT3_AMO_W),
+        "lr.w", FORMAT_LR },
+    { MASK_FUNCT5_FUNCT3, FUNCT5(FUNCT5_SC) | FUNCT3(FUNCT3_AMO_W),
+        "sc.w", FORMAT_AMO },
+    { MASK_FUNCT5_FUNCT3, FUNCT5(FUNCT5_AMOSWAP) | FUNCT3(FUNCT3_AMO_W),
+        "amoswap.w", FORMAT_AMO },
+    { MASK_FUNCT5_FUNCT3, FUNCT5(FUNCT5_AMOADD) | FUNCT3(FUNCT3_AMO_W),
+        "amoadd.w", FORMAT_AMO },
+    { MASK_FUNCT5_FUNCT3, FUNCT5(FUNCT5_AMOXOR) | FUNCT3(FUNCT3_AMO_W),
+        "amoxor.w", FORMAT_AMO },
+    { MASK_FUNCT5_FUNCT3, FUNCT5(FUNCT5_AMOAND) | FUNCT3(FUNCT3_AMO_W),
+        "amoand.w", FORMAT_AMO },
+    { MASK_FUNCT5_FUNCT3, FUNCT5(FUNCT5_AMOOR) | FUNCT3(FUNCT3_AMO_W),
+        "amoor.w", FORMAT_AMO },
+    { MASK_FUNCT5_FUNCT3, FUNCT5(FUNCT5_AMOMIN) | FUNCT3(FUNCT3_AMO_W),
+        "amomin.w", FORMAT_AMO },
+    { MASK_FUNCT5_FUNCT3, FUNCT5(FUNCT5_AMOMAX) | FUNCT3(FUNCT3_AMO_W),
+        "amomax.w", FORMAT_AMO },
+    { MASK_FUNCT5_FUNCT3, FUNCT5(FUNCT5_AMOMINU) | FUNCT3(FUNCT3_AMO_W),
+        "amominu.w", FORMAT_AMO },
+    { MASK_FUNCT5_FUNCT3, FUNCT5(FUNCT5_AMOMAXU) | FUNCT3(FUNCT3_AMO_W),
+        "amomaxu.w", FORMAT_AMO },
+};
+
+// The table of instructions for each opcode, indexed by the opcode
+static const disasm_table_t OPCODE_TABLES[RISCV_NUM_OPCODES] = {
+#define OPCODE_TABLE(opcode, table) \
+    [opcode] = { .entries = table, .num_entries = array_len(table) },
+    OPCODE_TABLE(OP_OP, OP_ENTRIES)
+    OPCODE_TABLE(OP_IMM, OP_IMM_ENTRIES)
+    OPCODE_TABLE(OP_LOAD, LOAD_ENTRIES)
+    OPCODE_TABLE(OP_STORE, STORE_ENTRIES)
+    OPCODE_TABLE(OP_LUI, LUI_ENTRIES)
+    OPCODE_TABLE(OP_AUIPC, AUIPC_ENTRIES)
+    OPCODE_TABLE(OP_JAL, JAL_ENTRIES)
+    OPCODE_TABLE(OP_JALR, JALR_ENTRIES)
+    OPCODE_TABLE(OP_BRANCH, BRANCH_ENTRIES)
+    OPCODE_TABLE(OP_SYSTEM, SYSTEM_ENTRIES)
+    OPCODE_TABLE(OP_AMO, AMO_ENTRIES)
+#undef OPCODE_TABLE
+};
+
+// The ABI names of the registers, as the assembler writes them
+static const char *const REGISTER_NAMES[RISCV_NUM_REGS] = {
+    "zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2",
+    "s0", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+    "a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7",
+    "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6",
+};
+
+// The names of the CSRs, by their address
+static const struct {
+    riscv_csr_t csr;                // Address of the CSR
+    const char *name;               // Name of the CSR
+} CSR_NAMES[] = {
+    { CSR_MSTATUS, "mstatus" },     { CSR_MISA, "misa" },
+    { CSR_MIE, "mie" },             { CSR_MTVEC, "mtvec" },
+    { CSR_MSCRATCH, "mscratch" },   { CSR_MEPC, "mepc" },
+    { CSR_MCAUSE, "mcause" },       { CSR_MTVAL, "mtval" },
+    { CSR_MIP, "mip" },             { CSR_MTIMECMP, "mtimecmp" },
+    { CSR_MTIMECMPH, "mtimecmph" }, { CSR_MCYCLE, "mcycle" },
+    { CSR_MINSTRET, "minstret" },   { CSR_MCYCLEH, "mcycleh" },
+    { CSR_MINSTRETH, "minstreth" }, { CSR_CYCLE, "cycle" },
+    { CSR_TIME, "time" },           { CSR_INSTRET, "instret" },
+    { CSR_CYCLEH, "cycleh" },       { CSR_TIMEH, "timeh" },
+    { CSR_INSTRETH, "instreth" },   { CSR_MHARTID, "mhartid" },
+};
+
+// The buffer that each thread's instructions are formatted into
+static __thread char DISASM_BUFFER[DISASM_MAX_LEN];
+
+/*----------------------------------------------------------------------------
+ * Helper Functions
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Sign extends the lowest bits of the value, up to and including the given
+ * sign bit.
+ **/
+static int32_t sign_extend(uint32_t value, int sign_bit)
+{
+    int shift = 31 - sign_bit;
+    return (int32_t)(value << shift) >> shift;
+}
+
+/**
+ * Finds the entry for the instruction in its opcode's table, or NULL if the
+ * instruction isn't recognized.
+ **/
+static const disasm_entry_t *find_entry(uint32_t instr)
+{
+    const disasm_table_t *table = &OPCODE_TABLES[instr &
+            (RISCV_NUM_OPCODES - 1)];
+    for (int i = 0; i < table->num_entries; i++)
+    {
+        const disasm_entry_t *entry = &table->entries[i];
+        if ((instr & entry->mask) == entry->match) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Writes the name of the CSR into the buffer, or its address if it has no
+ * name. Returns the name.
+ **/
+static const char *csr_name(uint32_t csr, char *buffer, size_t size)
+{
+    for (int i = 0; i < (int)array_len(CSR_NAMES); i++)
+    {
+        if (CSR_NAMES[i].csr == csr) {
+            return CSR_NAMES[i].name;
+        }
+    }
+    snprintf(buffer, size, "0x%03x", csr);
+    return buffer;
+}
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Disassembles the instruction at the given PC, which is used for the targets
+ * of branches and jumps. Instructions that aren't recognized are shown as a
+ * '.word' directive.
+ *
+ * The returned string is in a buffer belonging to the calling thread, which is
+ * overwritten by its next call.
+ **/
+const char *disasm_instruction(uint32_t pc, uint32_t instr)
+{
+    char *buffer = DISASM_BUFFER;
+    size_t size = sizeof(DISASM_BUFFER);
+    const disasm_entry_t *entry = find_entry(instr);
+    if (entry == NULL) {
+        snprintf(buffer, size, "%-9s 0x%08x", ".word", instr);
+        return buffer;
+    }
+
+    // Decode the fields used by the operand formats
+    const char *rd = REGISTER_NAMES[(instr >> 7) & 0x1F];
+    const char *rs1 = REGISTER_NAMES[(instr >> 15) & 0x1F];
+    const char *rs2 = REGISTER_NAMES[(instr >> 20) & 0x1F];
+    int32_t itype_imm = (int32_t)instr >> 20;
+    int32_t stype_imm = sign_extend((instr >> 25) << 5 | ((instr >> 7) & 0x1F),
+            11);
+    int32_t branch_offset = sign_extend((instr >> 31) << 12 |
+            ((instr >> 7) & 0x1) << 11 | ((instr >> 25) & 0x3F) << 5 |
+            ((instr >> 8) & 0xF) << 1, 12);
+    int32_t jal_offset = sign_extend((instr >> 31) << 20 | (instr & 0xFF000) |
+            ((instr >> 20) & 0x1) << 11 | ((instr >> 21) & 0x3FF) << 1, 20);
+    char csr_buffer[sizeof("0x000")];
+    const char *csr = csr_name(instr >> 20, csr_buffer, sizeof(csr_buffer));
+
+    const char *name = entry->name;
+    switch (entry->format)
+    {
+        case FORMAT_NONE:
+            snprintf(buffer, size, "%s", name);
+            break;
+
+        case FORMAT_R:
+            snprintf(buffer, size, "%-9s %s, %s, %s", name, rd, rs1, rs2);
+            break;
+
+        case FORMAT_I:
+            snprintf(buffer, size, "%-9s %s, %s, %d", name, rd, rs1,
+                    itype_imm);
+            break;
+
+        case FORMAT_SHIFT:
+            snprintf(buffer, size, "%-9s %s, %s, %u", name, rd, rs1,
+                    (instr >> 20) & 0x1F);
+            break;
+
+        case FORMAT_LOAD:
+        case FORMAT_JALR:
+            snprintf(buffer, size, "%-9s %s, %d(%s)", name, rd, itype_imm,
+                    rs1);
+            break;
+
+        case FORMAT_STORE:
+            snprintf(buffer, size, "%-9s %s, %d(%s)", name, rs2, stype_imm,
+                    rs1);
+            break;
+
+        case FORMAT_BRANCH:
+            snprintf(buffer, size, "%-9s %s, %s, 0x%08x", name, rs1, rs2,
+                    pc + branch_offset);
+            break;
+
+        case FORMAT_U:
+            snprintf(buffer, size, "%-9s %s, 0x%05x", name, rd, instr >> 12);
+            break;
+
+        case FORMAT_JAL:
+            snprintf(buffer, size, "%-9s %s, 0x%08x", name, rd,
+                    pc + jal_offset);
+            break;
+
+        case FORMAT_CSR:
+            snprintf(buffer, size, "%-9s %s, %s, %s", name, rd, csr, rs1);
+            break;
+
+        case FORMAT_CSRI:
+            snprintf(buffer, size, "%-9s %s, %s, %u", name, rd, csr,
+                    (instr >> 15) & 0x1F);
+            break;
+
+        case FORMAT_AMO:
+            snprintf(buffer, size, "%-9s %s, %s, (%s)", name, rd, rs2, rs1);
+            break;
+
+        case FORMAT_LR:
+            snprintf(buffer, size, "%-9s %s, (%s)", name, rd, rs1);
+            break;
+    }
+
+    return buffer;
+}
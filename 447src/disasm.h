@@ -0,0 +1,53 @@
+/**
+ * disasm.h
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the interface to the disassembler, which formats RV32I
+ * instructions, along with the A and Zicsr extensions, as assembly.
+ *
+ * The disassembler is driven by a table of the instructions for each opcode,
+ * built from the enumerations in riscv_isa.h. It never allocates memory, and
+ * formats each instruction into a buffer that is reused by every call on the
+ * same thread, so it is cheap enough to annotate every line of a long trace.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+#ifndef DISASM_H_
+#define DISASM_H_
+
+// Standard Includes
+#include <stdint.h>             // Fixed-size integral types
+
+/*----------------------------------------------------------------------------
+ * Definitions
+ *----------------------------------------------------------------------------*/
+
+// The maximum length of a disassembled instruction, including the terminator
+#define DISASM_MAX_LEN          64
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Disassembles the instruction at the given PC, which is used for the targets
+ * of branches and jumps. Instructions that aren't recognized are shown as a
+ * '.word' directive.
+ *
+ * The returned string is in a buffer belonging to the calling thread, which is
+ * overwritten by its next call.
+ **/
+const char *disasm_instruction(uint32_t pc, uint32_t instr);
+
+#endif /* DISASM_H_ */
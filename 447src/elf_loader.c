@@ -0,0 +1,584 @@
+/**
+ * elf_loader.c
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the ELF loader, which loads a program directly from the
+ * executable produced by the RISC-V toolchain.
+ *
+ * The executable is mapped read-only while it is being loaded. Every PT_LOAD
+ * segment is placed into the memory segment whose region contains it, and each
+ * memory segment is backed by an anonymous mapping that covers all of the
+ * PT_LOAD segments placed in it. Whole pages of file contents are mapped
+ * privately over the anonymous mapping, and only the partial pages are copied.
+ * The part of a segment beyond its file contents, the .bss, is never touched,
+ * so the host zeroes its pages on demand.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+// Standard Includes
+#include <stdlib.h>                 // Malloc, free, and qsort functions
+#include <stdio.h>                  // Printf and related functions
+#include <stdbool.h>                // Definition of the boolean type
+#include <stdint.h>                 // Fixed-size integral types
+
+// Standard Includes
+#include <errno.h>                  // Error codes
+#include <string.h>                 // String manipulation functions
+#include <endian.h>                 // Little-endian to host conversions
+#include <elf.h>                    // Definitions of the ELF file format
+#include <fcntl.h>                  // Open function and flags
+#include <unistd.h>                 // Close and sysconf functions
+#include <sys/mman.h>               // Mmap and munmap functions
+#include <sys/stat.h>               // Fstat function
+
+// 18-447 Simulator Includes
+#include <sim.h>                    // Definition of cpu_state_t
+#include <memory.h>                 // Definition of mem_segment_t
+
+// Local Includes
+#include "libc_extensions.h"        // Max function
+#include "memory_shell.h"           // Finding the segment of an address
+#include "elf_loader.h"             // This file's interface
+
+/*----------------------------------------------------------------------------
+ * Internal Definitions
+ *----------------------------------------------------------------------------*/
+
+// An ELF executable that is mapped into memory while it is loaded
+typedef struct elf_image {
+    const char *path;           // Path to the executable
+    int fd;                     // Open file descriptor for the executable
+    const uint8_t *data;        // Contents of the executable
+    size_t size;                // Size of the executable in bytes
+} elf_image_t;
+
+/*----------------------------------------------------------------------------
+ * Header Parsing
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Copies size bytes at the offset in the executable to the destination. Returns
+ * false if the bytes are not all inside the file.
+ **/
+static bool image_read(const elf_image_t *image, uint64_t offset, void *dest,
+        size_t size)
+{
+    if (offset > image->size || size > image->size - offset) {
+        return false;
+    }
+
+    memcpy(dest, &image->data[offset], size);
+    return true;
+}
+
+/**
+ * Reads and validates the ELF header of the executable, which must be a 32-bit,
+ * little-endian, RISC-V executable. The header's fields are converted to the
+ * host's byte order.
+ **/
+static int read_elf_header(const elf_image_t *image, Elf32_Ehdr *header)
+{
+    if (!image_read(image, 0, header, sizeof(*header)) ||
+            memcmp(header->e_ident, ELFMAG, SELFMAG) != 0) {
+        fprintf(stderr, "Error: %s: File is not an ELF file.\n", image->path);
+        return -ENOEXEC;
+    } else if (header->e_ident[EI_CLASS] != ELFCLASS32 ||
+            header->e_ident[EI_DATA] != ELFDATA2LSB) {
+        fprintf(stderr, "Error: %s: ELF file is not a 32-bit little-endian "
+                "file.\n", image->path);
+        return -ENOEXEC;
+    }
+
+    header->e_type = le16toh(header->e_type);
+    header->e_machine = le16toh(header->e_machine);
+    header->e_entry = le32toh(header->e_entry);
+    header->e_phoff = le32toh(header->e_phoff);
+    header->e_shoff = le32toh(header->e_shoff);
+    header->e_phentsize = le16toh(header->e_phentsize);
+    header->e_phnum = le16toh(header->e_phnum);
+    header->e_shentsize = le16toh(header->e_shentsize);
+    header->e_shnum = le16toh(header->e_shnum);
+
+    if (header->e_type != ET_EXEC || header->e_machine != EM_RISCV) {
+        fprintf(stderr, "Error: %s: ELF file is not a RISC-V executable.\n",
+                image->path);
+        return -ENOEXEC;
+    } else if ((header->e_phnum > 0 &&
+                header->e_phentsize != sizeof(Elf32_Phdr)) ||
+            (header->e_shnum > 0 &&
+                header->e_shentsize != sizeof(Elf32_Shdr))) {
+        fprintf(stderr, "Error: %s: ELF file has malformed headers.\n",
+                image->path);
+        return -ENOEXEC;
+    }
+
+    return 0;
+}
+
+/**
+ * Reads the program header at the given index, converting its fields to the
+ * host's byte order. Returns false if the header is not inside the file.
+ **/
+static bool read_program_header(const elf_image_t *image,
+        const Elf32_Ehdr *header, int index, Elf32_Phdr *program_header)
+{
+    uint64_t offset = header->e_phoff + (uint64_t)index * sizeof(Elf32_Phdr);
+    if (!image_read(image, offset, program_header, sizeof(*program_header))) {
+        return false;
+    }
+
+    program_header->p_type = le32toh(program_header->p_type);
+    program_header->p_offset = le32toh(program_header->p_offset);
+    program_header->p_vaddr = le32toh(program_header->p_vaddr);
+    program_header->p_filesz = le32toh(program_header->p_filesz);
+    program_header->p_memsz = le32toh(program_header->p_memsz);
+    return true;
+}
+
+/**
+ * Reads the section header at the given index, converting its fields to the
+ * host's byte order. Returns false if the header is not inside the file.
+ **/
+static bool read_section_header(const elf_image_t *image,
+        const Elf32_Ehdr *header, int index, Elf32_Shdr *section_header)
+{
+    uint64_t offset = header->e_shoff + (uint64_t)index * sizeof(Elf32_Shdr);
+    if (index >= header->e_shnum || !image_read(image, offset, section_header,
+                sizeof(*section_header))) {
+        return false;
+    }
+
+    section_header->sh_type = le32toh(section_header->sh_type);
+    section_header->sh_offset = le32toh(section_header->sh_offset);
+    section_header->sh_size = le32toh(section_header->sh_size);
+    section_header->sh_link = le32toh(section_header->sh_link);
+    return true;
+}
+
+/*----------------------------------------------------------------------------
+ * Segment Loading
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Finds the index of the memory segment whose region holds the given range of
+ * addresses. Only the segments that hold program data are considered. Returns
+ * -1 if there is no such segment.
+ **/
+static int find_region(const memory_t *memory, uint32_t addr, uint32_t size)
+{
+    for (int i = 0; i < memory->num_segments; i++)
+    {
+        const mem_segment_t *segment = &memory->segments[i];
+        if (segment->extension != NULL && addr >= segment->base_addr &&
+                (uint64_t)(addr - segment->base_addr) + size <=
+                segment->max_size) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Places size bytes at the offset in the executable into the segment, at the
+ * given offset from its base.
+ *
+ * When the contents start on a page boundary both in the file and in the
+ * segment, the whole pages of them are mapped directly from the file. The
+ * mapping is private, so stores by the program never reach the file. The
+ * remainder is copied into the segment.
+ **/
+static int place_contents(mem_segment_t *segment, const elf_image_t *image,
+        uint32_t file_offset, uint32_t mem_offset, uint32_t size,
+        size_t page_size)
+{
+    uint32_t mapped_size = 0;
+    if (file_offset % page_size == 0 && mem_offset % page_size == 0) {
+        mapped_size = size - size % page_size;
+    }
+
+    if (mapped_size > 0) {
+        void *mem = mmap(&segment->mem[mem_offset], mapped_size,
+                PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, image->fd,
+                file_offset);
+        if (mem == MAP_FAILED) {
+            int rc = -errno;
+            fprintf(stderr, "Error: %s: Unable to map the %s segment: %s.\n",
+                    image->path, segment->name, strerror(errno));
+            return rc;
+        }
+    }
+
+    memcpy(&segment->mem[mem_offset + mapped_size],
+            &image->data[file_offset + mapped_size], size - mapped_size);
+    return 0;
+}
+
+/**
+ * Loads the PT_LOAD segments of the executable into the memory segments.
+ *
+ * Each memory segment that receives a PT_LOAD segment is sized to cover all of
+ * the PT_LOAD segments placed in it, and is backed by an anonymous mapping. The
+ * other memory segments with data files are left empty.
+ **/
+static int load_segments(cpu_state_t *cpu_state, const elf_image_t *image,
+        const Elf32_Ehdr *header)
+{
+    // Check that every PT_LOAD segment fits, and find how far each region goes
+    memory_t *memory = &cpu_state->memory;
+    uint32_t region_ends[memory->num_segments];
+    memset(region_ends, 0, sizeof(region_ends));
+    for (int i = 0; i < header->e_phnum; i++)
+    {
+        Elf32_Phdr program_header;
+        if (!read_program_header(image, header, i, &program_header) ||
+                (program_header.p_type == PT_LOAD &&
+                 (program_header.p_filesz > program_header.p_memsz ||
+                  (uint64_t)program_header.p_offset + program_header.p_filesz >
+                  image->size))) {
+            fprintf(stderr, "Error: %s: ELF file has malformed program "
+                    "headers.\n", image->path);
+            return -ENOEXEC;
+        } else if (program_header.p_type != PT_LOAD ||
+                program_header.p_memsz == 0) {
+            continue;
+        }
+
+        int region = find_region(memory, program_header.p_vaddr,
+                program_header.p_memsz);
+        if (region < 0) {
+            fprintf(stderr, "Error: %s: Loadable segment at 0x%08x does not "
+                    "fit in any memory segment.\n", image->path,
+                    program_header.p_vaddr);
+            return -EFBIG;
+        }
+
+        uint32_t end = program_header.p_vaddr + program_header.p_memsz -
+                memory->segments[region].base_addr;
+        region_ends[region] = max(region_ends[region], end);
+    }
+
+    /* Back each region with anonymous memory, rounded up to whole words and
+     * pages. The host zeroes its pages when they are first touched. */
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    for (int i = 0; i < memory->num_segments; i++)
+    {
+        if (region_ends[i] == 0) {
+            continue;
+        }
+
+        mem_segment_t *segment = &memory->segments[i];
+        uint32_t size = (region_ends[i] + sizeof(uint32_t) - 1) &
+                ~(sizeof(uint32_t) - 1);
+        size_t mapped_size = (size + page_size - 1) & ~(page_size - 1);
+        void *mem = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (mem == MAP_FAILED) {
+            int rc = -errno;
+            fprintf(stderr, "Error: %s: Unable to map memory for the %s "
+                    "segment: %s.\n", image->path, segment->name,
+                    strerror(errno));
+            return rc;
+        }
+
+        segment->mem = mem;
+        segment->size = size;
+        segment->mapped_size = mapped_size;
+    }
+
+    // Place the file contents of each PT_LOAD segment into its region
+    for (int i = 0; i < header->e_phnum; i++)
+    {
+        Elf32_Phdr program_header;
+        read_program_header(image, header, i, &program_header);
+        if (program_header.p_type != PT_LOAD || program_header.p_filesz == 0) {
+            continue;
+        }
+
+        int region = find_region(memory, program_header.p_vaddr,
+                program_header.p_memsz);
+        mem_segment_t *segment = &memory->segments[region];
+        int rc = place_contents(segment, image, program_header.p_offset,
+                program_header.p_vaddr - segment->base_addr,
+                program_header.p_filesz, page_size);
+        if (rc < 0) {
+            return rc;
+        }
+    }
+
+    return 0;
+}
+
+/*----------------------------------------------------------------------------
+ * Symbol Table
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Orders symbols by address, and then by name.
+ **/
+static int compare_symbols(const void *symbol1, const void *symbol2)
+{
+    const symbol_t *sym1 = symbol1;
+    const symbol_t *sym2 = symbol2;
+    if (sym1->addr != sym2->addr) {
+        return (sym1->addr < sym2->addr) ? -1 : 1;
+    }
+    return strcmp(sym1->name, sym2->name);
+}
+
+/**
+ * Indicates if the symbol is worth keeping. Only named functions, objects, and
+ * labels that are defined in the program are kept, and not the assembler's
+ * local labels.
+ **/
+static bool keep_symbol(const Elf32_Sym *symbol, const char *name)
+{
+    int type = ELF32_ST_TYPE(symbol->st_info);
+    uint16_t section = le16toh(symbol->st_shndx);
+    return (type == STT_NOTYPE || type == STT_FUNC || type == STT_OBJECT) &&
+            section != SHN_UNDEF && section < SHN_LORESERVE &&
+            name[0] != '\0' && name[0] != '$' && strncmp(name, ".L", 2) != 0;
+}
+
+/**
+ * Builds the symbol table from the executable's SHT_SYMTAB section, keeping the
+ * symbols that lie inside a loaded memory segment. Executables without a symbol
+ * table are loaded without one.
+ **/
+static int load_symbols(cpu_state_t *cpu_state, const elf_image_t *image,
+        const Elf32_Ehdr *header)
+{
+    // Find the symbol table section, and the string table holding its names
+    Elf32_Shdr symtab_header, strtab_header;
+    int i;
+    for (i = 0; i < header->e_shnum; i++)
+    {
+        if (read_section_header(image, header, i, &symtab_header) &&
+                symtab_header.sh_type == SHT_SYMTAB) {
+            break;
+        }
+    }
+    if (i == header->e_shnum) {
+        return 0;
+    } else if (!read_section_header(image, header, symtab_header.sh_link,
+                &strtab_header) || strtab_header.sh_type != SHT_STRTAB ||
+            (uint64_t)symtab_header.sh_offset + symtab_header.sh_size >
+            image->size || (uint64_t)strtab_header.sh_offset +
+            strtab_header.sh_size > image->size) {
+        fprintf(stderr, "Error: %s: ELF file has a malformed symbol table.\n",
+                image->path);
+        return -ENOEXEC;
+    }
+
+    // Copy the names, making sure that the last one is terminated
+    int max_symbols = symtab_header.sh_size / sizeof(Elf32_Sym);
+    symbol_table_t *symbols = malloc(sizeof(*symbols));
+    char *names = malloc(strtab_header.sh_size + 1);
+    symbol_t *entries = malloc(max(max_symbols, 1) * sizeof(entries[0]));
+    if (symbols == NULL || names == NULL || entries == NULL) {
+        fprintf(stderr, "Error: %s: Unable to allocate the symbol table.\n",
+                image->path);
+        free(symbols);
+        free(names);
+        free(entries);
+        return -ENOMEM;
+    }
+    memcpy(names, &image->data[strtab_header.sh_offset], strtab_header.sh_size);
+    names[strtab_header.sh_size] = '\0';
+
+    // Keep the symbols that can be found in memory
+    int num_symbols = 0;
+    for (int i = 0; i < max_symbols; i++)
+    {
+        Elf32_Sym symbol;
+        image_read(image, symtab_header.sh_offset + i * sizeof(symbol),
+                &symbol, sizeof(symbol));
+        uint32_t name_offset = le32toh(symbol.st_name);
+        uint32_t addr = le32toh(symbol.st_value);
+        if (name_offset >= strtab_header.sh_size ||
+                !keep_symbol(&symbol, &names[name_offset])) {
+            continue;
+        }
+
+        const mem_segment_t *segment = mem_find_segment(cpu_state, addr);
+        if (segment == NULL) {
+            continue;
+        }
+
+        entries[num_symbols] = (symbol_t){
+            .addr = addr,
+            .size = le32toh(symbol.st_size),
+            .segment = segment - cpu_state->memory.segments,
+            .name = &names[name_offset],
+        };
+        num_symbols += 1;
+    }
+    qsort(entries, num_symbols, sizeof(entries[0]), compare_symbols);
+
+    symbols->num_symbols = num_symbols;
+    symbols->symbols = entries;
+    symbols->names = names;
+    cpu_state->memory.symbols = symbols;
+    return 0;
+}
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Loads the program's memory segments from the given ELF executable, and sets
+ * the entry point to the executable's entry address.
+ *
+ * Segments without a data file (the stack) are not touched. On success, the
+ * program's symbol table is stored in the CPU's memory. Returns 0 on success,
+ * or a negative error code on failure, in which case some segments may have
+ * already been loaded.
+ **/
+int elf_load_program(cpu_state_t *cpu_state, const char *elf_path,
+        uint32_t *entry)
+{
+    // Open the executable, and map it into memory while it is loaded
+    int fd = open(elf_path, O_RDONLY);
+    if (fd < 0) {
+        int rc = -errno;
+        fprintf(stderr, "Error: %s: Unable to open file: %s.\n", elf_path,
+                strerror(errno));
+        return rc;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) < 0) {
+        int rc = -errno;
+        fprintf(stderr, "Error: %s: Unable to stat file: %s.\n", elf_path,
+                strerror(errno));
+        close(fd);
+        return rc;
+    } else if ((size_t)file_stat.st_size < sizeof(Elf32_Ehdr)) {
+        fprintf(stderr, "Error: %s: File is not an ELF file.\n", elf_path);
+        close(fd);
+        return -ENOEXEC;
+    }
+
+    void *data = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        int rc = -errno;
+        fprintf(stderr, "Error: %s: Unable to map file: %s.\n", elf_path,
+                strerror(errno));
+        close(fd);
+        return rc;
+    }
+
+    // Load the segments, and then the symbols, which refer to the segments
+    elf_image_t image = {
+        .path = elf_path,
+        .fd = fd,
+        .data = data,
+        .size = file_stat.st_size,
+    };
+    Elf32_Ehdr header;
+    int rc = read_elf_header(&image, &header);
+    if (rc == 0) {
+        rc = load_segments(cpu_state, &image, &header);
+    }
+    if (rc == 0) {
+        rc = load_symbols(cpu_state, &image, &header);
+    }
+    if (rc == 0) {
+        *entry = header.e_entry;
+    }
+
+    // The segments' mappings of the file outlive the descriptor and image
+    munmap(data, file_stat.st_size);
+    close(fd);
+    return rc;
+}
+
+/**
+ * Frees the symbol table created by elf_load_program.
+ **/
+void elf_free_symbols(symbol_table_t *symbols)
+{
+    if (symbols == NULL) {
+        return;
+    }
+
+    free(symbols->symbols);
+    free(symbols->names);
+    free(symbols);
+    return;
+}
+
+/**
+ * Finds the symbol that contains the given address, which is the closest symbol
+ * at or before it in the same memory segment. Returns NULL if there is none.
+ **/
+const symbol_t *elf_find_symbol(const cpu_state_t *cpu_state, uint32_t addr)
+{
+    const symbol_table_t *symbols = cpu_state->memory.symbols;
+    const mem_segment_t *segment = mem_find_segment(cpu_state, addr);
+    if (symbols == NULL || segment == NULL) {
+        return NULL;
+    }
+
+    // Binary search for the first symbol after the address
+    int low = 0;
+    int high = symbols->num_symbols;
+    while (low < high)
+    {
+        int mid = low + (high - low) / 2;
+        if (symbols->symbols[mid].addr <= addr) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low == 0) {
+        return NULL;
+    }
+
+    // Prefer the first of the symbols that share the closest address
+    const symbol_t *symbol = &symbols->symbols[low - 1];
+    while (symbol > symbols->symbols && symbol[-1].addr == symbol->addr)
+    {
+        symbol -= 1;
+    }
+
+    // Sized symbols only contain the addresses up to their end
+    if (symbol->segment != segment - cpu_state->memory.segments ||
+            (symbol->size != 0 && addr - symbol->addr >= symbol->size)) {
+        return NULL;
+    }
+    return symbol;
+}
+
+/**
+ * Finds the symbol with the given name. Returns NULL if there is none.
+ **/
+const symbol_t *elf_lookup_symbol(const cpu_state_t *cpu_state,
+        const char *name)
+{
+    const symbol_table_t *symbols = cpu_state->memory.symbols;
+    if (symbols == NULL) {
+        return NULL;
+    }
+
+    for (int i = 0; i < symbols->num_symbols; i++)
+    {
+        if (strcmp(symbols->symbols[i].name, name) == 0) {
+            return &symbols->symbols[i];
+        }
+    }
+    return NULL;
+}
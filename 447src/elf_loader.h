@@ -0,0 +1,91 @@
+/**
+ * elf_loader.h
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the interface to the ELF loader, which loads a program
+ * directly from the executable produced by the RISC-V toolchain.
+ *
+ * Each loadable (PT_LOAD) segment of the executable is placed into the memory
+ * segment whose region contains it. The file's contents are mapped into the
+ * segment with mmap where the layout allows it, and the rest of the segment is
+ * backed by anonymous memory, so the .bss section is zeroed lazily by the host.
+ * The program's symbol table is kept for the profilers and the debugger.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+#ifndef ELF_LOADER_H_
+#define ELF_LOADER_H_
+
+// Standard Includes
+#include <stdint.h>             // Fixed-size integral types
+
+// 18-447 Simulator Includes
+#include <sim.h>                // Definition of cpu_state_t
+
+/*----------------------------------------------------------------------------
+ * Definitions
+ *----------------------------------------------------------------------------*/
+
+// The file extension of the program's ELF executable
+#define ELF_EXTENSION           ".elf"
+
+// A function or object symbol in the program
+typedef struct symbol {
+    uint32_t addr;              // Address of the symbol
+    uint32_t size;              // Size of the symbol, or 0 if it is unknown
+    int segment;                // Index of the memory segment it lies in
+    const char *name;           // Name of the symbol
+} symbol_t;
+
+// The symbol table of a program, sorted by address
+typedef struct symbol_table {
+    int num_symbols;            // Number of symbols in the table
+    symbol_t *symbols;          // The symbols, in order of address
+    char *names;                // Buffer holding the names of the symbols
+} symbol_table_t;
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Loads the program's memory segments from the given ELF executable, and sets
+ * the entry point to the executable's entry address.
+ *
+ * Segments without a data file (the stack) are not touched. On success, the
+ * program's symbol table is stored in the CPU's memory. Returns 0 on success,
+ * or a negative error code on failure, in which case some segments may have
+ * already been loaded.
+ **/
+int elf_load_program(cpu_state_t *cpu_state, const char *elf_path,
+        uint32_t *entry);
+
+/**
+ * Frees the symbol table created by elf_load_program.
+ **/
+void elf_free_symbols(symbol_table_t *symbols);
+
+/**
+ * Finds the symbol that contains the given address, which is the closest symbol
+ * at or before it in the same memory segment. Returns NULL if there is none.
+ **/
+const symbol_t *elf_find_symbol(const cpu_state_t *cpu_state, uint32_t addr);
+
+/**
+ * Finds the symbol with the given name. Returns NULL if there is none.
+ **/
+const symbol_t *elf_lookup_symbol(const cpu_state_t *cpu_state,
+        const char *name);
+
+#endif /* ELF_LOADER_H_ */
@@ -0,0 +1,416 @@
+/**
+ * engine.c
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the simulator's execution engine, which is the run loop
+ * that invokes the core simulator for each cycle.
+ *
+ * Rather than checking every device on every cycle, the engine asks the
+ * scheduler for the cycle of the next pending event once, and runs a batch of
+ * instructions up to that cycle. The only per-instruction work besides the
+ * instruction itself is the comparison against the end of the batch, which the
+ * scheduler lowers if an instruction posts an earlier event.
+ *
+ * The debugging features (verbose mode, profiling, breakpoints, plugins,
+ * recording for reverse execution, and block counts) each need hooks in the
+ * run loop. Instead of checking for them on every instruction, the run loop is
+ * written once, and a specialized variant of it is generated for each
+ * combination of features. The variant is chosen once per call, based on the
+ * features that are enabled, so the variant without any features has no
+ * debugging code in it at all.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+// Standard Includes
+#include <stdint.h>                 // Fixed-size integral types
+#include <stdbool.h>                // Definition of the boolean type
+#include <stdio.h>                  // Printf function
+#include <string.h>                 // Memcpy function
+
+// 18-447 Simulator Includes
+#include <sim.h>                    // Interface to the core simulator
+#include <scheduler.h>              // Interface to the event scheduler
+#include <trap.h>                   // Trap entry and interrupt checks
+
+// Local Includes
+#include "libc_extensions.h"        // Min function
+#include "memory_shell.h"           // Reading instructions for the profile
+#include "plugins.h"                // Events for the instrumentation plugins
+#include "reverse.h"                // Undo records for reverse execution
+#include "hotblocks.h"              // Counts of the basic blocks
+#include "stats.h"                  // Counts of the halts
+#include "disasm.h"                 // Disassembly of instructions
+#include "riscv_register_names.h"   // Names of the registers for verbose mode
+#include "commands.h"               // Register dump command for verbose mode
+#include "engine.h"                 // This file's interface
+
+/*----------------------------------------------------------------------------
+ * Internal Definitions
+ *----------------------------------------------------------------------------*/
+
+// The debugging features of the run loop, as bits in a feature set
+typedef enum engine_feature {
+    ENGINE_VERBOSE          = 1 << 0,   // Show each instruction and registers
+    ENGINE_PROFILE          = 1 << 1,   // Count the instructions by opcode
+    ENGINE_BREAKPOINTS      = 1 << 2,   // Stop before breakpoint addresses
+    ENGINE_PLUGINS          = 1 << 3,   // Deliver events to the plugins
+    ENGINE_UNDO             = 1 << 4,   // Log undo records for reverse steps
+    ENGINE_BLOCKS           = 1 << 5,   // Count the basic blocks entered
+} engine_feature_t;
+
+// The number of different feature sets, and so variants of the run loop
+#define ENGINE_NUM_VARIANTS     (1 << 6)
+
+/* The list of run loop variants, one for each feature set. Each entry is
+ * X(features), where features is the feature set of the variant. */
+#define ENGINE_VARIANT_LIST(X) \
+    X(0)  X(1)  X(2)  X(3)  X(4)  X(5)  X(6)  X(7) \
+    X(8)  X(9)  X(10) X(11) X(12) X(13) X(14) X(15) \
+    X(16) X(17) X(18) X(19) X(20) X(21) X(22) X(23) \
+    X(24) X(25) X(26) X(27) X(28) X(29) X(30) X(31) \
+    X(32) X(33) X(34) X(35) X(36) X(37) X(38) X(39) \
+    X(40) X(41) X(42) X(43) X(44) X(45) X(46) X(47) \
+    X(48) X(49) X(50) X(51) X(52) X(53) X(54) X(55) \
+    X(56) X(57) X(58) X(59) X(60) X(61) X(62) X(63)
+
+// The signature of a variant of the run loop
+typedef uint64_t (*engine_variant_t)(cpu_state_t *cpu_state,
+        uint64_t max_cycles);
+
+/* The state of a hart before a cycle in verbose mode, which is compared
+ * against its state after the cycle to find what the cycle changed. */
+typedef struct verbose_shadow {
+    uint32_t pc;                    // PC of the instruction run in the cycle
+    uint32_t instr;                 // The instruction, if it could be read
+    bool fetched;                   // The instruction could be read
+    uint32_t registers[RISCV_NUM_REGS]; // Registers before the cycle
+    int num_words;                  // Memory words the instruction can write
+    uint32_t addrs[2];              // Addresses of the memory words
+    uint32_t words[2];              // Memory words before the cycle
+} verbose_shadow_t;
+
+/*----------------------------------------------------------------------------
+ * Debugging Hooks
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Gets the set of debugging features that are enabled for the processor.
+ **/
+static unsigned int engine_features(const cpu_state_t *cpu_state)
+{
+    unsigned int features = 0;
+    if (cpu_state->verbose_mode) {
+        features |= ENGINE_VERBOSE;
+    }
+    if (cpu_state->debug.profile_mode) {
+        features |= ENGINE_PROFILE;
+    }
+    if (cpu_state->debug.num_breakpoints > 0) {
+        features |= ENGINE_BREAKPOINTS;
+    }
+    if (plugins_active()) {
+        features |= ENGINE_PLUGINS;
+    }
+    if (cpu_state->debug.undo != NULL) {
+        features |= ENGINE_UNDO;
+    }
+    if (HOTBLOCKS_ACTIVE && cpu_state->debug.hotblocks != NULL) {
+        features |= ENGINE_BLOCKS;
+    }
+    return features;
+}
+
+/**
+ * Checks if the processor should stop before running the instruction at the
+ * PC, because there is a breakpoint there.
+ *
+ * The breakpoint that execution last stopped at is skipped once, so that
+ * execution can resume from it.
+ **/
+static bool at_breakpoint(cpu_state_t *cpu_state)
+{
+    debug_state_t *debug = &cpu_state->debug;
+    if (debug->breakpoint_hit) {
+        debug->breakpoint_hit = false;
+        return false;
+    }
+
+    for (int i = 0; i < debug->num_breakpoints; i++)
+    {
+        if (debug->breakpoints[i] == cpu_state->pc) {
+            debug->breakpoint_hit = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Counts the instruction at the PC in the processor's profile, by its opcode.
+ **/
+static void profile_instruction(cpu_state_t *cpu_state)
+{
+    uint32_t instr;
+    if (mem_peek32(cpu_state, cpu_state->pc, &instr)) {
+        cpu_state->debug.opcode_counts[instr & (RISCV_NUM_OPCODES - 1)] += 1;
+    }
+    return;
+}
+
+/**
+ * Saves the instruction at the PC, and the registers and memory words that it
+ * can change, before it is run in verbose mode.
+ **/
+static void verbose_save(const cpu_state_t *cpu_state,
+        verbose_shadow_t *shadow)
+{
+    shadow->pc = cpu_state->pc;
+    shadow->fetched = mem_peek32(cpu_state, shadow->pc, &shadow->instr);
+    shadow->num_words = 0;
+    if (!cpu_state->debug.verbose_delta) {
+        return;
+    }
+    memcpy(shadow->registers, cpu_state->registers,
+            sizeof(shadow->registers));
+
+    // A misaligned store may span two words, and device registers are skipped
+    uint32_t addr;
+    if (!shadow->fetched || !mem_store_address(cpu_state, shadow->instr,
+                &addr)) {
+        return;
+    }
+    uint32_t word_addr = addr & ~(uint32_t)(sizeof(uint32_t) - 1);
+    int num_words = (addr == word_addr) ? 1 : 2;
+    for (int i = 0; i < num_words; i++)
+    {
+        uint32_t *value = &shadow->words[shadow->num_words];
+        shadow->addrs[shadow->num_words] = word_addr + i * sizeof(uint32_t);
+        if (mem_peek32(cpu_state, shadow->addrs[shadow->num_words], value)) {
+            shadow->num_words += 1;
+        }
+    }
+    return;
+}
+
+/**
+ * Shows the instruction that was just run in verbose mode, followed by either
+ * a full register dump, or only the registers and memory words it changed.
+ **/
+static void verbose_show(cpu_state_t *cpu_state,
+        const verbose_shadow_t *shadow)
+{
+    if (shadow->fetched) {
+        printf("Executed 0x%08x: 0x%08x  %s\n", shadow->pc, shadow->instr,
+                disasm_instruction(shadow->pc, shadow->instr));
+    }
+    if (!cpu_state->debug.verbose_delta) {
+        command_rdump(cpu_state, NULL, 0);
+        return;
+    }
+
+    for (int reg = 0; reg < RISCV_NUM_REGS; reg++)
+    {
+        uint32_t value = cpu_state->registers[reg];
+        if (value != shadow->registers[reg]) {
+            const register_name_t *name = &RISCV_REGISTER_NAMES[reg];
+            printf("    %-3s (%s) = 0x%08x\n", name->isa_name,
+                    name->abi_name, value);
+        }
+    }
+    for (int i = 0; i < shadow->num_words; i++)
+    {
+        uint32_t value;
+        if (mem_peek32(cpu_state, shadow->addrs[i], &value) &&
+                value != shadow->words[i]) {
+            printf("    mem[0x%08x] = 0x%08x\n", shadow->addrs[i], value);
+        }
+    }
+    return;
+}
+
+/*----------------------------------------------------------------------------
+ * Run Loop
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Runs instructions until the end of the current batch, given by the
+ * scheduler's horizon, or until the processor is halted. Returns true if the
+ * processor stopped at a breakpoint.
+ *
+ * This is always inlined into the variants, where the feature set is a
+ * constant, so the code for the disabled features is removed.
+ **/
+static inline __attribute__((always_inline)) bool run_batch(
+        cpu_state_t *cpu_state, const unsigned int features)
+{
+    const scheduler_t *scheduler = &cpu_state->scheduler;
+    while (cpu_state->cycle < scheduler->horizon && !cpu_state->halted)
+    {
+        if ((features & ENGINE_BREAKPOINTS) && at_breakpoint(cpu_state)) {
+            return true;
+        }
+        if (features & ENGINE_PROFILE) {
+            profile_instruction(cpu_state);
+        }
+
+        // Enter a new block, unless the PC continues the current one
+        uint32_t pc = cpu_state->pc;
+        debug_state_t *debug = &cpu_state->debug;
+        if ((features & ENGINE_BLOCKS) && (pc != debug->block_next ||
+                    pc > debug->block_last)) {
+            hotblocks_enter(cpu_state);
+        }
+        if (features & ENGINE_PLUGINS) {
+            plugins_before_instruction(cpu_state);
+        }
+        if (features & ENGINE_UNDO) {
+            reverse_record(cpu_state);
+        }
+
+        process_instruction(cpu_state);
+        cpu_state->cycle += 1;
+        if (features & ENGINE_BLOCKS) {
+            debug->block_next = pc + sizeof(pc);
+        }
+
+        // The next instruction continues the block if this one fell through
+        if (features & ENGINE_PLUGINS) {
+            cpu_state->debug.in_block = (cpu_state->pc == pc + sizeof(pc));
+        }
+    }
+    return false;
+}
+
+/**
+ * Runs the simulator for the specified number of cycles, until the processor is
+ * halted, or until it stops at a breakpoint. Returns the number of cycles that
+ * were run.
+ *
+ * This is the single source of the run loop, which is always inlined into each
+ * of the variants with a constant feature set.
+ **/
+static inline __attribute__((always_inline)) uint64_t run_engine(
+        cpu_state_t *cpu_state, uint64_t max_cycles,
+        const unsigned int features)
+{
+    scheduler_t *scheduler = &cpu_state->scheduler;
+    bool was_halted = cpu_state->halted;
+    uint64_t start_cycle = cpu_state->cycle;
+    uint64_t end_cycle = (max_cycles > UINT64_MAX - start_cycle) ? UINT64_MAX :
+            start_cycle + max_cycles;
+
+    while (!cpu_state->halted && cpu_state->cycle < end_cycle)
+    {
+        /* Fire any events that are due now, which may halt the processor,
+         * then take any interrupt that has become pending or enabled. */
+        sched_run_due(scheduler, cpu_state->cycle);
+        if (cpu_state->halted) {
+            break;
+        }
+        trap_check_interrupts(cpu_state);
+
+        /* Run a batch up to the next pending event. In verbose mode, each
+         * batch is a single cycle, so the registers can be dumped after it. */
+        uint64_t batch_end = min(end_cycle, sched_next_deadline(scheduler));
+        verbose_shadow_t shadow;
+        if (features & ENGINE_VERBOSE) {
+            batch_end = cpu_state->cycle + 1;
+            verbose_save(cpu_state, &shadow);
+        }
+        scheduler->horizon = batch_end;
+        bool stopped = run_batch(cpu_state, features);
+        scheduler->horizon = 0;
+
+        // If the last instruction raised an exception, enter the trap handler
+        if (cpu_state->csr.trap_pending) {
+            trap_commit(cpu_state);
+        }
+
+        // If the user has activated verbose mode, then show what the cycle did
+        if ((features & ENGINE_VERBOSE) && !stopped) {
+            verbose_show(cpu_state, &shadow);
+        }
+
+        // Stop running if the processor reached a breakpoint
+        if ((features & ENGINE_BREAKPOINTS) && stopped) {
+            break;
+        }
+    }
+
+    // Let the plugins and statistics know if the processor halted
+    if ((features & ENGINE_PLUGINS) && cpu_state->halted && !was_halted) {
+        plugins_halt(cpu_state);
+    }
+    if (cpu_state->halted && !was_halted) {
+        stats_halt(cpu_state);
+    }
+
+    return cpu_state->cycle - start_cycle;
+}
+
+// Define each of the variants of the run loop
+#define DEFINE_ENGINE_VARIANT(features) \
+    static uint64_t run_engine_##features(cpu_state_t *cpu_state, \
+            uint64_t max_cycles) \
+    { \
+        return run_engine(cpu_state, max_cycles, (features)); \
+    }
+ENGINE_VARIANT_LIST(DEFINE_ENGINE_VARIANT)
+#undef DEFINE_ENGINE_VARIANT
+
+// The variants of the run loop, indexed by their feature set
+static const engine_variant_t ENGINE_VARIANTS[ENGINE_NUM_VARIANTS] = {
+#define ENGINE_VARIANT_ENTRY(features) \
+    [(features)] = run_engine_##features,
+    ENGINE_VARIANT_LIST(ENGINE_VARIANT_ENTRY)
+#undef ENGINE_VARIANT_ENTRY
+};
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Runs the simulator for the specified number of cycles, until the processor is
+ * halted, or until it stops at a breakpoint. Returns the number of cycles that
+ * were run.
+ *
+ * Instructions are run in batches that end at the next pending scheduler
+ * event, so devices and timers cost nothing between their events. If verbose
+ * mode is active, a register dump is performed after every cycle. The variant
+ * of the run loop for the enabled debugging features is chosen on entry.
+ **/
+uint64_t engine_run(cpu_state_t *cpu_state, uint64_t max_cycles)
+{
+    unsigned int features = engine_features(cpu_state);
+
+    // Without any breakpoints, there is nothing to skip when resuming
+    if (!(features & ENGINE_BREAKPOINTS)) {
+        cpu_state->debug.breakpoint_hit = false;
+    }
+
+    return ENGINE_VARIANTS[features](cpu_state, max_cycles);
+}
+
+/**
+ * Runs the simulator for the specified number of cycles, or until the
+ * processor is halted, to reproduce cycles that were already run. None of the
+ * debugging features are used, except for recording. Returns the number of
+ * cycles that were run.
+ **/
+uint64_t engine_replay(cpu_state_t *cpu_state, uint64_t max_cycles)
+{
+    unsigned int features = engine_features(cpu_state) & ENGINE_UNDO;
+    return ENGINE_VARIANTS[features](cpu_state, max_cycles);
+}
@@ -0,0 +1,58 @@
+/**
+ * engine.h
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the interface to the simulator's execution engine.
+ *
+ * The engine is the run loop that repeatedly invokes the core simulator to
+ * process instructions. It is used by the shell commands that run the
+ * processor, and it is responsible for firing scheduled events at the right
+ * cycle.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+#ifndef ENGINE_H_
+#define ENGINE_H_
+
+// Standard Includes
+#include <stdint.h>             // Fixed-size integral types
+
+// 18-447 Simulator Includes
+#include <sim.h>                // Definition of cpu_state_t
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Runs the simulator for the specified number of cycles, until the processor is
+ * halted, or until it stops at a breakpoint. Returns the number of cycles that
+ * were run.
+ *
+ * Instructions are run in batches that end at the next pending scheduler
+ * event, so devices and timers cost nothing between their events. If verbose
+ * mode is active, a register dump is performed after every cycle. The variant
+ * of the run loop for the enabled debugging features is chosen on entry.
+ **/
+uint64_t engine_run(cpu_state_t *cpu_state, uint64_t max_cycles);
+
+/**
+ * Runs the simulator for the specified number of cycles, or until the
+ * processor is halted, to reproduce cycles that were already run. None of the
+ * debugging features are used, except for recording. Returns the number of
+ * cycles that were run.
+ **/
+uint64_t engine_replay(cpu_state_t *cpu_state, uint64_t max_cycles);
+
+#endif /* ENGINE_H_ */
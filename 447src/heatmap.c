@@ -0,0 +1,557 @@
+/**
+ * heatmap.c
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the implementation of the memory heat map.
+ *
+ * The blocks of all the segments are numbered consecutively, so each access
+ * updates a few flat arrays indexed by the block number. The working set is
+ * found by stamping each block with the last window it was accessed in.
+ *
+ * Reuse distances are measured exactly over the most recent accesses. Each
+ * block has a mark at the time of its last access, stored in a Fenwick tree
+ * indexed by the time modulo the reuse window. The reuse distance of an access
+ * is then the number of marks between the block's last access and now, which
+ * takes a logarithmic number of steps to count.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+// Standard Includes
+#include <stdlib.h>                 // Malloc and free functions
+#include <stdio.h>                  // Printf and related functions
+#include <stdbool.h>                // Definition of the boolean type
+#include <stdint.h>                 // Fixed-size integral types
+#include <inttypes.h>               // Format specifiers for fixed-size types
+
+// Standard Includes
+#include <errno.h>                  // Error codes
+#include <string.h>                 // Strerror function
+
+// 18-447 Simulator Includes
+#include <sim.h>                    // Definition of cpu_state_t
+#include <memory.h>                 // Definition of mem_segment_t
+
+// Local Includes
+#include "memory_shell.h"           // Memory access hooks
+#include "machine.h"                // Definition of the machine
+#include "heatmap.h"                // This file's interface
+
+/*----------------------------------------------------------------------------
+ * Internal Definitions
+ *----------------------------------------------------------------------------*/
+
+// The number of hottest blocks shown in the summary
+#define HEATMAP_NUM_HOTTEST     10
+
+// The heat map for a single hart
+typedef struct heatmap {
+    unsigned int block_shift;       // Log2 of the block size in bytes
+    uint64_t window;                // Instructions in a working set window
+    int num_segments;               // Number of segments covered
+    uint32_t *segment_first;        // First block number of each segment
+    uint32_t *segment_blocks;       // Number of blocks in each segment
+    uint32_t num_blocks;            // Total number of blocks
+
+    uint64_t *reads;                // Loads from each block
+    uint64_t *writes;               // Stores to each block
+    uint64_t *last_access;          // Time of the last access, plus 1
+    uint64_t *last_window;          // Window of the last access, plus 1
+    uint64_t time;                  // Number of accesses so far
+
+    uint64_t current_window;        // Window of the most recent access
+    uint64_t window_blocks;         // Blocks accessed in the current window
+    uint64_t num_windows;           // Windows that have finished
+    uint64_t working_set_total;     // Sum of the finished windows' sizes
+    uint64_t working_set_max;       // Largest finished window
+
+    uint64_t reuse[HEATMAP_REUSE_BUCKETS];          // Reuse histogram
+    uint32_t marks[HEATMAP_REUSE_WINDOW + 1];       // Fenwick tree of marks
+    uint32_t mark_owner[HEATMAP_REUSE_WINDOW];      // Block of each mark, + 1
+} heatmap_t;
+
+// Indicates if the heat map is collecting data
+bool HEATMAP_ACTIVE                     = false;
+
+/*----------------------------------------------------------------------------
+ * Reuse Distance Tracking
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Adds the delta to the number of marks in the given slot of the Fenwick tree.
+ **/
+static void marks_add(heatmap_t *heatmap, uint32_t slot, int32_t delta)
+{
+    for (uint32_t i = slot + 1; i <= HEATMAP_REUSE_WINDOW; i += i & -i)
+    {
+        heatmap->marks[i] += delta;
+    }
+    return;
+}
+
+/**
+ * Counts the number of marks in the slots [0, end) of the Fenwick tree.
+ **/
+static uint32_t marks_prefix(const heatmap_t *heatmap, uint32_t end)
+{
+    uint32_t count = 0;
+    for (uint32_t i = end; i > 0; i -= i & -i)
+    {
+        count += heatmap->marks[i];
+    }
+    return count;
+}
+
+/**
+ * Counts the number of marks at the times (start, end), which must span less
+ * than the reuse window.
+ **/
+static uint32_t marks_between(const heatmap_t *heatmap, uint64_t start,
+        uint64_t end)
+{
+    if (end - start <= 1) {
+        return 0;
+    }
+
+    uint32_t first = (start + 1) % HEATMAP_REUSE_WINDOW;
+    uint32_t last = (end - 1) % HEATMAP_REUSE_WINDOW;
+    if (first <= last) {
+        return marks_prefix(heatmap, last + 1) - marks_prefix(heatmap, first);
+    }
+    return marks_prefix(heatmap, HEATMAP_REUSE_WINDOW) -
+            marks_prefix(heatmap, first) + marks_prefix(heatmap, last + 1);
+}
+
+/**
+ * Gets the histogram bucket for the given reuse distance.
+ **/
+static int reuse_bucket(uint32_t distance)
+{
+    int bucket = (distance == 0) ? 0 : 64 - __builtin_clzll(distance);
+    return (bucket < HEATMAP_REUSE_BUCKETS - 1) ? bucket :
+            HEATMAP_REUSE_BUCKETS - 2;
+}
+
+/**
+ * Records the access to the block in the reuse distance histogram, and moves
+ * the block's mark to the current time.
+ **/
+static void record_reuse(heatmap_t *heatmap, uint32_t block)
+{
+    uint64_t now = heatmap->time;
+    uint32_t slot = now % HEATMAP_REUSE_WINDOW;
+
+    // The slot's old mark is from a full window ago, so drop it if it's live
+    uint32_t owner = heatmap->mark_owner[slot];
+    if (owner != 0 && now >= HEATMAP_REUSE_WINDOW &&
+            heatmap->last_access[owner - 1] == now - HEATMAP_REUSE_WINDOW + 1) {
+        marks_add(heatmap, slot, -1);
+    }
+
+    // Count the distinct blocks since the last access, unless it's too old
+    uint64_t last_access = heatmap->last_access[block];
+    if (last_access != 0 && now - (last_access - 1) < HEATMAP_REUSE_WINDOW) {
+        uint64_t last_time = last_access - 1;
+        uint32_t distance = marks_between(heatmap, last_time, now);
+        heatmap->reuse[reuse_bucket(distance)] += 1;
+        marks_add(heatmap, last_time % HEATMAP_REUSE_WINDOW, -1);
+    } else {
+        heatmap->reuse[HEATMAP_REUSE_BUCKETS - 1] += 1;
+    }
+
+    marks_add(heatmap, slot, 1);
+    heatmap->mark_owner[slot] = block + 1;
+    heatmap->last_access[block] = now + 1;
+    heatmap->time = now + 1;
+    return;
+}
+
+/*----------------------------------------------------------------------------
+ * Working Set Tracking
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Finishes the windows up to the given one. Windows without any accesses have
+ * an empty working set.
+ **/
+static void finish_windows(heatmap_t *heatmap, uint64_t window)
+{
+    if (window <= heatmap->current_window) {
+        return;
+    }
+
+    uint64_t size = heatmap->window_blocks;
+    heatmap->num_windows += window - heatmap->current_window;
+    heatmap->working_set_total += size;
+    heatmap->working_set_max = (size > heatmap->working_set_max) ? size :
+            heatmap->working_set_max;
+
+    heatmap->current_window = window;
+    heatmap->window_blocks = 0;
+    return;
+}
+
+/**
+ * Records the access to the block in the working set of the current window.
+ **/
+static void record_working_set(heatmap_t *heatmap, uint32_t block,
+        uint64_t cycle)
+{
+    uint64_t window = cycle / heatmap->window;
+    finish_windows(heatmap, window);
+
+    if (heatmap->last_window[block] != window + 1) {
+        heatmap->last_window[block] = window + 1;
+        heatmap->window_blocks += 1;
+    }
+    return;
+}
+
+/*----------------------------------------------------------------------------
+ * Allocation
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Frees a hart's heat map.
+ **/
+static void heatmap_destroy(heatmap_t *heatmap)
+{
+    if (heatmap == NULL) {
+        return;
+    }
+
+    free(heatmap->segment_first);
+    free(heatmap->segment_blocks);
+    free(heatmap->reads);
+    free(heatmap->writes);
+    free(heatmap->last_access);
+    free(heatmap->last_window);
+    free(heatmap);
+    return;
+}
+
+/**
+ * Creates a heat map for the hart, covering its segments as currently loaded.
+ * Returns NULL on failure.
+ **/
+static heatmap_t *heatmap_create(const cpu_state_t *cpu_state,
+        unsigned int block_shift, uint64_t window)
+{
+    heatmap_t *heatmap = calloc(1, sizeof(*heatmap));
+    if (heatmap == NULL) {
+        return NULL;
+    }
+
+    // Number the blocks of each segment consecutively
+    const memory_t *memory = &cpu_state->memory;
+    heatmap->block_shift = block_shift;
+    heatmap->window = window;
+    heatmap->num_segments = memory->num_segments;
+    heatmap->segment_first = calloc(memory->num_segments, sizeof(uint32_t));
+    heatmap->segment_blocks = calloc(memory->num_segments, sizeof(uint32_t));
+    if (heatmap->segment_first == NULL || heatmap->segment_blocks == NULL) {
+        heatmap_destroy(heatmap);
+        return NULL;
+    }
+
+    uint64_t num_blocks = 0;
+    uint64_t block_size = UINT64_C(1) << block_shift;
+    for (int i = 0; i < memory->num_segments; i++)
+    {
+        uint64_t size = memory->segments[i].size;
+        heatmap->segment_first[i] = num_blocks;
+        heatmap->segment_blocks[i] = (size + block_size - 1) >> block_shift;
+        num_blocks += heatmap->segment_blocks[i];
+    }
+    heatmap->num_blocks = num_blocks;
+
+    heatmap->reads = calloc(num_blocks, sizeof(uint64_t));
+    heatmap->writes = calloc(num_blocks, sizeof(uint64_t));
+    heatmap->last_access = calloc(num_blocks, sizeof(uint64_t));
+    heatmap->last_window = calloc(num_blocks, sizeof(uint64_t));
+    if (num_blocks > 0 && (heatmap->reads == NULL || heatmap->writes == NULL ||
+                heatmap->last_access == NULL || heatmap->last_window == NULL)) {
+        heatmap_destroy(heatmap);
+        return NULL;
+    }
+
+    heatmap->current_window = cpu_state->cycle / window;
+    return heatmap;
+}
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Starts collecting the heat map on every hart, counting by blocks of
+ * 2^block_shift bytes, with working set windows of the given number of
+ * instructions. The blocks cover the memory segments as currently loaded.
+ *
+ * Any previously collected data is discarded. Returns 0 on success, or a
+ * negative error code on failure.
+ **/
+int heatmap_start(machine_t *machine, unsigned int block_shift,
+        uint64_t window)
+{
+    heatmap_free(machine);
+    for (int i = 0; i < machine->num_harts; i++)
+    {
+        cpu_state_t *hart = &machine->harts[i];
+        hart->debug.heatmap = heatmap_create(hart, block_shift, window);
+        if (hart->debug.heatmap == NULL) {
+            fprintf(stderr, "Error: Unable to allocate the heat map.\n");
+            heatmap_free(machine);
+            return -ENOMEM;
+        }
+    }
+
+    HEATMAP_ACTIVE = true;
+    mem_hooks_update();
+    return 0;
+}
+
+/**
+ * Stops collecting the heat map, keeping the data collected so far.
+ **/
+void heatmap_stop(machine_t *machine)
+{
+    (void)machine;
+    HEATMAP_ACTIVE = false;
+    mem_hooks_update();
+    return;
+}
+
+/**
+ * Discards the heat maps of all the harts, and stops collecting.
+ **/
+void heatmap_free(machine_t *machine)
+{
+    HEATMAP_ACTIVE = false;
+    mem_hooks_update();
+    for (int i = 0; i < machine->num_harts; i++)
+    {
+        cpu_state_t *hart = &machine->harts[i];
+        heatmap_destroy(hart->debug.heatmap);
+        hart->debug.heatmap = NULL;
+    }
+    return;
+}
+
+/**
+ * Records a word access by the hart to the address, which lies inside the given
+ * segment.
+ **/
+void heatmap_record(cpu_state_t *cpu_state, const mem_segment_t *segment,
+        uint32_t addr, bool is_store)
+{
+    heatmap_t *heatmap = cpu_state->debug.heatmap;
+    if (heatmap == NULL) {
+        return;
+    }
+
+    // Find the block, ignoring segments that grew since the heat map started
+    int index = segment - cpu_state->memory.segments;
+    uint32_t offset = (addr - segment->base_addr) >> heatmap->block_shift;
+    if (index < 0 || index >= heatmap->num_segments ||
+            offset >= heatmap->segment_blocks[index]) {
+        return;
+    }
+    uint32_t block = heatmap->segment_first[index] + offset;
+
+    if (is_store) {
+        heatmap->writes[block] += 1;
+    } else {
+        heatmap->reads[block] += 1;
+    }
+    record_working_set(heatmap, block, cpu_state->cycle);
+    record_reuse(heatmap, block);
+    return;
+}
+
+/**
+ * Prints a summary of the heat map to the file: the access totals, the hottest
+ * blocks, the working set sizes, and the reuse distance histogram.
+ **/
+void heatmap_print_summary(const machine_t *machine, FILE *file)
+{
+    const heatmap_t *first = machine->harts[0].debug.heatmap;
+    if (first == NULL) {
+        fprintf(file, "The heat map has not been started.\n");
+        return;
+    }
+
+    // Combine the totals, working sets, and histograms of all the harts
+    uint64_t total_reads = 0;
+    uint64_t total_writes = 0;
+    uint64_t blocks_touched = 0;
+    uint64_t num_windows = 0;
+    uint64_t working_set_total = 0;
+    uint64_t working_set_max = 0;
+    uint64_t reuse[HEATMAP_REUSE_BUCKETS] = {0};
+    uint32_t hottest[HEATMAP_NUM_HOTTEST];
+    uint64_t hottest_count[HEATMAP_NUM_HOTTEST] = {0};
+    int num_hottest = 0;
+
+    for (uint32_t block = 0; block < first->num_blocks; block++)
+    {
+        uint64_t count = 0;
+        for (int i = 0; i < machine->num_harts; i++)
+        {
+            const heatmap_t *heatmap = machine->harts[i].debug.heatmap;
+            total_reads += heatmap->reads[block];
+            total_writes += heatmap->writes[block];
+            count += heatmap->reads[block] + heatmap->writes[block];
+        }
+        if (count == 0) {
+            continue;
+        }
+        blocks_touched += 1;
+
+        // Insert the block into the sorted list of the hottest blocks
+        int pos = (num_hottest < HEATMAP_NUM_HOTTEST) ? num_hottest++ :
+                HEATMAP_NUM_HOTTEST;
+        while (pos > 0 && hottest_count[pos - 1] < count)
+        {
+            if (pos < HEATMAP_NUM_HOTTEST) {
+                hottest[pos] = hottest[pos - 1];
+                hottest_count[pos] = hottest_count[pos - 1];
+            }
+            pos -= 1;
+        }
+        if (pos < HEATMAP_NUM_HOTTEST) {
+            hottest[pos] = block;
+            hottest_count[pos] = count;
+        }
+    }
+
+    for (int i = 0; i < machine->num_harts; i++)
+    {
+        const heatmap_t *heatmap = machine->harts[i].debug.heatmap;
+        num_windows += heatmap->num_windows;
+        working_set_total += heatmap->working_set_total;
+        if (heatmap->working_set_max > working_set_max) {
+            working_set_max = heatmap->working_set_max;
+        }
+        for (int bucket = 0; bucket < HEATMAP_REUSE_BUCKETS; bucket++)
+        {
+            reuse[bucket] += heatmap->reuse[bucket];
+        }
+    }
+
+    uint64_t block_size = UINT64_C(1) << first->block_shift;
+    fprintf(file, "Heat map (%s, %" PRIu64 "-byte blocks, %" PRIu64
+            "-instruction windows):\n", HEATMAP_ACTIVE ? "active" : "stopped",
+            block_size, first->window);
+    fprintf(file, "  Reads: %" PRIu64 ", Writes: %" PRIu64 ", Blocks "
+            "touched: %" PRIu64 " (%" PRIu64 " bytes)\n", total_reads,
+            total_writes, blocks_touched, blocks_touched * block_size);
+
+    // Show the hottest blocks, along with their segment
+    fprintf(file, "  Hottest blocks:\n");
+    for (int i = 0; i < num_hottest; i++)
+    {
+        int segment = 0;
+        while (segment + 1 < first->num_segments &&
+                first->segment_first[segment + 1] <= hottest[i])
+        {
+            segment += 1;
+        }
+        const mem_segment_t *mem_segment =
+                &machine->harts[0].memory.segments[segment];
+        uint32_t addr = mem_segment->base_addr + ((hottest[i] -
+                first->segment_first[segment]) << first->block_shift);
+        fprintf(file, "    0x%08x  %-12s %" PRIu64 "\n", addr,
+                mem_segment->name, hottest_count[i]);
+    }
+
+    // Show the working set, over the windows that have finished
+    uint64_t working_set_avg = (num_windows == 0) ? 0 :
+            working_set_total / num_windows;
+    fprintf(file, "  Working set: average %" PRIu64 " blocks (%" PRIu64
+            " bytes), maximum %" PRIu64 " blocks (%" PRIu64 " bytes), over %"
+            PRIu64 " windows\n", working_set_avg, working_set_avg * block_size,
+            working_set_max, working_set_max * block_size, num_windows);
+
+    // Show the reuse distance histogram
+    fprintf(file, "  Reuse distance (distinct blocks):\n");
+    for (int bucket = 0; bucket < HEATMAP_REUSE_BUCKETS; bucket++)
+    {
+        if (reuse[bucket] == 0) {
+            continue;
+        }
+
+        if (bucket == HEATMAP_REUSE_BUCKETS - 1) {
+            fprintf(file, "    %-16s %" PRIu64 "\n", "cold", reuse[bucket]);
+        } else if (bucket == 0) {
+            fprintf(file, "    %-16s %" PRIu64 "\n", "0", reuse[bucket]);
+        } else {
+            char range[32];
+            snprintf(range, sizeof(range), "%" PRIu64 "-%" PRIu64,
+                    UINT64_C(1) << (bucket - 1), (UINT64_C(1) << bucket) - 1);
+            fprintf(file, "    %-16s %" PRIu64 "\n", range, reuse[bucket]);
+        }
+    }
+
+    return;
+}
+
+/**
+ * Writes the heat map to the file as CSV, with one row per block that was
+ * accessed. Returns 0 on success, or a negative error code on failure.
+ **/
+int heatmap_write_csv(const machine_t *machine, const char *path)
+{
+    const heatmap_t *first = machine->harts[0].debug.heatmap;
+    if (first == NULL) {
+        fprintf(stderr, "Error: The heat map has not been started.\n");
+        return -ENOENT;
+    }
+
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        int rc = -errno;
+        fprintf(stderr, "Error: %s: Unable to open file: %s.\n", path,
+                strerror(errno));
+        return rc;
+    }
+
+    fprintf(file, "segment,address,reads,writes\n");
+    for (int segment = 0; segment < first->num_segments; segment++)
+    {
+        const mem_segment_t *mem_segment =
+                &machine->harts[0].memory.segments[segment];
+        for (uint32_t offset = 0; offset < first->segment_blocks[segment];
+                offset++)
+        {
+            uint32_t block = first->segment_first[segment] + offset;
+            uint64_t reads = 0;
+            uint64_t writes = 0;
+            for (int i = 0; i < machine->num_harts; i++)
+            {
+                const heatmap_t *heatmap = machine->harts[i].debug.heatmap;
+                reads += heatmap->reads[block];
+                writes += heatmap->writes[block];
+            }
+
+            if (reads != 0 || writes != 0) {
+                fprintf(file, "%s,0x%08x,%" PRIu64 ",%" PRIu64 "\n",
+                        mem_segment->name, mem_segment->base_addr +
+                        (offset << first->block_shift), reads, writes);
+            }
+        }
+    }
+
+    fclose(file);
+    return 0;
+}
@@ -0,0 +1,114 @@
+/**
+ * heatmap.h
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the interface to the memory heat map, which is an
+ * analysis of the program's data memory accesses.
+ *
+ * While it is active, every word load and store is counted against the cache
+ * line or page that it falls in, with reads and writes counted separately. It
+ * also tracks the working set, which is the number of distinct blocks (lines or
+ * pages) accessed in each window of instructions, and a histogram of reuse
+ * distances, which is the number of distinct blocks accessed between two
+ * accesses to the same block.
+ *
+ * Each hart keeps its own heat map, so the harts never contend on the counters.
+ * The heat maps of all of the harts are combined for the reports.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+#ifndef HEATMAP_H_
+#define HEATMAP_H_
+
+// Standard Includes
+#include <stdbool.h>            // Boolean type and definitions
+#include <stdint.h>             // Fixed-size integral types
+#include <stdio.h>              // Definition of the FILE type
+
+// 18-447 Simulator Includes
+#include <sim.h>                // Definition of cpu_state_t
+#include <memory.h>             // Definition of mem_segment_t
+
+// Local Includes
+#include "machine.h"            // Definition of the machine
+
+/*----------------------------------------------------------------------------
+ * Definitions
+ *----------------------------------------------------------------------------*/
+
+// The base-2 logarithm of the block sizes the heat map can count by
+#define HEATMAP_LINE_SHIFT      6           // 64-byte cache lines
+#define HEATMAP_PAGE_SHIFT      12          // 4 KiB pages
+
+// The default number of instructions in a working set window
+#define HEATMAP_DEFAULT_WINDOW  10000
+
+/* The number of most recent accesses that reuse distances are measured over.
+ * Accesses to a block that wasn't accessed within this many accesses are
+ * counted as cold. This must be a power of 2. */
+#define HEATMAP_REUSE_WINDOW    (1 << 16)
+
+/* The number of buckets in the reuse distance histogram. Bucket 0 holds a
+ * distance of 0, bucket i holds distances in [2^(i-1), 2^i), and the last
+ * bucket holds cold accesses. */
+#define HEATMAP_REUSE_BUCKETS   18
+
+// Indicates if the heat map is collecting data
+extern bool HEATMAP_ACTIVE;
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Starts collecting the heat map on every hart, counting by blocks of
+ * 2^block_shift bytes, with working set windows of the given number of
+ * instructions. The blocks cover the memory segments as currently loaded.
+ *
+ * Any previously collected data is discarded. Returns 0 on success, or a
+ * negative error code on failure.
+ **/
+int heatmap_start(machine_t *machine, unsigned int block_shift,
+        uint64_t window);
+
+/**
+ * Stops collecting the heat map, keeping the data collected so far.
+ **/
+void heatmap_stop(machine_t *machine);
+
+/**
+ * Discards the heat maps of all the harts, and stops collecting.
+ **/
+void heatmap_free(machine_t *machine);
+
+/**
+ * Records a word access by the hart to the address, which lies inside the given
+ * segment.
+ **/
+void heatmap_record(cpu_state_t *cpu_state, const mem_segment_t *segment,
+        uint32_t addr, bool is_store);
+
+/**
+ * Prints a summary of the heat map to the file: the access totals, the hottest
+ * blocks, the working set sizes, and the reuse distance histogram.
+ **/
+void heatmap_print_summary(const machine_t *machine, FILE *file);
+
+/**
+ * Writes the heat map to the file as CSV, with one row per block that was
+ * accessed. Returns 0 on success, or a negative error code on failure.
+ **/
+int heatmap_write_csv(const machine_t *machine, const char *path);
+
+#endif /* HEATMAP_H_ */
@@ -0,0 +1,581 @@
+/**
+ * hotblocks.c
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the implementation of the hot block report.
+ *
+ * Each hart has its own hash table of the blocks it has entered, keyed by the
+ * address of the block's first instruction, so the harts never contend for it.
+ * The extent of a block is found when it is first entered, by scanning ahead
+ * for the instruction that ends it. The instructions run in a block are only
+ * added up when the hart leaves it, from the PC that it left at, so a block
+ * that is left early by a trap is counted exactly.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+// Standard Includes
+#include <stdlib.h>                 // Malloc, free, and qsort functions
+#include <stdio.h>                  // Printf and related functions
+#include <stdbool.h>                // Definition of the boolean type
+#include <stdint.h>                 // Fixed-size integral types
+#include <inttypes.h>               // Format specifiers for fixed-size types
+
+// Standard Includes
+#include <errno.h>                  // Error codes
+
+// 18-447 Simulator Includes
+#include <sim.h>                    // Definition of cpu_state_t
+#include <riscv_isa.h>              // Definition of the opcodes
+#include <riscv_abi.h>              // Definition of the zero register
+
+// Local Includes
+#include "memory_shell.h"           // Reading the instructions of a block
+#include "disasm.h"                 // Disassembly of the block's instructions
+#include "elf_loader.h"             // Symbols of the loaded program
+#include "machine.h"                // Definition of the machine
+#include "hotblocks.h"              // This file's interface
+
+/*----------------------------------------------------------------------------
+ * Internal Definitions
+ *----------------------------------------------------------------------------*/
+
+// The initial number of slots in a hart's table, which must be a power of 2
+#define HOTBLOCKS_INITIAL_SLOTS     (1 << 10)
+
+/* The maximum number of instructions in a block. Longer runs of straight-line
+ * code are split into several blocks. */
+#define HOTBLOCKS_MAX_LENGTH        256
+
+// The index of the current block when a hart isn't in one
+#define HOTBLOCKS_NO_CURRENT        UINT32_MAX
+
+// A basic block, and the number of times it was run
+typedef struct hot_block {
+    uint32_t leader;                // Address of the first instruction
+    uint32_t last_pc;               // Address of the last instruction
+    uint32_t loop_head;             // Target of the last instruction, if it is
+                                    // a backward branch or jump
+    bool can_loop;                  // The last instruction branches backwards
+    uint64_t executions;            // Times the block was entered, or 0 if the
+                                    // table slot is empty
+    uint64_t instructions;          // Instructions run in the block
+    uint64_t back_edges;            // Times its backward branch was taken
+} hot_block_t;
+
+// A loop, formed by a backward branch or jump to its head
+typedef struct hot_loop {
+    uint32_t head;                  // Address of the first instruction
+    uint32_t tail;                  // Address of the backward branch
+    uint64_t iterations;            // Times the backward branch was taken
+    uint64_t instructions;          // Instructions run in the loop's blocks
+} hot_loop_t;
+
+// The basic block counts for a single hart
+typedef struct hotblocks {
+    uint32_t num_slots;             // Number of slots in the table
+    uint32_t num_blocks;            // Number of blocks in the table
+    uint32_t current;               // Slot of the block the hart is in
+    hot_block_t *blocks;            // Hash table of blocks, by leader
+} hotblocks_t;
+
+// Indicates if the basic blocks are being counted
+bool HOTBLOCKS_ACTIVE                   = false;
+
+/*----------------------------------------------------------------------------
+ * Block Table
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Gets the first slot to look for the block with the given leader in.
+ **/
+static uint32_t block_slot(const hotblocks_t *hotblocks, uint32_t leader)
+{
+    return ((leader / sizeof(uint32_t)) * UINT32_C(2654435761)) &
+            (hotblocks->num_slots - 1);
+}
+
+/**
+ * Doubles the number of slots in the table, moving the blocks into their new
+ * slots. Returns 0 on success, or a negative error code on failure.
+ **/
+static int grow_table(hotblocks_t *hotblocks)
+{
+    hot_block_t *old_blocks = hotblocks->blocks;
+    uint32_t old_num_slots = hotblocks->num_slots;
+    hot_block_t *blocks = calloc(2 * old_num_slots, sizeof(blocks[0]));
+    if (blocks == NULL) {
+        return -ENOMEM;
+    }
+
+    hotblocks->blocks = blocks;
+    hotblocks->num_slots = 2 * old_num_slots;
+    for (uint32_t i = 0; i < old_num_slots; i++)
+    {
+        if (old_blocks[i].executions == 0) {
+            continue;
+        }
+
+        uint32_t slot = block_slot(hotblocks, old_blocks[i].leader);
+        while (blocks[slot].executions != 0)
+        {
+            slot = (slot + 1) & (hotblocks->num_slots - 1);
+        }
+        blocks[slot] = old_blocks[i];
+    }
+
+    free(old_blocks);
+    return 0;
+}
+
+/**
+ * Finds the extent of the block starting at its leader, which runs through the
+ * first branch, jump, or system instruction, and notes if that instruction
+ * branches or jumps backwards.
+ **/
+static void scan_block(const cpu_state_t *cpu_state, hot_block_t *block)
+{
+    block->last_pc = block->leader;
+    block->can_loop = false;
+    for (uint32_t i = 0; i < HOTBLOCKS_MAX_LENGTH; i++)
+    {
+        uint32_t pc = block->leader + i * sizeof(uint32_t);
+        uint32_t instr;
+        if (!mem_peek32(cpu_state, pc, &instr)) {
+            return;
+        }
+        block->last_pc = pc;
+
+        // Only jumps that don't link can form loops, since the others are calls
+        uint32_t opcode = instr & (RISCV_NUM_OPCODES - 1);
+        uint32_t offset;
+        if (opcode == OP_BRANCH) {
+            offset = (instr >> 31) << 12 | ((instr >> 7) & 0x1) << 11 |
+                    ((instr >> 25) & 0x3F) << 5 | ((instr >> 8) & 0xF) << 1;
+            offset = (uint32_t)((int32_t)(offset << 19) >> 19);
+        } else if (opcode == OP_JAL && ((instr >> 7) & 0x1F) == REG_ZERO) {
+            offset = (instr >> 31) << 20 | (instr & 0xFF000) |
+                    ((instr >> 20) & 0x1) << 11 | ((instr >> 21) & 0x3FF) << 1;
+            offset = (uint32_t)((int32_t)(offset << 11) >> 11);
+        } else if (opcode == OP_JAL || opcode == OP_JALR ||
+                opcode == OP_SYSTEM) {
+            return;
+        } else {
+            continue;
+        }
+
+        block->loop_head = pc + offset;
+        block->can_loop = (block->loop_head <= pc);
+        return;
+    }
+    return;
+}
+
+/**
+ * Finds the block with the given leader in the hart's table, adding it if it
+ * isn't there. Returns NULL if the table couldn't be grown to add it.
+ **/
+static hot_block_t *find_block(const cpu_state_t *cpu_state,
+        hotblocks_t *hotblocks, uint32_t leader)
+{
+    // The table is kept at most half full, so the probe sequences stay short
+    if (2 * (hotblocks->num_blocks + 1) > hotblocks->num_slots &&
+            grow_table(hotblocks) < 0) {
+        return NULL;
+    }
+
+    uint32_t slot = block_slot(hotblocks, leader);
+    while (hotblocks->blocks[slot].executions != 0)
+    {
+        if (hotblocks->blocks[slot].leader == leader) {
+            return &hotblocks->blocks[slot];
+        }
+        slot = (slot + 1) & (hotblocks->num_slots - 1);
+    }
+
+    hot_block_t *block = &hotblocks->blocks[slot];
+    block->leader = leader;
+    scan_block(cpu_state, block);
+    hotblocks->num_blocks += 1;
+    return block;
+}
+
+/**
+ * Frees the hart's table of blocks.
+ **/
+static void destroy_table(hotblocks_t *hotblocks)
+{
+    if (hotblocks != NULL) {
+        free(hotblocks->blocks);
+        free(hotblocks);
+    }
+    return;
+}
+
+/*----------------------------------------------------------------------------
+ * Report
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Orders blocks by the address of their leader.
+ **/
+static int compare_leaders(const void *block1, const void *block2)
+{
+    const hot_block_t *b1 = block1;
+    const hot_block_t *b2 = block2;
+    if (b1->leader != b2->leader) {
+        return (b1->leader < b2->leader) ? -1 : 1;
+    }
+    return 0;
+}
+
+/**
+ * Orders blocks by the instructions run in them, the most first.
+ **/
+static int compare_block_instructions(const void *block1, const void *block2)
+{
+    const hot_block_t *b1 = block1;
+    const hot_block_t *b2 = block2;
+    if (b1->instructions != b2->instructions) {
+        return (b1->instructions > b2->instructions) ? -1 : 1;
+    }
+    return compare_leaders(block1, block2);
+}
+
+/**
+ * Orders loops by the instructions run in them, the most first.
+ **/
+static int compare_loop_instructions(const void *loop1, const void *loop2)
+{
+    const hot_loop_t *l1 = loop1;
+    const hot_loop_t *l2 = loop2;
+    if (l1->instructions != l2->instructions) {
+        return (l1->instructions > l2->instructions) ? -1 : 1;
+    } else if (l1->head != l2->head) {
+        return (l1->head < l2->head) ? -1 : 1;
+    }
+    return 0;
+}
+
+/**
+ * Gathers the blocks of every hart, combining the counts of the harts' blocks
+ * with the same leader, and sorts them by leader. The instructions run so far
+ * in the block each hart is in are included. Returns the number of blocks, or
+ * a negative error code on failure.
+ **/
+static int gather_blocks(const machine_t *machine, hot_block_t **blocks)
+{
+    uint32_t total_blocks = 0;
+    for (int i = 0; i < machine->num_harts; i++)
+    {
+        total_blocks += machine->harts[i].debug.hotblocks->num_blocks;
+    }
+
+    hot_block_t *gathered = malloc((total_blocks + 1) * sizeof(gathered[0]));
+    if (gathered == NULL) {
+        return -ENOMEM;
+    }
+
+    int num_blocks = 0;
+    for (int i = 0; i < machine->num_harts; i++)
+    {
+        const cpu_state_t *hart = &machine->harts[i];
+        const hotblocks_t *hotblocks = hart->debug.hotblocks;
+        for (uint32_t slot = 0; slot < hotblocks->num_slots; slot++)
+        {
+            const hot_block_t *block = &hotblocks->blocks[slot];
+            if (block->executions == 0) {
+                continue;
+            }
+
+            gathered[num_blocks] = *block;
+            if (slot == hotblocks->current) {
+                gathered[num_blocks].instructions += (hart->debug.block_next -
+                        block->leader) / sizeof(uint32_t);
+            }
+            num_blocks += 1;
+        }
+    }
+
+    // Combine the blocks with the same leader
+    qsort(gathered, num_blocks, sizeof(gathered[0]), compare_leaders);
+    int num_combined = 0;
+    for (int i = 0; i < num_blocks; i++)
+    {
+        if (num_combined == 0 ||
+                gathered[num_combined - 1].leader != gathered[i].leader) {
+            gathered[num_combined] = gathered[i];
+            num_combined += 1;
+            continue;
+        }
+
+        hot_block_t *combined = &gathered[num_combined - 1];
+        combined->executions += gathered[i].executions;
+        combined->instructions += gathered[i].instructions;
+        combined->back_edges += gathered[i].back_edges;
+    }
+
+    *blocks = gathered;
+    return num_combined;
+}
+
+/**
+ * Finds the loops formed by the blocks' backward branches, which are sorted by
+ * leader. The body of a loop is taken to be the blocks from its head up to the
+ * backward branch. Returns the number of loops, or a negative error code on
+ * failure.
+ **/
+static int find_loops(const hot_block_t *blocks, int num_blocks,
+        hot_loop_t **loops)
+{
+    hot_loop_t *found = malloc((num_blocks + 1) * sizeof(found[0]));
+    if (found == NULL) {
+        return -ENOMEM;
+    }
+
+    int num_loops = 0;
+    for (int i = 0; i < num_blocks; i++)
+    {
+        if (blocks[i].back_edges == 0) {
+            continue;
+        }
+
+        // The blocks of the body are just before the one with the branch
+        hot_loop_t *loop = &found[num_loops];
+        loop->head = blocks[i].loop_head;
+        loop->tail = blocks[i].last_pc;
+        loop->iterations = blocks[i].back_edges;
+        loop->instructions = 0;
+        for (int j = i; j >= 0 && blocks[j].leader >= loop->head; j--)
+        {
+            loop->instructions += blocks[j].instructions;
+        }
+        num_loops += 1;
+    }
+
+    *loops = found;
+    return num_loops;
+}
+
+/**
+ * Prints the symbol that contains the address, and the address's offset from
+ * it, if there is such a symbol.
+ **/
+static void print_symbol(FILE *file, const cpu_state_t *cpu_state,
+        uint32_t addr)
+{
+    const symbol_t *symbol = elf_find_symbol(cpu_state, addr);
+    if (symbol == NULL) {
+        return;
+    } else if (addr == symbol->addr) {
+        fprintf(file, " <%s>", symbol->name);
+    } else {
+        fprintf(file, " <%s+0x%x>", symbol->name, addr - symbol->addr);
+    }
+    return;
+}
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Starts counting the basic blocks on every hart. The counts collected so far
+ * are kept, unless there are none yet. Returns 0 on success, or a negative
+ * error code on failure.
+ **/
+int hotblocks_start(machine_t *machine)
+{
+    for (int i = 0; i < machine->num_harts; i++)
+    {
+        // The harts ran while stopped, so they start again outside of a block
+        cpu_state_t *hart = &machine->harts[i];
+        hart->debug.block_next = HOTBLOCKS_NO_BLOCK;
+        if (hart->debug.hotblocks != NULL) {
+            hart->debug.hotblocks->current = HOTBLOCKS_NO_CURRENT;
+            continue;
+        }
+
+        hotblocks_t *hotblocks = calloc(1, sizeof(*hotblocks));
+        hot_block_t *blocks = (hotblocks == NULL) ? NULL :
+                calloc(HOTBLOCKS_INITIAL_SLOTS, sizeof(blocks[0]));
+        if (blocks == NULL) {
+            fprintf(stderr, "Error: Unable to allocate the block counts.\n");
+            free(hotblocks);
+            hotblocks_free(machine);
+            return -ENOMEM;
+        }
+
+        hotblocks->num_slots = HOTBLOCKS_INITIAL_SLOTS;
+        hotblocks->current = HOTBLOCKS_NO_CURRENT;
+        hotblocks->blocks = blocks;
+        hart->debug.hotblocks = hotblocks;
+    }
+
+    HOTBLOCKS_ACTIVE = true;
+    return 0;
+}
+
+/**
+ * Stops counting the basic blocks, keeping the counts collected so far.
+ **/
+void hotblocks_stop(machine_t *machine)
+{
+    // Add up the instructions run so far in the block each hart is in
+    for (int i = 0; i < machine->num_harts && HOTBLOCKS_ACTIVE; i++)
+    {
+        cpu_state_t *hart = &machine->harts[i];
+        hotblocks_t *hotblocks = hart->debug.hotblocks;
+        if (hotblocks->current != HOTBLOCKS_NO_CURRENT) {
+            hot_block_t *block = &hotblocks->blocks[hotblocks->current];
+            block->instructions += (hart->debug.block_next - block->leader) /
+                    sizeof(uint32_t);
+            hotblocks->current = HOTBLOCKS_NO_CURRENT;
+        }
+    }
+
+    HOTBLOCKS_ACTIVE = false;
+    return;
+}
+
+/**
+ * Discards the counts of all the harts, and stops counting.
+ **/
+void hotblocks_free(machine_t *machine)
+{
+    HOTBLOCKS_ACTIVE = false;
+    for (int i = 0; i < machine->num_harts; i++)
+    {
+        cpu_state_t *hart = &machine->harts[i];
+        destroy_table(hart->debug.hotblocks);
+        hart->debug.hotblocks = NULL;
+    }
+    return;
+}
+
+/**
+ * Enters the basic block at the hart's PC, finishing the block it was in. This
+ * is invoked by the engine when the PC doesn't continue the current block.
+ **/
+void hotblocks_enter(cpu_state_t *cpu_state)
+{
+    debug_state_t *debug = &cpu_state->debug;
+    hotblocks_t *hotblocks = debug->hotblocks;
+    uint32_t pc = cpu_state->pc;
+
+    /* Add up the instructions run in the current block, which was left just
+     * before the PC it would have continued at. A loop went around if the
+     * block's last instruction ran, and branched back to the loop's head. */
+    if (hotblocks->current != HOTBLOCKS_NO_CURRENT) {
+        hot_block_t *block = &hotblocks->blocks[hotblocks->current];
+        block->instructions += (debug->block_next - block->leader) /
+                sizeof(uint32_t);
+        if (block->can_loop && pc == block->loop_head &&
+                debug->block_next == block->last_pc + sizeof(uint32_t)) {
+            block->back_edges += 1;
+        }
+    }
+
+    // If the table can't hold the block, it isn't counted
+    hot_block_t *block = find_block(cpu_state, hotblocks, pc);
+    if (block == NULL) {
+        hotblocks->current = HOTBLOCKS_NO_CURRENT;
+        debug->block_last = pc;
+        return;
+    }
+
+    block->executions += 1;
+    hotblocks->current = block - hotblocks->blocks;
+    debug->block_last = block->last_pc;
+    return;
+}
+
+/**
+ * Prints the given number of blocks and loops that ran the most instructions,
+ * with the instructions in each block.
+ **/
+void hotblocks_print(const machine_t *machine, int num_top, FILE *file)
+{
+    const cpu_state_t *cpu_state = &machine->harts[0];
+    if (cpu_state->debug.hotblocks == NULL) {
+        fprintf(stderr, "Error: The block counts have not been started.\n");
+        return;
+    }
+
+    hot_block_t *blocks;
+    hot_loop_t *loops = NULL;
+    int num_blocks = gather_blocks(machine, &blocks);
+    int num_loops = (num_blocks < 0) ? num_blocks :
+            find_loops(blocks, num_blocks, &loops);
+    if (num_loops < 0) {
+        fprintf(stderr, "Error: Unable to allocate memory for the report.\n");
+        free((num_blocks < 0) ? NULL : blocks);
+        return;
+    }
+
+    uint64_t total = 0;
+    for (int i = 0; i < num_blocks; i++)
+    {
+        total += blocks[i].instructions;
+    }
+    qsort(blocks, num_blocks, sizeof(blocks[0]), compare_block_instructions);
+    qsort(loops, num_loops, sizeof(loops[0]), compare_loop_instructions);
+
+    fprintf(file, "Hot blocks (%s): %d blocks, %d loops, %" PRIu64 " "
+            "instructions\n", HOTBLOCKS_ACTIVE ? "active" : "stopped",
+            num_blocks, num_loops, total);
+
+    // Show the hottest blocks, along with the instructions in them
+    fprintf(file, "  Hottest blocks:\n");
+    fprintf(file, "    %-10s %-8s %-14s %-16s %s\n", "Block", "Length",
+            "Executions", "Instructions", "Share");
+    for (int i = 0; i < num_blocks && i < num_top; i++)
+    {
+        const hot_block_t *block = &blocks[i];
+        uint32_t length = (block->last_pc - block->leader) / sizeof(uint32_t) +
+                1;
+        fprintf(file, "    0x%08x %-8" PRIu32 " %-14" PRIu64 " %-16" PRIu64
+                " %6.2f%%", block->leader, length, block->executions,
+                block->instructions, 100.0 * block->instructions / total);
+        print_symbol(file, cpu_state, block->leader);
+        fprintf(file, "\n");
+
+        for (uint32_t pc = block->leader; pc <= block->last_pc;
+                pc += sizeof(uint32_t))
+        {
+            uint32_t instr;
+            if (mem_peek32(cpu_state, pc, &instr)) {
+                fprintf(file, "      0x%08x: 0x%08x  %s\n", pc, instr,
+                        disasm_instruction(pc, instr));
+            }
+        }
+    }
+
+    // Show the hottest loops
+    fprintf(file, "  Hottest loops:\n");
+    fprintf(file, "    %-10s %-10s %-14s %-16s %s\n", "Head", "Back Edge",
+            "Iterations", "Instructions", "Share");
+    for (int i = 0; i < num_loops && i < num_top; i++)
+    {
+        const hot_loop_t *loop = &loops[i];
+        fprintf(file, "    0x%08x 0x%08x %-14" PRIu64 " %-16" PRIu64
+                " %6.2f%%", loop->head, loop->tail, loop->iterations,
+                loop->instructions, 100.0 * loop->instructions / total);
+        print_symbol(file, cpu_state, loop->head);
+        fprintf(file, "\n");
+    }
+
+    free(blocks);
+    free(loops);
+    return;
+}
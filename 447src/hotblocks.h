@@ -0,0 +1,90 @@
+/**
+ * hotblocks.h
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the interface to the hot block report, which counts the
+ * executions of each basic block of the program, and finds the loops that they
+ * form, to show where the program spends its instructions.
+ *
+ * A basic block starts at the target of a control transfer, and runs through
+ * the next branch, jump, or system instruction. The engine only calls into the
+ * report when the hart enters a block, so the cost of collecting is one lookup
+ * and counter increment per block, rather than per instruction. A loop is
+ * found from each backward branch or jump that is taken, and its body is taken
+ * to be the blocks from its head up to the branch.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+#ifndef HOTBLOCKS_H_
+#define HOTBLOCKS_H_
+
+// Standard Includes
+#include <stdbool.h>            // Boolean type and definitions
+#include <stdint.h>             // Fixed-size integral types
+#include <stdio.h>              // Definition of the FILE type
+
+// 18-447 Simulator Includes
+#include <sim.h>                // Definition of cpu_state_t
+
+// Local Includes
+#include "machine.h"            // Definition of the machine
+
+/*----------------------------------------------------------------------------
+ * Definitions
+ *----------------------------------------------------------------------------*/
+
+// The default number of blocks and loops shown in the report
+#define HOTBLOCKS_DEFAULT_TOP   10
+
+/* The PC that a hart continues its block at when it isn't in a block. This is
+ * misaligned, so no instruction can continue it. */
+#define HOTBLOCKS_NO_BLOCK      1
+
+// Indicates if the basic blocks are being counted
+extern bool HOTBLOCKS_ACTIVE;
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Starts counting the basic blocks on every hart. The counts collected so far
+ * are kept, unless there are none yet. Returns 0 on success, or a negative
+ * error code on failure.
+ **/
+int hotblocks_start(machine_t *machine);
+
+/**
+ * Stops counting the basic blocks, keeping the counts collected so far.
+ **/
+void hotblocks_stop(machine_t *machine);
+
+/**
+ * Discards the counts of all the harts, and stops counting.
+ **/
+void hotblocks_free(machine_t *machine);
+
+/**
+ * Enters the basic block at the hart's PC, finishing the block it was in. This
+ * is invoked by the engine when the PC doesn't continue the current block.
+ **/
+void hotblocks_enter(cpu_state_t *cpu_state);
+
+/**
+ * Prints the given number of blocks and loops that ran the most instructions,
+ * with the instructions in each block.
+ **/
+void hotblocks_print(const machine_t *machine, int num_top, FILE *file);
+
+#endif /* HOTBLOCKS_H_ */
@@ -0,0 +1,241 @@
+/**
+ * huge_pages.c
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the huge page allocator, which backs large memory segments
+ * with host memory that can use transparent huge pages.
+ *
+ * A huge page aligned mapping is made by mapping one huge page more than is
+ * needed, and unmapping the parts before and after the aligned range. The
+ * coverage report reads the host's mappings of the process (/proc/self/smaps),
+ * which give the amount of each mapping backed by huge pages, and whether it
+ * was advised to use them.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+// Standard Includes
+#include <stdlib.h>                 // Calloc function
+#include <stdio.h>                  // Printf and related functions
+#include <stdint.h>                 // Fixed-size integral types
+#include <stdbool.h>                // Definition of the boolean type
+#include <inttypes.h>               // Format specifiers for fixed-size types
+
+// Standard Includes
+#include <errno.h>                  // Error codes
+#include <string.h>                 // String manipulation functions
+#include <sys/mman.h>               // Mmap, munmap, and madvise functions
+
+// 18-447 Simulator Includes
+#include <sim.h>                    // Definition of cpu_state_t
+#include <memory.h>                 // Definition of mem_segment_t
+
+// Local Includes
+#include "huge_pages.h"             // This file's interface
+
+/*----------------------------------------------------------------------------
+ * Internal Definitions
+ *----------------------------------------------------------------------------*/
+
+// The host's transparent huge page mode, and its mappings of the process
+#define THP_MODE_PATH           "/sys/kernel/mm/transparent_hugepage/enabled"
+#define SMAPS_PATH              "/proc/self/smaps"
+
+// The maximum length of a line of the files read from the host
+#define LINE_MAX_LEN            512
+
+/* The error from the last attempt to advise the host to use huge pages, or 0
+ * if it succeeded. */
+static int ADVISE_ERROR         = 0;
+
+/*----------------------------------------------------------------------------
+ * Helper Functions
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Maps zero-filled memory of the given size, which is a multiple of the huge
+ * page size, on a huge page boundary, and advises the host to back it with huge
+ * pages. Returns NULL if the memory can't be mapped.
+ **/
+static uint8_t *map_huge(size_t size)
+{
+    // Map an extra huge page, so an aligned range of the size lies within it
+    size_t padded_size = size + HUGE_PAGE_SIZE;
+    uint8_t *mem = mmap(NULL, padded_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem == MAP_FAILED) {
+        return NULL;
+    }
+
+    // Unmap the parts before and after the aligned range
+    uintptr_t start = (uintptr_t)mem;
+    uintptr_t aligned = (start + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    size_t head_size = aligned - start;
+    if (head_size != 0) {
+        munmap(mem, head_size);
+    }
+    munmap((uint8_t *)aligned + size, padded_size - head_size - size);
+
+    /* The memory still works without huge pages, so a host without them only
+     * loses the benefit. The error is kept for the report. */
+    int rc = madvise((void *)aligned, size, MADV_HUGEPAGE);
+    __atomic_store_n(&ADVISE_ERROR, (rc < 0) ? errno : 0, __ATOMIC_RELAXED);
+    return (uint8_t *)aligned;
+}
+
+/**
+ * Prints the host's transparent huge page mode, which is the bracketed word in
+ * its settings file, or 'unavailable' if the host has no such file.
+ **/
+static void print_thp_mode(FILE *file)
+{
+    char line[LINE_MAX_LEN] = "";
+    FILE *mode_file = fopen(THP_MODE_PATH, "r");
+    if (mode_file != NULL) {
+        if (fgets(line, sizeof(line), mode_file) == NULL) {
+            line[0] = '\0';
+        }
+        fclose(mode_file);
+    }
+
+    char *start = strchr(line, '[');
+    char *end = (start == NULL) ? NULL : strchr(start, ']');
+    if (end != NULL) {
+        *end = '\0';
+        fprintf(file, "Transparent huge pages: %s.\n", start + 1);
+    } else {
+        fprintf(file, "Transparent huge pages: unavailable.\n");
+    }
+
+    int advise_error = __atomic_load_n(&ADVISE_ERROR, __ATOMIC_RELAXED);
+    if (advise_error != 0) {
+        fprintf(file, "Advising huge pages failed: %s.\n",
+                strerror(advise_error));
+    }
+    return;
+}
+
+/**
+ * Finds the number of bytes of the segment that are backed by huge pages, and
+ * if any of its memory was advised to use them, from the host's mappings of
+ * the process. A mapping that was merged with a neighbouring one is counted in
+ * proportion to the part of it that the segment covers. Returns a negative
+ * error code if the mappings can't be read.
+ **/
+static int segment_coverage(FILE *smaps, const mem_segment_t *segment,
+        uint64_t *huge_bytes, bool *advised)
+{
+    uintptr_t segment_start = (uintptr_t)segment->mem;
+    uintptr_t segment_end = segment_start + segment->size;
+    *huge_bytes = 0;
+    *advised = false;
+
+    // Each mapping has a header line, its fields, and lastly its flags
+    rewind(smaps);
+    char line[LINE_MAX_LEN];
+    uintptr_t start = 0, end = 0;
+    uint64_t anon_huge_kib = 0;
+    while (fgets(line, sizeof(line), smaps) != NULL)
+    {
+        unsigned long map_start, map_end, kib;
+        if (sscanf(line, "%lx-%lx ", &map_start, &map_end) == 2) {
+            start = map_start;
+            end = map_end;
+            anon_huge_kib = 0;
+        } else if (sscanf(line, "AnonHugePages: %lu kB", &kib) == 1) {
+            anon_huge_kib = kib;
+        } else if (strncmp(line, "VmFlags:", strlen("VmFlags:")) == 0 &&
+                start < segment_end && segment_start < end) {
+            uintptr_t overlap = ((end < segment_end) ? end : segment_end) -
+                    ((start > segment_start) ? start : segment_start);
+            *huge_bytes += anon_huge_kib * 1024 * overlap / (end - start);
+            *advised |= (strstr(line, " hg") != NULL);
+        }
+    }
+
+    return ferror(smaps) ? -EIO : 0;
+}
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Allocates zero-filled memory for a segment of the given size. Segments of at
+ * least one huge page are mapped on a huge page boundary, advised to use huge
+ * pages, and the mapped size is set to the size of the mapping. Otherwise, the
+ * memory is allocated with calloc, and the mapped size is set to 0. Returns
+ * NULL if the memory can't be allocated.
+ **/
+uint8_t *huge_pages_alloc(size_t size, uint32_t *mapped_size)
+{
+    // The mapped size must fit in the segment, or the segment is too small
+    size_t huge_size = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    *mapped_size = 0;
+    if (size >= HUGE_PAGE_SIZE && huge_size <= UINT32_MAX) {
+        uint8_t *mem = map_huge(huge_size);
+        if (mem != NULL) {
+            *mapped_size = huge_size;
+            return mem;
+        }
+    }
+
+    // Fall back to ordinary memory, which must not be empty
+    return calloc((size == 0) ? 1 : size, sizeof(uint8_t));
+}
+
+/**
+ * Prints the host's transparent huge page mode, and how much of each of the
+ * processor's segments is backed by huge pages.
+ **/
+void huge_pages_print(const cpu_state_t *cpu_state, FILE *file)
+{
+    print_thp_mode(file);
+    FILE *smaps = fopen(SMAPS_PATH, "r");
+    if (smaps == NULL) {
+        fprintf(stderr, "Error: %s: Unable to open file: %s.\n", SMAPS_PATH,
+                strerror(errno));
+        return;
+    }
+
+    uint64_t total_size = 0, total_huge = 0;
+    fprintf(file, "%-16s %-12s %-8s %-12s %s\n", "Segment", "Size", "Advised",
+            "Huge", "Coverage");
+    for (int i = 0; i < cpu_state->memory.num_segments; i++)
+    {
+        const mem_segment_t *segment = &cpu_state->memory.segments[i];
+        if (segment->mem == NULL || segment->size == 0) {
+            continue;
+        }
+
+        uint64_t huge_bytes;
+        bool advised;
+        if (segment_coverage(smaps, segment, &huge_bytes, &advised) < 0) {
+            fprintf(stderr, "Error: %s: Unable to read the host's mappings.\n",
+                    SMAPS_PATH);
+            break;
+        }
+
+        fprintf(file, "%-16s 0x%08x   %-8s 0x%08" PRIx64 "   %5.1f%%\n",
+                segment->name, segment->size, advised ? "yes" : "no",
+                huge_bytes, 100.0 * huge_bytes / segment->size);
+        total_size += segment->size;
+        total_huge += huge_bytes;
+    }
+
+    fprintf(file, "Total: %" PRIu64 " KiB of %" PRIu64 " KiB backed by huge "
+            "pages (%.1f%%).\n", total_huge / 1024, total_size / 1024,
+            (total_size == 0) ? 0.0 : 100.0 * total_huge / total_size);
+    fclose(smaps);
+    return;
+}
@@ -0,0 +1,66 @@
+/**
+ * huge_pages.h
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the interface to the huge page allocator, which backs
+ * large memory segments with host memory that can use transparent huge pages.
+ *
+ * Segments of at least one huge page are mapped on a huge page boundary, and
+ * the host is advised to back them with huge pages (MADV_HUGEPAGE), so that
+ * programs that touch memory all over a large segment take fewer host TLB
+ * misses. If the host has no transparent huge pages, or the mapping fails, the
+ * segment falls back to ordinary memory. Smaller segments are always ordinary
+ * memory, since they can't fill a huge page.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+#ifndef HUGE_PAGES_H_
+#define HUGE_PAGES_H_
+
+// Standard Includes
+#include <stddef.h>             // Definition of size_t
+#include <stdint.h>             // Fixed-size integral types
+#include <stdio.h>              // Definition of the FILE type
+
+// 18-447 Simulator Includes
+#include <sim.h>                // Definition of cpu_state_t
+
+/*----------------------------------------------------------------------------
+ * Definitions
+ *----------------------------------------------------------------------------*/
+
+// The base-2 logarithm of the size of a host huge page (2 MiB)
+#define HUGE_PAGE_SHIFT         21
+#define HUGE_PAGE_SIZE          ((size_t)1 << HUGE_PAGE_SHIFT)
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Allocates zero-filled memory for a segment of the given size. Segments of at
+ * least one huge page are mapped on a huge page boundary, advised to use huge
+ * pages, and the mapped size is set to the size of the mapping. Otherwise, the
+ * memory is allocated with calloc, and the mapped size is set to 0. Returns
+ * NULL if the memory can't be allocated.
+ **/
+uint8_t *huge_pages_alloc(size_t size, uint32_t *mapped_size);
+
+/**
+ * Prints the host's transparent huge page mode, and how much of each of the
+ * processor's segments is backed by huge pages.
+ **/
+void huge_pages_print(const cpu_state_t *cpu_state, FILE *file);
+
+#endif /* HUGE_PAGES_H_ */
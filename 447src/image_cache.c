@@ -0,0 +1,579 @@
+/**
+ * image_cache.c
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the program image cache, which keeps the pristine contents
+ * of each loaded program, so that reloading or restarting a program does not
+ * read and validate its files again.
+ *
+ * The contents of an image's segments are stored in an anonymous in-memory file
+ * (memfd), each segment starting on a page boundary. Pages that are entirely
+ * zero, such as the .bss, are never written, so the file stays sparse. Every
+ * load of the program maps the segments privately from the file, except for
+ * segments of at least one huge page. A private file mapping can't be backed
+ * by huge pages, so these are copied into huge page memory instead, skipping
+ * the holes in the file.
+ *
+ * Images are reference counted. The cache holds one reference to each image in
+ * it, and each load holds another, so an image that is evicted or replaced
+ * while it is loaded stays alive until it is unloaded.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+// Needed for the memfd_create function
+#define _GNU_SOURCE
+
+// Standard Includes
+#include <stdlib.h>                 // Malloc and free functions
+#include <stdio.h>                  // Printf and related functions
+#include <stdbool.h>                // Definition of the boolean type
+#include <stdint.h>                 // Fixed-size integral types
+
+// Standard Includes
+#include <errno.h>                  // Error codes
+#include <string.h>                 // String manipulation functions
+#include <unistd.h>                 // Pwrite, ftruncate, and close functions
+#include <pthread.h>                // Mutex for the cache
+#include <sys/mman.h>               // Mmap and memfd_create functions
+#include <sys/stat.h>               // Stat function
+
+// 18-447 Simulator Includes
+#include <sim.h>                    // Definition of cpu_state_t
+#include <memory.h>                 // Definition of mem_segment_t
+
+// Local Includes
+#include "memory_shell.h"           // Reading a program from its files
+#include "elf_loader.h"             // Program symbol tables
+#include "huge_pages.h"             // Huge page backing for large segments
+#include "image_cache.h"            // This file's interface
+
+/*----------------------------------------------------------------------------
+ * Internal Definitions
+ *----------------------------------------------------------------------------*/
+
+// The identity of a file that a program was read from
+typedef struct file_id {
+    bool exists;                // Indicates if the file exists
+    dev_t device;               // Device the file is on
+    ino_t inode;                // Inode number of the file
+    off_t size;                 // Size of the file in bytes
+    struct timespec mtime;      // Last time the file was modified
+} file_id_t;
+
+// The location of a segment's contents in the image's file
+typedef struct image_segment {
+    uint32_t size;              // Size of the segment in bytes
+    off_t offset;               // Offset of its contents in the file
+} image_segment_t;
+
+// The pristine contents of a program, shared by every load of it
+struct program_image {
+    char *path;                 // Path of the program, without an extension
+    int num_files;              // Number of files the program was read from
+    file_id_t *files;           // Identities of the files
+    int fd;                     // In-memory file holding the contents
+    int num_segments;           // Number of memory segments
+    image_segment_t *segments;  // Contents of each memory segment
+    uint32_t entry;             // Entry point of the program
+    struct symbol_table *symbols;   // Symbol table of the program, if any
+    int references;             // Number of references held to the image
+    uint64_t last_used;         // Time the image was last acquired
+    struct program_image *next; // Next image in the cache
+};
+
+// The lock for the cache, which protects all of the variables below
+static pthread_mutex_t CACHE_LOCK = PTHREAD_MUTEX_INITIALIZER;
+
+// The images in the cache, and the number of them
+static program_image_t *CACHE_IMAGES = NULL;
+static int CACHE_NUM_IMAGES = 0;
+
+// A counter that orders the acquisitions of the images
+static uint64_t CACHE_CLOCK = 0;
+
+/*----------------------------------------------------------------------------
+ * Helper Functions
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Rounds the size up to a whole number of host pages.
+ **/
+static size_t round_to_pages(size_t size)
+{
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    return (size + page_size - 1) & ~(page_size - 1);
+}
+
+/**
+ * Finds the identity of the file at the program's path with the extension. The
+ * file is marked as missing if it can't be found.
+ **/
+static void identify_file(const char *program_path, const char *extension,
+        file_id_t *file)
+{
+    char path[strlen(program_path) + strlen(extension) + 1];
+    strcpy(path, program_path);
+    strcat(path, extension);
+
+    struct stat file_stat;
+    *file = (file_id_t){ .exists = (stat(path, &file_stat) == 0) };
+    if (file->exists) {
+        file->device = file_stat.st_dev;
+        file->inode = file_stat.st_ino;
+        file->size = file_stat.st_size;
+        file->mtime = file_stat.st_mtim;
+    }
+    return;
+}
+
+/**
+ * Finds the identities of the files that the program is read from. This is
+ * either its ELF executable, or the data file of each segment that has one.
+ * The files array must have room for one file per memory segment. Returns the
+ * number of files.
+ **/
+static int identify_files(const memory_t *memory, const char *program_path,
+        file_id_t *files)
+{
+    identify_file(program_path, ELF_EXTENSION, &files[0]);
+    if (files[0].exists) {
+        return 1;
+    }
+
+    int num_files = 0;
+    for (int i = 0; i < memory->num_segments; i++)
+    {
+        const char *extension = memory->segments[i].extension;
+        if (extension != NULL) {
+            identify_file(program_path, extension, &files[num_files]);
+            num_files += 1;
+        }
+    }
+    return num_files;
+}
+
+/**
+ * Indicates if the image was read from the same files as the ones given.
+ **/
+static bool same_files(const program_image_t *image, const file_id_t *files,
+        int num_files)
+{
+    if (image->num_files != num_files) {
+        return false;
+    }
+
+    for (int i = 0; i < num_files; i++)
+    {
+        const file_id_t *file1 = &image->files[i];
+        const file_id_t *file2 = &files[i];
+        if (file1->exists != file2->exists || file1->device != file2->device ||
+                file1->inode != file2->inode || file1->size != file2->size ||
+                file1->mtime.tv_sec != file2->mtime.tv_sec ||
+                file1->mtime.tv_nsec != file2->mtime.tv_nsec) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Indicates if all size bytes in the buffer are zero.
+ **/
+static bool is_zero(const uint8_t *buffer, size_t size)
+{
+    return size == 0 || (buffer[0] == 0 &&
+            memcmp(buffer, &buffer[1], size - 1) == 0);
+}
+
+/**
+ * Writes the buffer to the file at the offset, skipping the pages that are
+ * entirely zero, which the file already reads as zero.
+ **/
+static int write_pages(int fd, const uint8_t *buffer, size_t size,
+        off_t offset)
+{
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    for (size_t page = 0; page < size; page += page_size)
+    {
+        size_t page_bytes = (size - page < page_size) ? size - page : page_size;
+        if (is_zero(&buffer[page], page_bytes)) {
+            continue;
+        }
+
+        for (size_t written = 0; written < page_bytes; )
+        {
+            ssize_t rc = pwrite(fd, &buffer[page + written],
+                    page_bytes - written, offset + page + written);
+            if (rc < 0 && errno != EINTR) {
+                return -errno;
+            } else if (rc > 0) {
+                written += rc;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * Frees the image, along with its file and symbol table.
+ **/
+static void free_image(program_image_t *image)
+{
+    if (image->fd >= 0) {
+        close(image->fd);
+    }
+    elf_free_symbols(image->symbols);
+    free(image->segments);
+    free(image->files);
+    free(image->path);
+    free(image);
+    return;
+}
+
+/**
+ * Drops a reference to the image, freeing it once there are none left. The
+ * cache lock must be held.
+ **/
+static void put_image(program_image_t *image)
+{
+    image->references -= 1;
+    if (image->references == 0) {
+        free_image(image);
+    }
+    return;
+}
+
+/**
+ * Removes the image from the cache, dropping the cache's reference to it. The
+ * cache lock must be held.
+ **/
+static void remove_image(program_image_t *image)
+{
+    for (program_image_t **link = &CACHE_IMAGES; *link != NULL;
+            link = &(*link)->next)
+    {
+        if (*link == image) {
+            *link = image->next;
+            CACHE_NUM_IMAGES -= 1;
+            put_image(image);
+            return;
+        }
+    }
+    return;
+}
+
+/**
+ * Evicts the least recently used image that isn't loaded anywhere, if the
+ * cache is full. The cache lock must be held.
+ **/
+static void evict_image(void)
+{
+    if (CACHE_NUM_IMAGES < IMAGE_CACHE_MAX_IMAGES) {
+        return;
+    }
+
+    program_image_t *victim = NULL;
+    for (program_image_t *image = CACHE_IMAGES; image != NULL;
+            image = image->next)
+    {
+        if (image->references == 1 && (victim == NULL ||
+                    image->last_used < victim->last_used)) {
+            victim = image;
+        }
+    }
+
+    if (victim != NULL) {
+        remove_image(victim);
+    }
+    return;
+}
+
+/**
+ * Stores the contents of each of the segments in the image's file.
+ **/
+static int store_segments(program_image_t *image, const mem_segment_t *segments)
+{
+    // Lay out the segments on page boundaries, and size the file to hold them
+    off_t offset = 0;
+    for (int i = 0; i < image->num_segments; i++)
+    {
+        image->segments[i].size = segments[i].size;
+        image->segments[i].offset = offset;
+        offset += round_to_pages(segments[i].size);
+    }
+
+    image->fd = memfd_create("riscv-sim-image", MFD_CLOEXEC);
+    if (image->fd < 0 || ftruncate(image->fd, offset) < 0) {
+        int rc = -errno;
+        fprintf(stderr, "Error: %s: Unable to create the program image: %s.\n",
+                image->path, strerror(errno));
+        return rc;
+    }
+
+    for (int i = 0; i < image->num_segments; i++)
+    {
+        if (segments[i].mem == NULL) {
+            continue;
+        }
+
+        int rc = write_pages(image->fd, segments[i].mem, segments[i].size,
+                image->segments[i].offset);
+        if (rc < 0) {
+            fprintf(stderr, "Error: %s: Unable to write the program image: "
+                    "%s.\n", image->path, strerror(-rc));
+            return rc;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Reads the program from its files, and creates a new image from it. The
+ * program is read into a scratch copy of the CPU's memory segments.
+ **/
+static int create_image(const cpu_state_t *cpu_state, const char *program_path,
+        const file_id_t *files, int num_files, program_image_t **new_image)
+{
+    int num_segments = cpu_state->memory.num_segments;
+    mem_segment_t segments[num_segments];
+    for (int i = 0; i < num_segments; i++)
+    {
+        segments[i] = cpu_state->memory.segments[i];
+        segments[i].mem = NULL;
+        segments[i].size = 0;
+        segments[i].mapped_size = 0;
+        segments[i].shared = NULL;
+        segments[i].page_writes = NULL;
+    }
+
+    cpu_state_t scratch = {
+        .memory = {
+            .num_segments = num_segments,
+            .segments = segments,
+        },
+    };
+    uint32_t entry;
+    int rc = mem_read_program(&scratch, program_path, &entry);
+    if (rc < 0) {
+        return rc;
+    }
+
+    // Allocate the image, taking ownership of the symbol table
+    program_image_t *image = calloc(1, sizeof(*image));
+    if (image == NULL) {
+        mem_unload_program(&scratch);
+        return -ENOMEM;
+    }
+    image->fd = -1;
+    image->symbols = scratch.memory.symbols;
+    scratch.memory.symbols = NULL;
+    image->path = strdup(program_path);
+    image->files = malloc(num_files * sizeof(image->files[0]));
+    image->segments = malloc(num_segments * sizeof(image->segments[0]));
+    if (image->path == NULL || image->files == NULL ||
+            image->segments == NULL) {
+        fprintf(stderr, "Error: Unable to allocate the program image.\n");
+        mem_unload_program(&scratch);
+        free_image(image);
+        return -ENOMEM;
+    }
+
+    memcpy(image->files, files, num_files * sizeof(files[0]));
+    image->num_files = num_files;
+    image->num_segments = num_segments;
+    image->entry = entry;
+
+    // Copy the segments into the image, and free the scratch copy
+    rc = store_segments(image, segments);
+    mem_unload_program(&scratch);
+    if (rc < 0) {
+        free_image(image);
+        return rc;
+    }
+
+    *new_image = image;
+    return 0;
+}
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Acquires the image of the program at the given path (without an extension),
+ * whose segments are laid out like the CPU's memory segments. The program is
+ * read from its files only if it isn't cached, or its files have changed.
+ *
+ * The image must be released with image_cache_release. Returns 0 on success,
+ * or a negative error code on failure.
+ **/
+int image_cache_acquire(const cpu_state_t *cpu_state, const char *program_path,
+        program_image_t **image)
+{
+    file_id_t files[cpu_state->memory.num_segments];
+    int num_files = identify_files(&cpu_state->memory, program_path, files);
+
+    pthread_mutex_lock(&CACHE_LOCK);
+    CACHE_CLOCK += 1;
+
+    // Use the cached image if its files haven't changed, otherwise drop it
+    for (program_image_t *cached = CACHE_IMAGES; cached != NULL;
+            cached = cached->next)
+    {
+        if (strcmp(cached->path, program_path) != 0) {
+            continue;
+        } else if (same_files(cached, files, num_files)) {
+            cached->references += 1;
+            cached->last_used = CACHE_CLOCK;
+            *image = cached;
+            pthread_mutex_unlock(&CACHE_LOCK);
+            return 0;
+        }
+
+        remove_image(cached);
+        break;
+    }
+
+    // Otherwise, read the program, and add its image to the cache
+    program_image_t *new_image;
+    int rc = create_image(cpu_state, program_path, files, num_files,
+            &new_image);
+    if (rc == 0) {
+        evict_image();
+        new_image->references = 2;
+        new_image->last_used = CACHE_CLOCK;
+        new_image->next = CACHE_IMAGES;
+        CACHE_IMAGES = new_image;
+        CACHE_NUM_IMAGES += 1;
+        *image = new_image;
+    }
+
+    pthread_mutex_unlock(&CACHE_LOCK);
+    return rc;
+}
+
+/**
+ * Releases an image acquired with image_cache_acquire.
+ **/
+void image_cache_release(program_image_t *image)
+{
+    pthread_mutex_lock(&CACHE_LOCK);
+    put_image(image);
+    pthread_mutex_unlock(&CACHE_LOCK);
+    return;
+}
+
+/**
+ * Copies the contents of the image segment into the zero-filled memory. Only
+ * the parts of the file holding data are read, so the pages of the holes are
+ * never touched. Returns 0 on success, or a negative error code on failure.
+ **/
+static int copy_segment(const program_image_t *image,
+        const image_segment_t *image_segment, uint8_t *mem)
+{
+    off_t start = image_segment->offset;
+    off_t end = start + image_segment->size;
+    while (start < end)
+    {
+        // If the host can't find the holes, the whole segment is read
+        off_t data_start = lseek(image->fd, start, SEEK_DATA);
+        off_t data_end = (data_start < 0) ? end : lseek(image->fd,
+                data_start, SEEK_HOLE);
+        if (data_start < 0 && errno == ENXIO) {
+            return 0;
+        } else if (data_start < 0 || data_end < 0) {
+            data_start = start;
+            data_end = end;
+        } else if (data_start >= end) {
+            return 0;
+        }
+
+        // Read the data up to the next hole, or the end of the segment
+        data_end = (data_end < end) ? data_end : end;
+        while (data_start < data_end)
+        {
+            ssize_t bytes = pread(image->fd, &mem[data_start -
+                    image_segment->offset], data_end - data_start, data_start);
+            if (bytes <= 0) {
+                return (bytes < 0) ? -errno : -EIO;
+            }
+            data_start += bytes;
+        }
+        start = data_end;
+    }
+
+    return 0;
+}
+
+/**
+ * Maps the contents of the segment with the given index from the image into
+ * the segment, privately, so that writes to it are not seen by other loads.
+ * Segments of at least one huge page are copied into huge page memory instead.
+ * Returns 0 on success, or a negative error code on failure.
+ **/
+int image_map_segment(const program_image_t *image, int index,
+        mem_segment_t *segment)
+{
+    const image_segment_t *image_segment = &image->segments[index];
+    segment->size = image_segment->size;
+    if (image_segment->size == 0) {
+        return 0;
+    }
+
+    if (image_segment->size >= HUGE_PAGE_SIZE) {
+        segment->mem = huge_pages_alloc(image_segment->size,
+                &segment->mapped_size);
+        int rc = (segment->mem == NULL) ? -ENOMEM : copy_segment(image,
+                image_segment, segment->mem);
+        if (rc < 0) {
+            fprintf(stderr, "Error: %s: Unable to copy the %s segment: %s.\n",
+                    image->path, segment->name, strerror(-rc));
+            mem_release_segment(segment);
+        }
+        return rc;
+    }
+
+    size_t mapped_size = round_to_pages(image_segment->size);
+    void *mem = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+            image->fd, image_segment->offset);
+    if (mem == MAP_FAILED) {
+        int rc = -errno;
+        fprintf(stderr, "Error: %s: Unable to map the %s segment: %s.\n",
+                image->path, segment->name, strerror(errno));
+        segment->size = 0;
+        return rc;
+    }
+
+    segment->mem = mem;
+    segment->mapped_size = mapped_size;
+    return 0;
+}
+
+/**
+ * Returns the entry point of the program.
+ **/
+uint32_t image_entry(const program_image_t *image)
+{
+    return image->entry;
+}
+
+/**
+ * Returns the symbol table of the program, or NULL if it has none. The table
+ * belongs to the image.
+ **/
+struct symbol_table *image_symbols(const program_image_t *image)
+{
+    return image->symbols;
+}
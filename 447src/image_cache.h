@@ -0,0 +1,91 @@
+/**
+ * image_cache.h
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the interface to the program image cache, which keeps the
+ * pristine contents of each loaded program, so that reloading or restarting a
+ * program does not read and validate its files again.
+ *
+ * An image is keyed by the program's path, and by the identity (device, inode,
+ * size, and modification time) of each of the files it was read from. The
+ * contents of its segments are kept in an in-memory file, which is mapped
+ * privately into each load of the program. The loads share the pages of the
+ * image until they write to them, at which point the host copies the page.
+ *
+ * The cache is shared by the whole process, and is safe to use from several
+ * threads at once.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+#ifndef IMAGE_CACHE_H_
+#define IMAGE_CACHE_H_
+
+// Standard Includes
+#include <stdint.h>             // Fixed-size integral types
+
+// 18-447 Simulator Includes
+#include <sim.h>                // Definition of cpu_state_t
+#include <memory.h>             // Definition of mem_segment_t
+
+/*----------------------------------------------------------------------------
+ * Definitions
+ *----------------------------------------------------------------------------*/
+
+/* The maximum number of images kept in the cache. When the cache is full, the
+ * least recently used image that isn't loaded is evicted. */
+#define IMAGE_CACHE_MAX_IMAGES  16
+
+// The pristine contents of a program, shared by every load of it
+typedef struct program_image program_image_t;
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Acquires the image of the program at the given path (without an extension),
+ * whose segments are laid out like the CPU's memory segments. The program is
+ * read from its files only if it isn't cached, or its files have changed.
+ *
+ * The image must be released with image_cache_release. Returns 0 on success,
+ * or a negative error code on failure.
+ **/
+int image_cache_acquire(const cpu_state_t *cpu_state, const char *program_path,
+        program_image_t **image);
+
+/**
+ * Releases an image acquired with image_cache_acquire.
+ **/
+void image_cache_release(program_image_t *image);
+
+/**
+ * Maps the contents of the segment with the given index from the image into
+ * the segment, privately, so that writes to it are not seen by other loads.
+ * Returns 0 on success, or a negative error code on failure.
+ **/
+int image_map_segment(const program_image_t *image, int index,
+        mem_segment_t *segment);
+
+/**
+ * Returns the entry point of the program.
+ **/
+uint32_t image_entry(const program_image_t *image);
+
+/**
+ * Returns the symbol table of the program, or NULL if it has none. The table
+ * belongs to the image.
+ **/
+struct symbol_table *image_symbols(const program_image_t *image);
+
+#endif /* IMAGE_CACHE_H_ */
@@ -0,0 +1,484 @@
+/**
+ * lockstep.c
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the implementation of the lockstep engine, which runs
+ * several instances of the same program at once with SIMD operations.
+ *
+ * The instances in a lockstep group share the PC, and their registers are
+ * stored as one vector per register, with one 32-bit lane per instance. The
+ * instructions that the scalar process_instruction implements with plain
+ * integer arithmetic (ADD and ADDI) are executed on whole vectors, using the
+ * GCC vector extensions, so a lockstep run gives the same results as running
+ * each instance on its own. The main loop is compiled both for AVX2 and for
+ * the baseline instruction set, and the version matching the host is picked at
+ * load time.
+ *
+ * Any other instruction is handed to the scalar process_instruction for each
+ * lane in turn, so it is supported, or raises the same exception, exactly as
+ * on the scalar engine. Lanes that end up at a different PC than the rest of
+ * the group are peeled off and finish running on the scalar engine.
+ *
+ * The instances are assumed to run the same program, so instructions are
+ * fetched once from the first lane's text segment. The instances share the
+ * template's text segments, so the instructions are decoded only once for all
+ * of them, and each instance gets a private copy of a text segment only if it
+ * writes to it. The run subscribes to the code writes, so that a lane that
+ * writes to its text is peeled off, and the cached text is dropped only when
+ * the segment it was fetched from is written.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+// Standard Includes
+#include <stdlib.h>                 // Malloc and free functions
+#include <stdio.h>                  // Printf and related functions
+#include <stdint.h>                 // Fixed-size integral types
+#include <stdbool.h>                // Definition of the boolean type
+
+// Standard Includes
+#include <assert.h>                 // Assert macro
+#include <errno.h>                  // Error codes
+#include <string.h>                 // Memcpy function
+#include <endian.h>                 // Little-endian to host conversions
+
+// 18-447 Simulator Includes
+#include <sim.h>                    // Interface to the core simulator
+#include <riscv_isa.h>              // Definition of RISC-V opcodes
+#include <memory.h>                 // Definition of mem_segment_t
+#include <scheduler.h>              // Interface to the event scheduler
+#include <trap.h>                   // Trap entry and interrupt checks
+
+// Local Includes
+#include "libc_extensions.h"        // Min function
+#include "memory_shell.h"           // Memory segment lookup
+#include "memory_map.h"             // Permissions of the text segments
+#include "shared_text.h"            // Shared text and decoded instructions
+#include "code_watch.h"             // Notification of writes to the text
+#include "huge_pages.h"             // Huge page backing for large segments
+#include "engine.h"                 // The scalar run loop
+#include "lockstep.h"               // This file's interface
+
+/*----------------------------------------------------------------------------
+ * Internal Definitions
+ *----------------------------------------------------------------------------*/
+
+// A vector holding one 32-bit value per lane
+typedef uint32_t lane_vec_t __attribute__((vector_size(LOCKSTEP_LANES *
+        sizeof(uint32_t))));
+
+// The mask with a bit set for every lane
+#define ALL_LANES               ((1U << LOCKSTEP_LANES) - 1)
+
+// A group of instances that are run in lockstep at the same PC
+typedef struct lane_group {
+    lane_vec_t regs[RISCV_NUM_REGS];    // Registers, one lane per instance
+    uint32_t pc;                        // PC shared by the group
+    uint32_t active;                    // Mask of the lanes in the group
+    uint64_t cycles;                    // Cycles run in lockstep so far
+    uint64_t limit;                     // Maximum cycles to run in lockstep
+    uint64_t start_cycle[LOCKSTEP_LANES];   // Cycle of each lane at the start
+    cpu_state_t *lanes[LOCKSTEP_LANES]; // CPU state of each instance
+    const mem_segment_t *text;          // Segment instructions are fetched
+    int text_lane;                      // Lane the text segment belongs to
+    const decoded_instr_t *decoded;     // Decoded instructions of the text
+    uint32_t code_written;              // Mask of lanes that wrote their text
+    lockstep_stats_t *stats;            // Statistics for the run
+} lane_group_t;
+
+/*----------------------------------------------------------------------------
+ * Lane Helper Functions
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Loads the registers of all of the lanes in the group into the vectors.
+ **/
+static void gather_lanes(lane_group_t *group)
+{
+    for (uint32_t mask = group->active; mask != 0; mask &= mask - 1)
+    {
+        int lane = __builtin_ctz(mask);
+        const cpu_state_t *instance = group->lanes[lane];
+        for (int reg = 0; reg < RISCV_NUM_REGS; reg++)
+        {
+            group->regs[reg][lane] = instance->registers[reg];
+        }
+    }
+    return;
+}
+
+/**
+ * Writes the registers, PC, and cycle count of the given lanes back to their
+ * CPU states.
+ **/
+static void scatter_lanes(lane_group_t *group, uint32_t lanes, uint32_t pc)
+{
+    for (uint32_t mask = lanes; mask != 0; mask &= mask - 1)
+    {
+        int lane = __builtin_ctz(mask);
+        cpu_state_t *instance = group->lanes[lane];
+        for (int reg = 0; reg < RISCV_NUM_REGS; reg++)
+        {
+            instance->registers[reg] = group->regs[reg][lane];
+        }
+        instance->pc = pc;
+        instance->cycle = group->start_cycle[lane] + group->cycles;
+    }
+    return;
+}
+
+/**
+ * Removes the given lanes from the group, once their CPU states are up to date.
+ **/
+static void peel_lanes(lane_group_t *group, uint32_t lanes)
+{
+    // The text is looked up again if the lane it was fetched from leaves
+    if (group->text != NULL && (lanes & (1U << group->text_lane)) != 0) {
+        group->text = NULL;
+        group->decoded = NULL;
+    }
+
+    group->active &= ~lanes;
+    group->stats->peeled_lanes += __builtin_popcount(lanes);
+    return;
+}
+
+/**
+ * Writes the value to the destination register in every lane. Writes to
+ * register 0 are ignored, as per the RISC-V ISA. The value is passed by
+ * pointer, since vectors passed by value have a different ABI depending on
+ * whether AVX is enabled.
+ **/
+static inline void write_reg(lane_group_t *group, riscv_isa_reg_t rd,
+        const lane_vec_t *value)
+{
+    if (rd != 0) {
+        group->regs[rd] = *value;
+    }
+}
+
+/**
+ * Fetches and decodes the instruction at the group's PC. The decoded form is
+ * taken from the shared text when there is one, and the instruction is decoded
+ * on the spot otherwise. Returns NULL if the PC is not inside a segment, or is
+ * misaligned, in which case the scalar engine must raise the fault.
+ **/
+static const decoded_instr_t *fetch_instruction(lane_group_t *group,
+        decoded_instr_t *scratch)
+{
+    // Look up the segment only when the PC leaves the one last used
+    const mem_segment_t *text = group->text;
+    uint32_t pc = group->pc;
+    if (text == NULL || pc < text->base_addr ||
+            pc - text->base_addr >= text->size) {
+        /* Only text that is executable throughout is used, so that the
+         * permissions of its pages needn't be checked on every fetch. */
+        int leader = __builtin_ctz(group->active);
+        const cpu_state_t *lane = group->lanes[leader];
+        text = mem_find_segment(lane, pc);
+        if (text != NULL && !(mem_map_region_perms(text -
+                lane->memory.segments) & MEM_PERM_EXEC)) {
+            text = NULL;
+        }
+        group->text = text;
+        group->text_lane = leader;
+        group->decoded = (text == NULL) ? NULL : text_decoded(text);
+    }
+    if (text == NULL || pc % sizeof(uint32_t) != 0 ||
+            text->size - (pc - text->base_addr) < sizeof(uint32_t)) {
+        return NULL;
+    }
+
+    uint32_t offset = pc - text->base_addr;
+    if (group->decoded != NULL) {
+        return &group->decoded[offset / sizeof(uint32_t)];
+    }
+
+    uint32_t word;
+    memcpy(&word, &text->mem[offset], sizeof(word));
+    text_decode(le32toh(word), scratch);
+    return scratch;
+}
+
+/**
+ * Handles a write to a text segment during a run. The lane that owns the
+ * segment is marked to be peeled off after the instruction, and the cached
+ * text is dropped if it was fetched from the segment.
+ **/
+static void code_written(void *data, const mem_segment_t *segment,
+        uint32_t addr)
+{
+    (void)addr;
+    lane_group_t *group = data;
+    if (segment == group->text) {
+        group->text = NULL;
+        group->decoded = NULL;
+    }
+
+    for (uint32_t mask = group->active; mask != 0; mask &= mask - 1)
+    {
+        int lane = __builtin_ctz(mask);
+        const memory_t *memory = &group->lanes[lane]->memory;
+        if (memory->segments <= segment &&
+                segment < &memory->segments[memory->num_segments]) {
+            group->code_written |= 1U << lane;
+        }
+    }
+    return;
+}
+
+/*----------------------------------------------------------------------------
+ * Instruction Execution
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Executes the current instruction on each lane in turn with the scalar
+ * process_instruction. Afterwards, any lane that is not at the same PC as the
+ * first lane, is halted, or needs to stop at a batch boundary is peeled off.
+ **/
+static void step_scalar(lane_group_t *group)
+{
+    uint32_t lanes = group->active;
+    scatter_lanes(group, lanes, group->pc);
+    for (uint32_t mask = lanes; mask != 0; mask &= mask - 1)
+    {
+        int lane = __builtin_ctz(mask);
+        cpu_state_t *instance = group->lanes[lane];
+        instance->scheduler.horizon = SCHED_NEVER;
+
+        process_instruction(instance);
+        instance->cycle += 1;
+        if (instance->csr.trap_pending) {
+            trap_commit(instance);
+        }
+    }
+    group->cycles += 1;
+    group->stats->scalar_instrs += __builtin_popcount(lanes);
+
+    /* Keep the lanes that agree with the leader, and can keep running. Lanes
+     * that wrote to their text no longer run the same code as the rest. */
+    const cpu_state_t *leader = group->lanes[__builtin_ctz(lanes)];
+    group->pc = leader->pc;
+    uint32_t diverged = group->code_written & lanes;
+    group->code_written = 0;
+    for (uint32_t mask = lanes; mask != 0; mask &= mask - 1)
+    {
+        int lane = __builtin_ctz(mask);
+        const cpu_state_t *instance = group->lanes[lane];
+        if (instance->halted || instance->pc != group->pc ||
+                instance->scheduler.horizon != SCHED_NEVER) {
+            diverged |= 1U << lane;
+        }
+    }
+
+    peel_lanes(group, diverged);
+    gather_lanes(group);
+    return;
+}
+
+/**
+ * Runs the group in lockstep until it has fewer than two lanes left, or has
+ * reached its cycle limit.
+ *
+ * This is compiled for both AVX2 and the baseline instruction set, and the
+ * version that the host supports is selected when the simulator is loaded.
+ **/
+__attribute__((target_clones("avx2", "default")))
+static void run_group(lane_group_t *group)
+{
+    while (__builtin_popcount(group->active) >= 2 &&
+            group->cycles < group->limit)
+    {
+        decoded_instr_t scratch;
+        const decoded_instr_t *decoded = fetch_instruction(group, &scratch);
+
+        /* Only ADD and ADDI are executed on the vectors, since they are the
+         * arithmetic instructions that process_instruction implements. */
+        bool is_add = decoded != NULL && decoded->opcode == OP_OP &&
+                decoded->funct3 == FUNCT3_ADD_SUB &&
+                decoded->funct7 == FUNCT7_INT;
+        bool is_addi = decoded != NULL && decoded->opcode == OP_IMM &&
+                decoded->funct3 == FUNCT3_ADDI;
+        if (!is_add && !is_addi) {
+            step_scalar(group);
+            continue;
+        }
+
+        lane_vec_t operand = group->regs[decoded->rs2];
+        if (is_addi) {
+            operand = (lane_vec_t){0} + (uint32_t)decoded->imm;
+        }
+        lane_vec_t result = group->regs[decoded->rs1] + operand;
+        write_reg(group, decoded->rd, &result);
+        group->pc += sizeof(uint32_t);
+        group->cycles += 1;
+        group->stats->vector_instrs += 1;
+    }
+
+    // Write the state of the lanes still in the group back
+    scatter_lanes(group, group->active, group->pc);
+    return;
+}
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Initializes a new instance of the program loaded in the template CPU state.
+ *
+ * The instance gets its own copy of the template's memory, using the given
+ * array of segments, which must have room for all of the template's segments.
+ * The text segments are shared with the template until they are written.
+ * The rest of the CPU state (registers, PC, CSRs) is copied from the template.
+ * Returns 0 on success, or a negative error code on failure.
+ **/
+int lockstep_instance_init(cpu_state_t *instance, mem_segment_t *segments,
+        const cpu_state_t *template)
+{
+    *instance = *template;
+    instance->verbose_mode = false;
+    instance->machine = NULL;
+    instance->debug.undo = NULL;
+    instance->debug.hotblocks = NULL;
+    instance->debug.stats = NULL;
+    instance->memory.segments = segments;
+    instance->memory.reservation.valid = false;
+    mem_flush_access_caches(instance);
+
+    /* Give the instance its own copy of each of the template's segments,
+     * except for the text segments, which are shared. */
+    int num_segments = template->memory.num_segments;
+    for (int i = 0; i < num_segments; i++)
+    {
+        mem_segment_t *template_segment = &template->memory.segments[i];
+        segments[i] = *template_segment;
+        segments[i].mem = NULL;
+        segments[i].mapped_size = 0;
+        segments[i].shared = NULL;
+        segments[i].page_writes = NULL;
+        if (template_segment->mem == NULL) {
+            continue;
+        } else if (template_segment->executable) {
+            if (text_share(template_segment, &segments[i]) < 0) {
+                instance->memory.num_segments = i;
+                lockstep_instance_free(instance);
+                return -ENOMEM;
+            }
+            continue;
+        }
+
+        segments[i].mem = huge_pages_alloc(template_segment->size,
+                &segments[i].mapped_size);
+        if (segments[i].mem == NULL) {
+            fprintf(stderr, "Error: Unable to allocate memory for an "
+                    "instance.\n");
+            instance->memory.num_segments = i;
+            lockstep_instance_free(instance);
+            return -ENOMEM;
+        }
+        memcpy(segments[i].mem, template_segment->mem, template_segment->size);
+    }
+
+    // Pending events belong to the template, so start with a fresh scheduler
+    sched_init(&instance->scheduler, instance->cycle);
+    trap_reset(instance);
+    return 0;
+}
+
+/**
+ * Frees the memory of an instance created by lockstep_instance_init.
+ **/
+void lockstep_instance_free(cpu_state_t *instance)
+{
+    for (int i = 0; i < instance->memory.num_segments; i++)
+    {
+        mem_release_segment(&instance->memory.segments[i]);
+    }
+    return;
+}
+
+/**
+ * Runs each of the instances for the specified number of cycles, or until it
+ * is halted.
+ *
+ * The instances that are at the same PC as the first running instance are run
+ * in lockstep, while the rest are run on the scalar engine. The number of
+ * instances must not exceed LOCKSTEP_LANES. If stats is not NULL, the
+ * statistics for the run are added to it.
+ **/
+void lockstep_run(cpu_state_t *const instances[], int num_instances,
+        uint64_t max_cycles, lockstep_stats_t *stats)
+{
+    assert(num_instances <= LOCKSTEP_LANES);
+
+    lockstep_stats_t local_stats = {0};
+    lane_group_t group = {
+        .stats = (stats != NULL) ? stats : &local_stats,
+        .limit = max_cycles,
+    };
+
+    /* Form a group from the running instances at the same PC as the first.
+     * Pending interrupts are taken first, since they are only checked at the
+     * boundaries of the scalar engine's batches. */
+    uint64_t end_cycle[LOCKSTEP_LANES];
+    for (int lane = 0; lane < num_instances; lane++)
+    {
+        cpu_state_t *instance = instances[lane];
+        group.lanes[lane] = instance;
+        group.start_cycle[lane] = instance->cycle;
+        end_cycle[lane] = (max_cycles > UINT64_MAX - instance->cycle) ?
+                UINT64_MAX : instance->cycle + max_cycles;
+        if (instance->halted) {
+            continue;
+        }
+
+        trap_check_interrupts(instance);
+        if (group.active == 0) {
+            group.pc = instance->pc;
+        } else if (instance->pc != group.pc) {
+            continue;
+        }
+        group.active |= 1U << lane;
+
+        // The group must stop before any of its lanes' pending events
+        uint64_t deadline = sched_next_deadline(&instance->scheduler);
+        uint64_t until_deadline = (deadline > instance->cycle) ?
+                deadline - instance->cycle : 0;
+        group.limit = min(group.limit, until_deadline);
+    }
+
+    /* Run the group in lockstep, if there's more than one instance in it.
+     * Without a subscription to the code writes, the text can't be cached, so
+     * every instance is run on the scalar engine instead. */
+    if (__builtin_popcount(group.active) >= 2) {
+        int subscription = code_watch_subscribe(code_written, &group);
+        if (subscription >= 0) {
+            gather_lanes(&group);
+            run_group(&group);
+            code_watch_unsubscribe(subscription);
+        }
+    }
+
+    // Run the rest of the cycles for every instance on the scalar engine
+    for (int lane = 0; lane < num_instances; lane++)
+    {
+        cpu_state_t *instance = instances[lane];
+        instance->scheduler.horizon = 0;
+        if (!instance->halted && instance->cycle < end_cycle[lane]) {
+            engine_run(instance, end_cycle[lane] - instance->cycle);
+        }
+    }
+
+    return;
+}
@@ -0,0 +1,86 @@
+/**
+ * lockstep.h
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the interface to the lockstep engine, which runs several
+ * independent instances of the same program at once.
+ *
+ * Each instance has its own CPU state and private copy of memory. While the
+ * instances are at the same PC, their registers are kept in a
+ * structure-of-arrays layout, and each instruction is decoded once and
+ * executed across all of the instances with SIMD (AVX2) operations. When the
+ * instances' control flow diverges, the instances that leave the group are
+ * peeled off and finish running on the scalar engine.
+ *
+ * This is used to sweep a program over many different inputs.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+#ifndef LOCKSTEP_H_
+#define LOCKSTEP_H_
+
+// Standard Includes
+#include <stdint.h>             // Fixed-size integral types
+
+// 18-447 Simulator Includes
+#include <sim.h>                // Definition of cpu_state_t
+#include <memory.h>             // Definition of mem_segment_t
+
+/*----------------------------------------------------------------------------
+ * Definitions
+ *----------------------------------------------------------------------------*/
+
+// The number of instances run in lockstep, one per 32-bit lane of a vector
+#define LOCKSTEP_LANES          8
+
+// Statistics about how instructions were executed by the lockstep engine
+typedef struct lockstep_stats {
+    uint64_t vector_instrs;     // Instructions executed across all lanes
+    uint64_t scalar_instrs;     // Instructions executed one lane at a time
+    uint64_t peeled_lanes;      // Lanes that diverged from their group
+} lockstep_stats_t;
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Initializes a new instance of the program loaded in the template CPU state.
+ *
+ * The instance gets its own copy of the template's memory, using the given
+ * array of segments, which must have room for all of the template's segments.
+ * The rest of the CPU state (registers, PC, CSRs) is copied from the template.
+ * Returns 0 on success, or a negative error code on failure.
+ **/
+int lockstep_instance_init(cpu_state_t *instance, mem_segment_t *segments,
+        const cpu_state_t *template);
+
+/**
+ * Frees the memory of an instance created by lockstep_instance_init.
+ **/
+void lockstep_instance_free(cpu_state_t *instance);
+
+/**
+ * Runs each of the instances for the specified number of cycles, or until it
+ * is halted.
+ *
+ * The instances that are at the same PC as the first running instance are run
+ * in lockstep, while the rest are run on the scalar engine. The number of
+ * instances must not exceed LOCKSTEP_LANES. If stats is not NULL, the
+ * statistics for the run are added to it.
+ **/
+void lockstep_run(cpu_state_t *const instances[], int num_instances,
+        uint64_t max_cycles, lockstep_stats_t *stats);
+
+#endif /* LOCKSTEP_H_ */
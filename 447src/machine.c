@@ -0,0 +1,536 @@
+/**
+ * machine.c
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the implementation of the machine, which runs each of the
+ * simulated harts on its own host thread.
+ *
+ * In parallel mode, the harts run independently until they have run the
+ * requested number of cycles. In quantum mode, the harts wait at a barrier
+ * after each quantum, so no hart gets more than a quantum ahead of the others.
+ * In round-robin mode, a token is passed between the threads in hart order, and
+ * only the hart holding the token runs, which makes the interleaving of the
+ * harts' memory accesses reproducible.
+ *
+ * In interleave mode, the same schedule as round-robin mode is followed, but
+ * without any host threads. The calling thread runs each hart for a quantum,
+ * and then simply moves on to the next hart's CPU state. This is both
+ * deterministic and free of any synchronization overhead.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+// Standard Includes
+#include <stdlib.h>                 // Calloc and free functions
+#include <stdio.h>                  // Printf and related functions
+#include <stdint.h>                 // Fixed-size integral types
+#include <stdbool.h>                // Definition of the boolean type
+
+// Standard Includes
+#include <errno.h>                  // Error codes
+#include <string.h>                 // String functions and memset
+#include <pthread.h>                // Threads, mutexes, and condition variables
+#include <time.h>                   // Clock_gettime function
+
+// 18-447 Simulator Includes
+#include <sim.h>                    // Definition of cpu_state_t
+#include <riscv_abi.h>              // ABI registers
+#include <register_file.h>          // Interface to the register file
+#include <scheduler.h>              // Scheduler initialization
+#include <trap.h>                   // CSR reset
+
+// Local Includes
+#include "libc_extensions.h"        // Min function, array_len
+#include "memory_map.h"             // Stack segment layout
+#include "memory_shell.h"           // Unloading the program
+#include "commands.h"               // Initialization of the CPU state
+#include "engine.h"                 // Interface to the run loop
+#include "stats.h"                  // Host time and statistics log
+#include "machine.h"                // This file's interface
+
+/*----------------------------------------------------------------------------
+ * Internal Definitions
+ *----------------------------------------------------------------------------*/
+
+// The alignment of the initial stack pointer of each hart
+#define HART_STACK_ALIGN            16
+
+// The names of the hart scheduling modes, indexed by mode
+static const char *const HART_MODE_NAMES[] = {
+    [HART_MODE_PARALLEL]            = "parallel",
+    [HART_MODE_QUANTUM]             = "quantum",
+    [HART_MODE_ROUND_ROBIN]         = "round-robin",
+    [HART_MODE_INTERLEAVE]          = "interleave",
+};
+
+// The state shared by the host threads during a run of the machine
+typedef struct run_sync {
+    pthread_mutex_t lock;           // Lock protecting the fields below
+    pthread_cond_t cond;            // Signalled when the barrier or turn moves
+    bool started;                   // All of the threads have been created
+    bool aborted;                   // Creating one of the threads failed
+    int num_harts;                  // Number of threads participating
+    int arrived;                    // Threads that have reached the barrier
+    uint64_t generation;            // Number of times the barrier has opened
+    bool any_running;               // Some hart can run another quantum
+    bool any_stopped;               // Some hart stopped at a breakpoint
+    bool keep_running;              // Result of the last barrier or round
+    int turn;                       // Hart holding the token in round-robin
+} run_sync_t;
+
+// The arguments for a host thread running a hart
+typedef struct hart_thread {
+    pthread_t thread;               // The host thread running the hart
+    const machine_t *machine;       // The machine the hart belongs to
+    cpu_state_t *hart;              // The hart run by the thread
+    int hartid;                     // Index of the hart in the machine
+    uint64_t max_cycles;            // Number of cycles to run the hart for
+    run_sync_t *sync;               // State shared with the other threads
+} hart_thread_t;
+
+/*----------------------------------------------------------------------------
+ * Internal Helper Functions
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Resets a secondary hart to start running the program loaded by the boot
+ * hart. The hart starts at the same PC, with its own slice of the stack.
+ **/
+static void reset_hart(const machine_t *machine, cpu_state_t *hart,
+        int hartid)
+{
+    const cpu_state_t *boot_hart = &machine->harts[0];
+    uint32_t stack_end, stack_size;
+    mem_map_stack(&stack_end, &stack_size);
+    uint32_t stack_slice = (stack_size / machine->num_harts) &
+            ~(HART_STACK_ALIGN - 1);
+
+    hart->cycle = 0;
+    memset(hart->registers, 0, sizeof(hart->registers));
+    sched_init(&hart->scheduler, hart->cycle);
+    hart->pc = boot_hart->pc;
+    register_write(hart, (riscv_isa_reg_t)REG_SP,
+            stack_end - hartid * stack_slice);
+    register_write(hart, (riscv_isa_reg_t)REG_GP,
+            register_read(boot_hart, (riscv_isa_reg_t)REG_GP));
+    trap_reset(hart);
+    hart->memory.reservation.valid = false;
+    mem_flush_access_caches(hart);
+    hart->memory.symbols = boot_hart->memory.symbols;
+    hart->debug.in_block = false;
+
+    hart->halted = boot_hart->halted;
+    hart->program = boot_hart->program;
+    return;
+}
+
+/**
+ * Waits at the barrier until all threads have arrived. Returns true if any
+ * thread indicated that its hart can keep running, and none indicated that its
+ * hart stopped at a breakpoint.
+ **/
+static bool barrier_wait(run_sync_t *sync, bool running, bool stopped)
+{
+    pthread_mutex_lock(&sync->lock);
+    uint64_t generation = sync->generation;
+    sync->any_running |= running;
+    sync->any_stopped |= stopped;
+    sync->arrived += 1;
+
+    // The last thread to arrive opens the barrier for the others
+    if (sync->arrived == sync->num_harts) {
+        sync->keep_running = sync->any_running && !sync->any_stopped;
+        sync->any_running = false;
+        sync->any_stopped = false;
+        sync->arrived = 0;
+        sync->generation += 1;
+        pthread_cond_broadcast(&sync->cond);
+    } else {
+        while (sync->generation == generation) {
+            pthread_cond_wait(&sync->cond, &sync->lock);
+        }
+    }
+
+    bool keep_running = sync->keep_running;
+    pthread_mutex_unlock(&sync->lock);
+    return keep_running;
+}
+
+/**
+ * Runs the hart in quantum mode, synchronizing with the other harts at a
+ * barrier after each quantum. Halted harts keep arriving at the barrier, so the
+ * others are not left waiting on them. If any hart stops at a breakpoint, the
+ * run ends at the barrier.
+ **/
+static void run_quantum(hart_thread_t *thread)
+{
+    cpu_state_t *hart = thread->hart;
+    uint64_t quantum = thread->machine->quantum;
+    uint64_t cycles = 0;
+
+    bool running = true;
+    while (running)
+    {
+        uint64_t run_cycles = min(quantum, thread->max_cycles - cycles);
+        bool stopped = false;
+        if (!hart->halted) {
+            cycles += engine_run(hart, run_cycles);
+            stopped = hart->debug.breakpoint_hit;
+        }
+
+        bool can_run = !hart->halted && cycles < thread->max_cycles;
+        running = barrier_wait(thread->sync, can_run, stopped);
+    }
+    return;
+}
+
+/**
+ * Runs the hart in round-robin mode, waiting for the token before running each
+ * quantum, and then passing it to the next hart. The last hart in each round
+ * decides whether another round is needed. If the hart stops at a breakpoint,
+ * the run ends immediately.
+ **/
+static void run_round_robin(hart_thread_t *thread)
+{
+    run_sync_t *sync = thread->sync;
+    cpu_state_t *hart = thread->hart;
+    uint64_t quantum = thread->machine->quantum;
+    uint64_t cycles = 0;
+
+    pthread_mutex_lock(&sync->lock);
+    while (true)
+    {
+        while (sync->keep_running && sync->turn != thread->hartid) {
+            pthread_cond_wait(&sync->cond, &sync->lock);
+        }
+        if (!sync->keep_running) {
+            break;
+        }
+
+        // Run the hart for a quantum while holding the token
+        pthread_mutex_unlock(&sync->lock);
+        uint64_t run_cycles = min(quantum, thread->max_cycles - cycles);
+        bool stopped = false;
+        if (!hart->halted) {
+            cycles += engine_run(hart, run_cycles);
+            stopped = hart->debug.breakpoint_hit;
+        }
+        pthread_mutex_lock(&sync->lock);
+
+        /* Pass the token on, ending the run after a round where nothing ran,
+         * or as soon as a hart stops at a breakpoint. */
+        sync->any_running |= !hart->halted && cycles < thread->max_cycles;
+        sync->turn = (thread->hartid + 1) % sync->num_harts;
+        if (stopped) {
+            sync->keep_running = false;
+        } else if (sync->turn == 0) {
+            sync->keep_running = sync->any_running;
+            sync->any_running = false;
+        }
+        pthread_cond_broadcast(&sync->cond);
+    }
+    pthread_mutex_unlock(&sync->lock);
+
+    return;
+}
+
+/**
+ * Runs the harts in interleave mode, on the calling thread. Each hart runs for
+ * a quantum in turn, until they have all run for the requested number of
+ * cycles, every hart is halted, or a hart stops at a breakpoint.
+ **/
+static void run_interleaved(machine_t *machine, uint64_t max_cycles)
+{
+    cpu_state_t *harts_end = &machine->harts[machine->num_harts];
+    uint64_t cycles = 0;
+
+    bool running = true;
+    while (running && cycles < max_cycles)
+    {
+        // Each round counts the cycles of the longest run of a hart in it
+        uint64_t run_cycles = min(machine->quantum, max_cycles - cycles);
+        uint64_t round_cycles = 0;
+        running = false;
+        for (cpu_state_t *hart = machine->harts; hart < harts_end; hart++)
+        {
+            if (hart->halted) {
+                continue;
+            }
+
+            uint64_t hart_cycles = engine_run(hart, run_cycles);
+            round_cycles = max(round_cycles, hart_cycles);
+            if (hart->debug.breakpoint_hit) {
+                return;
+            }
+            running |= !hart->halted;
+        }
+        cycles += round_cycles;
+    }
+
+    return;
+}
+
+/**
+ * The entry point for a host thread running a hart.
+ **/
+static void *hart_thread_main(void *arg)
+{
+    hart_thread_t *thread = arg;
+    run_sync_t *sync = thread->sync;
+
+    /* The threads synchronize with each other, so don't start running until
+     * all of them exist, and stop if any of them could not be created. */
+    pthread_mutex_lock(&sync->lock);
+    while (!sync->started) {
+        pthread_cond_wait(&sync->cond, &sync->lock);
+    }
+    bool aborted = sync->aborted;
+    pthread_mutex_unlock(&sync->lock);
+    if (aborted) {
+        return NULL;
+    }
+
+    switch (thread->machine->mode)
+    {
+        case HART_MODE_PARALLEL:
+            engine_run(thread->hart, thread->max_cycles);
+            break;
+
+        case HART_MODE_QUANTUM:
+            run_quantum(thread);
+            break;
+
+        case HART_MODE_ROUND_ROBIN:
+            run_round_robin(thread);
+            break;
+
+        // Interleaved harts are never run on their own threads
+        case HART_MODE_INTERLEAVE:
+            break;
+    }
+
+    return NULL;
+}
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Initializes the machine with the given number of harts, all sharing the
+ * processor's memory segments. The program is not loaded.
+ *
+ * Returns 0 on success, or a negative error code on failure.
+ **/
+int machine_init(machine_t *machine, int num_harts, hart_mode_t mode,
+        uint64_t quantum)
+{
+    if (num_harts < 1 || num_harts > MACHINE_MAX_HARTS) {
+        fprintf(stderr, "Error: The number of harts must be between 1 and "
+                "%d.\n", MACHINE_MAX_HARTS);
+        return -EINVAL;
+    } else if (quantum == 0) {
+        fprintf(stderr, "Error: The quantum must be at least 1 cycle.\n");
+        return -EINVAL;
+    }
+
+    // The CPU state is allocated on cache line boundaries, as it is aligned
+    cpu_state_t *harts = aligned_alloc(_Alignof(cpu_state_t),
+            num_harts * sizeof(harts[0]));
+    if (harts == NULL) {
+        fprintf(stderr, "Error: Unable to allocate the CPU state for the "
+                "harts.\n");
+        return -ENOMEM;
+    }
+    memset(harts, 0, num_harts * sizeof(harts[0]));
+
+    // The machine has its own segment table, which every hart shares
+    int rc = mem_create_segments(&harts[0].memory);
+    if (rc < 0) {
+        free(harts);
+        return rc;
+    }
+
+    for (int i = 0; i < num_harts; i++)
+    {
+        harts[i].memory.num_segments = harts[0].memory.num_segments;
+        harts[i].memory.segments = harts[0].memory.segments;
+        harts[i].memory.shared = (num_harts > 1);
+        harts[i].csr.mhartid = i;
+        harts[i].machine = machine;
+        harts[i].halted = true;
+    }
+
+    machine->num_harts = num_harts;
+    machine->current = 0;
+    machine->mode = mode;
+    machine->quantum = quantum;
+    machine->harts = harts;
+    return 0;
+}
+
+/**
+ * Loads the program into the machine's memory, and resets all of the harts to
+ * start running it.
+ *
+ * Every hart starts at the program's entry point, with its own slice of the
+ * stack segment. Returns 0 on success, or a negative error code on failure, in
+ * which case all harts are halted.
+ **/
+int machine_load(machine_t *machine, char *program_path)
+{
+    // The boot hart loads the program into the shared memory
+    int rc = init_cpu_state(&machine->harts[0], program_path);
+    for (int i = 1; i < machine->num_harts; i++)
+    {
+        reset_hart(machine, &machine->harts[i], i);
+    }
+
+    return rc;
+}
+
+/**
+ * Unloads the program loaded by machine_load, freeing the shared memory.
+ **/
+void machine_unload(machine_t *machine)
+{
+    mem_unload_program(&machine->harts[0]);
+    return;
+}
+
+/**
+ * Indicates if all of the harts in the machine are halted.
+ **/
+bool machine_halted(const machine_t *machine)
+{
+    for (int i = 0; i < machine->num_harts; i++)
+    {
+        if (!machine->harts[i].halted) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Runs every hart in the machine for the specified number of cycles, or until
+ * it is halted.
+ *
+ * With a single hart, or in interleave mode, the harts are run directly on the
+ * calling thread. Otherwise, each hart is run on its own host thread, scheduled
+ * according to the machine's mode, and this returns once all of them have
+ * stopped.
+ **/
+static void run_harts(machine_t *machine, uint64_t max_cycles)
+{
+    if (machine->num_harts == 1) {
+        engine_run(&machine->harts[0], max_cycles);
+        return;
+    } else if (machine->mode == HART_MODE_INTERLEAVE) {
+        run_interleaved(machine, max_cycles);
+        return;
+    }
+
+    run_sync_t sync = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .cond = PTHREAD_COND_INITIALIZER,
+        .num_harts = machine->num_harts,
+        .keep_running = true,
+    };
+
+    // Start a host thread for each hart
+    hart_thread_t threads[MACHINE_MAX_HARTS];
+    int num_started = 0;
+    for (int i = 0; i < machine->num_harts; i++)
+    {
+        threads[i] = (hart_thread_t) {
+            .machine = machine,
+            .hart = &machine->harts[i],
+            .hartid = i,
+            .max_cycles = max_cycles,
+            .sync = &sync,
+        };
+
+        int rc = pthread_create(&threads[i].thread, NULL, hart_thread_main,
+                &threads[i]);
+        if (rc != 0) {
+            fprintf(stderr, "Error: Unable to create a thread for hart %d: "
+                    "%s.\n", i, strerror(rc));
+            break;
+        }
+        num_started += 1;
+    }
+
+    // Let the threads start running, or tell them to exit if one failed
+    pthread_mutex_lock(&sync.lock);
+    sync.started = true;
+    sync.aborted = (num_started != machine->num_harts);
+    pthread_cond_broadcast(&sync.cond);
+    pthread_mutex_unlock(&sync.lock);
+
+    for (int i = 0; i < num_started; i++)
+    {
+        pthread_join(threads[i].thread, NULL);
+    }
+
+    pthread_mutex_destroy(&sync.lock);
+    pthread_cond_destroy(&sync.cond);
+    return;
+}
+
+/**
+ * Runs every hart in the machine for the specified number of cycles, or until
+ * it is halted. The host time taken is added to the statistics, and any
+ * records that are due are written to the statistics log.
+ **/
+void machine_run(machine_t *machine, uint64_t max_cycles)
+{
+    // Let the log see the machine before it runs, in case it was restarted
+    stats_log_poll(machine);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    run_harts(machine, max_cycles);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    uint64_t host_ns = (uint64_t)(end.tv_sec - start.tv_sec) * 1000000000 +
+            (end.tv_nsec - start.tv_nsec);
+    stats_add_host_time(host_ns);
+    stats_log_poll(machine);
+    return;
+}
+
+/**
+ * Parses the name of a hart scheduling mode. Returns 0 on success, or a
+ * negative error code if the name is not a valid mode.
+ **/
+int parse_hart_mode(const char *string, hart_mode_t *mode)
+{
+    for (int i = 0; i < (int)array_len(HART_MODE_NAMES); i++)
+    {
+        if (strcmp(string, HART_MODE_NAMES[i]) == 0) {
+            *mode = (hart_mode_t)i;
+            return 0;
+        }
+    }
+
+    return -EINVAL;
+}
+
+/**
+ * Gets the name of the given hart scheduling mode.
+ **/
+const char *hart_mode_name(hart_mode_t mode)
+{
+    return HART_MODE_NAMES[mode];
+}
@@ -0,0 +1,130 @@
+/**
+ * machine.h
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the interface to the machine, which is the collection of
+ * hardware threads (harts) being simulated.
+ *
+ * Each hart has its own CPU state (registers, PC, CSRs, and scheduler), while
+ * all harts share the same memory segments. When there is more than one hart,
+ * each hart runs on its own host thread, and the harts are kept in step
+ * according to the machine's scheduling mode. Alternatively, the harts can be
+ * interleaved on the calling thread, switching between them every quantum.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+#ifndef MACHINE_H_
+#define MACHINE_H_
+
+// Standard Includes
+#include <stdbool.h>            // Boolean type and definitions
+#include <stdint.h>             // Fixed-size integral types
+
+// 18-447 Simulator Includes
+#include <sim.h>                // Definition of cpu_state_t
+
+/*----------------------------------------------------------------------------
+ * Definitions
+ *----------------------------------------------------------------------------*/
+
+// The maximum number of harts that can be simulated
+#define MACHINE_MAX_HARTS       64
+
+// The default number of cycles each hart runs for in a quantum
+#define MACHINE_DEFAULT_QUANTUM 1000
+
+// The modes for scheduling the harts against one another
+typedef enum hart_mode {
+    HART_MODE_PARALLEL,         // Harts run freely, fully in parallel
+    HART_MODE_QUANTUM,          // Harts run in parallel, with a barrier every
+                                // quantum to keep them loosely synchronized
+    HART_MODE_ROUND_ROBIN,      // Harts take turns running for a quantum each,
+                                // in hart order, which is fully deterministic
+    HART_MODE_INTERLEAVE,       // Like round-robin, but all harts run on the
+                                // calling thread, with no locks or threads
+} hart_mode_t;
+
+// The representation of the machine and all of its harts
+typedef struct machine {
+    int num_harts;              // Number of harts in the machine
+    int current;                // Hart currently selected by the shell
+    hart_mode_t mode;           // How the harts are scheduled
+    uint64_t quantum;           // Cycles a hart runs before synchronizing
+    cpu_state_t *harts;         // CPU state for each of the harts
+} machine_t;
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Initializes the machine with the given number of harts, all sharing the
+ * processor's memory segments. The program is not loaded.
+ *
+ * Returns 0 on success, or a negative error code on failure.
+ **/
+int machine_init(machine_t *machine, int num_harts, hart_mode_t mode,
+        uint64_t quantum);
+
+/**
+ * Loads the program into the machine's memory, and resets all of the harts to
+ * start running it.
+ *
+ * Every hart starts at the program's entry point, with its own slice of the
+ * stack segment. Returns 0 on success, or a negative error code on failure, in
+ * which case all harts are halted.
+ **/
+int machine_load(machine_t *machine, char *program_path);
+
+/**
+ * Unloads the program loaded by machine_load, freeing the shared memory.
+ **/
+void machine_unload(machine_t *machine);
+
+/**
+ * Indicates if all of the harts in the machine are halted.
+ **/
+bool machine_halted(const machine_t *machine);
+
+/**
+ * Runs every hart in the machine for the specified number of cycles, or until
+ * it is halted.
+ *
+ * With a single hart, or in interleave mode, the harts are run directly on the
+ * calling thread. Otherwise, each hart is run on its own host thread, scheduled
+ * according to the machine's mode, and this returns once all of them have
+ * stopped.
+ **/
+void machine_run(machine_t *machine, uint64_t max_cycles);
+
+/**
+ * Gets the CPU state of the hart currently selected by the shell.
+ **/
+static inline cpu_state_t *machine_current(machine_t *machine)
+{
+    return &machine->harts[machine->current];
+}
+
+/**
+ * Parses the name of a hart scheduling mode. Returns 0 on success, or a
+ * negative error code if the name is not a valid mode.
+ **/
+int parse_hart_mode(const char *string, hart_mode_t *mode);
+
+/**
+ * Gets the name of the given hart scheduling mode.
+ **/
+const char *hart_mode_name(hart_mode_t mode);
+
+#endif /* MACHINE_H_ */
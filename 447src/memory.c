@@ -28,17 +28,56 @@
 #include <assert.h>                 // Assert macro
 #include <errno.h>                  // Error codes and perror
 #include <string.h>                 // String manipulation functions and memset
+#include <endian.h>                 // Host to little-endian conversions
+#include <unistd.h>                 // Access function
+#include <sys/mman.h>               // Munmap function
 
 // 18-447 Simulator Includes
 #include <sim.h>                    // Interface to the core simulator
+#include <riscv_isa.h>              // Opcodes of stores and atomics
 #include <riscv_abi.h>              // ABI registers and memory segments
 #include <register_file.h>          // Interface to the register file
 #include <memory.h>                 // This file's interface to core simulator
+#include <trap.h>                   // Interface to raise memory exceptions
 
 // Local Includes
 #include "libc_extensions.h"        // Various utilities
-#include "memory_segments.h"        // Definition of memory segment constants
+#include "memory_map.h"             // Regions and translation of addresses
 #include "memory_shell.h"           // This file's interface to the shell
+#include "plugins.h"                // Memory access events for plugins
+#include "heatmap.h"                // Memory access heat map
+#include "stats.h"                  // Memory access statistics
+#include "elf_loader.h"             // Loading programs from ELF executables
+#include "image_cache.h"            // Cached images of loaded programs
+#include "shared_text.h"            // Text segments shared between instances
+#include "code_watch.h"             // Tracking writes to the text segments
+#include "huge_pages.h"             // Huge page backing for large segments
+
+/*----------------------------------------------------------------------------
+ * Global Variables
+ *----------------------------------------------------------------------------*/
+
+// The policy for handling misaligned loads and stores
+mem_align_policy_t MEM_ALIGN_POLICY     = MEM_ALIGN_TRAP;
+
+// The number of misaligned accesses that have been emulated
+uint64_t MEM_SPLIT_ACCESSES             = 0;
+
+// Indicates if any observer of the processor's loads and stores is active
+bool MEM_HOOKS_ACTIVE                   = false;
+
+// Indicates if the observers of the loads and stores are paused
+static bool MEM_HOOKS_PAUSED            = false;
+
+/* The number of reservation granules. Words are mapped to the granules by their
+ * address, so words that share a granule can make each other's
+ * store-conditionals fail, which the ISA allows. This must be a power of 2. */
+#define MEM_NUM_GRANULES                4096
+
+/* The generation of each reservation granule, which every store to a word in it
+ * advances by 2, when other harts share the memory. The lowest bit is set while
+ * a hart is storing to the granule. */
+static uint32_t MEM_GRANULE_GENERATIONS[MEM_NUM_GRANULES];
 
 /*----------------------------------------------------------------------------
  * Shared Helper Functions
@@ -46,23 +85,349 @@
 
 /**
  * Reads the specified value out from the given address in the segment in
- * little-endian order.
+ * little-endian order. The address must be aligned to a 4-byte boundary.
+ *
+ * The segments may be shared by several harts running on different host
+ * threads, so the word is read with a single relaxed atomic load. This never
+ * tears, and costs the same as a plain load.
  **/
 static uint32_t mem_read_word(const mem_segment_t *segment, uint32_t addr)
 {
     assert(segment->base_addr <= addr &&
             addr < segment->base_addr + segment->size);
+    assert(addr % sizeof(uint32_t) == 0);
+
+    const uint32_t *mem_addr = (const uint32_t *)&segment->mem[addr -
+            segment->base_addr];
+    return le32toh(__atomic_load_n(mem_addr, __ATOMIC_RELAXED));
+}
+
+/**
+ * Gets the generation of the reservation granule that the word at the given
+ * address belongs to.
+ **/
+static inline uint32_t *granule_generation(uint32_t addr)
+{
+    uint32_t granule = (addr / sizeof(uint32_t)) % MEM_NUM_GRANULES;
+    return &MEM_GRANULE_GENERATIONS[granule];
+}
+
+/**
+ * Starts a store by the hart to the word at the given address, which breaks
+ * any reservation on the word. When other harts share the memory, the word's
+ * granule is locked until end_store, waiting for any other hart storing to it
+ * to finish, and its generation is returned. Otherwise, only the hart's own
+ * reservation can be on the word, and NULL is returned.
+ **/
+static inline uint32_t *begin_store(cpu_state_t *cpu_state, uint32_t addr)
+{
+    uint32_t word_addr = addr - addr % sizeof(uint32_t);
+    if (!cpu_state->memory.shared) {
+        mem_reservation_t *reservation = &cpu_state->memory.reservation;
+        if (reservation->addr == word_addr) {
+            reservation->valid = false;
+        }
+        return NULL;
+    }
+
+    uint32_t *generation = granule_generation(word_addr);
+    uint32_t unlocked = __atomic_load_n(generation, __ATOMIC_RELAXED) & ~1U;
+    while (!__atomic_compare_exchange_n(generation, &unlocked, unlocked | 1,
+                true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        unlocked &= ~1U;
+    }
+    return generation;
+}
+
+/**
+ * Finishes a store started by begin_store, unlocking the granule and advancing
+ * its generation, if it was locked.
+ **/
+static inline void end_store(uint32_t *generation)
+{
+    if (generation != NULL) {
+        __atomic_fetch_add(generation, 1, __ATOMIC_RELEASE);
+    }
+    return;
+}
+
+/**
+ * Passes a load or store by the hart to the given segment on to the observers
+ * of the memory accesses that are active. This is only invoked while
+ * MEM_HOOKS_ACTIVE is set.
+ **/
+static void observe_access(cpu_state_t *cpu_state,
+        const mem_segment_t *segment, uint32_t addr, uint32_t value,
+        bool is_store)
+{
+    if (HEATMAP_ACTIVE) {
+        heatmap_record(cpu_state, segment, addr, is_store);
+    }
+    if (STATS_ACTIVE) {
+        stats_memory_access(cpu_state, segment, is_store);
+    }
+    if (PLUGINS_MEM_HOOKED) {
+        plugins_mem_access(cpu_state, addr, value, is_store);
+    }
+    return;
+}
+
+/**
+ * Finds the segment for a word access to the given address by the processor,
+ * which needs the given permissions (MEM_PERM_*) on the address's page.
+ *
+ * The cache holds the segment of the last access of the same kind, which is
+ * checked before searching the segment table, and updated on a miss. The
+ * permissions are checked along with the lookup, on a miss, and a segment is
+ * only cached if every one of its pages has both the permissions the access
+ * needs and read permission. Thus, a hit in the cache needs no check. The store
+ * cache is shared by stores and atomic operations, which read as well.
+ *
+ * If the address is misaligned or invalid, or its page doesn't have the needed
+ * permissions, then the corresponding exception is raised. If no trap handler
+ * is installed, or the alignment policy is to halt on a misaligned address, an
+ * error message is printed and the processor is halted instead. In either case,
+ * NULL is returned.
+ *
+ * Plain loads and stores (data accesses) have two slow paths, for which NULL is
+ * returned without raising anything: a misaligned access that is emulated,
+ * which the caller splits, and an access to a device, which the caller passes
+ * on to it. Other accesses to devices raise the access exception. Device
+ * segments are never cached, so a hit in the cache is always plain memory.
+ **/
+static mem_segment_t *find_access_segment(cpu_state_t *cpu_state,
+        mem_segment_t **cache, uint32_t addr, bool data_access, uint8_t perms,
+        riscv_trap_cause_t misaligned_cause, riscv_trap_cause_t access_cause)
+{
+    // Most accesses hit the same segment as the last one
+    mem_segment_t *cached = *cache;
+    if (cached != NULL && addr % sizeof(uint32_t) == 0 &&
+            addr - cached->base_addr < cached->size) {
+        return cached;
+    }
+
+    // Make sure the address is aligned, unless the access will be split
+    if (addr % sizeof(uint32_t) != 0) {
+        if (data_access && MEM_ALIGN_POLICY == MEM_ALIGN_EMULATE) {
+            return NULL;
+        } else if (MEM_ALIGN_POLICY == MEM_ALIGN_HALT ||
+                !trap_raise(cpu_state, misaligned_cause, addr)) {
+            fprintf(stderr, "Encountered an unaligned memory address 0x%08x. "
+                    "Halting simulation.\n", addr);
+            cpu_state->halted = true;
+        }
+        return NULL;
+    }
+
+    /* Try to find the specified address, which must be memory unless it's
+     * data, and must allow the access. */
+    mem_segment_t *segment = mem_find_segment(cpu_state, addr);
+    bool device = (segment != NULL && segment->backing == MEM_BACKING_MMIO);
+    bool allowed = (mem_map_page_perms(addr) & perms) == perms;
+    if (device && data_access && allowed) {
+        return NULL;
+    } else if (segment == NULL || device || !allowed) {
+        if (!trap_raise(cpu_state, access_cause, addr)) {
+            fprintf(stderr, "Encountered invalid memory address 0x%08x. "
+                    "Halting simulation.\n", addr);
+            cpu_state->halted = true;
+        }
+        return NULL;
+    }
+
+    uint8_t cache_perms = perms | MEM_PERM_READ;
+    int region = segment - cpu_state->memory.segments;
+    if ((mem_map_region_perms(region) & cache_perms) == cache_perms) {
+        *cache = segment;
+    }
+    return segment;
+}
+
+/**
+ * Indicates if the access to the address, which wasn't found by
+ * find_access_segment, is a misaligned access that should be emulated.
+ **/
+static inline bool emulate_misaligned(uint32_t addr)
+{
+    return addr % sizeof(uint32_t) != 0 &&
+            MEM_ALIGN_POLICY == MEM_ALIGN_EMULATE;
+}
+
+/**
+ * Finds the segment holding each byte of the misaligned word at the given
+ * address, which may span two segments and pages. If any byte is invalid,
+ * belongs to a device, or its page doesn't have the given permissions, the
+ * access exception is raised for its address, or the processor is halted if no
+ * trap handler is installed, and false is returned.
+ **/
+static bool find_split_segments(cpu_state_t *cpu_state, uint32_t addr,
+        mem_segment_t *segments[sizeof(uint32_t)], uint8_t perms,
+        riscv_trap_cause_t access_cause)
+{
+    mem_segment_t *segment = NULL;
+    for (uint32_t i = 0; i < sizeof(uint32_t); i++)
+    {
+        uint32_t byte_addr = addr + i;
+        if (segment == NULL || byte_addr - segment->base_addr >=
+                segment->size) {
+            segment = mem_find_segment(cpu_state, byte_addr);
+        }
+
+        if (segment == NULL || segment->backing == MEM_BACKING_MMIO ||
+                (mem_map_page_perms(byte_addr) & perms) != perms) {
+            if (!trap_raise(cpu_state, access_cause, byte_addr)) {
+                fprintf(stderr, "Encountered invalid memory address 0x%08x. "
+                        "Halting simulation.\n", byte_addr);
+                cpu_state->halted = true;
+            }
+            return false;
+        }
+        segments[i] = segment;
+    }
+
+    __atomic_fetch_add(&MEM_SPLIT_ACCESSES, 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+/**
+ * Emulates a misaligned load of the word at the given address, by reading each
+ * of its bytes separately. Errors are handled in the same way as mem_read32.
+ **/
+static uint32_t read_split(cpu_state_t *cpu_state, uint32_t addr)
+{
+    mem_segment_t *segments[sizeof(uint32_t)];
+    if (!find_split_segments(cpu_state, addr, segments, MEM_PERM_READ,
+                CAUSE_LOAD_ACCESS)) {
+        return 0;
+    }
 
-    const uint8_t *mem_addr = &segment->mem[addr - segment->base_addr];
     uint32_t value = 0;
-    for (int i = 0; i < (int)sizeof(uint32_t); i++)
+    for (uint32_t i = 0; i < sizeof(uint32_t); i++)
     {
-        value |= set_byte(mem_addr[i], i);
+        const uint8_t *byte = &segments[i]->mem[addr + i -
+                segments[i]->base_addr];
+        value |= (uint32_t)__atomic_load_n(byte, __ATOMIC_RELAXED) << (8 * i);
     }
 
+    if (__builtin_expect(MEM_HOOKS_ACTIVE, false)) {
+        observe_access(cpu_state, segments[0], addr, value, false);
+    }
     return value;
 }
 
+/**
+ * Emulates a misaligned store of the word to the given address, by writing each
+ * of its bytes separately. Memory is only updated if every byte is valid.
+ * Errors are handled in the same way as mem_write32.
+ **/
+static void write_split(cpu_state_t *cpu_state, uint32_t addr, uint32_t value)
+{
+    mem_segment_t *segments[sizeof(uint32_t)];
+    if (!find_split_segments(cpu_state, addr, segments, MEM_PERM_WRITE,
+                CAUSE_STORE_ACCESS)) {
+        return;
+    }
+
+    uint32_t *generation = NULL;
+    for (uint32_t i = 0; i < sizeof(uint32_t); i++)
+    {
+        // Each of the two words written is stored to on its own
+        if (i == 0 || (addr + i) % sizeof(uint32_t) == 0) {
+            end_store(generation);
+            generation = begin_store(cpu_state, addr + i);
+        }
+
+        // Writes to code are tracked once for each segment written
+        mem_segment_t *segment = segments[i];
+        if (segment->executable && (i == 0 || segments[i - 1] != segment)) {
+            code_watch_write(segment, addr + i);
+        }
+
+        uint8_t *byte = &segment->mem[addr + i - segment->base_addr];
+        __atomic_store_n(byte, get_byte(value, i), __ATOMIC_RELAXED);
+    }
+    end_store(generation);
+
+    if (__builtin_expect(MEM_HOOKS_ACTIVE, false)) {
+        observe_access(cpu_state, segments[0], addr, value, true);
+    }
+    return;
+}
+
+/**
+ * Finds the device region holding the aligned address, which wasn't found by
+ * find_access_segment, and sets its index. Returns NULL if the address is not
+ * in a device region.
+ **/
+static const mem_segment_t *find_device_segment(const cpu_state_t *cpu_state,
+        uint32_t addr, int *region)
+{
+    const mem_segment_t *segment = mem_find_segment(cpu_state, addr);
+    if (addr % sizeof(uint32_t) != 0 || segment == NULL ||
+            segment->backing != MEM_BACKING_MMIO) {
+        return NULL;
+    }
+
+    *region = segment - cpu_state->memory.segments;
+    return segment;
+}
+
+/**
+ * Completes a load that wasn't found by find_access_segment: either a
+ * misaligned load that is emulated, or a load from a device register. Regions
+ * with no device attached read as 0. Returns 0 if the load failed.
+ **/
+static uint32_t read_slow(cpu_state_t *cpu_state, uint32_t addr)
+{
+    if (emulate_misaligned(addr)) {
+        return read_split(cpu_state, addr);
+    }
+
+    int region;
+    const mem_segment_t *segment = find_device_segment(cpu_state, addr,
+            &region);
+    if (segment == NULL) {
+        return 0;
+    }
+
+    const mem_device_t *device = mem_map_device(region);
+    uint32_t value = (device == NULL || device->read == NULL) ? 0 :
+            device->read(device->data, addr - segment->base_addr);
+    if (__builtin_expect(MEM_HOOKS_ACTIVE, false)) {
+        observe_access(cpu_state, segment, addr, value, false);
+    }
+    return value;
+}
+
+/**
+ * Completes a store that wasn't found by find_access_segment: either a
+ * misaligned store that is emulated, or a store to a device register. Stores to
+ * regions with no device attached are dropped.
+ **/
+static void write_slow(cpu_state_t *cpu_state, uint32_t addr, uint32_t value)
+{
+    if (emulate_misaligned(addr)) {
+        write_split(cpu_state, addr, value);
+        return;
+    }
+
+    int region;
+    const mem_segment_t *segment = find_device_segment(cpu_state, addr,
+            &region);
+    if (segment == NULL) {
+        return;
+    }
+
+    const mem_device_t *device = mem_map_device(region);
+    if (device != NULL && device->write != NULL) {
+        device->write(device->data, addr - segment->base_addr, value);
+    }
+    if (__builtin_expect(MEM_HOOKS_ACTIVE, false)) {
+        observe_access(cpu_state, segment, addr, value, true);
+    }
+    return;
+}
+
 /*----------------------------------------------------------------------------
  * Core Simulator Interface Functions
  *----------------------------------------------------------------------------*/
@@ -71,9 +436,12 @@ static uint32_t mem_read_word(const mem_segment_t *segment, uint32_t addr)
  * Reads the value at the specified address in the processor's memory.
  *
  * This function ensures that the value is read in little-endian order from the
- * address. If the address is invalid or it is not aligned to a 4-byte boundary,
- * then this function will mark the CPU as halted, and print out an error
- * message.
+ * address. If the address is invalid, then this function raises a load
+ * exception. If no trap handler is installed, it will instead mark the CPU as
+ * halted, and print out an error message. If the address is not aligned to a
+ * 4-byte boundary, it is handled according to the alignment policy: a load
+ * exception is raised as above (the default), the load is emulated byte by
+ * byte, or the CPU is halted.
  *
  * Inputs:
  *  - cpu_state     The CPU state structure for the processor.
@@ -81,38 +449,58 @@ static uint32_t mem_read_word(const mem_segment_t *segment, uint32_t addr)
  *
  * Outputs:
  *  - cpu_state     If the address is misaligned or invalid, the halted field
- *                  will be set to true.
+ *                  will be set to true, unless a trap handler is installed.
  *  - return        The value at the given address in the CPU's memory.
  **/
 uint32_t mem_read32(cpu_state_t *cpu_state, uint32_t addr)
 {
-    // Make sure the address is aligned
-    if (addr % sizeof(uint32_t) != 0) {
-        fprintf(stderr, "Encountered an unaligned memory address 0x%08x. "
-                "Halting simulation.\n", addr);
-        cpu_state->halted = true;
-        return 0;
+    const mem_segment_t *segment = find_access_segment(cpu_state,
+            &cpu_state->load_segment, addr, true, MEM_PERM_READ,
+            CAUSE_MISALIGNED_LOAD, CAUSE_LOAD_ACCESS);
+    if (segment == NULL) {
+        return read_slow(cpu_state, addr);
     }
 
-    // Try to find the specified address
-    mem_segment_t *segment = mem_find_segment(cpu_state, addr);
-    if (segment == NULL) {
-        fprintf(stderr, "Encountered invalid memory address 0x%08x. Halting "
-                "simulation.\n", addr);
-        cpu_state->halted = true;
-        return 0;
+    uint32_t value = mem_read_word(segment, addr);
+    if (__builtin_expect(MEM_HOOKS_ACTIVE, false)) {
+        observe_access(cpu_state, segment, addr, value, false);
     }
+    return value;
+}
 
-    return mem_read_word(segment, addr);
+/**
+ * Fetches the instruction at the specified address in the processor's memory.
+ *
+ * This behaves like mem_read32, except that a misaligned or invalid address
+ * raises an instruction fetch exception instead of a load exception.
+ *
+ * Inputs:
+ *  - cpu_state     The CPU state structure for the processor.
+ *  - addr          The address from which to fetch the instruction.
+ *
+ * Outputs:
+ *  - cpu_state     If the address is misaligned or invalid, the halted field
+ *                  will be set to true, unless a trap handler is installed.
+ *  - return        The instruction at the given address, or 0 on failure.
+ **/
+uint32_t mem_fetch32(cpu_state_t *cpu_state, uint32_t addr)
+{
+    const mem_segment_t *segment = find_access_segment(cpu_state,
+            &cpu_state->fetch_segment, addr, false, MEM_PERM_EXEC,
+            CAUSE_MISALIGNED_FETCH, CAUSE_FETCH_ACCESS);
+    return (segment == NULL) ? 0 : mem_read_word(segment, addr);
 }
 
 /**
  * Writes the specified value to the given address in the processor's memory.
  *
  * The function ensures that the value is written in little-endian order to the
- * address. If the address is invalid or it is not aligned to a 4-byte boundary,
- * then this function will mark the CPU as halted, and no update to memory
- * happens.
+ * address. If the address is invalid, then this function raises a store
+ * exception, and no update to memory happens. If no trap handler is installed,
+ * it will instead mark the CPU as halted. If the address is not aligned to a
+ * 4-byte boundary, it is handled according to the alignment policy: a store
+ * exception is raised as above (the default), the store is emulated byte by
+ * byte, or the CPU is halted.
  *
  * Inputs:
  *  - cpu_state     The CPU state structure for the processor.
@@ -121,44 +509,220 @@ uint32_t mem_read32(cpu_state_t *cpu_state, uint32_t addr)
  *
  * Outputs:
  *  - cpu_state     If the address is misaligned or invalid, the halted field
- *                  will be set to true. The processor memory is also
- *                  appropriately updated.
+ *                  will be set to true, unless a trap handler is installed.
+ *                  The processor memory is also appropriately updated.
  **/
 void mem_write32(cpu_state_t *cpu_state, uint32_t addr, uint32_t value)
 {
-    // Make sure the address is aligned
-    if (addr % sizeof(uint32_t) != 0) {
-        fprintf(stderr, "Encountered an unaligned memory address 0x%08x. "
-                "Halting simulation.\n", addr);
-        cpu_state->halted = true;
-        return;
-    }
-
-    // Try to find the specified address
-    mem_segment_t *segment = mem_find_segment(cpu_state, addr);
+    mem_segment_t *segment = find_access_segment(cpu_state,
+            &cpu_state->store_segment, addr, true, MEM_PERM_WRITE,
+            CAUSE_MISALIGNED_STORE, CAUSE_STORE_ACCESS);
     if (segment == NULL) {
-        fprintf(stderr, "Encountered invalid memory address 0x%08x. Halting "
-                "simulation.\n", addr);
-        cpu_state->halted = true;
+        write_slow(cpu_state, addr, value);
         return;
     }
 
     // Write the value out in little-endian order
+    uint32_t *generation = begin_store(cpu_state, addr);
     mem_write_word(segment, addr, value);
+    end_store(generation);
+    if (__builtin_expect(MEM_HOOKS_ACTIVE, false)) {
+        observe_access(cpu_state, segment, addr, value, true);
+    }
     return;
 }
 
+/* The atomic memory operations work directly on the little-endian words in the
+ * segment memory, so they require a little-endian host. */
+_Static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "The atomic memory "
+        "operations require a little-endian host.");
+
+/**
+ * Gets the host address of the word at the given address for an atomic memory
+ * operation. Operations that store need read and write permission, and the
+ * others need read permission. Returns NULL if the address is misaligned or
+ * invalid, after raising the given exceptions.
+ **/
+static uint32_t *find_atomic_word(cpu_state_t *cpu_state, uint32_t addr,
+        riscv_trap_cause_t misaligned_cause, riscv_trap_cause_t access_cause)
+{
+    bool store = (access_cause == CAUSE_STORE_ACCESS);
+    mem_segment_t *segment = find_access_segment(cpu_state, store ?
+            &cpu_state->store_segment : &cpu_state->load_segment, addr, false,
+            store ? (MEM_PERM_READ | MEM_PERM_WRITE) : MEM_PERM_READ,
+            misaligned_cause, access_cause);
+    if (segment == NULL) {
+        return NULL;
+    } else if (store && __builtin_expect(segment->executable, false)) {
+        code_watch_write(segment, addr);
+    }
+
+    // Of the observers of the memory accesses, only the statistics count these
+    if (__builtin_expect(MEM_HOOKS_ACTIVE, false) && STATS_ACTIVE) {
+        stats_memory_access(cpu_state, segment, store);
+    }
+
+    return (uint32_t *)&segment->mem[addr - segment->base_addr];
+}
+
+/**
+ * Atomically loads the word at the specified address, and places a reservation
+ * on it for a subsequent store-conditional (the LR.W instruction).
+ *
+ * Errors are handled in the same way as mem_read32.
+ **/
+uint32_t mem_load_reserved32(cpu_state_t *cpu_state, uint32_t addr)
+{
+    uint32_t *word = find_atomic_word(cpu_state, addr, CAUSE_MISALIGNED_LOAD,
+            CAUSE_LOAD_ACCESS);
+    if (word == NULL) {
+        return 0;
+    }
+
+    /* If a hart is storing to the granule, the generation it will leave is
+     * not the one recorded, so the store-conditional fails. */
+    mem_reservation_t *reservation = &cpu_state->memory.reservation;
+    if (cpu_state->memory.shared) {
+        reservation->generation = __atomic_load_n(granule_generation(addr),
+                __ATOMIC_ACQUIRE) & ~1U;
+    }
+    reservation->addr = addr;
+    reservation->valid = true;
+    return __atomic_load_n(word, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * Atomically stores the value to the specified address if the hart still holds
+ * a reservation on it (the SC.W instruction). The reservation is released.
+ *
+ * The store succeeds only if no hart has stored to the word since the
+ * reservation was made. Returns true if the store succeeded. Errors are
+ * handled in the same way as mem_write32, in which case false is returned.
+ *
+ * A hart's own stores release its reservation, so with no other harts, holding
+ * the reservation is enough. Otherwise, the word's granule is locked only if
+ * its generation is still the one recorded, which also advances it.
+ **/
+bool mem_store_conditional32(cpu_state_t *cpu_state, uint32_t addr,
+        uint32_t value)
+{
+    uint32_t *word = find_atomic_word(cpu_state, addr, CAUSE_MISALIGNED_STORE,
+            CAUSE_STORE_ACCESS);
+    mem_reservation_t *reservation = &cpu_state->memory.reservation;
+    bool reserved = reservation->valid && reservation->addr == addr;
+    reservation->valid = false;
+    if (word == NULL || !reserved) {
+        return false;
+    }
+
+    uint32_t *generation = NULL;
+    if (cpu_state->memory.shared) {
+        generation = granule_generation(addr);
+        uint32_t expected = reservation->generation;
+        if (!__atomic_compare_exchange_n(generation, &expected, expected | 1,
+                    false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return false;
+        }
+    }
+
+    __atomic_store_n(word, value, __ATOMIC_SEQ_CST);
+    end_store(generation);
+    return true;
+}
+
+/**
+ * Performs the atomic memory operation on the word, returning its original
+ * value. The operation is a single atomic instruction on the host where
+ * possible.
+ **/
+static uint32_t amo_operate(uint32_t *word, amo_funct5_t op, uint32_t value)
+{
+    /* The acquire and release bits are always satisfied, since all of the
+     * operations are sequentially consistent on the host. */
+    switch (op)
+    {
+        case FUNCT5_AMOSWAP:
+            return __atomic_exchange_n(word, value, __ATOMIC_SEQ_CST);
+        case FUNCT5_AMOADD:
+            return __atomic_fetch_add(word, value, __ATOMIC_SEQ_CST);
+        case FUNCT5_AMOXOR:
+            return __atomic_fetch_xor(word, value, __ATOMIC_SEQ_CST);
+        case FUNCT5_AMOAND:
+            return __atomic_fetch_and(word, value, __ATOMIC_SEQ_CST);
+        case FUNCT5_AMOOR:
+            return __atomic_fetch_or(word, value, __ATOMIC_SEQ_CST);
+        default:
+            break;
+    }
+
+    // The host has no minimum or maximum operations, so use a CAS loop
+    uint32_t old_value = __atomic_load_n(word, __ATOMIC_RELAXED);
+    uint32_t new_value;
+    do {
+        switch (op)
+        {
+            case FUNCT5_AMOMIN:
+                new_value = ((int32_t)value < (int32_t)old_value) ? value :
+                        old_value;
+                break;
+            case FUNCT5_AMOMAX:
+                new_value = ((int32_t)value > (int32_t)old_value) ? value :
+                        old_value;
+                break;
+            case FUNCT5_AMOMINU:
+                new_value = min(value, old_value);
+                break;
+            case FUNCT5_AMOMAXU:
+                new_value = max(value, old_value);
+                break;
+            default:
+                assert(false);
+                return 0;
+        }
+    } while (!__atomic_compare_exchange_n(word, &old_value, new_value, true,
+                __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+
+    return old_value;
+}
+
+/**
+ * Performs the atomic memory operation on the word at the specified address,
+ * combining it with the given value (the AMO*.W instructions). Returns the
+ * original value of the word.
+ *
+ * The operation is carried out with a single atomic instruction on the host
+ * where possible, so it is atomic with respect to all other harts. Like a
+ * store, it makes any store-conditional to the word that is pending fail.
+ * Errors are handled in the same way as mem_write32, in which case 0 is
+ * returned.
+ **/
+uint32_t mem_amo32(cpu_state_t *cpu_state, uint32_t addr, amo_funct5_t op,
+        uint32_t value)
+{
+    uint32_t *word = find_atomic_word(cpu_state, addr, CAUSE_MISALIGNED_STORE,
+            CAUSE_STORE_ACCESS);
+    if (word == NULL) {
+        return 0;
+    }
+
+    uint32_t *generation = begin_store(cpu_state, addr);
+    uint32_t old_value = amo_operate(word, op, value);
+    end_store(generation);
+    return old_value;
+}
+
 /*----------------------------------------------------------------------------
  * Shell Interface Functions
  *----------------------------------------------------------------------------*/
 
 /**
  * Allocates the memory for the given segment, which will have segment->size
- * bytes in it. Exits on error
+ * bytes in it, zero-filled. Large segments are backed by huge pages where the
+ * host allows it. Exits on error
  **/
 static void malloc_mem_segment(mem_segment_t *segment)
 {
-    segment->mem = malloc(segment->size * sizeof(segment->mem[0]));
+    segment->mem = huge_pages_alloc(segment->size, &segment->mapped_size);
     if (segment->mem == NULL) {
         fprintf(stderr, "Error: Unable to allocate memory for processor memory "
                 "segment.\n");
@@ -167,6 +731,17 @@ static void malloc_mem_segment(mem_segment_t *segment)
     return;
 }
 
+/**
+ * Allocates zero-filled memory for the whole memory segment, up to its maximum
+ * size. Exits on error.
+ **/
+static void zero_mem_segment(mem_segment_t *segment)
+{
+    segment->size = segment->max_size;
+    malloc_mem_segment(segment);
+    return;
+}
+
 /**
  * Loads the memory segment from its corresponding data (binary) file. The size
  * of this file cannot exceed the max_size for the memory segment.
@@ -212,10 +787,7 @@ static int load_mem_segment(mem_segment_t *segment, char *data_path)
         rc = -errno;
         fprintf(stderr, "Error: %s: Unable to read memory section file: %s.\n",
                 data_path, strerror(errno));
-
-        free(segment->mem);
-        segment->mem = NULL;
-        segment->size = 0;
+        mem_release_segment(segment);
     }
 
     // Close the data file
@@ -244,30 +816,32 @@ static char *join_strings(const char *string1, const char *string2)
 }
 
 /**
- * Initializes the memory subsystem part of the CPU state.
+ * Reads the program's memory segments from its files into newly allocated
+ * memory, bypassing the image cache. Segments without a data file (the stack)
+ * are not allocated.
  *
- * This loads the memory segments from the specified program into the CPU
- * memory, and initializes them to the values specified in their respective data
- * files. Program name should be the path to the executable file (it has no
- * extension).
+ * If the program's ELF executable exists, then the segments are read from it,
+ * and the entry point is its entry address. Otherwise, each segment is read
+ * from its own binary data file, and the program starts at the user text.
  **/
-int mem_load_program(cpu_state_t *cpu_state, const char *program_path)
+int mem_read_program(cpu_state_t *cpu_state, const char *program_path,
+        uint32_t *entry)
 {
-    // Initialize each memory segment, loading data from the associated file
+    char *elf_path = join_strings(program_path, ELF_EXTENSION);
+    bool load_elf = (access(elf_path, F_OK) == 0);
+
+    // Load each memory segment from its associated data file
     int rc = 0;
-    for (int i = 0; i < cpu_state->memory.num_segments; i++)
+    *entry = mem_map_entry();
+    for (int i = 0; i < cpu_state->memory.num_segments && !load_elf; i++)
     {
-        /* If the memory segment doesn't have a data file, we only allocate it.
-         * In this case, the size of the memory segment is max_size. */
         mem_segment_t *segment = &cpu_state->memory.segments[i];
         if (segment->extension == NULL) {
-            segment->size = segment->max_size;
-            malloc_mem_segment(segment);
             continue;
         }
 
-        /* Otherwise, combine the program path and extension to get the path
-         * to the data file, load it, then free the buffer. */
+        /* Combine the program path and extension to get the path to the data
+         * file, load it, then free the buffer. */
         char *data_path = join_strings(program_path, segment->extension);
         rc = load_mem_segment(segment, data_path);
         free(data_path);
@@ -279,11 +853,81 @@ int mem_load_program(cpu_state_t *cpu_state, const char *program_path)
         }
     }
 
-    /* Point the PC to the user text segment, the stack pointer (x2) to the
+    // Otherwise, load the segments from the executable
+    if (load_elf) {
+        rc = elf_load_program(cpu_state, elf_path, entry);
+        if (rc < 0) {
+            mem_unload_program(cpu_state);
+        }
+    }
+
+    free(elf_path);
+    return rc;
+}
+
+/**
+ * Initializes the memory subsystem part of the CPU state.
+ *
+ * This loads the memory segments from the specified program into the CPU
+ * memory, and initializes them to the values specified in their respective data
+ * files. Program name should be the path to the executable file (it has no
+ * extension).
+ *
+ * The program's contents come from the image cache, so the files are only read
+ * again if they have changed since the program was last loaded. Each segment is
+ * mapped privately from the cached image.
+ **/
+int mem_load_program(cpu_state_t *cpu_state, const char *program_path)
+{
+    memory_t *memory = &cpu_state->memory;
+    program_image_t *image = NULL;
+    int rc = image_cache_acquire(cpu_state, program_path, &image);
+    memory->image = image;
+
+    /* Initialize each memory segment, mapping its contents from the image if
+     * it has a data file, and zero-filling it otherwise. Devices have no memory
+     * behind them, but span their whole region. */
+    for (int i = 0; i < memory->num_segments; i++)
+    {
+        mem_segment_t *segment = &memory->segments[i];
+        switch (segment->backing)
+        {
+            case MEM_BACKING_FILE:
+                rc = (rc < 0) ? rc : image_map_segment(image, i, segment);
+                break;
+
+            case MEM_BACKING_ZERO:
+            case MEM_BACKING_STACK:
+                zero_mem_segment(segment);
+                break;
+
+            case MEM_BACKING_MMIO:
+                segment->size = segment->max_size;
+                break;
+        }
+    }
+
+    // Free the memory segments if we failed to load any of them
+    uint32_t entry = mem_map_entry();
+    if (rc < 0) {
+        mem_unload_program(cpu_state);
+    } else {
+        entry = image_entry(image);
+        memory->symbols = image_symbols(image);
+    }
+
+    // Drop any reservation left over from the previous program
+    memory->reservation.valid = false;
+    mem_flush_access_caches(cpu_state);
+
+    /* Point the PC to the program's entry point, the stack pointer (x2) to the
      * stack segment, and the global pointer (x3) to the user data segment. */
-    cpu_state->pc = USER_TEXT_START;
-    register_write(cpu_state, REG_SP, STACK_END);
-    register_write(cpu_state, REG_GP, USER_DATA_START);
+    uint32_t stack_end, stack_size;
+    mem_map_stack(&stack_end, &stack_size);
+    cpu_state->pc = entry;
+    register_write(cpu_state, (riscv_isa_reg_t)REG_SP, stack_end);
+    register_write(cpu_state, (riscv_isa_reg_t)REG_GP,
+            mem_map_global_pointer());
 
     return rc;
 }
@@ -300,14 +944,116 @@ void mem_unload_program(struct cpu_state *cpu_state)
     memory_t *memory = &cpu_state->memory;
     for (int i = 0; i < memory->num_segments; i++)
     {
-        mem_segment_t *segment = &memory->segments[i];
-        if (segment->mem != NULL) {
-            free(segment->mem);
-            segment->mem = NULL;
-            segment->size = 0;
-        }
+        mem_release_segment(&memory->segments[i]);
+    }
+
+    // Release the image the program was loaded from, which owns its symbols
+    if (memory->image != NULL) {
+        image_cache_release(memory->image);
+        memory->image = NULL;
+    }
+    memory->symbols = NULL;
+    return;
+}
+
+/**
+ * Frees the memory of the segment, however it was allocated: by malloc, by
+ * mapping it, or by sharing it with other instances.
+ **/
+void mem_release_segment(mem_segment_t *segment)
+{
+    if (segment->shared != NULL) {
+        text_release(segment);
+    } else if (segment->mapped_size != 0) {
+        munmap(segment->mem, segment->mapped_size);
+    } else {
+        free(segment->mem);
     }
 
+    code_watch_release(segment);
+    segment->mem = NULL;
+    segment->size = 0;
+    segment->mapped_size = 0;
+    return;
+}
+
+/**
+ * Gives the memory its own table of segments, laid out as the processor's
+ * memory segments, with nothing loaded in them. Returns 0 on success, or a
+ * negative error code on failure.
+ **/
+int mem_create_segments(memory_t *memory)
+{
+    // The memory map is fixed once the first table of segments is created
+    int rc = mem_map_build();
+    if (rc < 0) {
+        return rc;
+    }
+
+    int num_regions;
+    const mem_segment_t *regions = mem_map_regions(&num_regions);
+    mem_segment_t *segments = malloc(num_regions * sizeof(segments[0]));
+    if (segments == NULL) {
+        fprintf(stderr, "Error: Unable to allocate the memory segments.\n");
+        return -ENOMEM;
+    }
+
+    memcpy(segments, regions, num_regions * sizeof(segments[0]));
+    memory->num_segments = num_regions;
+    memory->segments = segments;
+    return 0;
+}
+
+/**
+ * Empties the caches of the segments last used by the processor's fetches,
+ * loads, and stores.
+ **/
+void mem_flush_access_caches(cpu_state_t *cpu_state)
+{
+    cpu_state->fetch_segment = NULL;
+    cpu_state->load_segment = NULL;
+    cpu_state->store_segment = NULL;
+    return;
+}
+
+/**
+ * Recomputes whether any observer of the processor's loads and stores is
+ * active. This must be invoked whenever an observer is started or stopped.
+ **/
+void mem_hooks_update(void)
+{
+    MEM_HOOKS_ACTIVE = !MEM_HOOKS_PAUSED && (HEATMAP_ACTIVE || STATS_ACTIVE ||
+            PLUGINS_MEM_HOOKED);
+    return;
+}
+
+/**
+ * Pauses or resumes every observer of the processor's loads and stores, such
+ * as while the accesses they have already seen are replayed.
+ **/
+void mem_hooks_pause(bool paused)
+{
+    MEM_HOOKS_PAUSED = paused;
+    mem_hooks_update();
+    return;
+}
+
+/**
+ * Updates the processor's segments after the permissions of the memory map's
+ * pages have been changed. The access caches are emptied, since they may hold
+ * segments that no longer allow every access, and segments that now hold
+ * executable pages have their writes tracked.
+ **/
+void mem_update_permissions(cpu_state_t *cpu_state)
+{
+    mem_flush_access_caches(cpu_state);
+
+    int num_regions;
+    const mem_segment_t *regions = mem_map_regions(&num_regions);
+    for (int i = 0; i < cpu_state->memory.num_segments; i++)
+    {
+        cpu_state->memory.segments[i].executable |= regions[i].executable;
+    }
     return;
 }
 
@@ -321,19 +1067,10 @@ bool mem_range_valid(const cpu_state_t *cpu_state, uint32_t start_addr,
 {
     assert(start_addr < end_addr);
 
-    /* Iterate over the memory segments, checking if the range is completely
-     * contained in any segment. */
-    for (int i = 0; i < cpu_state->memory.num_segments; i++)
-    {
-        const mem_segment_t *segment = &cpu_state->memory.segments[i];
-        uint32_t segment_end_addr = segment->base_addr + segment->size;
-
-        if (segment->base_addr <= start_addr && end_addr <= segment_end_addr) {
-            return true;
-        }
-    }
-
-    return false;
+    /* The segments don't overlap, so the range is valid only if the segment
+     * holding its start also holds its end. */
+    const mem_segment_t *segment = mem_find_segment(cpu_state, start_addr);
+    return segment != NULL && end_addr - segment->base_addr <= segment->size;
 }
 
 /**
@@ -344,18 +1081,53 @@ bool mem_range_valid(const cpu_state_t *cpu_state, uint32_t start_addr,
  **/
 mem_segment_t *mem_find_segment(const cpu_state_t *cpu_state, uint32_t addr)
 {
-    // Iterate over the memory segments, checking if the address lies in them
-    for (int i = 0; i < cpu_state->memory.num_segments; i++)
-    {
-        mem_segment_t *segment = &cpu_state->memory.segments[i];
-        uint32_t segment_end_addr = segment->base_addr + segment->size;
+    /* Every table of segments is laid out as the memory map, so the region's
+     * index is the segment's. Only the part of the region that is loaded is
+     * valid. */
+    int index = mem_map_lookup(addr);
+    if (index < 0 || index >= cpu_state->memory.num_segments) {
+        return NULL;
+    }
 
-        if (segment->base_addr <= addr && addr < segment_end_addr) {
-            return segment;
-        }
+    mem_segment_t *segment = &cpu_state->memory.segments[index];
+    return (addr - segment->base_addr < segment->size) ? segment : NULL;
+}
+
+/**
+ * Reads the word at the specified address, without raising any exceptions.
+ * Returns false if the address is misaligned, invalid, or a device register.
+ **/
+bool mem_peek32(const cpu_state_t *cpu_state, uint32_t addr, uint32_t *value)
+{
+    const mem_segment_t *segment = mem_find_segment(cpu_state, addr);
+    if (segment == NULL || addr % sizeof(uint32_t) != 0 ||
+            segment->backing == MEM_BACKING_MMIO) {
+        return false;
     }
 
-    return NULL;
+    *value = mem_read_word(segment, addr);
+    return true;
+}
+
+/**
+ * Finds the address that the instruction writes, from the hart's registers, if
+ * it is a store or an atomic memory operation. Returns false for any other
+ * instruction.
+ **/
+bool mem_store_address(const cpu_state_t *cpu_state, uint32_t instr,
+        uint32_t *addr)
+{
+    uint32_t opcode = instr & (RISCV_NUM_OPCODES - 1);
+    uint32_t rs1_value = cpu_state->registers[(instr >> 15) & 0x1F];
+    if (opcode == OP_STORE) {
+        uint32_t imm = (instr >> 25) << 5 | ((instr >> 7) & 0x1F);
+        *addr = rs1_value + (uint32_t)((int32_t)(imm << 20) >> 20);
+        return true;
+    } else if (opcode == OP_AMO) {
+        *addr = rs1_value;
+        return true;
+    }
+    return false;
 }
 
 /**
@@ -370,11 +1142,24 @@ void mem_write_word(mem_segment_t *segment, uint32_t addr, uint32_t value)
     assert(segment->base_addr <= addr &&
             addr < segment->base_addr + segment->size);
 
+    // Writes to code are tracked, and shared text is copied before them
+    if (__builtin_expect(segment->executable, false)) {
+        code_watch_write(segment, addr);
+    }
+
     // Determine the number of bytes that can be written into the segment
     uint32_t end_addr = segment->base_addr + segment->size;
     int bytes_write = min(sizeof(uint32_t), end_addr - addr);
     uint8_t *mem_addr = &segment->mem[addr - segment->base_addr];
 
+    /* Aligned words are written with a single relaxed atomic store, since the
+     * segment may be shared with harts running on other host threads. */
+    if (addr % sizeof(uint32_t) == 0 && bytes_write == sizeof(uint32_t)) {
+        __atomic_store_n((uint32_t *)mem_addr, htole32(value),
+                __ATOMIC_RELAXED);
+        return;
+    }
+
     for (int i = 0; i < bytes_write; i++)
     {
         mem_addr[i] = get_byte(value, i);
@@ -0,0 +1,828 @@
+/**
+ * memory_map.c
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the implementation of the memory map, which defines the
+ * regions of the processor's memory, and translates addresses to them.
+ *
+ * The map is configured on the command line, before any harts are created, and
+ * is never changed afterwards, so it is kept in global state that every hart
+ * reads without locking.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+// Standard Includes
+#include <stdlib.h>                 // Malloc, strtoull, and related functions
+#include <stdio.h>                  // Printf and related functions
+#include <stdint.h>                 // Fixed-size integral types
+#include <stdbool.h>                // Definition of the boolean type
+
+// Standard Includes
+#include <errno.h>                  // Error codes
+#include <string.h>                 // String manipulation functions
+#include <ctype.h>                  // Character classification functions
+#include <assert.h>                 // Assert macro
+
+// 18-447 Simulator Includes
+#include <memory.h>                 // Definition of mem_segment_t
+
+// Local Includes
+#include "libc_extensions.h"        // Array length and min functions
+#include "memory_segments.h"        // The default memory map
+#include "memory_map.h"             // This file's interface
+
+/*----------------------------------------------------------------------------
+ * Internal Definitions
+ *----------------------------------------------------------------------------*/
+
+// The maximum number of fields on a line of a map file
+#define MAX_FIELDS              6
+
+// The minimum number of fields in a region's description
+#define MIN_FIELDS              5
+
+// The maximum length of a line of a map file
+#define MAX_LINE_LEN            512
+
+// The regions of the memory map, and the devices attached to them
+static mem_segment_t REGIONS[MEM_MAP_MAX_REGIONS];
+static const mem_device_t *DEVICES[MEM_MAP_MAX_REGIONS];
+static int NUM_REGIONS                  = 0;
+
+// Indicates if the regions have been set, and if the map has been built
+static bool MAP_INITIALIZED             = false;
+static bool MAP_BUILT                   = false;
+
+// The permissions that every page of each region has
+static uint8_t REGION_PERMS[MEM_MAP_MAX_REGIONS];
+
+// The second-level table for the unmapped parts of memory
+static const mem_map_entry_t EMPTY_TABLE[MEM_MAP_TABLE_ENTRIES];
+
+/* Indicates if each second-level table is shared by every part of memory
+ * wholly inside a region, rather than private to one part of memory. */
+static bool TABLE_SHARED[MEM_MAP_NUM_TABLES];
+
+// The first level of the translation table
+const mem_map_entry_t *MEM_MAP_TABLES[MEM_MAP_NUM_TABLES];
+
+// The names of the backings, indexed by backing
+static const char *const BACKING_NAMES[] = {
+    [MEM_BACKING_FILE] = "file",
+    [MEM_BACKING_ZERO] = "zero",
+    [MEM_BACKING_STACK] = "stack",
+    [MEM_BACKING_MMIO] = "mmio",
+};
+
+/*----------------------------------------------------------------------------
+ * Parsing Helper Functions
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Starts the memory map out as the default memory segments, if no regions have
+ * been set yet.
+ **/
+static void init_regions(void)
+{
+    if (!MAP_INITIALIZED) {
+        memcpy(REGIONS, MEMORY_SEGMENTS, sizeof(MEMORY_SEGMENTS));
+        NUM_REGIONS = array_len(MEMORY_SEGMENTS);
+        MAP_INITIALIZED = true;
+    }
+    return;
+}
+
+/**
+ * Splits the line into its whitespace-separated fields in place, stopping at a
+ * comment. A field may be quoted to include spaces. Returns the number of
+ * fields, or a negative error code if there are too many, or a quote is left
+ * open.
+ **/
+static int split_fields(char *line, char *fields[MAX_FIELDS])
+{
+    int num_fields = 0;
+    char *cursor = line;
+    while (true)
+    {
+        while (isspace((unsigned char)*cursor)) {
+            cursor++;
+        }
+        if (*cursor == '\0' || *cursor == '#') {
+            return num_fields;
+        } else if (num_fields == MAX_FIELDS) {
+            return -E2BIG;
+        }
+
+        // Find the end of the field, which is either a quote or a space
+        char *end;
+        if (*cursor == '"') {
+            cursor++;
+            end = strchr(cursor, '"');
+            if (end == NULL) {
+                return -EINVAL;
+            }
+        } else {
+            end = cursor;
+            while (*end != '\0' && *end != '#' &&
+                    !isspace((unsigned char)*end)) {
+                end++;
+            }
+        }
+
+        fields[num_fields] = cursor;
+        num_fields += 1;
+        if (*end == '\0' || *end == '#') {
+            *end = '\0';
+            return num_fields;
+        }
+        *end = '\0';
+        cursor = end + 1;
+    }
+}
+
+/**
+ * Parses the string as an unsigned integer of at most 32 bits, in decimal or
+ * hexadecimal, with an optional K, M, or G suffix if allowed. Values up to
+ * 2^32 are accepted, so that a region can reach the top of memory. Returns 0
+ * on success, or a negative error code on failure.
+ **/
+static int parse_quantity(const char *string, bool allow_suffix,
+        uint64_t *value)
+{
+    char *end;
+    errno = 0;
+    unsigned long long parsed = strtoull(string, &end, 0);
+    if (errno != 0 || end == string || string[0] == '-') {
+        return -EINVAL;
+    }
+
+    unsigned int shift = 0;
+    if (allow_suffix && *end != '\0' && end[1] == '\0') {
+        switch (toupper((unsigned char)*end))
+        {
+            case 'K': shift = 10; end++; break;
+            case 'M': shift = 20; end++; break;
+            case 'G': shift = 30; end++; break;
+        }
+    }
+
+    if (*end != '\0' || parsed > (UINT64_C(1) << (32 - shift))) {
+        return -EINVAL;
+    }
+    *value = (uint64_t)parsed << shift;
+    return 0;
+}
+
+/**
+ * Parses the description of a region into the region, which has the fields of
+ * the map file's lines. The location is used for error messages. Returns 0 on
+ * success, or a negative error code on failure.
+ **/
+static int parse_region(char *spec, const char *location,
+        mem_segment_t *region)
+{
+    char *fields[MAX_FIELDS];
+    int num_fields = split_fields(spec, fields);
+    if (num_fields < 0) {
+        fprintf(stderr, "Error: %s: Too many fields or unterminated quote.\n",
+                location);
+        return num_fields;
+    } else if (num_fields < MIN_FIELDS) {
+        fprintf(stderr, "Error: %s: Expected '<name> <base> <size> <perms> "
+                "<backing> [extension]'.\n", location);
+        return -EINVAL;
+    }
+
+    uint64_t base, size;
+    uint8_t perms;
+    if (parse_quantity(fields[1], false, &base) < 0 || base > UINT32_MAX) {
+        fprintf(stderr, "Error: %s: Invalid base address '%s'.\n", location,
+                fields[1]);
+        return -EINVAL;
+    } else if (parse_quantity(fields[2], true, &size) < 0 || size == 0) {
+        fprintf(stderr, "Error: %s: Invalid size '%s'.\n", location,
+                fields[2]);
+        return -EINVAL;
+    } else if (mem_map_parse_perms(fields[3], &perms) < 0) {
+        fprintf(stderr, "Error: %s: Invalid permissions '%s'.\n", location,
+                fields[3]);
+        return -EINVAL;
+    }
+
+    int backing = -1;
+    for (int i = 0; i < (int)array_len(BACKING_NAMES); i++)
+    {
+        if (strcmp(fields[4], BACKING_NAMES[i]) == 0) {
+            backing = i;
+        }
+    }
+
+    // Only file-backed regions have the extension of their data file
+    bool has_extension = (num_fields == MAX_FIELDS);
+    if (backing < 0) {
+        fprintf(stderr, "Error: %s: Invalid backing '%s'.\n", location,
+                fields[4]);
+        return -EINVAL;
+    } else if ((backing == MEM_BACKING_FILE) != has_extension ||
+            (has_extension && fields[5][0] != '.')) {
+        fprintf(stderr, "Error: %s: A 'file' region, and only a 'file' "
+                "region, must have a data file extension starting with '.'.\n",
+                location);
+        return -EINVAL;
+    }
+
+    /* The region's size is capped by the largest size that reaches the top of
+     * memory, which is representable. */
+    *region = (mem_segment_t){
+        .base_addr = base,
+        .max_size = min(size, (uint64_t)UINT32_MAX - base),
+        .name = strdup(fields[0]),
+        .extension = has_extension ? strdup(fields[5]) : NULL,
+        .executable = (perms & MEM_PERM_EXEC) != 0,
+        .perms = perms,
+        .backing = backing,
+    };
+    if (region->name == NULL || (has_extension && region->extension == NULL)) {
+        fprintf(stderr, "Error: Unable to allocate the memory region.\n");
+        return -ENOMEM;
+    }
+    return 0;
+}
+
+/**
+ * Returns the index of the region with the given name, or -1 if there is none.
+ **/
+static int find_region(const char *name)
+{
+    for (int i = 0; i < NUM_REGIONS; i++)
+    {
+        if (strcmp(REGIONS[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Returns the region loaded from the data file with the given extension, or
+ * NULL if there is none.
+ **/
+static const mem_segment_t *find_file_region(const char *extension)
+{
+    for (int i = 0; i < NUM_REGIONS; i++)
+    {
+        const mem_segment_t *region = &REGIONS[i];
+        if (region->extension != NULL &&
+                strcmp(region->extension, extension) == 0) {
+            return region;
+        }
+    }
+    return NULL;
+}
+
+/*----------------------------------------------------------------------------
+ * Translation Table Helper Functions
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Checks that the region is page-aligned, and isn't a duplicate of one of the
+ * regions before it. Returns 0 on success, or a negative error code on failure.
+ **/
+static int check_region(int index)
+{
+    const mem_segment_t *region = &REGIONS[index];
+    if (region->base_addr % MEM_MAP_PAGE_SIZE != 0) {
+        fprintf(stderr, "Error: Memory region '%s' at 0x%08x is not aligned to "
+                "a %u-byte page.\n", region->name, region->base_addr,
+                MEM_MAP_PAGE_SIZE);
+        return -EINVAL;
+    }
+
+    for (int i = 0; i < index; i++)
+    {
+        const mem_segment_t *other = &REGIONS[i];
+        if (strcmp(other->name, region->name) == 0) {
+            fprintf(stderr, "Error: Memory region '%s' is defined twice.\n",
+                    region->name);
+            return -EINVAL;
+        } else if (region->extension != NULL && other->extension != NULL &&
+                strcmp(other->extension, region->extension) == 0) {
+            fprintf(stderr, "Error: Memory regions '%s' and '%s' are both "
+                    "loaded from '%s' files.\n", other->name, region->name,
+                    region->extension);
+            return -EINVAL;
+        } else if (region->backing == MEM_BACKING_STACK &&
+                other->backing == MEM_BACKING_STACK) {
+            fprintf(stderr, "Error: Memory regions '%s' and '%s' are both "
+                    "stacks.\n", other->name, region->name);
+            return -EINVAL;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Reports that the region overlaps the region that already holds the page.
+ * Returns a negative error code.
+ **/
+static int overlap_error(int index, uint32_t page, mem_map_entry_t entry)
+{
+    int other = (entry & MEM_MAP_REGION_MASK) - 1;
+    fprintf(stderr, "Error: Memory regions '%s' and '%s' overlap at "
+            "0x%08x.\n", REGIONS[other].name, REGIONS[index].name,
+            page << MEM_MAP_PAGE_SHIFT);
+    return -EINVAL;
+}
+
+/**
+ * Returns the entry of the translation table for a page of the region, with the
+ * given permissions.
+ **/
+static mem_map_entry_t make_entry(int index, uint8_t perms)
+{
+    return (mem_map_entry_t)((perms << MEM_MAP_PERMS_SHIFT) | (index + 1));
+}
+
+/**
+ * Gives the part of memory its own copy of its second-level table, if it is
+ * shared or empty, so that its entries can be changed. Returns NULL if the
+ * table can't be allocated.
+ **/
+static mem_map_entry_t *private_table(uint32_t table)
+{
+    const mem_map_entry_t *current = MEM_MAP_TABLES[table];
+    if (current != EMPTY_TABLE && !TABLE_SHARED[table]) {
+        return (mem_map_entry_t *)current;
+    }
+
+    mem_map_entry_t *copy = malloc(MEM_MAP_TABLE_ENTRIES * sizeof(copy[0]));
+    if (copy == NULL) {
+        fprintf(stderr, "Error: Unable to allocate the memory map's "
+                "translation table.\n");
+        return NULL;
+    }
+
+    memcpy(copy, current, MEM_MAP_TABLE_ENTRIES * sizeof(copy[0]));
+    MEM_MAP_TABLES[table] = copy;
+    TABLE_SHARED[table] = false;
+    return copy;
+}
+
+/**
+ * Recomputes the permissions that every page of the region has.
+ **/
+static void update_region_perms(int index)
+{
+    const mem_segment_t *region = &REGIONS[index];
+    uint32_t first_page = region->base_addr >> MEM_MAP_PAGE_SHIFT;
+    uint32_t last_page = (uint32_t)(((uint64_t)region->base_addr +
+            region->max_size - 1) >> MEM_MAP_PAGE_SHIFT);
+
+    uint8_t perms = MEM_PERM_READ | MEM_PERM_WRITE | MEM_PERM_EXEC;
+    for (uint32_t page = first_page; page <= last_page; page++)
+    {
+        const mem_map_entry_t *table = MEM_MAP_TABLES[page /
+                MEM_MAP_TABLE_ENTRIES];
+        perms &= table[page % MEM_MAP_TABLE_ENTRIES] >> MEM_MAP_PERMS_SHIFT;
+
+        // Shared tables have the region's permissions throughout
+        if (TABLE_SHARED[page / MEM_MAP_TABLE_ENTRIES]) {
+            page |= MEM_MAP_TABLE_ENTRIES - 1;
+        }
+    }
+
+    REGION_PERMS[index] = perms;
+    return;
+}
+
+/**
+ * Maps the pages of the region into the translation table. Returns 0 on
+ * success, or a negative error code on failure.
+ **/
+static int map_region(int index, mem_map_entry_t *shared_table)
+{
+    const mem_segment_t *region = &REGIONS[index];
+    uint32_t first_page = region->base_addr >> MEM_MAP_PAGE_SHIFT;
+    uint32_t last_page = (uint32_t)(((uint64_t)region->base_addr +
+            region->max_size - 1) >> MEM_MAP_PAGE_SHIFT);
+    uint32_t pages_per_table = MEM_MAP_TABLE_ENTRIES;
+
+    uint32_t first_table = first_page / pages_per_table;
+    uint32_t last_table = last_page / pages_per_table;
+    for (uint32_t table = first_table; table <= last_table; table++)
+    {
+        uint32_t table_first = table * pages_per_table;
+        uint32_t start = max(first_page, table_first);
+        uint32_t end = min(last_page, table_first + pages_per_table - 1);
+
+        // Parts of memory wholly inside the region share a single table
+        const mem_map_entry_t *current = MEM_MAP_TABLES[table];
+        if (current == EMPTY_TABLE && start == table_first &&
+                end == table_first + pages_per_table - 1) {
+            MEM_MAP_TABLES[table] = shared_table;
+            TABLE_SHARED[table] = true;
+            continue;
+        } else if (TABLE_SHARED[table]) {
+            return overlap_error(index, start, current[0]);
+        }
+
+        // Otherwise, the part of memory gets its own table
+        mem_map_entry_t *entries = private_table(table);
+        if (entries == NULL) {
+            return -ENOMEM;
+        }
+
+        for (uint32_t page = start; page <= end; page++)
+        {
+            mem_map_entry_t *entry = &entries[page - table_first];
+            if (*entry != 0) {
+                return overlap_error(index, page, *entry);
+            }
+            *entry = make_entry(index, region->perms);
+        }
+    }
+
+    return 0;
+}
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Parses a string of permissions, such as 'rw' or '-', into a mask of
+ * MEM_PERM_* flags. Returns 0 on success, or a negative error code on failure.
+ **/
+int mem_map_parse_perms(const char *string, uint8_t *perms)
+{
+    *perms = 0;
+    if (strcmp(string, "-") == 0) {
+        return 0;
+    }
+
+    for (const char *c = string; *c != '\0'; c++)
+    {
+        uint8_t perm;
+        switch (*c)
+        {
+            case 'r': perm = MEM_PERM_READ; break;
+            case 'w': perm = MEM_PERM_WRITE; break;
+            case 'x': perm = MEM_PERM_EXEC; break;
+            default: return -EINVAL;
+        }
+
+        if ((*perms & perm) != 0) {
+            return -EINVAL;
+        }
+        *perms |= perm;
+    }
+    return 0;
+}
+
+/**
+ * Replaces the memory map with the regions in the map file. Returns 0 on
+ * success, or a negative error code on failure.
+ **/
+int mem_map_load_file(const char *map_path)
+{
+    assert(!MAP_BUILT);
+
+    FILE *map_file = fopen(map_path, "r");
+    if (map_file == NULL) {
+        int rc = -errno;
+        fprintf(stderr, "Error: %s: Unable to open file: %s.\n", map_path,
+                strerror(errno));
+        return rc;
+    }
+
+    // Parse each line with a region on it, replacing any earlier regions
+    int rc = 0;
+    char line[MAX_LINE_LEN];
+    MAP_INITIALIZED = true;
+    NUM_REGIONS = 0;
+    for (int line_num = 1; rc == 0 && fgets(line, sizeof(line), map_file) !=
+            NULL; line_num++)
+    {
+        char location[strlen(map_path) + 16];
+        Snprintf(location, sizeof(location), "%s:%d", map_path, line_num);
+
+        char *fields[MAX_FIELDS];
+        char copy[sizeof(line)];
+        strcpy(copy, line);
+        if (split_fields(copy, fields) == 0) {
+            continue;
+        } else if (NUM_REGIONS == MEM_MAP_MAX_REGIONS) {
+            fprintf(stderr, "Error: %s: Too many memory regions, at most %d "
+                    "are allowed.\n", location, MEM_MAP_MAX_REGIONS);
+            rc = -E2BIG;
+            break;
+        }
+
+        rc = parse_region(line, location, &REGIONS[NUM_REGIONS]);
+        NUM_REGIONS += (rc == 0);
+    }
+
+    fclose(map_file);
+    return rc;
+}
+
+/**
+ * Adds the region described by the string, which has the same form as a line
+ * of a map file, to the memory map. A region with the same name is replaced.
+ * Returns 0 on success, or a negative error code on failure.
+ **/
+int mem_map_set_region(const char *region_spec)
+{
+    assert(!MAP_BUILT);
+    init_regions();
+
+    char spec[strlen(region_spec) + 1];
+    strcpy(spec, region_spec);
+    mem_segment_t region;
+    int rc = parse_region(spec, "-r option", &region);
+    if (rc < 0) {
+        return rc;
+    }
+
+    int index = find_region(region.name);
+    if (index < 0 && NUM_REGIONS == MEM_MAP_MAX_REGIONS) {
+        fprintf(stderr, "Error: Too many memory regions, at most %d are "
+                "allowed.\n", MEM_MAP_MAX_REGIONS);
+        return -E2BIG;
+    } else if (index < 0) {
+        index = NUM_REGIONS;
+        NUM_REGIONS += 1;
+    }
+
+    REGIONS[index] = region;
+    return 0;
+}
+
+/**
+ * Checks the memory map, and builds its translation table. The map can't be
+ * changed afterwards. Does nothing if the map is already built. Returns 0 on
+ * success, or a negative error code on failure.
+ **/
+int mem_map_build(void)
+{
+    if (MAP_BUILT) {
+        return 0;
+    }
+    init_regions();
+
+    for (uint32_t table = 0; table < MEM_MAP_NUM_TABLES; table++)
+    {
+        MEM_MAP_TABLES[table] = EMPTY_TABLE;
+    }
+
+    for (int i = 0; i < NUM_REGIONS; i++)
+    {
+        int rc = check_region(i);
+        if (rc < 0) {
+            return rc;
+        }
+
+        // Build the table shared by the parts of memory wholly in the region
+        mem_map_entry_t *shared_table = malloc(MEM_MAP_TABLE_ENTRIES *
+                sizeof(shared_table[0]));
+        if (shared_table == NULL) {
+            fprintf(stderr, "Error: Unable to allocate the memory map's "
+                    "translation table.\n");
+            return -ENOMEM;
+        }
+        for (uint32_t page = 0; page < MEM_MAP_TABLE_ENTRIES; page++)
+        {
+            shared_table[page] = make_entry(i, REGIONS[i].perms);
+        }
+
+        rc = map_region(i, shared_table);
+        if (rc < 0) {
+            return rc;
+        }
+        REGION_PERMS[i] = REGIONS[i].perms;
+    }
+
+    MAP_BUILT = true;
+    return 0;
+}
+
+/**
+ * Returns the regions of the memory map, which are the layout of every table of
+ * memory segments, and sets the number of them. The map must have been built.
+ **/
+const mem_segment_t *mem_map_regions(int *num_regions)
+{
+    assert(MAP_BUILT);
+    *num_regions = NUM_REGIONS;
+    return REGIONS;
+}
+
+/**
+ * Returns the permissions that every page of the region with the given index
+ * has, which are the region's own unless some of its pages were changed.
+ **/
+uint8_t mem_map_region_perms(int region)
+{
+    return REGION_PERMS[region];
+}
+
+/**
+ * Sets the permissions (MEM_PERM_*) of the pages in the range [start, end),
+ * which must start on a page boundary, and lie in mapped pages. The range is
+ * extended to the end of its last page. A region stays executable once any of
+ * its pages is made executable. Returns 0 on success, or a negative error code
+ * on failure.
+ **/
+int mem_map_protect(uint32_t start_addr, uint32_t end_addr, uint8_t perms)
+{
+    assert(MAP_BUILT && start_addr < end_addr);
+    if (start_addr % MEM_MAP_PAGE_SIZE != 0) {
+        fprintf(stderr, "Error: Address 0x%08x is not aligned to a %u-byte "
+                "page.\n", start_addr, MEM_MAP_PAGE_SIZE);
+        return -EINVAL;
+    }
+
+    // Check that the whole range is mapped before changing any of it
+    uint32_t first_page = start_addr >> MEM_MAP_PAGE_SHIFT;
+    uint32_t last_page = (end_addr - 1) >> MEM_MAP_PAGE_SHIFT;
+    for (uint32_t page = first_page; page <= last_page; page++)
+    {
+        if (mem_map_lookup(page << MEM_MAP_PAGE_SHIFT) < 0) {
+            fprintf(stderr, "Error: Page 0x%08x is not mapped.\n",
+                    page << MEM_MAP_PAGE_SHIFT);
+            return -EINVAL;
+        }
+    }
+
+    bool changed[MEM_MAP_MAX_REGIONS] = { false };
+    for (uint32_t page = first_page; page <= last_page; page++)
+    {
+        mem_map_entry_t *table = private_table(page / MEM_MAP_TABLE_ENTRIES);
+        if (table == NULL) {
+            return -ENOMEM;
+        }
+
+        mem_map_entry_t *entry = &table[page % MEM_MAP_TABLE_ENTRIES];
+        int index = (*entry & MEM_MAP_REGION_MASK) - 1;
+        *entry = make_entry(index, perms);
+        changed[index] = true;
+
+        // A region that has ever had executable pages may hold code
+        REGIONS[index].executable |= (perms & MEM_PERM_EXEC) != 0;
+    }
+
+    for (int i = 0; i < NUM_REGIONS; i++)
+    {
+        if (changed[i]) {
+            update_region_perms(i);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Returns the default entry point of programs, which is the base of the region
+ * loaded from the user text file, or 0 if there is none.
+ **/
+uint32_t mem_map_entry(void)
+{
+    const mem_segment_t *region = find_file_region(USER_TEXT_EXTENSION);
+    return (region == NULL) ? 0 : region->base_addr;
+}
+
+/**
+ * Returns the initial global pointer, which is the base of the region loaded
+ * from the user data file, or 0 if there is none.
+ **/
+uint32_t mem_map_global_pointer(void)
+{
+    const mem_segment_t *region = find_file_region(USER_DATA_EXTENSION);
+    return (region == NULL) ? 0 : region->base_addr;
+}
+
+/**
+ * Returns the address of the trap vector, which is the base of the region
+ * loaded from the kernel text file, or 0 if there is none.
+ **/
+uint32_t mem_map_trap_vector(void)
+{
+    const mem_segment_t *region = find_file_region(KERNEL_TEXT_EXTENSION);
+    return (region == NULL) ? 0 : region->base_addr;
+}
+
+/**
+ * Gets the end address and size of the stack region. Both are 0 if there is no
+ * stack.
+ **/
+void mem_map_stack(uint32_t *stack_end, uint32_t *stack_size)
+{
+    *stack_end = 0;
+    *stack_size = 0;
+    for (int i = 0; i < NUM_REGIONS; i++)
+    {
+        const mem_segment_t *region = &REGIONS[i];
+        if (region->backing == MEM_BACKING_STACK) {
+            *stack_end = region->base_addr + region->max_size;
+            *stack_size = region->max_size;
+        }
+    }
+    return;
+}
+
+/**
+ * Attaches the device to the memory-mapped I/O region with the given name.
+ * Returns 0 on success, or a negative error code on failure.
+ **/
+int mem_map_attach_device(const char *name, const mem_device_t *device)
+{
+    init_regions();
+    int index = find_region(name);
+    if (index < 0 || REGIONS[index].backing != MEM_BACKING_MMIO) {
+        fprintf(stderr, "Error: There is no memory-mapped I/O region named "
+                "'%s'.\n", name);
+        return -ENOENT;
+    }
+
+    __atomic_store_n(&DEVICES[index], device, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * Returns the device attached to the region with the given index, or NULL if
+ * none is attached.
+ **/
+const mem_device_t *mem_map_device(int region)
+{
+    return __atomic_load_n(&DEVICES[region], __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Prints the regions of the memory map, and the size of its translation table.
+ **/
+void mem_map_print(FILE *file)
+{
+    fprintf(file, "%-16s %-10s   %-10s   %-5s  %-7s %s\n", "Region", "Base",
+            "Size", "Perms", "Backing", "File");
+    for (int i = 0; i < NUM_REGIONS; i++)
+    {
+        const mem_segment_t *region = &REGIONS[i];
+        const char *device = "";
+        if (region->backing == MEM_BACKING_MMIO) {
+            device = (mem_map_device(i) != NULL) ? "(device)" : "(no device)";
+        }
+        fprintf(file, "%-16s 0x%08x   0x%08x   %c%c%c    %-7s %s\n",
+                region->name, region->base_addr, region->max_size,
+                (region->perms & MEM_PERM_READ) ? 'r' : '-',
+                (region->perms & MEM_PERM_WRITE) ? 'w' : '-',
+                (region->perms & MEM_PERM_EXEC) ? 'x' : '-',
+                BACKING_NAMES[region->backing],
+                (region->extension != NULL) ? region->extension : device);
+    }
+
+    // List the pages whose permissions were changed from their region's
+    for (uint32_t table = 0; table < MEM_MAP_NUM_TABLES; table++)
+    {
+        const mem_map_entry_t *entries = MEM_MAP_TABLES[table];
+        if (entries == EMPTY_TABLE || TABLE_SHARED[table]) {
+            continue;
+        }
+
+        for (uint32_t page = 0; page < MEM_MAP_TABLE_ENTRIES; page++)
+        {
+            int index = (entries[page] & MEM_MAP_REGION_MASK) - 1;
+            uint8_t perms = entries[page] >> MEM_MAP_PERMS_SHIFT;
+            if (index < 0 || perms == REGIONS[index].perms) {
+                continue;
+            }
+            fprintf(file, "Page 0x%08x of %s: %c%c%c\n", (table <<
+                    MEM_MAP_TABLE_SHIFT) | (page << MEM_MAP_PAGE_SHIFT),
+                    REGIONS[index].name,
+                    (perms & MEM_PERM_READ) ? 'r' : '-',
+                    (perms & MEM_PERM_WRITE) ? 'w' : '-',
+                    (perms & MEM_PERM_EXEC) ? 'x' : '-');
+        }
+    }
+
+    // Count the second-level tables, the shared ones once for each region
+    int private_tables = 0;
+    for (uint32_t table = 0; table < MEM_MAP_NUM_TABLES; table++)
+    {
+        private_tables += (MEM_MAP_TABLES[table] != EMPTY_TABLE &&
+                !TABLE_SHARED[table]);
+    }
+    fprintf(file, "Translation table: %u entries, %d private and %d shared "
+            "second-level tables.\n", MEM_MAP_NUM_TABLES, private_tables,
+            NUM_REGIONS);
+    return;
+}
@@ -0,0 +1,206 @@
+/**
+ * memory_map.h
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the interface to the memory map, which defines the regions
+ * of the processor's memory, and translates addresses to them.
+ *
+ * The memory map starts out as the default segments in memory_segments.h. It
+ * can be replaced by a map file, and individual regions can be added or
+ * replaced, until the first hart is created. Each line of a map file, and each
+ * region given on its own, has the form:
+ *
+ *      <name> <base> <size> <perms> <backing> [extension]
+ *
+ * The name may be quoted if it contains spaces. The size may have a K, M, or G
+ * suffix. The permissions are a combination of r, w, and x, or '-' for none.
+ * The backing is 'file', with the extension of the program's data file, 'zero'
+ * for zero-filled memory, 'stack' for the zero-filled stack, or 'mmio' for the
+ * registers of a device. Everything after a '#' is a comment.
+ *
+ * Addresses are translated with a two-level table, indexed by the top 10 bits
+ * of the address and then by the next 10, whose entries hold the region and
+ * permissions of each 4 KiB page. A lookup is always two loads, no matter how
+ * many regions there are. Second-level tables that lie wholly inside one region
+ * and have its permissions are shared.
+ *
+ * Pages start out with the permissions of their region, and can be changed with
+ * mem_map_protect. The permissions are the same for every hart.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+#ifndef MEMORY_MAP_H_
+#define MEMORY_MAP_H_
+
+// Standard Includes
+#include <stdint.h>             // Fixed-size integral types
+#include <stdio.h>              // Definition of the FILE type
+
+// 18-447 Simulator Includes
+#include <memory.h>             // Definition of mem_segment_t
+
+/*----------------------------------------------------------------------------
+ * Definitions
+ *----------------------------------------------------------------------------*/
+
+// The maximum number of regions in the memory map
+#define MEM_MAP_MAX_REGIONS     64
+
+// The base-2 logarithm of the size of the pages that regions are mapped by
+#define MEM_MAP_PAGE_SHIFT      12
+#define MEM_MAP_PAGE_SIZE       (1U << MEM_MAP_PAGE_SHIFT)
+
+/* The base-2 logarithm of the size of the memory covered by each second-level
+ * table, and the number of entries in the tables at each level. */
+#define MEM_MAP_TABLE_SHIFT     22
+#define MEM_MAP_TABLE_ENTRIES   (1U << (MEM_MAP_TABLE_SHIFT - \
+                                    MEM_MAP_PAGE_SHIFT))
+#define MEM_MAP_NUM_TABLES      (1U << (32 - MEM_MAP_TABLE_SHIFT))
+
+/* A memory-mapped device, whose registers are read and written at offsets from
+ * the base of its region. */
+typedef struct mem_device {
+    uint32_t (*read)(void *data, uint32_t offset);  // Reads a register
+    void (*write)(void *data, uint32_t offset, uint32_t value); // Writes one
+    void *data;                 // Data passed to the callbacks
+} mem_device_t;
+
+/* An entry of a second-level table, which holds the index of the region that
+ * holds the page plus 1, or 0 if the page is unmapped, in its low bits, and the
+ * page's permissions (MEM_PERM_*) above them. */
+typedef uint16_t mem_map_entry_t;
+#define MEM_MAP_REGION_MASK     0xFF
+#define MEM_MAP_PERMS_SHIFT     8
+
+/* The first level of the translation table. Each entry points to the
+ * second-level table for its part of memory. */
+extern const mem_map_entry_t *MEM_MAP_TABLES[MEM_MAP_NUM_TABLES];
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Returns the index of the region of the memory map that holds the page
+ * containing the address, or -1 if the page is unmapped. The memory map must
+ * have been built.
+ **/
+static inline int mem_map_lookup(uint32_t addr)
+{
+    const mem_map_entry_t *table = MEM_MAP_TABLES[addr >> MEM_MAP_TABLE_SHIFT];
+    uint32_t page = (addr >> MEM_MAP_PAGE_SHIFT) & (MEM_MAP_TABLE_ENTRIES - 1);
+    return (int)(table[page] & MEM_MAP_REGION_MASK) - 1;
+}
+
+/**
+ * Returns the permissions (MEM_PERM_*) of the page containing the address,
+ * which are 0 if the page is unmapped. The memory map must have been built.
+ **/
+static inline uint8_t mem_map_page_perms(uint32_t addr)
+{
+    const mem_map_entry_t *table = MEM_MAP_TABLES[addr >> MEM_MAP_TABLE_SHIFT];
+    uint32_t page = (addr >> MEM_MAP_PAGE_SHIFT) & (MEM_MAP_TABLE_ENTRIES - 1);
+    return table[page] >> MEM_MAP_PERMS_SHIFT;
+}
+
+/**
+ * Parses a string of permissions, such as 'rw' or '-', into a mask of
+ * MEM_PERM_* flags. Returns 0 on success, or a negative error code on failure.
+ **/
+int mem_map_parse_perms(const char *string, uint8_t *perms);
+
+/**
+ * Replaces the memory map with the regions in the map file. Returns 0 on
+ * success, or a negative error code on failure.
+ **/
+int mem_map_load_file(const char *map_path);
+
+/**
+ * Adds the region described by the string, which has the same form as a line
+ * of a map file, to the memory map. A region with the same name is replaced.
+ * Returns 0 on success, or a negative error code on failure.
+ **/
+int mem_map_set_region(const char *region_spec);
+
+/**
+ * Checks the memory map, and builds its translation table. The map can't be
+ * changed afterwards. Does nothing if the map is already built. Returns 0 on
+ * success, or a negative error code on failure.
+ **/
+int mem_map_build(void);
+
+/**
+ * Returns the regions of the memory map, which are the layout of every table of
+ * memory segments, and sets the number of them. The map must have been built.
+ **/
+const mem_segment_t *mem_map_regions(int *num_regions);
+
+/**
+ * Returns the permissions that every page of the region with the given index
+ * has, which are the region's own unless some of its pages were changed.
+ **/
+uint8_t mem_map_region_perms(int region);
+
+/**
+ * Sets the permissions (MEM_PERM_*) of the pages in the range [start, end),
+ * which must start on a page boundary, and lie in mapped pages. The range is
+ * extended to the end of its last page. A region stays executable once any of
+ * its pages is made executable. Returns 0 on success, or a negative error code
+ * on failure.
+ **/
+int mem_map_protect(uint32_t start_addr, uint32_t end_addr, uint8_t perms);
+
+/**
+ * Returns the default entry point of programs, which is the base of the region
+ * loaded from the user text file, or 0 if there is none.
+ **/
+uint32_t mem_map_entry(void);
+
+/**
+ * Returns the initial global pointer, which is the base of the region loaded
+ * from the user data file, or 0 if there is none.
+ **/
+uint32_t mem_map_global_pointer(void);
+
+/**
+ * Returns the address of the trap vector, which is the base of the region
+ * loaded from the kernel text file, or 0 if there is none.
+ **/
+uint32_t mem_map_trap_vector(void);
+
+/**
+ * Gets the end address and size of the stack region. Both are 0 if there is no
+ * stack.
+ **/
+void mem_map_stack(uint32_t *stack_end, uint32_t *stack_size);
+
+/**
+ * Attaches the device to the memory-mapped I/O region with the given name.
+ * Returns 0 on success, or a negative error code on failure.
+ **/
+int mem_map_attach_device(const char *name, const mem_device_t *device);
+
+/**
+ * Returns the device attached to the region with the given index, or NULL if
+ * none is attached.
+ **/
+const mem_device_t *mem_map_device(int region);
+
+/**
+ * Prints the regions of the memory map, the pages whose permissions differ from
+ * their region's, and the size of the translation table.
+ **/
+void mem_map_print(FILE *file);
+
+#endif /* MEMORY_MAP_H_ */
@@ -10,7 +10,8 @@
  *
  * This defines the metadata about each segment in memory, such as its starting
  * address and maximum size. Also, this defines an array that represents all of
- * the available memory segments.
+ * the available memory segments, which is the default memory map, used unless
+ * another one is configured on the command line.
  *
  * Authors:
  *  - 2017: Brandon Perez
@@ -31,7 +32,7 @@
  * Memory Segment Addresses
  *----------------------------------------------------------------------------*/
 
-// The number of memory segments in the processor
+// The number of memory segments in the default memory map
 #define NUM_MEM_SEGMENTS    5
 
 // The starting addresses of the user's data and text segments
@@ -47,6 +48,14 @@
 #define KERNEL_TEXT_START   0x80000000
 #define KERNEL_DATA_START   0x90000000
 
+/* The file extensions of the program's segments. The segments loaded from the
+ * user text, user data, and kernel text files hold the program's entry point,
+ * global pointer, and trap vector, respectively, in any memory map. */
+#define USER_TEXT_EXTENSION     ".text.bin"
+#define USER_DATA_EXTENSION     ".data.bin"
+#define KERNEL_TEXT_EXTENSION   ".ktext.bin"
+#define KERNEL_DATA_EXTENSION   ".kdata.bin"
+
 /*----------------------------------------------------------------------------
  * Memory Segments
  *----------------------------------------------------------------------------*/
@@ -58,16 +67,21 @@ static mem_segment_t MEMORY_SEGMENTS[NUM_MEM_SEGMENTS] = {
     {
         .base_addr          = USER_TEXT_START,
         .max_size           = USER_DATA_START - USER_TEXT_START,
-        .extension          = ".text.bin",
+        .extension          = USER_TEXT_EXTENSION,
         .name               = "User Text",
+        .executable         = true,
+        .perms              = MEM_PERM_READ | MEM_PERM_EXEC,
+        .backing            = MEM_BACKING_FILE,
     },
 
     // The user data memory segment, containing user global variables
     {
         .base_addr          = USER_DATA_START,
         .max_size           = STACK_START - USER_DATA_START,
-        .extension          = ".data.bin",
+        .extension          = USER_DATA_EXTENSION,
         .name               = "User Data",
+        .perms              = MEM_PERM_READ | MEM_PERM_WRITE,
+        .backing            = MEM_BACKING_FILE,
     },
 
     /* The stack memory segment, containing local values in the program. This is
@@ -76,23 +90,30 @@ static mem_segment_t MEMORY_SEGMENTS[NUM_MEM_SEGMENTS] = {
         .base_addr          = STACK_END - STACK_SIZE,
         .max_size           = STACK_SIZE,
         .extension          = NULL,
-        .name               = "Stack"
+        .name               = "Stack",
+        .perms              = MEM_PERM_READ | MEM_PERM_WRITE,
+        .backing            = MEM_BACKING_STACK,
     },
 
     // The kernel text segment, containing kernel code
     {
         .base_addr          = KERNEL_TEXT_START,
         .max_size           = KERNEL_DATA_START - KERNEL_TEXT_START,
-        .extension          = ".ktext.bin",
+        .extension          = KERNEL_TEXT_EXTENSION,
         .name               = "Kernel Text",
+        .executable         = true,
+        .perms              = MEM_PERM_READ | MEM_PERM_EXEC,
+        .backing            = MEM_BACKING_FILE,
     },
 
     // The kernel data segment, containing kernel global variables
     {
         .base_addr          = KERNEL_DATA_START,
         .max_size           = UINT32_MAX - KERNEL_DATA_START,
-        .extension          = ".kdata.bin",
+        .extension          = KERNEL_DATA_EXTENSION,
         .name               = "Kernel Data",
+        .perms              = MEM_PERM_READ | MEM_PERM_WRITE,
+        .backing            = MEM_BACKING_FILE,
     },
 };
 
@@ -32,6 +32,33 @@
 // 18-447 Simulator Includes
 #include <sim.h>                // Definition of cpu_state_t
 
+/*----------------------------------------------------------------------------
+ * Definitions
+ *----------------------------------------------------------------------------*/
+
+// The ways that a misaligned load or store by the processor can be handled
+typedef enum mem_align_policy {
+    MEM_ALIGN_TRAP,             // Raise a misaligned exception, or halt if no
+                                // trap handler is installed
+    MEM_ALIGN_EMULATE,          // Split the access into bytes, which may lie in
+                                // different segments
+    MEM_ALIGN_HALT,             // Halt the processor, even if a trap handler
+                                // is installed
+} mem_align_policy_t;
+
+/* The policy for handling misaligned loads and stores. Instruction fetches and
+ * atomic memory operations are never emulated. */
+extern mem_align_policy_t MEM_ALIGN_POLICY;
+
+// The number of misaligned accesses that have been emulated
+extern uint64_t MEM_SPLIT_ACCESSES;
+
+/* Indicates if any observer of the processor's loads and stores is active. The
+ * loads and stores only check this, so they make a single check when none are.
+ * It is recomputed by mem_hooks_update, and is cleared while the observers are
+ * paused. */
+extern bool MEM_HOOKS_ACTIVE;
+
 /*----------------------------------------------------------------------------
  * Interface
  *----------------------------------------------------------------------------*/
@@ -43,9 +70,25 @@
  * memory, and initializes them to the values specified in their respective data
  * files. Program name should be the path to the executable file (it has no
  * extension).
+ *
+ * The program's contents come from the image cache, so the files are only read
+ * again if they have changed since the program was last loaded. Each segment is
+ * mapped privately from the cached image.
  **/
 int mem_load_program(cpu_state_t *cpu_state, const char *program_path);
 
+/**
+ * Reads the program's memory segments from its files into newly allocated
+ * memory, bypassing the image cache. Segments without a data file (the stack)
+ * are not allocated.
+ *
+ * If the program's ELF executable exists, then the segments are read from it,
+ * and the entry point is its entry address. Otherwise, each segment is read
+ * from its own binary data file, and the program starts at the user text.
+ **/
+int mem_read_program(cpu_state_t *cpu_state, const char *program_path,
+        uint32_t *entry);
+
 /**
  * Unloads a program previously loaded by mem_load_program.
  *
@@ -54,6 +97,45 @@ int mem_load_program(cpu_state_t *cpu_state, const char *program_path);
  **/
 void mem_unload_program(cpu_state_t *cpu_state);
 
+/**
+ * Frees the memory of the segment, however it was allocated: by malloc, by
+ * mapping it, or by sharing it with other instances.
+ **/
+void mem_release_segment(mem_segment_t *segment);
+
+/**
+ * Gives the memory its own table of segments, laid out as the processor's
+ * memory segments, with nothing loaded in them. Returns 0 on success, or a
+ * negative error code on failure.
+ **/
+int mem_create_segments(memory_t *memory);
+
+/**
+ * Empties the caches of the segments last used by the processor's fetches,
+ * loads, and stores.
+ **/
+void mem_flush_access_caches(cpu_state_t *cpu_state);
+
+/**
+ * Recomputes whether any observer of the processor's loads and stores is
+ * active. This must be invoked whenever an observer is started or stopped.
+ **/
+void mem_hooks_update(void);
+
+/**
+ * Pauses or resumes every observer of the processor's loads and stores, such
+ * as while the accesses they have already seen are replayed.
+ **/
+void mem_hooks_pause(bool paused);
+
+/**
+ * Updates the processor's segments after the permissions of the memory map's
+ * pages have been changed. The access caches are emptied, since they may hold
+ * segments that no longer allow every access, and segments that now hold
+ * executable pages have their writes tracked.
+ **/
+void mem_update_permissions(cpu_state_t *cpu_state);
+
 /**
  * Checks if the given memory range from start to end (inclusive) is valid.
  *
@@ -70,6 +152,20 @@ bool mem_range_valid(const cpu_state_t *cpu_state, uint32_t start_addr,
  **/
 mem_segment_t *mem_find_segment(const cpu_state_t *cpu_state, uint32_t addr);
 
+/**
+ * Reads the word at the specified address, without raising any exceptions.
+ * Returns false if the address is misaligned, invalid, or a device register.
+ **/
+bool mem_peek32(const cpu_state_t *cpu_state, uint32_t addr, uint32_t *value);
+
+/**
+ * Finds the address that the instruction writes, from the hart's registers, if
+ * it is a store or an atomic memory operation. Returns false for any other
+ * instruction.
+ **/
+bool mem_store_address(const cpu_state_t *cpu_state, uint32_t instr,
+        uint32_t *addr);
+
 /**
  * Writes the specified value out to the given address in the segment in
  * little-endian order.
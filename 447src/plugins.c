@@ -0,0 +1,379 @@
+/**
+ * plugins.c
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the implementation of the plugin loader, which loads the
+ * instrumentation plugins with dlopen, and delivers events to them.
+ *
+ * The plugins are only loaded at startup, before any hart runs, so the set of
+ * subscribers never changes while the harts are running, and it can be read
+ * from any host thread without locking.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+// Standard Includes
+#include <stdlib.h>                 // Malloc and free functions
+#include <stdio.h>                  // Printf and related functions
+#include <stdbool.h>                // Definition of the boolean type
+#include <stdint.h>                 // Fixed-size integral types
+
+// Standard Includes
+#include <errno.h>                  // Error codes
+#include <string.h>                 // String manipulation functions
+#include <dlfcn.h>                  // Dynamic loading of shared objects
+
+// 18-447 Simulator Includes
+#include <sim.h>                    // Definition of cpu_state_t
+#include <riscv_isa.h>              // Definition of the system opcode
+#include <plugin.h>                 // Interface for the plugins
+
+// Local Includes
+#include "memory_shell.h"           // Reading instructions, and memory hooks
+#include "disasm.h"                 // Disassembly of instructions
+#include "machine.h"                // Definition of the machine
+#include "plugins.h"                // This file's interface
+
+/*----------------------------------------------------------------------------
+ * Internal Definitions
+ *----------------------------------------------------------------------------*/
+
+// The ECALL instruction is the system opcode with every other field zero
+static const uint32_t ECALL_INSTR       = OP_SYSTEM;
+
+// A plugin that has been loaded into the simulator
+typedef struct loaded_plugin {
+    void *handle;                   // Handle for the shared object
+    char *spec;                     // Copy of the path and the arguments
+    sim_plugin_t plugin;            // The plugin's callbacks and data
+} loaded_plugin_t;
+
+// The loaded plugins
+static loaded_plugin_t PLUGINS[PLUGINS_MAX];
+static int NUM_PLUGINS                  = 0;
+
+// The machine the plugins observe, for reading the counters
+static machine_t *PLUGINS_MACHINE       = NULL;
+
+// Indicates if a plugin is being initialized, and can register counters
+static bool PLUGINS_LOADING             = false;
+
+// The mask of the kinds of events that have counters registered
+static uint32_t PLUGINS_COUNTED         = 0;
+
+// Indicates which of the plugin hooks the run loop needs to call
+static bool PLUGINS_RUN_LOOP_HOOKED     = false;
+static bool PLUGINS_INSTR_HOOKED        = false;
+
+// Indicates if any plugin observes memory accesses
+bool PLUGINS_MEM_HOOKED                 = false;
+
+/*----------------------------------------------------------------------------
+ * Host Services
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Registers a counter for the given kind of event. The handle for the counter
+ * is the kind itself, since every counter of a kind has the same value.
+ **/
+static int host_counter_register(sim_plugin_count_t kind)
+{
+    if (!PLUGINS_LOADING) {
+        return -EPERM;
+    } else if (kind < 0 || kind >= SIM_PLUGIN_NUM_COUNTS) {
+        return -EINVAL;
+    }
+
+    PLUGINS_COUNTED |= 1U << kind;
+    return kind;
+}
+
+/**
+ * Reads the total value of the counter across all of the harts.
+ **/
+static uint64_t host_counter_read(int counter)
+{
+    if (counter < 0 || counter >= SIM_PLUGIN_NUM_COUNTS) {
+        return 0;
+    }
+
+    uint64_t total = 0;
+    for (int i = 0; i < PLUGINS_MACHINE->num_harts; i++)
+    {
+        total += PLUGINS_MACHINE->harts[i].debug.plugin_counts[counter];
+    }
+    return total;
+}
+
+/**
+ * Reads the word at the given address in the hart's memory, without raising
+ * any exceptions.
+ **/
+static bool host_mem_peek32(const struct cpu_state *cpu_state, uint32_t addr,
+        uint32_t *value)
+{
+    return mem_peek32(cpu_state, addr, value);
+}
+
+/**
+ * Indicates if the given kind of event has a counter registered.
+ **/
+static inline bool counted(sim_plugin_count_t kind)
+{
+    return (PLUGINS_COUNTED & (1U << kind)) != 0;
+}
+
+/**
+ * Recomputes which hooks are needed, based on the loaded plugins' callbacks
+ * and the registered counters.
+ **/
+static void update_hooks()
+{
+    bool instr_hooked = counted(SIM_PLUGIN_COUNT_ECALLS);
+    bool run_loop_hooked = counted(SIM_PLUGIN_COUNT_INSTRUCTIONS) ||
+            counted(SIM_PLUGIN_COUNT_BLOCKS);
+    bool mem_hooked = counted(SIM_PLUGIN_COUNT_LOADS) ||
+            counted(SIM_PLUGIN_COUNT_STORES);
+
+    for (int i = 0; i < NUM_PLUGINS; i++)
+    {
+        const sim_plugin_callbacks_t *callbacks = &PLUGINS[i].plugin.callbacks;
+        instr_hooked |= (callbacks->instruction != NULL) ||
+                (callbacks->ecall != NULL);
+        run_loop_hooked |= (callbacks->block != NULL) ||
+                (callbacks->halt != NULL);
+        mem_hooked |= (callbacks->mem_access != NULL);
+    }
+
+    PLUGINS_INSTR_HOOKED = instr_hooked;
+    PLUGINS_RUN_LOOP_HOOKED = run_loop_hooked || instr_hooked;
+    PLUGINS_MEM_HOOKED = mem_hooked;
+    mem_hooks_update();
+    return;
+}
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Loads the plugin described by the specification, which is the path to the
+ * shared object, optionally followed by a colon and the plugin's arguments.
+ *
+ * Returns 0 on success, or a negative error code on failure.
+ **/
+int plugins_load(machine_t *machine, const char *spec)
+{
+    if (NUM_PLUGINS == PLUGINS_MAX) {
+        fprintf(stderr, "Error: Too many plugins, at most %d can be loaded.\n",
+                PLUGINS_MAX);
+        return -E2BIG;
+    }
+
+    /* Split the specification into the path and the arguments. The copy is
+     * kept while the plugin is loaded, since it may hold on to the
+     * arguments. */
+    char *path = strdup(spec);
+    if (path == NULL) {
+        fprintf(stderr, "Error: Unable to allocate memory for the plugin "
+                "path.\n");
+        return -ENOMEM;
+    }
+    char *args = strchr(path, ':');
+    if (args != NULL) {
+        *args = '\0';
+        args += 1;
+    } else {
+        args = "";
+    }
+
+    // Open the shared object, and find its initialization function
+    void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL) {
+        fprintf(stderr, "Error: %s: Unable to load plugin: %s.\n", path,
+                dlerror());
+        free(path);
+        return -ENOENT;
+    }
+
+    sim_plugin_init_t init;
+    *(void **)&init = dlsym(handle, SIM_PLUGIN_INIT_SYMBOL);
+    if (init == NULL) {
+        fprintf(stderr, "Error: %s: Plugin does not export '%s'.\n", path,
+                SIM_PLUGIN_INIT_SYMBOL);
+        dlclose(handle);
+        free(path);
+        return -ENOENT;
+    }
+
+    /* Initialize the plugin, letting it subscribe to events. The plugin may
+     * keep a pointer to the host services, so they're never freed. */
+    static sim_plugin_host_t host;
+    host = (sim_plugin_host_t){
+        .api_version = SIM_PLUGIN_API_VERSION,
+        .num_harts = machine->num_harts,
+        .counter_register = host_counter_register,
+        .counter_read = host_counter_read,
+        .mem_peek32 = host_mem_peek32,
+        .disassemble = disasm_instruction,
+    };
+    loaded_plugin_t *loaded = &PLUGINS[NUM_PLUGINS];
+    memset(loaded, 0, sizeof(*loaded));
+    loaded->handle = handle;
+    loaded->spec = path;
+    PLUGINS_MACHINE = machine;
+
+    uint32_t counted_before = PLUGINS_COUNTED;
+    PLUGINS_LOADING = true;
+    int rc = init(&host, &loaded->plugin, args);
+    PLUGINS_LOADING = false;
+
+    if (rc < 0) {
+        fprintf(stderr, "Error: %s: Plugin failed to initialize: %s.\n", path,
+                strerror(-rc));
+    } else if (loaded->plugin.api_version != SIM_PLUGIN_API_VERSION) {
+        fprintf(stderr, "Error: %s: Plugin was built for interface version "
+                "%d, but the simulator has version %d.\n", path,
+                loaded->plugin.api_version, SIM_PLUGIN_API_VERSION);
+        rc = -EPROTO;
+    }
+
+    if (rc < 0) {
+        PLUGINS_COUNTED = counted_before;
+        dlclose(handle);
+        free(path);
+        return rc;
+    }
+
+    NUM_PLUGINS += 1;
+    update_hooks();
+    return 0;
+}
+
+/**
+ * Notifies each plugin that the simulator is exiting, and unloads them.
+ **/
+void plugins_unload(void)
+{
+    for (int i = NUM_PLUGINS - 1; i >= 0; i--)
+    {
+        sim_plugin_t *plugin = &PLUGINS[i].plugin;
+        if (plugin->callbacks.unload != NULL) {
+            plugin->callbacks.unload(plugin->data);
+        }
+        dlclose(PLUGINS[i].handle);
+        free(PLUGINS[i].spec);
+    }
+
+    NUM_PLUGINS = 0;
+    PLUGINS_COUNTED = 0;
+    update_hooks();
+    return;
+}
+
+/**
+ * Indicates if the run loop needs to call into the plugins, because a plugin
+ * observes instructions, blocks, ECALLs, or halts.
+ **/
+bool plugins_active(void)
+{
+    return PLUGINS_RUN_LOOP_HOOKED;
+}
+
+/**
+ * Delivers the events for the instruction at the PC, which is about to be
+ * executed, to the plugins.
+ **/
+void plugins_before_instruction(cpu_state_t *cpu_state)
+{
+    debug_state_t *debug = &cpu_state->debug;
+    if (counted(SIM_PLUGIN_COUNT_INSTRUCTIONS)) {
+        debug->plugin_counts[SIM_PLUGIN_COUNT_INSTRUCTIONS] += 1;
+    }
+
+    // Any instruction that wasn't reached by falling through starts a block
+    if (!debug->in_block) {
+        if (counted(SIM_PLUGIN_COUNT_BLOCKS)) {
+            debug->plugin_counts[SIM_PLUGIN_COUNT_BLOCKS] += 1;
+        }
+        for (int i = 0; i < NUM_PLUGINS; i++)
+        {
+            const sim_plugin_t *plugin = &PLUGINS[i].plugin;
+            if (plugin->callbacks.block != NULL) {
+                plugin->callbacks.block(plugin->data, cpu_state);
+            }
+        }
+    }
+
+    // Only read the instruction if a plugin needs to look at it
+    uint32_t instr;
+    if (!PLUGINS_INSTR_HOOKED || !mem_peek32(cpu_state, cpu_state->pc,
+                &instr)) {
+        return;
+    }
+
+    bool is_ecall = (instr == ECALL_INSTR);
+    if (is_ecall && counted(SIM_PLUGIN_COUNT_ECALLS)) {
+        debug->plugin_counts[SIM_PLUGIN_COUNT_ECALLS] += 1;
+    }
+    for (int i = 0; i < NUM_PLUGINS; i++)
+    {
+        const sim_plugin_t *plugin = &PLUGINS[i].plugin;
+        if (plugin->callbacks.instruction != NULL) {
+            plugin->callbacks.instruction(plugin->data, cpu_state, instr);
+        }
+        if (is_ecall && plugin->callbacks.ecall != NULL) {
+            plugin->callbacks.ecall(plugin->data, cpu_state);
+        }
+    }
+
+    return;
+}
+
+/**
+ * Delivers a halt event for the hart to the plugins.
+ **/
+void plugins_halt(cpu_state_t *cpu_state)
+{
+    for (int i = 0; i < NUM_PLUGINS; i++)
+    {
+        const sim_plugin_t *plugin = &PLUGINS[i].plugin;
+        if (plugin->callbacks.halt != NULL) {
+            plugin->callbacks.halt(plugin->data, cpu_state);
+        }
+    }
+    return;
+}
+
+/**
+ * Delivers a word memory access by the hart to the plugins.
+ **/
+void plugins_mem_access(cpu_state_t *cpu_state, uint32_t addr, uint32_t value,
+        bool is_store)
+{
+    sim_plugin_count_t kind = is_store ? SIM_PLUGIN_COUNT_STORES :
+            SIM_PLUGIN_COUNT_LOADS;
+    if (counted(kind)) {
+        cpu_state->debug.plugin_counts[kind] += 1;
+    }
+
+    for (int i = 0; i < NUM_PLUGINS; i++)
+    {
+        const sim_plugin_t *plugin = &PLUGINS[i].plugin;
+        if (plugin->callbacks.mem_access != NULL) {
+            plugin->callbacks.mem_access(plugin->data, cpu_state, addr, value,
+                    is_store);
+        }
+    }
+    return;
+}
@@ -0,0 +1,90 @@
+/**
+ * plugins.h
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the interface to the plugin loader, which loads the
+ * instrumentation plugins and delivers events to them.
+ *
+ * The run loop only calls into the plugins from its plugin variant, which is
+ * used when plugins_active returns true. Memory accesses are delivered from
+ * mem_read32 and mem_write32, behind the check of MEM_HOOKS_ACTIVE that every
+ * observer of the memory accesses shares.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+#ifndef PLUGINS_H_
+#define PLUGINS_H_
+
+// Standard Includes
+#include <stdbool.h>            // Boolean type and definitions
+#include <stdint.h>             // Fixed-size integral types
+
+// 18-447 Simulator Includes
+#include <sim.h>                // Definition of cpu_state_t
+
+// Local Includes
+#include "machine.h"            // Definition of the machine
+
+/*----------------------------------------------------------------------------
+ * Definitions
+ *----------------------------------------------------------------------------*/
+
+// The maximum number of plugins that can be loaded
+#define PLUGINS_MAX             8
+
+/* Indicates if any plugin observes memory accesses, either with a callback or
+ * a counter. This is only set while the plugins are loaded at startup. */
+extern bool PLUGINS_MEM_HOOKED;
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Loads the plugin described by the specification, which is the path to the
+ * shared object, optionally followed by a colon and the plugin's arguments.
+ *
+ * Returns 0 on success, or a negative error code on failure.
+ **/
+int plugins_load(machine_t *machine, const char *spec);
+
+/**
+ * Notifies each plugin that the simulator is exiting, and unloads them.
+ **/
+void plugins_unload(void);
+
+/**
+ * Indicates if the run loop needs to call into the plugins, because a plugin
+ * observes instructions, blocks, ECALLs, or halts.
+ **/
+bool plugins_active(void);
+
+/**
+ * Delivers the events for the instruction at the PC, which is about to be
+ * executed, to the plugins.
+ **/
+void plugins_before_instruction(cpu_state_t *cpu_state);
+
+/**
+ * Delivers a halt event for the hart to the plugins.
+ **/
+void plugins_halt(cpu_state_t *cpu_state);
+
+/**
+ * Delivers a word memory access by the hart to the plugins.
+ **/
+void plugins_mem_access(cpu_state_t *cpu_state, uint32_t addr, uint32_t value,
+        bool is_store);
+
+#endif /* PLUGINS_H_ */
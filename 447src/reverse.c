@@ -0,0 +1,454 @@
+/**
+ * reverse.c
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains reverse execution, which steps a hart backwards through
+ * the instructions it has run, using a ring buffer of undo records and periodic
+ * checkpoints.
+ *
+ * Records are numbered from the start of the recording, so record n is for the
+ * instruction run at the recording's first cycle plus n, and is kept in slot n
+ * of the ring modulo its size. A checkpoint is taken before every record whose
+ * number is a multiple of the checkpoint interval. There are enough checkpoint
+ * slots for twice the records the ring holds, so the checkpoints for every
+ * record still in the ring are kept.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+// Standard Includes
+#include <stdlib.h>                 // Malloc and related functions
+#include <stdio.h>                  // Printf and related functions
+#include <stdint.h>                 // Fixed-size integral types
+#include <stdbool.h>                // Definition of the boolean type
+#include <inttypes.h>               // Format specifiers for fixed-size types
+
+// Standard Includes
+#include <errno.h>                  // Error codes
+#include <string.h>                 // Memcpy function
+
+// 18-447 Simulator Includes
+#include <sim.h>                    // Definition of cpu_state_t
+#include <memory.h>                 // Definition of mem_segment_t
+#include <riscv_isa.h>              // Number of registers
+#include <scheduler.h>              // Interface to the event scheduler
+#include <trap.h>                   // Restoring the CSRs
+
+// Local Includes
+#include "memory_shell.h"           // Memory access and its hooks
+#include "engine.h"                 // Running the hart forward again
+#include "reverse.h"                // This file's interface
+
+/*----------------------------------------------------------------------------
+ * Internal Definitions
+ *----------------------------------------------------------------------------*/
+
+/* The number of checkpoints kept, and the number of them taken over the
+ * records in the ring. The ring holds half as many records as the checkpoints
+ * cover, so the checkpoint before the oldest record is always kept. */
+#define REVERSE_NUM_CHECKPOINTS     64
+#define REVERSE_CHECKPOINTS_PER_RING    (REVERSE_NUM_CHECKPOINTS / 2)
+
+// The bits of an undo record's words that indicate which old words are valid
+#define UNDO_WORD_0                 (1 << 0)
+#define UNDO_WORD_1                 (1 << 1)
+
+// The undo record for one instruction
+typedef struct undo_record {
+    uint32_t pc;                    // PC of the instruction
+    uint32_t old_rd;                // Old value of the destination register
+    uint32_t addr;                  // Address of the first old memory word
+    uint32_t old_words[2];          // Old memory words at addr and addr + 4
+    uint8_t rd;                     // Destination register of the instruction
+    uint8_t words;                  // Which of the old memory words are valid
+} undo_record_t;
+
+// A checkpoint of the hart's state before a record
+typedef struct undo_checkpoint {
+    uint64_t record;                // Number of the record it was taken before
+    uint32_t pc;                    // PC of the hart
+    uint32_t registers[RISCV_NUM_REGS]; // Registers of the hart
+    csr_file_t csr;                 // CSRs of the hart
+    mem_reservation_t reservation;  // Load reservation of the hart
+} undo_checkpoint_t;
+
+// The recording of a hart's instructions
+struct undo_log {
+    uint64_t first_cycle;           // Cycle of the first record
+    uint64_t num_records;           // Number of records made
+    uint32_t capacity;              // Number of records in the ring
+    uint32_t interval;              // Number of records between checkpoints
+    undo_record_t *records;         // Ring of the most recent records
+    undo_checkpoint_t checkpoints[REVERSE_NUM_CHECKPOINTS]; // Checkpoint ring
+};
+
+/*----------------------------------------------------------------------------
+ * Helper Functions
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Gets the number of the oldest record still in the ring.
+ **/
+static uint64_t oldest_record(const struct undo_log *log)
+{
+    return (log->num_records > log->capacity) ?
+            log->num_records - log->capacity : 0;
+}
+
+/**
+ * Gets the record with the given number, which must still be in the ring.
+ **/
+static undo_record_t *get_record(const struct undo_log *log, uint64_t record)
+{
+    return &log->records[record & (log->capacity - 1)];
+}
+
+/**
+ * Gets the checkpoint taken before the given record, or NULL if it is no
+ * longer kept, or it was taken before the records in the ring.
+ **/
+static undo_checkpoint_t *find_checkpoint(struct undo_log *log,
+        uint64_t record)
+{
+    uint64_t number = record / log->interval;
+    undo_checkpoint_t *checkpoint =
+            &log->checkpoints[number % REVERSE_NUM_CHECKPOINTS];
+    if (checkpoint->record != number * log->interval ||
+            checkpoint->record < oldest_record(log)) {
+        return NULL;
+    }
+    return checkpoint;
+}
+
+/**
+ * Takes a checkpoint of the hart's state before the next record.
+ **/
+static void take_checkpoint(cpu_state_t *cpu_state, struct undo_log *log)
+{
+    uint64_t number = log->num_records / log->interval;
+    undo_checkpoint_t *checkpoint =
+            &log->checkpoints[number % REVERSE_NUM_CHECKPOINTS];
+    checkpoint->record = log->num_records;
+    checkpoint->pc = cpu_state->pc;
+    memcpy(checkpoint->registers, cpu_state->registers,
+            sizeof(checkpoint->registers));
+    checkpoint->csr = cpu_state->csr;
+    checkpoint->reservation = cpu_state->memory.reservation;
+    return;
+}
+
+/**
+ * Logs the old memory words that the instruction could overwrite in the
+ * record, if it is a store or an atomic. A misaligned store may span two words.
+ * Words that can't be read directly, such as device registers, are skipped.
+ **/
+static void record_memory(const cpu_state_t *cpu_state, uint32_t instr,
+        undo_record_t *record)
+{
+    uint32_t addr;
+    if (!mem_store_address(cpu_state, instr, &addr)) {
+        return;
+    }
+
+    record->addr = addr & ~(uint32_t)(sizeof(uint32_t) - 1);
+    if (mem_peek32(cpu_state, record->addr, &record->old_words[0])) {
+        record->words |= UNDO_WORD_0;
+    }
+    if (addr != record->addr && mem_peek32(cpu_state,
+                record->addr + sizeof(uint32_t), &record->old_words[1])) {
+        record->words |= UNDO_WORD_1;
+    }
+    return;
+}
+
+/**
+ * Writes an old memory word back, if it differs from the current one.
+ **/
+static void restore_word(cpu_state_t *cpu_state, uint32_t addr,
+        uint32_t old_value)
+{
+    uint32_t value;
+    if (mem_peek32(cpu_state, addr, &value) && value != old_value) {
+        mem_write_word(mem_find_segment(cpu_state, addr), addr, old_value);
+    }
+    return;
+}
+
+/**
+ * Restores the hart's state from the checkpoint, dropping any pending events,
+ * and discards the records and checkpoints after it.
+ **/
+static void restore_checkpoint(cpu_state_t *cpu_state, struct undo_log *log,
+        const undo_checkpoint_t *checkpoint)
+{
+    cpu_state->cycle = log->first_cycle + checkpoint->record;
+    cpu_state->pc = checkpoint->pc;
+    cpu_state->halted = false;
+    memcpy(cpu_state->registers, checkpoint->registers,
+            sizeof(cpu_state->registers));
+    cpu_state->memory.reservation = checkpoint->reservation;
+    cpu_state->debug.breakpoint_hit = false;
+    cpu_state->debug.in_block = false;
+    mem_flush_access_caches(cpu_state);
+
+    // The timer is the only event, and it is posted again with the CSRs
+    sched_init(&cpu_state->scheduler, cpu_state->cycle);
+    trap_restore(cpu_state, &checkpoint->csr);
+
+    log->num_records = checkpoint->record;
+    return;
+}
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Starts recording the hart's instructions, keeping undo records for at least
+ * the given number of the most recent ones. Any previous recording is
+ * discarded. Returns 0 on success, or a negative error code on failure.
+ **/
+int reverse_start(cpu_state_t *cpu_state, uint32_t num_records)
+{
+    // The ring holds a power of 2 records, so the slots wrap around cheaply
+    uint32_t capacity = REVERSE_MIN_RECORDS;
+    while (capacity < num_records && capacity <= UINT32_MAX / 2)
+    {
+        capacity *= 2;
+    }
+
+    reverse_stop(cpu_state);
+    struct undo_log *log = calloc(1, sizeof(*log));
+    undo_record_t *records = (log == NULL) ? NULL :
+            malloc(capacity * sizeof(*records));
+    if (records == NULL) {
+        fprintf(stderr, "Error: Unable to allocate memory for %" PRIu32 " undo "
+                "records.\n", capacity);
+        free(log);
+        return -ENOMEM;
+    }
+
+    log->capacity = capacity;
+    log->interval = capacity / REVERSE_CHECKPOINTS_PER_RING;
+    log->records = records;
+    for (int i = 0; i < REVERSE_NUM_CHECKPOINTS; i++)
+    {
+        log->checkpoints[i].record = UINT64_MAX;
+    }
+
+    cpu_state->debug.undo = log;
+    reverse_reset(cpu_state);
+    return 0;
+}
+
+/**
+ * Stops recording the hart's instructions, and discards the recording.
+ **/
+void reverse_stop(cpu_state_t *cpu_state)
+{
+    struct undo_log *log = cpu_state->debug.undo;
+    if (log != NULL) {
+        free(log->records);
+        free(log);
+        cpu_state->debug.undo = NULL;
+    }
+    return;
+}
+
+/**
+ * Discards the recording so far, and continues recording from the hart's
+ * current state. This must be done whenever the hart's state is changed outside
+ * of the engine, since it couldn't be reproduced by running forward.
+ **/
+void reverse_reset(cpu_state_t *cpu_state)
+{
+    struct undo_log *log = cpu_state->debug.undo;
+    if (log != NULL) {
+        log->first_cycle = cpu_state->cycle;
+        log->num_records = 0;
+    }
+    return;
+}
+
+/**
+ * Logs the undo record for the instruction at the PC, which is about to run.
+ * This is invoked by the engine before each instruction while recording.
+ **/
+void reverse_record(cpu_state_t *cpu_state)
+{
+    // If the cycle was changed outside of the engine, start recording anew
+    struct undo_log *log = cpu_state->debug.undo;
+    if (cpu_state->cycle != log->first_cycle + log->num_records) {
+        reverse_reset(cpu_state);
+    }
+    if (log->num_records % log->interval == 0) {
+        take_checkpoint(cpu_state, log);
+    }
+
+    undo_record_t *record = get_record(log, log->num_records);
+    uint32_t instr = 0;
+    mem_peek32(cpu_state, cpu_state->pc, &instr);
+    record->pc = cpu_state->pc;
+    record->rd = (instr >> 7) & 0x1F;
+    record->old_rd = cpu_state->registers[record->rd];
+    record->words = 0;
+    record_memory(cpu_state, instr, record);
+
+    log->num_records += 1;
+    return;
+}
+
+/**
+ * Gets the earliest cycle that the hart can go back to, which is its current
+ * cycle if nothing has been recorded.
+ **/
+uint64_t reverse_first_cycle(const cpu_state_t *cpu_state)
+{
+    struct undo_log *log = cpu_state->debug.undo;
+    if (log == NULL || cpu_state->cycle != log->first_cycle +
+            log->num_records) {
+        return cpu_state->cycle;
+    }
+
+    // The oldest record can only be undone if its checkpoint is kept
+    uint64_t oldest = oldest_record(log);
+    uint64_t first = (oldest + log->interval - 1) / log->interval *
+            log->interval;
+    return log->first_cycle + ((first < log->num_records) ? first :
+            log->num_records);
+}
+
+/**
+ * Takes the hart back to the given earlier cycle. Returns 0 on success, or a
+ * negative error code if the recording doesn't go back that far.
+ **/
+int reverse_to_cycle(cpu_state_t *cpu_state, uint64_t cycle)
+{
+    struct undo_log *log = cpu_state->debug.undo;
+    if (cycle < reverse_first_cycle(cpu_state) || cycle > cpu_state->cycle) {
+        return -ERANGE;
+    } else if (cycle == cpu_state->cycle) {
+        return 0;
+    }
+
+    // Undo the memory writes of the records back to the checkpoint
+    uint64_t target = cycle - log->first_cycle;
+    undo_checkpoint_t *checkpoint = find_checkpoint(log, target);
+    for (uint64_t i = log->num_records; i > checkpoint->record; i--)
+    {
+        const undo_record_t *record = get_record(log, i - 1);
+        if (record->words & UNDO_WORD_0) {
+            restore_word(cpu_state, record->addr, record->old_words[0]);
+        }
+        if (record->words & UNDO_WORD_1) {
+            restore_word(cpu_state, record->addr + sizeof(uint32_t),
+                    record->old_words[1]);
+        }
+    }
+    restore_checkpoint(cpu_state, log, checkpoint);
+
+    /* Run forward to the cycle, recording again. The observers of the memory
+     * accesses already saw these accesses, so they are paused meanwhile. */
+    mem_hooks_pause(true);
+    engine_replay(cpu_state, cycle - cpu_state->cycle);
+    mem_hooks_pause(false);
+
+    if (cpu_state->cycle != cycle) {
+        fprintf(stderr, "Warning: The hart halted at cycle %" PRIu64 " while "
+                "running forward to cycle %" PRIu64 ".\n", cpu_state->cycle,
+                cycle);
+    }
+    return 0;
+}
+
+/**
+ * Searches backwards from the current cycle for the last instruction that met
+ * the condition, and sets cycle to the cycle before it ran. For the PC, the
+ * target is an address, for a register, a register number, and for memory, the
+ * address of a word. Returns 0 on success, or -ENOENT if no recorded
+ * instruction met the condition.
+ **/
+int reverse_find(const cpu_state_t *cpu_state, reverse_cond_t cond,
+        uint32_t target, uint64_t *cycle)
+{
+    struct undo_log *log = cpu_state->debug.undo;
+    uint64_t first = reverse_first_cycle(cpu_state);
+    if (first == cpu_state->cycle) {
+        return -ENOENT;
+    }
+
+    /* The value of the register or word is tracked back through the records.
+     * An instruction changed it if the old value it logged differs. */
+    uint32_t value = 0;
+    if (cond == REVERSE_UNTIL_REG) {
+        value = cpu_state->registers[target];
+    } else if (cond == REVERSE_UNTIL_MEM && !mem_peek32(cpu_state, target,
+                &value)) {
+        return -ENOENT;
+    }
+
+    for (uint64_t i = log->num_records; i > first - log->first_cycle; i--)
+    {
+        const undo_record_t *record = get_record(log, i - 1);
+        bool found = false;
+        switch (cond)
+        {
+            case REVERSE_UNTIL_PC:
+                found = (record->pc == target);
+                break;
+
+            case REVERSE_UNTIL_REG:
+                found = (record->rd == target && record->old_rd != value);
+                value = (record->rd == target) ? record->old_rd : value;
+                break;
+
+            case REVERSE_UNTIL_MEM:
+                for (int j = 0; j < 2; j++)
+                {
+                    uint32_t addr = record->addr + j * sizeof(uint32_t);
+                    if ((record->words & (1 << j)) && addr == target) {
+                        found = (record->old_words[j] != value);
+                        value = record->old_words[j];
+                    }
+                }
+                break;
+        }
+
+        if (found) {
+            *cycle = log->first_cycle + i - 1;
+            return 0;
+        }
+    }
+    return -ENOENT;
+}
+
+/**
+ * Prints the status of the hart's recording: the cycles it covers, and the
+ * memory used by it.
+ **/
+void reverse_print_status(const cpu_state_t *cpu_state, FILE *file)
+{
+    struct undo_log *log = cpu_state->debug.undo;
+    if (log == NULL) {
+        fprintf(file, "Recording is off.\n");
+        return;
+    }
+
+    size_t size = sizeof(*log) + log->capacity * sizeof(undo_record_t);
+    fprintf(file, "Recording is on, keeping %" PRIu32 " records (%zu KiB), "
+            "with a checkpoint every %" PRIu32 " records.\n", log->capacity,
+            size / 1024, log->interval);
+    fprintf(file, "Cycles %" PRIu64 " to %" PRIu64 " can be stepped back "
+            "to.\n", reverse_first_cycle(cpu_state), cpu_state->cycle);
+    return;
+}
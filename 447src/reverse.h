@@ -0,0 +1,117 @@
+/**
+ * reverse.h
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the interface to reverse execution, which steps a hart
+ * backwards through the instructions it has run.
+ *
+ * While recording, the engine logs a compact undo record for each instruction
+ * into a fixed-size ring buffer: its PC, the old value of its destination
+ * register, and the old memory words that a store or atomic could overwrite.
+ * Every so often, a checkpoint of the hart's registers and CSRs is taken as
+ * well. To go back to an earlier cycle, the memory writes are undone back to
+ * the nearest checkpoint before it, the checkpoint is restored, and the hart is
+ * run forward again to the cycle. This bounds the cost of each step back by the
+ * distance between checkpoints, no matter how far into the program it is.
+ *
+ * Only the hart's own state is rewound. Devices are not, so their registers
+ * are accessed again as the hart is run forward.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+#ifndef REVERSE_H_
+#define REVERSE_H_
+
+// Standard Includes
+#include <stdint.h>             // Fixed-size integral types
+#include <stdio.h>              // Definition of the FILE type
+
+// 18-447 Simulator Includes
+#include <sim.h>                // Definition of cpu_state_t
+
+/*----------------------------------------------------------------------------
+ * Definitions
+ *----------------------------------------------------------------------------*/
+
+// The default number of undo records kept, which must be a power of 2
+#define REVERSE_DEFAULT_RECORDS (1 << 20)
+
+// The minimum number of undo records that can be kept
+#define REVERSE_MIN_RECORDS     (1 << 6)
+
+// The kinds of conditions that can be searched for backwards
+typedef enum reverse_cond {
+    REVERSE_UNTIL_PC,           // The PC was at the address
+    REVERSE_UNTIL_REG,          // An instruction changed the register
+    REVERSE_UNTIL_MEM,          // An instruction changed the memory word
+} reverse_cond_t;
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Starts recording the hart's instructions, keeping undo records for at least
+ * the given number of the most recent ones. Any previous recording is
+ * discarded. Returns 0 on success, or a negative error code on failure.
+ **/
+int reverse_start(cpu_state_t *cpu_state, uint32_t num_records);
+
+/**
+ * Stops recording the hart's instructions, and discards the recording.
+ **/
+void reverse_stop(cpu_state_t *cpu_state);
+
+/**
+ * Discards the recording so far, and continues recording from the hart's
+ * current state. This must be done whenever the hart's state is changed outside
+ * of the engine, since it couldn't be reproduced by running forward.
+ **/
+void reverse_reset(cpu_state_t *cpu_state);
+
+/**
+ * Logs the undo record for the instruction at the PC, which is about to run.
+ * This is invoked by the engine before each instruction while recording.
+ **/
+void reverse_record(cpu_state_t *cpu_state);
+
+/**
+ * Gets the earliest cycle that the hart can go back to, which is its current
+ * cycle if nothing has been recorded.
+ **/
+uint64_t reverse_first_cycle(const cpu_state_t *cpu_state);
+
+/**
+ * Takes the hart back to the given earlier cycle. Returns 0 on success, or a
+ * negative error code if the recording doesn't go back that far.
+ **/
+int reverse_to_cycle(cpu_state_t *cpu_state, uint64_t cycle);
+
+/**
+ * Searches backwards from the current cycle for the last instruction that met
+ * the condition, and sets cycle to the cycle before it ran. For the PC, the
+ * target is an address, for a register, a register number, and for memory, the
+ * address of a word. Returns 0 on success, or -ENOENT if no recorded
+ * instruction met the condition.
+ **/
+int reverse_find(const cpu_state_t *cpu_state, reverse_cond_t cond,
+        uint32_t target, uint64_t *cycle);
+
+/**
+ * Prints the status of the hart's recording: the cycles it covers, and the
+ * memory used by it.
+ **/
+void reverse_print_status(const cpu_state_t *cpu_state, FILE *file);
+
+#endif /* REVERSE_H_ */
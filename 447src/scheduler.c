@@ -0,0 +1,377 @@
+/**
+ * scheduler.c
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the implementation of the discrete-event scheduler, which
+ * is a hierarchical timing wheel keyed on the processor's cycle counter.
+ *
+ * Level 0 of the wheel has one slot per cycle, and each level above it has
+ * slots that cover SCHED_WHEEL_SLOTS times as many cycles as the level below.
+ * An event is filed in the lowest level whose range, relative to the current
+ * time of the wheel, contains the event. As the wheel advances, the slot in
+ * each level that contains the new current time is re-filed into the lower
+ * levels. Events too far in the future for the wheel go on an overflow list.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+// Standard Includes
+#include <stdint.h>                 // Fixed-size integral types
+#include <stdbool.h>                // Definition of the boolean type
+#include <stddef.h>                 // Definition of NULL
+
+// Standard Includes
+#include <assert.h>                 // Assert macro
+#include <string.h>                 // Memset function
+
+// 18-447 Simulator Includes
+#include <scheduler.h>              // This file's interface
+
+/*----------------------------------------------------------------------------
+ * Internal Helper Functions
+ *----------------------------------------------------------------------------*/
+
+// The number of cycles covered by the whole wheel
+#define SCHED_WHEEL_RANGE_BITS  (SCHED_WHEEL_BITS * SCHED_WHEEL_LEVELS)
+
+/**
+ * Gets the bit position of the lowest cycle bit that selects a slot in the
+ * given level of the wheel.
+ **/
+static inline int level_shift(int level)
+{
+    return level * SCHED_WHEEL_BITS;
+}
+
+/**
+ * Gets the index of the slot that contains the given cycle in the given level.
+ **/
+static inline int slot_index(int level, uint64_t when)
+{
+    return (when >> level_shift(level)) & (SCHED_WHEEL_SLOTS - 1);
+}
+
+/**
+ * Links the event into the front of the given list.
+ **/
+static void list_push(sched_event_t **head, sched_event_t *event)
+{
+    event->next = *head;
+    if (event->next != NULL) {
+        event->next->prev_next = &event->next;
+    }
+    event->prev_next = head;
+    *head = event;
+    return;
+}
+
+/**
+ * Unlinks the event from the list it is currently on.
+ **/
+static void list_remove(sched_event_t *event)
+{
+    assert(event->prev_next != NULL);
+
+    *event->prev_next = event->next;
+    if (event->next != NULL) {
+        event->next->prev_next = event->prev_next;
+    }
+    event->next = NULL;
+    event->prev_next = NULL;
+    return;
+}
+
+/**
+ * Moves all of the events on the source list to the front of the destination
+ * list. The destination list must be empty.
+ **/
+static void list_move(sched_event_t **dest, sched_event_t **src)
+{
+    assert(*dest == NULL);
+
+    *dest = *src;
+    *src = NULL;
+    if (*dest != NULL) {
+        (*dest)->prev_next = dest;
+    }
+    return;
+}
+
+/**
+ * Files the event into the level and slot appropriate for its deadline,
+ * relative to the current time of the wheel.
+ **/
+static void file_event(scheduler_t *scheduler, sched_event_t *event)
+{
+    assert(event->when >= scheduler->now);
+
+    /* The event goes in the lowest level for which it is in the same range of
+     * the next level up as the current time. */
+    for (int level = 0; level < SCHED_WHEEL_LEVELS; level++)
+    {
+        int upper_shift = level_shift(level + 1);
+        if ((event->when >> upper_shift) == (scheduler->now >> upper_shift)) {
+            int slot = slot_index(level, event->when);
+            list_push(&scheduler->slots[level][slot], event);
+            scheduler->occupied[level] |= UINT64_C(1) << slot;
+            event->level = level;
+            return;
+        }
+    }
+
+    // The event is too far in the future for the wheel
+    list_push(&scheduler->overflow, event);
+    event->level = -1;
+    return;
+}
+
+/**
+ * Re-files all of the events on the given list relative to the current time.
+ **/
+static void refile_list(scheduler_t *scheduler, sched_event_t **list)
+{
+    while (*list != NULL)
+    {
+        sched_event_t *event = *list;
+        list_remove(event);
+        file_event(scheduler, event);
+    }
+    return;
+}
+
+/**
+ * Advances the current time of the wheel to the given cycle.
+ *
+ * No pending event may lie strictly between the old and new current time. This
+ * means that the only events that need to move are the ones in the slot of each
+ * level that contains the new time, plus the overflow list if the new time is
+ * in a different range of the whole wheel.
+ **/
+static void set_time(scheduler_t *scheduler, uint64_t now)
+{
+    assert(now >= scheduler->now);
+
+    uint64_t old_now = scheduler->now;
+    scheduler->now = now;
+    if (now == old_now) {
+        return;
+    }
+
+    // Re-file the overflow list if we've moved into a new range of the wheel
+    if ((now >> SCHED_WHEEL_RANGE_BITS) !=
+            (old_now >> SCHED_WHEEL_RANGE_BITS)) {
+        sched_event_t *overflow = NULL;
+        list_move(&overflow, &scheduler->overflow);
+        refile_list(scheduler, &overflow);
+    }
+
+    /* Then, from the top level down, move the slot containing the new time
+     * down to the lower levels. */
+    for (int level = SCHED_WHEEL_LEVELS - 1; level > 0; level--)
+    {
+        int slot = slot_index(level, now);
+        if (scheduler->slots[level][slot] != NULL) {
+            sched_event_t *list = NULL;
+            list_move(&list, &scheduler->slots[level][slot]);
+            scheduler->occupied[level] &= ~(UINT64_C(1) << slot);
+            refile_list(scheduler, &list);
+        }
+    }
+
+    return;
+}
+
+/**
+ * Gets the index of the first occupied slot at or after the given slot in the
+ * bitmap, or -1 if there is none.
+ **/
+static int first_occupied(uint64_t occupied, int start_slot)
+{
+    uint64_t candidates = occupied & (~UINT64_C(0) << start_slot);
+    return (candidates == 0) ? -1 : __builtin_ctzll(candidates);
+}
+
+/**
+ * Finds the earliest deadline among the events on the given list.
+ **/
+static uint64_t list_min_deadline(const sched_event_t *list)
+{
+    uint64_t deadline = SCHED_NEVER;
+    for (const sched_event_t *event = list; event != NULL; event = event->next)
+    {
+        if (event->when < deadline) {
+            deadline = event->when;
+        }
+    }
+    return deadline;
+}
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Initializes the scheduler, dropping any events that were pending.
+ *
+ * The wheel starts at the given cycle, which is normally 0 for a freshly
+ * loaded program.
+ **/
+void sched_init(scheduler_t *scheduler, uint64_t now)
+{
+    memset(scheduler, 0, sizeof(*scheduler));
+    scheduler->now = now;
+    scheduler->horizon = 0;
+    scheduler->next_deadline = SCHED_NEVER;
+    scheduler->deadline_valid = true;
+    return;
+}
+
+/**
+ * Initializes an event with the given callback and argument.
+ *
+ * This must be called once before the event is posted for the first time.
+ **/
+void sched_event_init(sched_event_t *event, sched_callback_t callback,
+        void *arg)
+{
+    memset(event, 0, sizeof(*event));
+    event->callback = callback;
+    event->arg = arg;
+    event->level = -1;
+    return;
+}
+
+/**
+ * Posts an event to fire at the specified cycle.
+ *
+ * If the event is already pending, it is moved to the new cycle. Events in the
+ * past fire at the next batch boundary. If the event falls before the end of
+ * the batch that is currently running, the batch is cut short so that the event
+ * fires on time.
+ **/
+void sched_post(scheduler_t *scheduler, sched_event_t *event, uint64_t when)
+{
+    assert(event->callback != NULL);
+
+    if (sched_event_pending(event)) {
+        sched_cancel(scheduler, event);
+    }
+
+    // Events in the past fire as soon as possible
+    event->when = (when < scheduler->now) ? scheduler->now : when;
+    file_event(scheduler, event);
+
+    // Update the cached deadline, and cut the running batch short if needed
+    if (scheduler->deadline_valid && event->when < scheduler->next_deadline) {
+        scheduler->next_deadline = event->when;
+    }
+    if (event->when < scheduler->horizon) {
+        scheduler->horizon = event->when;
+    }
+    return;
+}
+
+/**
+ * Cancels a pending event. Cancelling an event that is not pending does
+ * nothing.
+ **/
+void sched_cancel(scheduler_t *scheduler, sched_event_t *event)
+{
+    if (!sched_event_pending(event)) {
+        return;
+    }
+
+    // Unlink the event, clearing its slot's occupied bit if it is now empty
+    list_remove(event);
+    if (event->level >= 0) {
+        int slot = slot_index(event->level, event->when);
+        if (scheduler->slots[event->level][slot] == NULL) {
+            scheduler->occupied[event->level] &= ~(UINT64_C(1) << slot);
+        }
+    }
+    event->level = -1;
+
+    // The cached deadline may have been this event
+    if (event->when == scheduler->next_deadline) {
+        scheduler->deadline_valid = false;
+    }
+    return;
+}
+
+/**
+ * Returns the cycle of the earliest pending event, or SCHED_NEVER if there are
+ * no pending events.
+ **/
+uint64_t sched_next_deadline(scheduler_t *scheduler)
+{
+    if (scheduler->deadline_valid) {
+        return scheduler->next_deadline;
+    }
+
+    /* The levels partition the future into increasingly coarse ranges, so the
+     * earliest event is in the first occupied slot of the lowest non-empty
+     * level. Slots before the current time's slot in each level are empty. */
+    uint64_t deadline = SCHED_NEVER;
+    for (int level = 0; level < SCHED_WHEEL_LEVELS; level++)
+    {
+        int slot = first_occupied(scheduler->occupied[level],
+                slot_index(level, scheduler->now));
+        if (slot >= 0) {
+            deadline = list_min_deadline(scheduler->slots[level][slot]);
+            break;
+        }
+    }
+
+    // If the wheel is empty, then the earliest event is on the overflow list
+    if (deadline == SCHED_NEVER) {
+        deadline = list_min_deadline(scheduler->overflow);
+    }
+
+    scheduler->next_deadline = deadline;
+    scheduler->deadline_valid = true;
+    return deadline;
+}
+
+/**
+ * Advances the scheduler to the given cycle, firing all events that are due at
+ * or before it in cycle order.
+ **/
+void sched_run_due(scheduler_t *scheduler, uint64_t now)
+{
+    // Fire the events in order, moving the wheel forward to each deadline
+    uint64_t deadline;
+    while ((deadline = sched_next_deadline(scheduler)) <= now)
+    {
+        set_time(scheduler, deadline);
+
+        /* All events due now are in the current level 0 slot. Move them to the
+         * firing list first, since the callbacks may post new events into the
+         * slot, or cancel events that are about to fire. */
+        int slot = slot_index(0, deadline);
+        list_move(&scheduler->firing, &scheduler->slots[0][slot]);
+        scheduler->occupied[0] &= ~(UINT64_C(1) << slot);
+        scheduler->deadline_valid = false;
+        while (scheduler->firing != NULL)
+        {
+            sched_event_t *event = scheduler->firing;
+            list_remove(event);
+            event->level = -1;
+            event->callback(event, deadline);
+        }
+    }
+
+    if (now > scheduler->now) {
+        set_time(scheduler, now);
+    }
+    return;
+}
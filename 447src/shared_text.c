@@ -0,0 +1,274 @@
+/**
+ * shared_text.c
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the implementation of shared text, which lets several CPU
+ * instances running the same program use one copy of its text segments.
+ *
+ * Sharing a segment, unsharing it, and dropping references are rare, so they
+ * are all serialized by a single lock. The decoded instructions are built
+ * under the same lock, and published with a release store so that they can be
+ * read without it.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+// Standard Includes
+#include <stdlib.h>                 // Malloc and free functions
+#include <stdio.h>                  // Printf and related functions
+#include <stdint.h>                 // Fixed-size integral types
+
+// Standard Includes
+#include <errno.h>                  // Error codes
+#include <string.h>                 // Memcpy function
+#include <endian.h>                 // Little-endian to host conversions
+#include <pthread.h>                // Mutex for the shared objects
+#include <sys/mman.h>               // Munmap function
+
+// 18-447 Simulator Includes
+#include <riscv_isa.h>              // Definition of RISC-V opcodes
+#include <memory.h>                 // Definition of mem_segment_t
+
+// Local Includes
+#include "shared_text.h"            // This file's interface
+
+/*----------------------------------------------------------------------------
+ * Internal Definitions
+ *----------------------------------------------------------------------------*/
+
+// The contents of a text segment shared by several instances
+struct shared_text {
+    int references;             // Number of segments sharing the contents
+    uint8_t *mem;               // Buffer holding the contents
+    uint32_t size;              // Size of the contents in bytes
+    uint32_t mapped_size;       // Size of the mapping, if the buffer was
+                                // mapped with mmap instead of allocated
+    decoded_instr_t *decoded;   // Decoded instructions, once they are built
+};
+
+// The lock that serializes all changes to the sharing of segments
+static pthread_mutex_t SHARE_LOCK = PTHREAD_MUTEX_INITIALIZER;
+
+/*----------------------------------------------------------------------------
+ * Helper Functions
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Frees the shared object, along with its buffer and decoded instructions.
+ **/
+static void free_shared(struct shared_text *shared)
+{
+    if (shared->mapped_size != 0) {
+        munmap(shared->mem, shared->mapped_size);
+    } else {
+        free(shared->mem);
+    }
+    free(shared->decoded);
+    free(shared);
+    return;
+}
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Decodes the instruction into its fields. The immediate is decoded according
+ * to the format of the instruction's opcode, and is 0 for R-type instructions.
+ **/
+void text_decode(uint32_t instr, decoded_instr_t *decoded)
+{
+    decoded->instr = instr;
+    decoded->opcode = instr & 0x7F;
+    decoded->rd = (instr >> 7) & 0x1F;
+    decoded->funct3 = (instr >> 12) & 0x7;
+    decoded->rs1 = (instr >> 15) & 0x1F;
+    decoded->rs2 = (instr >> 20) & 0x1F;
+    decoded->funct7 = (instr >> 25) & 0x7F;
+
+    switch (decoded->opcode)
+    {
+        // I-type instructions
+        case OP_IMM:
+        case OP_LOAD:
+        case OP_JALR:
+        case OP_SYSTEM:
+            decoded->imm = (int32_t)instr >> 20;
+            break;
+
+        // S-type instructions
+        case OP_STORE:
+            decoded->imm = (int32_t)(((instr >> 25) << 5) |
+                    ((instr >> 7) & 0x1F)) << 20 >> 20;
+            break;
+
+        // SB-type instructions
+        case OP_BRANCH:
+            decoded->imm = (int32_t)(((instr >> 31) << 12) |
+                    (((instr >> 7) & 0x1) << 11) |
+                    (((instr >> 25) & 0x3F) << 5) |
+                    (((instr >> 8) & 0xF) << 1)) << 19 >> 19;
+            break;
+
+        // U-type instructions
+        case OP_LUI:
+        case OP_AUIPC:
+            decoded->imm = instr & 0xFFFFF000;
+            break;
+
+        // UJ-type instructions
+        case OP_JAL:
+            decoded->imm = (int32_t)(((instr >> 31) << 20) |
+                    (((instr >> 12) & 0xFF) << 12) |
+                    (((instr >> 20) & 0x1) << 11) |
+                    (((instr >> 21) & 0x3FF) << 1)) << 11 >> 11;
+            break;
+
+        // R-type instructions, and unknown opcodes
+        default:
+            decoded->imm = 0;
+            break;
+    }
+
+    return;
+}
+
+/**
+ * Makes the destination segment share the contents of the source segment,
+ * which must have been loaded. If the source isn't shared yet, its buffer is
+ * handed over to a new shared object. Returns 0 on success, or a negative error
+ * code on failure.
+ **/
+int text_share(mem_segment_t *source, mem_segment_t *dest)
+{
+    pthread_mutex_lock(&SHARE_LOCK);
+    struct shared_text *shared = source->shared;
+    if (shared == NULL) {
+        shared = calloc(1, sizeof(*shared));
+        if (shared == NULL) {
+            pthread_mutex_unlock(&SHARE_LOCK);
+            fprintf(stderr, "Error: Unable to allocate shared text.\n");
+            return -ENOMEM;
+        }
+
+        shared->references = 1;
+        shared->mem = source->mem;
+        shared->size = source->size;
+        shared->mapped_size = source->mapped_size;
+        source->mapped_size = 0;
+        source->shared = shared;
+    }
+
+    shared->references += 1;
+    dest->mem = shared->mem;
+    dest->size = shared->size;
+    dest->mapped_size = 0;
+    dest->shared = shared;
+    pthread_mutex_unlock(&SHARE_LOCK);
+    return 0;
+}
+
+/**
+ * Gives the shared segment a private copy of its contents, so that it can be
+ * written. Exits on error.
+ **/
+void text_unshare(mem_segment_t *segment)
+{
+    // Another hart using the same segment table may have already unshared it
+    pthread_mutex_lock(&SHARE_LOCK);
+    struct shared_text *shared = segment->shared;
+    if (shared == NULL) {
+        pthread_mutex_unlock(&SHARE_LOCK);
+        return;
+    }
+
+    // The last user of the contents takes the buffer back instead of copying
+    if (shared->references == 1) {
+        segment->mapped_size = shared->mapped_size;
+        shared->mem = NULL;
+        shared->mapped_size = 0;
+        free_shared(shared);
+    } else {
+        uint8_t *mem = malloc(shared->size);
+        if (mem == NULL) {
+            fprintf(stderr, "Error: Unable to allocate a private copy of a "
+                    "text segment.\n");
+            exit(ENOMEM);
+        }
+
+        memcpy(mem, shared->mem, shared->size);
+        shared->references -= 1;
+        segment->mem = mem;
+        segment->mapped_size = 0;
+    }
+
+    __atomic_store_n(&segment->shared, NULL, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&SHARE_LOCK);
+    return;
+}
+
+/**
+ * Drops the segment's reference to its shared contents, freeing them once no
+ * other segment is using them.
+ **/
+void text_release(mem_segment_t *segment)
+{
+    pthread_mutex_lock(&SHARE_LOCK);
+    struct shared_text *shared = segment->shared;
+    shared->references -= 1;
+    if (shared->references == 0) {
+        free_shared(shared);
+    }
+
+    segment->shared = NULL;
+    segment->mem = NULL;
+    pthread_mutex_unlock(&SHARE_LOCK);
+    return;
+}
+
+/**
+ * Returns the decoded instructions of the shared segment, one per word, which
+ * are built the first time they are requested. Returns NULL if the segment is
+ * not shared, or the instructions could not be decoded.
+ **/
+const decoded_instr_t *text_decoded(const mem_segment_t *segment)
+{
+    struct shared_text *shared = __atomic_load_n(&segment->shared,
+            __ATOMIC_ACQUIRE);
+    if (shared == NULL) {
+        return NULL;
+    }
+
+    decoded_instr_t *decoded = __atomic_load_n(&shared->decoded,
+            __ATOMIC_ACQUIRE);
+    if (decoded != NULL) {
+        return decoded;
+    }
+
+    // Decode every word of the segment, unless another thread already has
+    pthread_mutex_lock(&SHARE_LOCK);
+    decoded = shared->decoded;
+    uint32_t num_words = shared->size / sizeof(uint32_t);
+    if (decoded == NULL && num_words > 0) {
+        decoded = malloc(num_words * sizeof(decoded[0]));
+        for (uint32_t i = 0; decoded != NULL && i < num_words; i++)
+        {
+            uint32_t word;
+            memcpy(&word, &shared->mem[i * sizeof(word)], sizeof(word));
+            text_decode(le32toh(word), &decoded[i]);
+        }
+        __atomic_store_n(&shared->decoded, decoded, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&SHARE_LOCK);
+    return decoded;
+}
@@ -0,0 +1,89 @@
+/**
+ * shared_text.h
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the interface to shared text, which lets several CPU
+ * instances running the same program use one copy of its text segments.
+ *
+ * A shared text segment's buffer is owned by a reference-counted object, along
+ * with the decoded form of its instructions, which is built the first time it
+ * is needed. The contents are never written while they are shared. The first
+ * write by an instance gives that instance a private copy of the segment, which
+ * no longer has the decoded instructions.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+#ifndef SHARED_TEXT_H_
+#define SHARED_TEXT_H_
+
+// Standard Includes
+#include <stdint.h>             // Fixed-size integral types
+
+// 18-447 Simulator Includes
+#include <memory.h>             // Definition of mem_segment_t
+
+/*----------------------------------------------------------------------------
+ * Definitions
+ *----------------------------------------------------------------------------*/
+
+// An instruction split into its fields, with its immediate fully decoded
+typedef struct decoded_instr {
+    uint32_t instr;             // The raw instruction
+    int32_t imm;                // Immediate for the instruction's format
+    uint8_t opcode;             // Opcode of the instruction
+    uint8_t rd;                 // Destination register
+    uint8_t rs1;                // First source register
+    uint8_t rs2;                // Second source register
+    uint8_t funct3;             // 3-bit function code
+    uint8_t funct7;             // 7-bit function code
+} decoded_instr_t;
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Decodes the instruction into its fields. The immediate is decoded according
+ * to the format of the instruction's opcode, and is 0 for R-type instructions.
+ **/
+void text_decode(uint32_t instr, decoded_instr_t *decoded);
+
+/**
+ * Makes the destination segment share the contents of the source segment,
+ * which must have been loaded. If the source isn't shared yet, its buffer is
+ * handed over to a new shared object. Returns 0 on success, or a negative error
+ * code on failure.
+ **/
+int text_share(mem_segment_t *source, mem_segment_t *dest);
+
+/**
+ * Gives the shared segment a private copy of its contents, so that it can be
+ * written. Exits on error.
+ **/
+void text_unshare(mem_segment_t *segment);
+
+/**
+ * Drops the segment's reference to its shared contents, freeing them once no
+ * other segment is using them.
+ **/
+void text_release(mem_segment_t *segment);
+
+/**
+ * Returns the decoded instructions of the shared segment, one per word, which
+ * are built the first time they are requested. Returns NULL if the segment is
+ * not shared, or the instructions could not be decoded.
+ **/
+const decoded_instr_t *text_decoded(const mem_segment_t *segment);
+
+#endif /* SHARED_TEXT_H_ */
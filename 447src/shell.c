@@ -32,6 +32,7 @@
 #include <string.h>             // String manipulation functions and memset
 #include <errno.h>              // Error codes and perror
 #include <signal.h>             // Signal numbers and sigaction function
+#include <unistd.h>             // Getopt function
 
 // Readline Includes
 #include <readline/readline.h>  // Interface to the readline library
@@ -43,22 +44,36 @@
 // Local Includes
 #include "libc_extensions.h"    // The array_len function
 #include "commands.h"           // Interface to the shell commands
-#include "memory_shell.h"       // Interface to the processor memory
-#include "memory_segments.h"    // Definition of memory segments array
+#include "plugins.h"            // Loading instrumentation plugins
+#include "machine.h"            // Interface to the machine's harts
+#include "memory_map.h"         // Configuring the memory map
+#include "stats.h"              // Statistics registry and log
 
 /*----------------------------------------------------------------------------
  * Internal Definitions
  *----------------------------------------------------------------------------*/
 
-// The expected number of command line arguments, including the program name
-static const int NUM_CMDLINE_ARGS       = 2;
+// The expected number of positional command line arguments (the program)
+static const int NUM_CMDLINE_ARGS       = 1;
+
+// The options for the machine, which are specified on the command line
+typedef struct machine_options {
+    int num_harts;              // Number of harts to simulate
+    hart_mode_t mode;           // How the harts are scheduled
+    uint64_t quantum;           // Cycles a hart runs before synchronizing
+    int num_plugins;            // Number of plugins to load
+    const char *plugins[PLUGINS_MAX];   // Specifications of the plugins
+    char *stats_path;           // Path of the statistics log, or NULL
+    stats_format_t stats_format;        // Format of the statistics log
+    int stats_interval;         // Cycles between the statistics log's records
+} machine_options_t;
 
 // The maximum line length the user can type in for a command
 static const int COMMAND_MAX_LEN        = 100;
 
 /* The maximum number of arguments that can be parsed from user input. This more
  * than the max possible, so too many arguments can be detected. */
-static const int COMMAND_MAX_ARGS       = 4;
+static const int COMMAND_MAX_ARGS       = 6;
 
 // The readline history file name, and the maximum number of lines for it
 static const int HISTORY_MAX_LINES      = 100;
@@ -76,26 +91,148 @@ volatile bool SIGINT_RECEIVED           = false;
  **/
 static void print_usage()
 {
-    fprintf(stdout, "Usage: riscv-sim <program>\n");
+    fprintf(stdout, "Usage: riscv-sim [-n harts] [-m mode] [-q quantum] "
+            "[-p plugin[:args]]... [-M map_file] [-r region]...\n"
+            "                 [-s stats_file[:cycles]] <program>\n");
     fprintf(stdout, "Example: riscv-sim 447inputs/additest.S\n");
+    fprintf(stdout, "Options:\n");
+    fprintf(stdout, "  -n harts      Number of harts sharing memory (default "
+            "1).\n");
+    fprintf(stdout, "  -m mode       How the harts are scheduled: parallel, "
+            "quantum, round-robin,\n"
+            "                or interleave (default parallel).\n");
+    fprintf(stdout, "  -q quantum    Cycles a hart runs before synchronizing "
+            "with the others (default %d).\n", MACHINE_DEFAULT_QUANTUM);
+    fprintf(stdout, "  -p plugin     Load the instrumentation plugin from the "
+            "shared object, passing it\n"
+            "                the arguments after the colon. Can be "
+            "repeated.\n");
+    fprintf(stdout, "  -M map_file   Replace the memory map with the regions "
+            "in the file.\n");
+    fprintf(stdout, "  -r region     Add or replace a region of the memory "
+            "map, given as\n"
+            "                '<name> <base> <size> <perms> <backing> "
+            "[extension]'. Can be\n"
+            "                repeated.\n");
+    fprintf(stdout, "  -s stats_file Log the statistics to the file when the "
+            "machine halts, and every\n"
+            "                cycles if given. The file is CSV if it ends in "
+            "'.csv', or JSON.\n");
     return;
 }
 
 /**
- * Parses the command-line arguments to the program, which only consist of an
- * optional path to the program to run.
+ * Parses the specification of the statistics log, which is the path to the
+ * log, optionally followed by a colon and the cycles between its records. The
+ * log is written as CSV if the path ends in '.csv', and as JSON otherwise.
  **/
-static int parse_arguments(int argc, char *argv[], char **program_path)
+static int parse_stats_log(char *spec, machine_options_t *options)
 {
+    options->stats_interval = 0;
+    char *separator = strrchr(spec, ':');
+    if (separator != NULL) {
+        if (parse_int(separator + 1, &options->stats_interval) < 0 ||
+                options->stats_interval <= 0) {
+            fprintf(stderr, "Error: Invalid statistics interval '%s'.\n",
+                    separator + 1);
+            return -EINVAL;
+        }
+        *separator = '\0';
+    }
+
+    const char *extension = strrchr(spec, '.');
+    bool is_csv = extension != NULL && strcmp(extension, ".csv") == 0;
+    options->stats_format = is_csv ? STATS_FORMAT_CSV : STATS_FORMAT_JSON;
+    options->stats_path = spec;
+    return 0;
+}
+
+/**
+ * Parses the command-line arguments to the program, which consist of the
+ * options for the machine, and the path to the program to run.
+ **/
+static int parse_arguments(int argc, char *argv[], char **program_path,
+        machine_options_t *options)
+{
+    options->num_harts = 1;
+    options->mode = HART_MODE_PARALLEL;
+    options->quantum = MACHINE_DEFAULT_QUANTUM;
+    options->num_plugins = 0;
+    options->stats_path = NULL;
+
+    int opt;
+    int quantum;
+    while ((opt = getopt(argc, argv, "n:m:q:p:M:r:s:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n':
+                if (parse_int(optarg, &options->num_harts) < 0) {
+                    fprintf(stderr, "Error: Unable to parse '%s' as an int.\n",
+                            optarg);
+                    return -EINVAL;
+                }
+                break;
+
+            case 'm':
+                if (parse_hart_mode(optarg, &options->mode) < 0) {
+                    fprintf(stderr, "Error: Invalid hart mode '%s'.\n",
+                            optarg);
+                    return -EINVAL;
+                }
+                break;
+
+            case 'q':
+                if (parse_int(optarg, &quantum) < 0 || quantum <= 0) {
+                    fprintf(stderr, "Error: Invalid quantum '%s'.\n", optarg);
+                    return -EINVAL;
+                }
+                options->quantum = quantum;
+                break;
+
+            case 'p':
+                if (options->num_plugins == PLUGINS_MAX) {
+                    fprintf(stderr, "Error: Too many plugins, at most %d can "
+                            "be loaded.\n", PLUGINS_MAX);
+                    return -EINVAL;
+                }
+                options->plugins[options->num_plugins] = optarg;
+                options->num_plugins += 1;
+                break;
+
+            case 'M':
+                if (mem_map_load_file(optarg) < 0) {
+                    return -EINVAL;
+                }
+                break;
+
+            case 'r':
+                if (mem_map_set_region(optarg) < 0) {
+                    return -EINVAL;
+                }
+                break;
+
+            case 's':
+                if (parse_stats_log(optarg, options) < 0) {
+                    return -EINVAL;
+                }
+                break;
+
+            default:
+                print_usage();
+                return -EINVAL;
+        }
+    }
+
     // Check that the proper number of command line arguments was specified
-    if (argc != NUM_CMDLINE_ARGS) {
+    if (argc - optind != NUM_CMDLINE_ARGS) {
         fprintf(stderr, "Error: Improper number of command line arguments.\n");
         print_usage();
         return -EINVAL;
     }
 
     // Get the program path from the command line arguments
-    *program_path = argv[1];
+    *program_path = argv[optind];
     return 0;
 }
 
@@ -212,10 +349,46 @@ static bool process_long_command(cpu_state_t *cpu_state, const char *command,
         command_rdump(cpu_state, args, num_args);
     } else if (strcmp(command, "mdump") == 0) {
         command_mdump(cpu_state, args, num_args);
+    } else if (strcmp(command, "disasm") == 0) {
+        command_disasm(cpu_state, args, num_args);
     } else if (strcmp(command, "restart") == 0) {
         command_restart(cpu_state, args, num_args);
     } else if (strcmp(command, "load") == 0) {
         command_load(cpu_state, args, num_args);
+    } else if (strcmp(command, "hart") == 0) {
+        command_hart(cpu_state, args, num_args);
+    } else if (strcmp(command, "break") == 0) {
+        command_break(cpu_state, args, num_args);
+    } else if (strcmp(command, "delete") == 0) {
+        command_delete(cpu_state, args, num_args);
+    } else if (strcmp(command, "profile") == 0) {
+        command_profile(cpu_state, args, num_args);
+    } else if (strcmp(command, "heatmap") == 0) {
+        command_heatmap(cpu_state, args, num_args);
+    } else if (strcmp(command, "hotblocks") == 0) {
+        command_hotblocks(cpu_state, args, num_args);
+    } else if (strcmp(command, "stats") == 0) {
+        command_stats(cpu_state, args, num_args);
+    } else if (strcmp(command, "codewrites") == 0) {
+        command_codewrites(cpu_state, args, num_args);
+    } else if (strcmp(command, "hugepages") == 0) {
+        command_hugepages(cpu_state, args, num_args);
+    } else if (strcmp(command, "align") == 0) {
+        command_align(cpu_state, args, num_args);
+    } else if (strcmp(command, "memmap") == 0) {
+        command_memmap(cpu_state, args, num_args);
+    } else if (strcmp(command, "protect") == 0) {
+        command_protect(cpu_state, args, num_args);
+    } else if (strcmp(command, "fork") == 0) {
+        command_fork(cpu_state, args, num_args);
+    } else if (strcmp(command, "sweep") == 0) {
+        command_sweep(cpu_state, args, num_args);
+    } else if (strcmp(command, "record") == 0) {
+        command_record(cpu_state, args, num_args);
+    } else if (strcmp(command, "rstep") == 0) {
+        command_rstep(cpu_state, args, num_args);
+    } else if (strcmp(command, "rgo-until") == 0) {
+        command_rgo_until(cpu_state, args, num_args);
     } else if (strcmp(command, "verbose") == 0) {
         command_verbose(cpu_state, args, num_args);
     } else if (strcmp(command, "quit") == 0) {
@@ -267,6 +440,10 @@ static bool process_short_command(cpu_state_t *cpu_state, const char *command,
             command_mem(cpu_state, args, num_args);
             return true;
 
+        case 'b':
+            command_break(cpu_state, args, num_args);
+            return true;
+
         case 'v':
             command_verbose(cpu_state, args, num_args);
             return true;
@@ -327,7 +504,7 @@ static int split_command(char *command_string, char **command,
  * long form of the command, a string), or the short form, a single character.
  * Returns true if the quit command was specified.
  **/
-static bool process_command(cpu_state_t *cpu_state, char *command_string)
+static bool process_command(machine_t *machine, char *command_string)
 {
     // Separate the command string into the command and a list of arguments
     char *command;
@@ -340,7 +517,8 @@ static bool process_command(cpu_state_t *cpu_state, char *command_string)
     }
 
     /* Otherwise, identify the command based on its short alias or long form.
-     * If the command is valid, then add it to readline's history. */
+     * The command applies to the hart currently selected by the user. */
+    cpu_state_t *cpu_state = machine_current(machine);
     bool quit;
     if (process_long_command(cpu_state, command, args, num_args, &quit)) {
         return quit;
@@ -360,7 +538,7 @@ static bool process_command(cpu_state_t *cpu_state, char *command_string)
  * user input, and performs the specified command, until the user specifies quit
  * or sends an EOF character.
  **/
-static void simulator_repl(cpu_state_t *cpu_state)
+static void simulator_repl(machine_t *machine)
 {
     // Continuously process user commands until a quit or EOF
     while (true)
@@ -375,7 +553,7 @@ static void simulator_repl(cpu_state_t *cpu_state)
         add_history(line);
 
         // Process the user's command, stop if the user requested quit
-        bool quit = process_command(cpu_state, line);
+        bool quit = process_command(machine, line);
         free(line);
         if (quit) {
             break;
@@ -393,27 +571,53 @@ static void simulator_repl(cpu_state_t *cpu_state)
  **/
 int main(int argc, char *argv[])
 {
-    // Parse the program filename from the command line
+    // Parse the program filename and machine options from the command line
     char *program_path;
-    int rc = parse_arguments(argc, argv, &program_path);
+    machine_options_t options;
+    int rc = parse_arguments(argc, argv, &program_path, &options);
     if (rc < 0) {
         return -rc;
     }
 
-    // Instantiate a CPU state, zero it out, and setup the memory segments
-    cpu_state_t cpu_state;
-    memset(&cpu_state, 0, sizeof(cpu_state));
-    cpu_state.memory.num_segments = array_len(MEMORY_SEGMENTS);
-    cpu_state.memory.segments = MEMORY_SEGMENTS;
+    // Instantiate the machine's harts, which share the memory segments
+    machine_t machine;
+    rc = machine_init(&machine, options.num_harts, options.mode,
+            options.quantum);
+    if (rc < 0) {
+        return -rc;
+    }
+
+    // Load the instrumentation plugins, before any hart runs
+    for (int i = 0; i < options.num_plugins; i++)
+    {
+        rc = plugins_load(&machine, options.plugins[i]);
+        if (rc < 0) {
+            return -rc;
+        }
+    }
 
-    // Initialize the CPU state, and load the program
-    rc = init_cpu_state(&cpu_state, program_path);
+    // Initialize the CPU state of each hart, and load the program
+    rc = machine_load(&machine, program_path);
     if (rc < 0) {
         fprintf(stderr, "Failed to load the first program. Not starting the "
                 "simulator.\n");
         return -rc;
     }
 
+    // Register the statistics, and start logging them if requested
+    stats_register_builtin(&machine);
+    if (options.stats_path != NULL) {
+        rc = stats_start(&machine);
+        if (rc < 0) {
+            return -rc;
+        }
+        rc = stats_log_open(&machine, options.stats_path, options.stats_format,
+                options.stats_interval);
+        if (rc < 0) {
+            return -rc;
+        }
+    }
+
     // Setup the signal handling for the program
     setup_signals();
 
@@ -424,7 +628,13 @@ int main(int argc, char *argv[])
     }
 
     // The REPL loop for the simulator, wait for and read user commands
-    simulator_repl(&cpu_state);
+    simulator_repl(&machine);
+
+    // Let the plugins report their results, and unload them
+    plugins_unload();
+
+    // Close the statistics log, if one was opened
+    stats_log_close();
 
     // Cleanup the readline library
     return -cleanup_readline(HISTORY_FILE, HISTORY_MAX_LINES);
@@ -0,0 +1,238 @@
+/**
+ * snapshot.c
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains snapshots, which branch the running simulation off into a
+ * child process with the host's fork, to explore what would happen if its state
+ * were changed.
+ *
+ * The harts' threads only exist while the machine runs, so the shell is the
+ * only thread when a snapshot is taken, and the child can run the machine
+ * itself. The child never returns to the shell; it exits once it has written
+ * its result to the pipe.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+// Standard Includes
+#include <stdlib.h>                 // Exit codes
+#include <stdio.h>                  // Printf and related functions
+#include <stdint.h>                 // Fixed-size integral types
+#include <stdbool.h>                // Definition of the boolean type
+
+// Standard Includes
+#include <errno.h>                  // Error codes
+#include <string.h>                 // String manipulation functions
+#include <unistd.h>                 // Fork, pipe, read, and write functions
+#include <sys/wait.h>               // Waitpid function
+
+// 18-447 Simulator Includes
+#include <sim.h>                    // Definition of cpu_state_t
+#include <memory.h>                 // Definition of mem_segment_t
+#include <register_file.h>          // Interface to the register file
+
+// Local Includes
+#include "memory_shell.h"           // Writing to memory from the shell
+#include "machine.h"                // Running the machine in the child
+#include "stats.h"                  // Detaching the statistics log
+#include "snapshot.h"               // This file's interface
+
+/*----------------------------------------------------------------------------
+ * Helper Functions
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Makes the change to the hart. Memory is written directly, without raising any
+ * exceptions, as with the shell's mem command. Returns false if the address of
+ * a memory change is misaligned, invalid, or a device register.
+ **/
+static bool apply_change(cpu_state_t *cpu_state,
+        const snapshot_change_t *change)
+{
+    uint32_t value = change->value;
+    switch (change->kind)
+    {
+        case SNAPSHOT_FLIP_REG:
+            value ^= register_read(cpu_state, change->target);
+            // Fallthrough
+
+        case SNAPSHOT_SET_REG:
+            register_write(cpu_state, change->target, value);
+            return true;
+
+        case SNAPSHOT_SET_PC:
+            cpu_state->pc = value;
+            return true;
+
+        case SNAPSHOT_SET_MEM:
+        case SNAPSHOT_FLIP_MEM:
+            break;
+    }
+
+    uint32_t old_value;
+    mem_segment_t *segment = mem_find_segment(cpu_state, change->target);
+    if (!mem_peek32(cpu_state, change->target, &old_value)) {
+        return false;
+    } else if (change->kind == SNAPSHOT_FLIP_MEM) {
+        value ^= old_value;
+    }
+
+    mem_write_word(segment, change->target, value);
+    return true;
+}
+
+/**
+ * Writes the whole buffer to the file descriptor. Returns 0 on success, or a
+ * negative error code on failure.
+ **/
+static int write_all(int fd, const void *buffer, size_t size)
+{
+    const uint8_t *bytes = buffer;
+    while (size > 0)
+    {
+        ssize_t written = write(fd, bytes, size);
+        if (written < 0 && errno != EINTR) {
+            return -errno;
+        } else if (written > 0) {
+            bytes += written;
+            size -= written;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Runs the snapshot in the child process, and reports its result over the
+ * pipe. Never returns.
+ **/
+static void run_child(machine_t *machine, const snapshot_change_t *changes,
+        int num_changes, uint64_t max_cycles, int fd)
+{
+    // The log belongs to the parent, which keeps writing to it
+    stats_log_detach();
+
+    cpu_state_t *cpu_state = machine_current(machine);
+    snapshot_result_t result = { .applied = true };
+    for (int i = 0; i < num_changes && result.applied; i++)
+    {
+        result.applied = apply_change(cpu_state, &changes[i]);
+    }
+
+    if (result.applied && !machine_halted(machine) && max_cycles > 0) {
+        machine_run(machine, max_cycles);
+    }
+
+    result.halted = machine_halted(machine);
+    for (int i = 0; i < machine->num_harts; i++)
+    {
+        result.breakpoint |= machine->harts[i].debug.breakpoint_hit;
+    }
+    result.cycle = cpu_state->cycle;
+    result.pc = cpu_state->pc;
+    memcpy(result.registers, cpu_state->registers, sizeof(result.registers));
+
+    // The program's output must be written before the result is seen
+    fflush(stdout);
+    fflush(stderr);
+    int rc = write_all(fd, &result, sizeof(result));
+    _exit((rc < 0) ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Takes a snapshot of the machine in a child process, which makes the changes
+ * to the current hart, and runs every hart for up to the given number of
+ * cycles, or until they halt or hit a breakpoint. Returns 0 on success, or a
+ * negative error code on failure.
+ **/
+int snapshot_fork(machine_t *machine, const snapshot_change_t *changes,
+        int num_changes, uint64_t max_cycles, snapshot_t *snapshot)
+{
+    int fds[2];
+    if (pipe(fds) < 0) {
+        int rc = -errno;
+        fprintf(stderr, "Error: Unable to create a pipe for the snapshot: "
+                "%s.\n", strerror(errno));
+        return rc;
+    }
+
+    // Anything buffered would otherwise be written by both processes
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0) {
+        int rc = -errno;
+        fprintf(stderr, "Error: Unable to fork the snapshot: %s.\n",
+                strerror(errno));
+        close(fds[0]);
+        close(fds[1]);
+        return rc;
+    } else if (pid == 0) {
+        close(fds[0]);
+        run_child(machine, changes, num_changes, max_cycles, fds[1]);
+    }
+
+    close(fds[1]);
+    const cpu_state_t *cpu_state = machine_current(machine);
+    snapshot->pid = pid;
+    snapshot->fd = fds[0];
+    snapshot->cycle = cpu_state->cycle;
+    snapshot->pc = cpu_state->pc;
+    memcpy(snapshot->registers, cpu_state->registers,
+            sizeof(snapshot->registers));
+    return 0;
+}
+
+/**
+ * Waits for the snapshot's child to finish, and gets its result. The snapshot
+ * can't be used afterwards. Returns 0 on success, or a negative error code if
+ * the child didn't report a result.
+ **/
+int snapshot_wait(snapshot_t *snapshot, snapshot_result_t *result)
+{
+    // Read the result, which is only complete if the child finished normally
+    size_t size = 0;
+    uint8_t *bytes = (uint8_t *)result;
+    while (size < sizeof(*result))
+    {
+        ssize_t bytes_read = read(snapshot->fd, &bytes[size],
+                sizeof(*result) - size);
+        if (bytes_read < 0 && errno == EINTR) {
+            continue;
+        } else if (bytes_read <= 0) {
+            break;
+        }
+        size += bytes_read;
+    }
+    close(snapshot->fd);
+
+    int status = 0;
+    while (waitpid(snapshot->pid, &status, 0) < 0 && errno == EINTR)
+    {
+        continue;
+    }
+    if (size != sizeof(*result)) {
+        if (WIFSIGNALED(status)) {
+            fprintf(stderr, "Error: Snapshot %d was killed by signal %d.\n",
+                    (int)snapshot->pid, WTERMSIG(status));
+        } else {
+            fprintf(stderr, "Error: Snapshot %d exited without a result.\n",
+                    (int)snapshot->pid);
+        }
+        return -ECHILD;
+    }
+    return 0;
+}
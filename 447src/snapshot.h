@@ -0,0 +1,103 @@
+/**
+ * snapshot.h
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the interface to snapshots, which branch the running
+ * simulation off into a child process to explore what would happen if its
+ * state were changed, such as by an injected fault or a different input.
+ *
+ * A snapshot is taken with the host's fork, so the child starts with the whole
+ * simulation copied on write, and nothing is copied up front. The child applies
+ * the changes to the current hart, runs the machine, and reports the result
+ * back over a pipe, then exits. The parent is unaffected, and can wait for the
+ * result, or keep running and collect it later.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+// Standard Includes
+#include <stdbool.h>            // Boolean type and definitions
+#include <stdint.h>             // Fixed-size integral types
+#include <sys/types.h>          // Definition of pid_t
+
+// 18-447 Simulator Includes
+#include <sim.h>                // Definition of cpu_state_t
+#include <riscv_isa.h>          // Number of RISC-V registers
+
+// Local Includes
+#include "machine.h"            // Definition of machine_t
+
+/*----------------------------------------------------------------------------
+ * Definitions
+ *----------------------------------------------------------------------------*/
+
+// The kinds of changes that can be made to a snapshot before it runs
+typedef enum snapshot_change_kind {
+    SNAPSHOT_SET_REG,           // Set a register to the value
+    SNAPSHOT_FLIP_REG,          // Flip the bits of a register set in the value
+    SNAPSHOT_SET_PC,            // Set the PC to the value
+    SNAPSHOT_SET_MEM,           // Set a word of memory to the value
+    SNAPSHOT_FLIP_MEM,          // Flip the bits of a word set in the value
+} snapshot_change_kind_t;
+
+// A change made to the current hart of a snapshot before it runs
+typedef struct snapshot_change {
+    snapshot_change_kind_t kind;    // Kind of change
+    uint32_t target;                // Register number or memory address
+    uint32_t value;                 // Value or mask of bits to flip
+} snapshot_change_t;
+
+// A snapshot running in a child process
+typedef struct snapshot {
+    pid_t pid;                  // Process ID of the child
+    int fd;                     // Read end of the pipe the child reports over
+    uint64_t cycle;             // Cycle of the current hart when it was taken
+    uint32_t pc;                // PC of the current hart when it was taken
+    uint32_t registers[RISCV_NUM_REGS]; // Registers of the current hart when
+                                        // it was taken
+} snapshot_t;
+
+// The state of a snapshot's current hart once it has run
+typedef struct snapshot_result {
+    bool applied;               // Indicates if all changes could be made
+    bool halted;                // Indicates if every hart halted
+    bool breakpoint;            // Indicates if a breakpoint was hit
+    uint64_t cycle;             // Cycle of the current hart
+    uint32_t pc;                // PC of the current hart
+    uint32_t registers[RISCV_NUM_REGS]; // Registers of the current hart
+} snapshot_result_t;
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Takes a snapshot of the machine in a child process, which makes the changes
+ * to the current hart, and runs every hart for up to the given number of
+ * cycles, or until they halt or hit a breakpoint. Returns 0 on success, or a
+ * negative error code on failure.
+ **/
+int snapshot_fork(machine_t *machine, const snapshot_change_t *changes,
+        int num_changes, uint64_t max_cycles, snapshot_t *snapshot);
+
+/**
+ * Waits for the snapshot's child to finish, and gets its result. The snapshot
+ * can't be used afterwards. Returns 0 on success, or a negative error code if
+ * the child didn't report a result.
+ **/
+int snapshot_wait(snapshot_t *snapshot, snapshot_result_t *result);
+
+#endif /* SNAPSHOT_H_ */
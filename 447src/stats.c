@@ -0,0 +1,636 @@
+/**
+ * stats.c
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the statistics registry, which exports the simulator's
+ * counters as JSON or CSV.
+ *
+ * The registry is a fixed table of counters, each with a function that reads
+ * its value from wherever it is kept. The memory access and halt counts are
+ * kept by this file, per hart, so that the harts never contend for them, and
+ * are totalled across the harts when they are read.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+// Standard Includes
+#include <stdlib.h>                 // Calloc and free functions
+#include <stdio.h>                  // Printf and related functions
+#include <stdbool.h>                // Definition of the boolean type
+#include <stdint.h>                 // Fixed-size integral types
+#include <inttypes.h>               // Format specifiers for fixed-size types
+
+// Standard Includes
+#include <errno.h>                  // Error codes
+#include <string.h>                 // String comparison and copy functions
+#include <ctype.h>                  // Character classification functions
+
+// 18-447 Simulator Includes
+#include <sim.h>                    // Definition of cpu_state_t
+#include <riscv_isa.h>              // Opcodes and their names
+
+// Local Includes
+#include "libc_extensions.h"        // Snprintf and min functions
+#include "memory_shell.h"           // Halting instruction and memory hooks
+#include "memory_map.h"             // Maximum number of segments
+#include "machine.h"                // Definition of the machine
+#include "stats.h"                  // This file's interface
+
+/*----------------------------------------------------------------------------
+ * Internal Definitions
+ *----------------------------------------------------------------------------*/
+
+// The reasons that a hart halts
+typedef enum stats_halt_reason {
+    STATS_HALT_ECALL,               // An ECALL with the halt argument
+    STATS_HALT_EBREAK,              // An EBREAK without a trap handler
+    STATS_HALT_FAULT,               // Any other exception without a handler
+    STATS_NUM_HALT_REASONS,
+} stats_halt_reason_t;
+
+// The names of the halt reasons, used in their counters' names
+static const char *const HALT_REASON_NAMES[STATS_NUM_HALT_REASONS] = {
+    [STATS_HALT_ECALL] = "ecall",
+    [STATS_HALT_EBREAK] = "ebreak",
+    [STATS_HALT_FAULT] = "fault",
+};
+
+// The ECALL and EBREAK instructions, which have no operands
+#define STATS_ECALL_INSTR           0x00000073U
+#define STATS_EBREAK_INSTR          0x00100073U
+
+// The memory access and halt counts for a single hart
+typedef struct stats_hart {
+    uint64_t loads[MEM_MAP_MAX_REGIONS];    // Loads from each segment
+    uint64_t stores[MEM_MAP_MAX_REGIONS];   // Stores and atomics to each
+    uint64_t halts[STATS_NUM_HALT_REASONS]; // Halts for each reason
+} stats_hart_t;
+
+// A registered counter
+typedef struct stats_counter {
+    char name[STATS_MAX_NAME_LEN];  // Name of the counter
+    stats_read_t read;              // Function that reads its value
+    const void *arg;                // Argument passed to the function
+} stats_counter_t;
+
+// The log that records are written to as the machine runs
+typedef struct stats_log {
+    FILE *file;                     // Log file, or NULL if there is no log
+    stats_format_t format;          // Format of the records
+    uint64_t interval;              // Cycles between records, or 0
+    uint64_t next_cycle;            // Cycle the next periodic record is due
+    uint64_t last_cycle;            // Cycle of the boot hart at the last poll
+    bool halted;                    // The machine was halted at the last poll
+} stats_log_t;
+
+// Indicates if the memory accesses and halts are being counted
+bool STATS_ACTIVE                       = false;
+
+// The registered counters
+static stats_counter_t COUNTERS[STATS_MAX_COUNTERS];
+static int NUM_COUNTERS                 = 0;
+
+// The host time spent running the machine, in nanoseconds
+static uint64_t HOST_TIME_NS            = 0;
+
+// The log of records, if one is open
+static stats_log_t LOG                  = { .file = NULL };
+
+/*----------------------------------------------------------------------------
+ * Built-in Counters
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Reads the number of instructions run by all of the harts, which is their
+ * number of cycles.
+ **/
+static uint64_t read_instructions(const machine_t *machine, const void *arg)
+{
+    (void)arg;
+    uint64_t total = 0;
+    for (int i = 0; i < machine->num_harts; i++)
+    {
+        total += machine->harts[i].cycle;
+    }
+    return total;
+}
+
+/**
+ * Reads the host time spent running the machine.
+ **/
+static uint64_t read_host_time(const machine_t *machine, const void *arg)
+{
+    (void)machine;
+    (void)arg;
+    return HOST_TIME_NS;
+}
+
+/**
+ * Reads the number of instructions profiled with the opcode given by the
+ * argument, across all of the harts.
+ **/
+static uint64_t read_opcode(const machine_t *machine, const void *arg)
+{
+    uintptr_t opcode = (uintptr_t)arg;
+    uint64_t total = 0;
+    for (int i = 0; i < machine->num_harts; i++)
+    {
+        total += machine->harts[i].debug.opcode_counts[opcode];
+    }
+    return total;
+}
+
+/**
+ * Reads the number of loads from the segment given by the argument, across
+ * all of the harts.
+ **/
+static uint64_t read_loads(const machine_t *machine, const void *arg)
+{
+    uintptr_t segment = (uintptr_t)arg;
+    uint64_t total = 0;
+    for (int i = 0; i < machine->num_harts; i++)
+    {
+        const stats_hart_t *stats = machine->harts[i].debug.stats;
+        total += (stats == NULL) ? 0 : stats->loads[segment];
+    }
+    return total;
+}
+
+/**
+ * Reads the number of stores to the segment given by the argument, across all
+ * of the harts.
+ **/
+static uint64_t read_stores(const machine_t *machine, const void *arg)
+{
+    uintptr_t segment = (uintptr_t)arg;
+    uint64_t total = 0;
+    for (int i = 0; i < machine->num_harts; i++)
+    {
+        const stats_hart_t *stats = machine->harts[i].debug.stats;
+        total += (stats == NULL) ? 0 : stats->stores[segment];
+    }
+    return total;
+}
+
+/**
+ * Reads the number of halts for the reason given by the argument, across all
+ * of the harts.
+ **/
+static uint64_t read_halts(const machine_t *machine, const void *arg)
+{
+    uintptr_t reason = (uintptr_t)arg;
+    uint64_t total = 0;
+    for (int i = 0; i < machine->num_harts; i++)
+    {
+        const stats_hart_t *stats = machine->harts[i].debug.stats;
+        total += (stats == NULL) ? 0 : stats->halts[reason];
+    }
+    return total;
+}
+
+/**
+ * Reads the number of misaligned accesses that were emulated.
+ **/
+static uint64_t read_split_accesses(const machine_t *machine, const void *arg)
+{
+    (void)machine;
+    (void)arg;
+    return __atomic_load_n(&MEM_SPLIT_ACCESSES, __ATOMIC_RELAXED);
+}
+
+/**
+ * Formats the name of a segment's counter into the buffer, with the segment's
+ * name in lowercase, and anything other than letters and digits replaced with
+ * underscores, so that it can be used as a key. The segment's name is truncated
+ * so that the name fits in the buffer.
+ **/
+static void format_segment_name(char *buffer, size_t size,
+        const char *segment_name, const char *counter)
+{
+    char key[STATS_MAX_NAME_LEN];
+    size_t len = 0;
+    for (; segment_name[len] != '\0' && len < sizeof(key) - 1; len++)
+    {
+        unsigned char c = segment_name[len];
+        key[len] = isalnum(c) ? tolower(c) : '_';
+    }
+    key[len] = '\0';
+
+    // Leave room for the prefix, the separators, the counter, and the NUL
+    size_t overhead = strlen("memory..") + strlen(counter) + 1;
+    int key_len = (size > overhead) ? (int)min(len, size - overhead) : 0;
+    Snprintf(buffer, size, "memory.%.*s.%s", key_len, key, counter);
+    return;
+}
+
+/*----------------------------------------------------------------------------
+ * Output Helpers
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Writes the string to the file as a JSON string, escaping it as needed.
+ **/
+static void write_json_string(const char *string, FILE *file)
+{
+    fputc('"', file);
+    for (const char *c = string; *c != '\0'; c++)
+    {
+        if (*c == '"' || *c == '\\') {
+            fprintf(file, "\\%c", *c);
+        } else if ((unsigned char)*c < 0x20) {
+            fprintf(file, "\\u%04x", (unsigned char)*c);
+        } else {
+            fputc(*c, file);
+        }
+    }
+    fputc('"', file);
+    return;
+}
+
+/**
+ * Writes the string to the file as a CSV field, quoting it, and doubling any
+ * quotes inside of it.
+ **/
+static void write_csv_string(const char *string, FILE *file)
+{
+    fputc('"', file);
+    for (const char *c = string; *c != '\0'; c++)
+    {
+        if (*c == '"') {
+            fputc('"', file);
+        }
+        fputc(*c, file);
+    }
+    fputc('"', file);
+    return;
+}
+
+/**
+ * Writes the header row of the CSV format, which names the columns.
+ **/
+static void write_csv_header(FILE *file)
+{
+    fprintf(file, "program");
+    for (int i = 0; i < NUM_COUNTERS; i++)
+    {
+        fputc(',', file);
+        write_csv_string(COUNTERS[i].name, file);
+    }
+    fprintf(file, "\n");
+    return;
+}
+
+/**
+ * Writes a record of the program's name, and every counter's value, to the
+ * file, as a JSON object on one line, or a CSV row.
+ **/
+static void write_record(const machine_t *machine, stats_format_t format,
+        FILE *file)
+{
+    const char *program = machine->harts[0].program;
+    program = (program == NULL) ? "" : program;
+
+    if (format == STATS_FORMAT_CSV) {
+        write_csv_string(program, file);
+        for (int i = 0; i < NUM_COUNTERS; i++)
+        {
+            const stats_counter_t *counter = &COUNTERS[i];
+            fprintf(file, ",%" PRIu64, counter->read(machine, counter->arg));
+        }
+        fprintf(file, "\n");
+        return;
+    }
+
+    fprintf(file, "{\"program\": ");
+    write_json_string(program, file);
+    for (int i = 0; i < NUM_COUNTERS; i++)
+    {
+        const stats_counter_t *counter = &COUNTERS[i];
+        fprintf(file, ", ");
+        write_json_string(counter->name, file);
+        fprintf(file, ": %" PRIu64, counter->read(machine, counter->arg));
+    }
+    fprintf(file, "}\n");
+    return;
+}
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Registers a counter with the given name, which is read by the function with
+ * the argument when the statistics are written. The name is copied. Counters
+ * should be registered before a log is opened, since its CSV header is only
+ * written once. Returns 0 on success, or a negative error code on failure.
+ **/
+int stats_register(const char *name, stats_read_t read, const void *arg)
+{
+    if (NUM_COUNTERS >= STATS_MAX_COUNTERS) {
+        fprintf(stderr, "Error: Unable to register the counter '%s', since "
+                "the maximum of %d counters are registered.\n", name,
+                STATS_MAX_COUNTERS);
+        return -ENOSPC;
+    } else if (strlen(name) >= STATS_MAX_NAME_LEN) {
+        fprintf(stderr, "Error: The counter name '%s' is too long.\n", name);
+        return -ENAMETOOLONG;
+    }
+
+    for (int i = 0; i < NUM_COUNTERS; i++)
+    {
+        if (strcmp(COUNTERS[i].name, name) == 0) {
+            fprintf(stderr, "Error: The counter '%s' is already registered.\n",
+                    name);
+            return -EEXIST;
+        }
+    }
+
+    stats_counter_t *counter = &COUNTERS[NUM_COUNTERS];
+    strcpy(counter->name, name);
+    counter->read = read;
+    counter->arg = arg;
+    NUM_COUNTERS += 1;
+    return 0;
+}
+
+/**
+ * Registers the simulator's own counters: the instructions run and the host
+ * time, the instructions with each opcode, the loads and stores to each memory
+ * segment, and the halts by their reason. The machine's segments must already
+ * be created.
+ **/
+void stats_register_builtin(const machine_t *machine)
+{
+    stats_register("instructions", read_instructions, NULL);
+    stats_register("host_time_ns", read_host_time, NULL);
+
+    // The instructions run with each opcode, from the profile
+#define REGISTER_OPCODE(opcode, name) \
+    stats_register("opcode." name, read_opcode, \
+            (const void *)(uintptr_t)opcode);
+    RISCV_OPCODE_LIST(REGISTER_OPCODE)
+#undef REGISTER_OPCODE
+
+    // The loads and stores to each of the memory segments
+    const memory_t *memory = &machine->harts[0].memory;
+    for (int i = 0; i < memory->num_segments; i++)
+    {
+        char name[STATS_MAX_NAME_LEN];
+        const void *arg = (const void *)(uintptr_t)i;
+        format_segment_name(name, sizeof(name), memory->segments[i].name,
+                "loads");
+        stats_register(name, read_loads, arg);
+        format_segment_name(name, sizeof(name), memory->segments[i].name,
+                "stores");
+        stats_register(name, read_stores, arg);
+    }
+    stats_register("memory.split_accesses", read_split_accesses, NULL);
+
+    // The halts for each reason
+    for (int i = 0; i < STATS_NUM_HALT_REASONS; i++)
+    {
+        char name[STATS_MAX_NAME_LEN];
+        Snprintf(name, sizeof(name), "halts.%s", HALT_REASON_NAMES[i]);
+        stats_register(name, read_halts, (const void *)(uintptr_t)i);
+    }
+    return;
+}
+
+/**
+ * Starts counting the memory accesses and halts on every hart. The counts
+ * collected so far are kept. Profiling is also started, since it provides the
+ * opcode counts. Returns 0 on success, or a negative error code on failure.
+ **/
+int stats_start(machine_t *machine)
+{
+    for (int i = 0; i < machine->num_harts; i++)
+    {
+        cpu_state_t *hart = &machine->harts[i];
+        hart->debug.profile_mode = true;
+        if (hart->debug.stats != NULL) {
+            continue;
+        }
+
+        hart->debug.stats = calloc(1, sizeof(stats_hart_t));
+        if (hart->debug.stats == NULL) {
+            fprintf(stderr, "Error: Unable to allocate the statistics.\n");
+            stats_free(machine);
+            return -ENOMEM;
+        }
+    }
+
+    STATS_ACTIVE = true;
+    mem_hooks_update();
+    return 0;
+}
+
+/**
+ * Stops counting the memory accesses and halts, keeping the counts. Profiling
+ * is also stopped.
+ **/
+void stats_stop(machine_t *machine)
+{
+    STATS_ACTIVE = false;
+    mem_hooks_update();
+    for (int i = 0; i < machine->num_harts; i++)
+    {
+        machine->harts[i].debug.profile_mode = false;
+    }
+    return;
+}
+
+/**
+ * Discards the memory access and halt counts of all the harts, and stops
+ * counting them.
+ **/
+void stats_free(machine_t *machine)
+{
+    stats_stop(machine);
+    for (int i = 0; i < machine->num_harts; i++)
+    {
+        cpu_state_t *hart = &machine->harts[i];
+        free(hart->debug.stats);
+        hart->debug.stats = NULL;
+    }
+    return;
+}
+
+/**
+ * Counts a load or store by the hart to the given segment. This is invoked by
+ * the memory accesses while the statistics are active.
+ **/
+void stats_memory_access(cpu_state_t *cpu_state, const mem_segment_t *segment,
+        bool is_store)
+{
+    stats_hart_t *stats = cpu_state->debug.stats;
+    int index = segment - cpu_state->memory.segments;
+    if (stats == NULL || index < 0 || index >= MEM_MAP_MAX_REGIONS) {
+        return;
+    }
+
+    if (is_store) {
+        stats->stores[index] += 1;
+    } else {
+        stats->loads[index] += 1;
+    }
+    return;
+}
+
+/**
+ * Counts the halt of the hart by its reason. This is invoked by the engine
+ * when a hart halts.
+ **/
+void stats_halt(const cpu_state_t *cpu_state)
+{
+    stats_hart_t *stats = cpu_state->debug.stats;
+    if (!STATS_ACTIVE || stats == NULL) {
+        return;
+    }
+
+    // The instruction that halted the hart hasn't moved the PC past it
+    uint32_t instr = 0;
+    mem_peek32(cpu_state, cpu_state->pc, &instr);
+    if (instr == STATS_ECALL_INSTR) {
+        stats->halts[STATS_HALT_ECALL] += 1;
+    } else if (instr == STATS_EBREAK_INSTR) {
+        stats->halts[STATS_HALT_EBREAK] += 1;
+    } else {
+        stats->halts[STATS_HALT_FAULT] += 1;
+    }
+    return;
+}
+
+/**
+ * Adds the host time spent running the machine, in nanoseconds.
+ **/
+void stats_add_host_time(uint64_t host_ns)
+{
+    HOST_TIME_NS += host_ns;
+    return;
+}
+
+/**
+ * Writes the value of every counter to the file in the given format.
+ **/
+void stats_write(const machine_t *machine, stats_format_t format, FILE *file)
+{
+    if (format == STATS_FORMAT_CSV) {
+        write_csv_header(file);
+    }
+    write_record(machine, format, file);
+    return;
+}
+
+/**
+ * Opens a log at the given path, which gets a record in the given format each
+ * time the machine halts, and every interval cycles if the interval is not 0.
+ * Any previous log is closed. Returns 0 on success, or a negative error code
+ * on failure.
+ **/
+int stats_log_open(const machine_t *machine, const char *path,
+        stats_format_t format, uint64_t interval)
+{
+    stats_log_close();
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        int rc = -errno;
+        fprintf(stderr, "Error: %s: Unable to open the statistics log: %s.\n",
+                path, strerror(errno));
+        return rc;
+    }
+
+    uint64_t cycle = machine->harts[0].cycle;
+    LOG = (stats_log_t){
+        .file = file,
+        .format = format,
+        .interval = interval,
+        .next_cycle = (interval == 0) ? 0 : (cycle / interval + 1) * interval,
+        .last_cycle = cycle,
+        .halted = machine_halted(machine),
+    };
+    if (format == STATS_FORMAT_CSV) {
+        write_csv_header(file);
+        fflush(file);
+    }
+    return 0;
+}
+
+/**
+ * Closes the log, if one is open.
+ **/
+void stats_log_close(void)
+{
+    if (LOG.file != NULL) {
+        fclose(LOG.file);
+        LOG.file = NULL;
+    }
+    return;
+}
+
+/**
+ * Drops the log without writing to it or closing it. This is invoked by a child
+ * process that was forked while the log was open, so that the child's runs are
+ * not recorded in the parent's log.
+ **/
+void stats_log_detach(void)
+{
+    LOG.file = NULL;
+    return;
+}
+
+/**
+ * Writes the records that are due to the log after the machine has run: one
+ * if it has just halted, and one if an interval has passed. This is invoked
+ * before and after each run of the machine.
+ **/
+void stats_log_poll(const machine_t *machine)
+{
+    if (LOG.file == NULL) {
+        return;
+    }
+
+    // If the program was restarted, the periodic records start over
+    uint64_t cycle = machine->harts[0].cycle;
+    if (LOG.interval != 0 && cycle < LOG.last_cycle) {
+        LOG.next_cycle = (cycle / LOG.interval + 1) * LOG.interval;
+    }
+    LOG.last_cycle = cycle;
+
+    bool halted = machine_halted(machine);
+    bool due = (LOG.interval != 0 && cycle >= LOG.next_cycle);
+    if ((halted && !LOG.halted) || due) {
+        write_record(machine, LOG.format, LOG.file);
+        fflush(LOG.file);
+    }
+    if (due) {
+        LOG.next_cycle = (cycle / LOG.interval + 1) * LOG.interval;
+    }
+    LOG.halted = halted;
+    return;
+}
+
+/**
+ * Parses the name of a format, which is 'json' or 'csv'. Returns 0 on
+ * success, or a negative error code if the name is not a format.
+ **/
+int stats_parse_format(const char *string, stats_format_t *format)
+{
+    if (strcmp(string, "json") == 0) {
+        *format = STATS_FORMAT_JSON;
+    } else if (strcmp(string, "csv") == 0) {
+        *format = STATS_FORMAT_CSV;
+    } else {
+        return -EINVAL;
+    }
+    return 0;
+}
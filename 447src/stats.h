@@ -0,0 +1,164 @@
+/**
+ * stats.h
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the interface to the statistics registry, which exports
+ * the simulator's counters in a form that other programs can read.
+ *
+ * A counter is a named 64-bit value, which is read through a function when the
+ * statistics are written, so the parts of the simulator that keep it don't need
+ * to change how they count. The counters are written as a JSON object, or as
+ * a CSV header and row, either on demand, or to a log that gets a record each
+ * time the machine halts, and optionally every given number of cycles.
+ *
+ * The memory access and halt counters are only collected while the statistics
+ * are on, since they are counted on every load and store.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+#ifndef STATS_H_
+#define STATS_H_
+
+// Standard Includes
+#include <stdbool.h>            // Boolean type and definitions
+#include <stdint.h>             // Fixed-size integral types
+#include <stdio.h>              // Definition of the FILE type
+
+// 18-447 Simulator Includes
+#include <sim.h>                // Definition of cpu_state_t
+#include <memory.h>             // Definition of mem_segment_t
+
+// Local Includes
+#include "machine.h"            // Definition of the machine
+
+/*----------------------------------------------------------------------------
+ * Definitions
+ *----------------------------------------------------------------------------*/
+
+// The maximum number of counters that can be registered
+#define STATS_MAX_COUNTERS      256
+
+// The maximum length of a counter's name, including the terminator
+#define STATS_MAX_NAME_LEN      64
+
+// The formats the statistics can be written in
+typedef enum stats_format {
+    STATS_FORMAT_JSON,          // A JSON object, one per line in a log
+    STATS_FORMAT_CSV,           // A header row of names, then rows of values
+} stats_format_t;
+
+/* The function that reads a counter, given the argument it was registered
+ * with. Counters kept per hart are totalled across the machine's harts. */
+typedef uint64_t (*stats_read_t)(const machine_t *machine, const void *arg);
+
+// Indicates if the memory accesses and halts are being counted
+extern bool STATS_ACTIVE;
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Registers a counter with the given name, which is read by the function with
+ * the argument when the statistics are written. The name is copied. Counters
+ * should be registered before a log is opened, since its CSV header is only
+ * written once. Returns 0 on success, or a negative error code on failure.
+ **/
+int stats_register(const char *name, stats_read_t read, const void *arg);
+
+/**
+ * Registers the simulator's own counters: the instructions run and the host
+ * time, the instructions with each opcode, the loads and stores to each memory
+ * segment, and the halts by their reason. The machine's segments must already
+ * be created.
+ **/
+void stats_register_builtin(const machine_t *machine);
+
+/**
+ * Starts counting the memory accesses and halts on every hart. The counts
+ * collected so far are kept. Profiling is also started, since it provides the
+ * opcode counts. Returns 0 on success, or a negative error code on failure.
+ **/
+int stats_start(machine_t *machine);
+
+/**
+ * Stops counting the memory accesses and halts, keeping the counts. Profiling
+ * is also stopped.
+ **/
+void stats_stop(machine_t *machine);
+
+/**
+ * Discards the memory access and halt counts of all the harts, and stops
+ * counting them.
+ **/
+void stats_free(machine_t *machine);
+
+/**
+ * Counts a load or store by the hart to the given segment. This is invoked by
+ * the memory accesses while the statistics are active.
+ **/
+void stats_memory_access(cpu_state_t *cpu_state, const mem_segment_t *segment,
+        bool is_store);
+
+/**
+ * Counts the halt of the hart by its reason. This is invoked by the engine
+ * when a hart halts.
+ **/
+void stats_halt(const cpu_state_t *cpu_state);
+
+/**
+ * Adds the host time spent running the machine, in nanoseconds.
+ **/
+void stats_add_host_time(uint64_t host_ns);
+
+/**
+ * Writes the value of every counter to the file in the given format.
+ **/
+void stats_write(const machine_t *machine, stats_format_t format, FILE *file);
+
+/**
+ * Opens a log at the given path, which gets a record in the given format each
+ * time the machine halts, and every interval cycles if the interval is not 0.
+ * Any previous log is closed. Returns 0 on success, or a negative error code
+ * on failure.
+ **/
+int stats_log_open(const machine_t *machine, const char *path,
+        stats_format_t format, uint64_t interval);
+
+/**
+ * Closes the log, if one is open.
+ **/
+void stats_log_close(void);
+
+/**
+ * Drops the log without writing to it or closing it. This is invoked by a child
+ * process that was forked while the log was open, so that the child's runs are
+ * not recorded in the parent's log.
+ **/
+void stats_log_detach(void);
+
+/**
+ * Writes the records that are due to the log after the machine has run: one
+ * if it has just halted, and one if an interval has passed. This is invoked
+ * before and after each run of the machine.
+ **/
+void stats_log_poll(const machine_t *machine);
+
+/**
+ * Parses the name of a format, which is 'json' or 'csv'. Returns 0 on
+ * success, or a negative error code if the name is not a format.
+ **/
+int stats_parse_format(const char *string, stats_format_t *format);
+
+#endif /* STATS_H_ */
@@ -0,0 +1,363 @@
+/**
+ * trap.c
+ *
+ * RISC-V 32-bit Instruction Level Simulator
+ *
+ * ECE 18-447
+ * Carnegie Mellon University
+ *
+ * This file contains the implementation of machine-mode traps, the control and
+ * status registers (CSRs), and the machine timer.
+ *
+ * The machine timer counts processor cycles. Rather than comparing the timer
+ * against mtimecmp every cycle, writing mtimecmp posts a scheduler event for
+ * the cycle at which the timer interrupt becomes pending.
+ *
+ * Authors:
+ *  - 2016 - 2017: Brandon Perez
+ **/
+
+/*----------------------------------------------------------------------------*
+ *                          DO NOT MODIFY THIS FILE!                          *
+ *          You should only add or change files in the src directory!         *
+ *----------------------------------------------------------------------------*/
+
+// Standard Includes
+#include <stdint.h>                 // Fixed-size integral types
+#include <stdbool.h>                // Definition of the boolean type
+#include <stddef.h>                 // Definition of NULL
+
+// Standard Includes
+#include <errno.h>                  // Error codes
+
+// 18-447 Simulator Includes
+#include <sim.h>                    // Definition of cpu_state_t
+#include <riscv_isa.h>              // Definition of CSRs and trap causes
+#include <scheduler.h>              // Interface to the event scheduler
+#include <trap.h>                   // This file's interface
+
+// Local Includes
+#include "memory_map.h"             // Kernel text segment address
+#include "memory_shell.h"           // Memory segment lookup
+
+/*----------------------------------------------------------------------------
+ * Internal Definitions
+ *----------------------------------------------------------------------------*/
+
+// The value of the misa CSR: a 32-bit machine with the I and A extensions
+static const uint32_t MISA_VALUE        = (1U << 30) | (1U << ('I' - 'A')) |
+        (1U << ('A' - 'A'));
+
+// The bits of mstatus and mie that are writable
+static const uint32_t MSTATUS_WRITABLE  = MSTATUS_MIE | MSTATUS_MPIE;
+static const uint32_t MIE_WRITABLE      = MIP_MTIP;
+
+/*----------------------------------------------------------------------------
+ * Internal Helper Functions
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Enters a trap with the given cause, saving the return address and disabling
+ * interrupts. The PC is not updated.
+ **/
+static void enter_trap(cpu_state_t *cpu_state, uint32_t cause, uint32_t epc,
+        uint32_t tval)
+{
+    csr_file_t *csr = &cpu_state->csr;
+    csr->mepc = epc;
+    csr->mcause = cause;
+    csr->mtval = tval;
+
+    // A trap breaks any reservation held by a load-reserved instruction
+    cpu_state->memory.reservation.valid = false;
+
+    // Save the interrupt enable bit, then disable interrupts
+    uint32_t mpie = (csr->mstatus & MSTATUS_MIE) ? MSTATUS_MPIE : 0;
+    csr->mstatus = (csr->mstatus & ~(MSTATUS_MIE | MSTATUS_MPIE)) | mpie |
+            MSTATUS_MPP;
+    return;
+}
+
+/**
+ * Updates the machine timer interrupt pending bit for the current cycle, and
+ * schedules the timer event if the timer has not gone off yet.
+ **/
+static void update_timer(cpu_state_t *cpu_state)
+{
+    csr_file_t *csr = &cpu_state->csr;
+    scheduler_t *scheduler = &cpu_state->scheduler;
+
+    if (csr->mtimecmp <= cpu_state->cycle) {
+        csr->mip |= MIP_MTIP;
+        sched_cancel(scheduler, &csr->timer_event);
+        sched_end_batch(scheduler);
+    } else {
+        csr->mip &= ~MIP_MTIP;
+        sched_post(scheduler, &csr->timer_event, csr->mtimecmp);
+    }
+    return;
+}
+
+/**
+ * The scheduler callback for when the machine timer reaches mtimecmp. This
+ * runs between instructions, so the interrupt can be taken immediately.
+ **/
+static void timer_fired(sched_event_t *event, uint64_t now)
+{
+    (void)now;
+
+    cpu_state_t *cpu_state = event->arg;
+    cpu_state->csr.mip |= MIP_MTIP;
+    trap_check_interrupts(cpu_state);
+    return;
+}
+
+/*----------------------------------------------------------------------------
+ * Interface
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Resets the CSRs and the machine timer for a newly loaded program.
+ *
+ * The trap vector points at the start of the Kernel Text segment if the
+ * program has kernel text, and is 0 (no handler) otherwise.
+ **/
+void trap_reset(cpu_state_t *cpu_state)
+{
+    csr_file_t *csr = &cpu_state->csr;
+
+    csr->mstatus = MSTATUS_MPP;
+    csr->mie = 0;
+    csr->mip = 0;
+    csr->mscratch = 0;
+    csr->mepc = 0;
+    csr->mcause = 0;
+    csr->mtval = 0;
+    csr->trap_pending = false;
+    uint32_t trap_vector = mem_map_trap_vector();
+    csr->mtvec = (mem_find_segment(cpu_state, trap_vector) != NULL) ?
+            trap_vector : 0;
+
+    // The timer is off until the program sets mtimecmp
+    csr->mtimecmp = UINT64_MAX;
+    sched_event_init(&csr->timer_event, timer_fired, cpu_state);
+    return;
+}
+
+/**
+ * Restores the CSRs from a copy saved earlier, such as by a checkpoint, and
+ * posts the timer event again for the restored mtimecmp. The scheduler must
+ * not have the timer event pending.
+ **/
+void trap_restore(cpu_state_t *cpu_state, const csr_file_t *saved)
+{
+    csr_file_t *csr = &cpu_state->csr;
+    *csr = *saved;
+    csr->trap_pending = false;
+
+    // The saved timer event's links are stale, so it starts out unposted
+    sched_event_init(&csr->timer_event, timer_fired, cpu_state);
+    if (csr->mtimecmp != UINT64_MAX) {
+        update_timer(cpu_state);
+    }
+    return;
+}
+
+/**
+ * Raises an exception with the given cause for the current instruction.
+ *
+ * The trap CSRs are updated immediately, with mepc set to the current PC, and
+ * the PC is redirected to the trap handler once the current instruction has
+ * completed. Only the first exception raised by an instruction is taken.
+ *
+ * Returns true if the trap will be taken. If no trap handler is installed, then
+ * nothing is changed, and false is returned, in which case the caller should
+ * halt the processor.
+ **/
+bool trap_raise(cpu_state_t *cpu_state, riscv_trap_cause_t cause,
+        uint32_t tval)
+{
+    csr_file_t *csr = &cpu_state->csr;
+    if (csr->mtvec == 0) {
+        return false;
+    } else if (csr->trap_pending) {
+        return true;
+    }
+
+    /* The instruction has not updated the PC yet, so it is the address of the
+     * faulting instruction. End the batch so the run loop commits the trap. */
+    enter_trap(cpu_state, cause, cpu_state->pc, tval);
+    csr->trap_pending = true;
+    sched_end_batch(&cpu_state->scheduler);
+    return true;
+}
+
+/**
+ * Completes entry into a trap raised by the last instruction, redirecting the
+ * PC to the trap handler. This is invoked by the run loop after an instruction
+ * raises a trap.
+ **/
+void trap_commit(cpu_state_t *cpu_state)
+{
+    cpu_state->csr.trap_pending = false;
+    cpu_state->pc = cpu_state->csr.mtvec;
+    return;
+}
+
+/**
+ * Returns from a trap handler (the MRET instruction), restoring the interrupt
+ * enable bit and jumping to the address in mepc.
+ **/
+void trap_return(cpu_state_t *cpu_state)
+{
+    csr_file_t *csr = &cpu_state->csr;
+    uint32_t mie = (csr->mstatus & MSTATUS_MPIE) ? MSTATUS_MIE : 0;
+    csr->mstatus = (csr->mstatus & ~MSTATUS_MIE) | mie | MSTATUS_MPIE;
+    cpu_state->pc = csr->mepc;
+
+    // Interrupts may have been re-enabled, so check them at the batch boundary
+    if (mie != 0) {
+        sched_end_batch(&cpu_state->scheduler);
+    }
+    return;
+}
+
+/**
+ * Takes any pending and enabled interrupt, redirecting the PC to the trap
+ * handler. This must only be invoked between instructions. Returns true if an
+ * interrupt was taken.
+ **/
+bool trap_check_interrupts(cpu_state_t *cpu_state)
+{
+    csr_file_t *csr = &cpu_state->csr;
+    uint32_t pending = csr->mip & csr->mie;
+    if (pending == 0 || !(csr->mstatus & MSTATUS_MIE) || csr->mtvec == 0) {
+        return false;
+    }
+
+    /* The timer is the only interrupt source. The interrupted instruction has
+     * not executed yet, so the handler returns to it. */
+    enter_trap(cpu_state, MCAUSE_INTERRUPT | IRQ_MACHINE_TIMER, cpu_state->pc,
+            0);
+    cpu_state->pc = csr->mtvec;
+    return true;
+}
+
+/**
+ * Reads the specified CSR into value.
+ *
+ * Returns 0 on success, or a negative error code if the CSR does not exist, in
+ * which case the instruction accessing it is illegal.
+ **/
+int csr_read(cpu_state_t *cpu_state, uint32_t csr_num, uint32_t *value)
+{
+    const csr_file_t *csr = &cpu_state->csr;
+
+    // Each instruction takes one cycle, so the counters are all the same
+    uint64_t cycle = cpu_state->cycle;
+    switch ((riscv_csr_t)csr_num)
+    {
+        case CSR_MSTATUS:   *value = csr->mstatus; return 0;
+        case CSR_MISA:      *value = MISA_VALUE; return 0;
+        case CSR_MIE:       *value = csr->mie; return 0;
+        case CSR_MTVEC:     *value = csr->mtvec; return 0;
+        case CSR_MSCRATCH:  *value = csr->mscratch; return 0;
+        case CSR_MEPC:      *value = csr->mepc; return 0;
+        case CSR_MCAUSE:    *value = csr->mcause; return 0;
+        case CSR_MTVAL:     *value = csr->mtval; return 0;
+        case CSR_MIP:       *value = csr->mip; return 0;
+        case CSR_MTIMECMP:  *value = (uint32_t)csr->mtimecmp; return 0;
+        case CSR_MTIMECMPH: *value = (uint32_t)(csr->mtimecmp >> 32); return 0;
+        case CSR_MHARTID:   *value = csr->mhartid; return 0;
+
+        case CSR_MCYCLE:
+        case CSR_MINSTRET:
+        case CSR_CYCLE:
+        case CSR_TIME:
+        case CSR_INSTRET:
+            *value = (uint32_t)cycle;
+            return 0;
+
+        case CSR_MCYCLEH:
+        case CSR_MINSTRETH:
+        case CSR_CYCLEH:
+        case CSR_TIMEH:
+        case CSR_INSTRETH:
+            *value = (uint32_t)(cycle >> 32);
+            return 0;
+    }
+
+    return -ENOENT;
+}
+
+/**
+ * Writes the value to the specified CSR.
+ *
+ * Returns 0 on success, or a negative error code if the CSR does not exist or
+ * is read-only, in which case the instruction accessing it is illegal.
+ **/
+int csr_write(cpu_state_t *cpu_state, uint32_t csr_num, uint32_t value)
+{
+    csr_file_t *csr = &cpu_state->csr;
+    scheduler_t *scheduler = &cpu_state->scheduler;
+
+    switch ((riscv_csr_t)csr_num)
+    {
+        // Enabling interrupts requires a check at the next batch boundary
+        case CSR_MSTATUS:
+            csr->mstatus = (csr->mstatus & ~MSTATUS_WRITABLE) |
+                    (value & MSTATUS_WRITABLE);
+            sched_end_batch(scheduler);
+            return 0;
+
+        case CSR_MIE:
+            csr->mie = value & MIE_WRITABLE;
+            sched_end_batch(scheduler);
+            return 0;
+
+        // Only direct mode is supported for the trap vector
+        case CSR_MTVEC:
+            csr->mtvec = value & ~0x3U;
+            return 0;
+
+        case CSR_MSCRATCH:  csr->mscratch = value; return 0;
+        case CSR_MEPC:      csr->mepc = value & ~0x3U; return 0;
+        case CSR_MCAUSE:    csr->mcause = value; return 0;
+        case CSR_MTVAL:     csr->mtval = value; return 0;
+
+        // The timer pending bit is controlled by mtimecmp, not software
+        case CSR_MIP:
+            return 0;
+
+        case CSR_MTIMECMP:
+            csr->mtimecmp = (csr->mtimecmp & ~(uint64_t)UINT32_MAX) | value;
+            update_timer(cpu_state);
+            return 0;
+
+        case CSR_MTIMECMPH:
+            csr->mtimecmp = (csr->mtimecmp & UINT32_MAX) |
+                    ((uint64_t)value << 32);
+            update_timer(cpu_state);
+            return 0;
+
+        // The ISA register is read-only, and ignores writes
+        case CSR_MISA:
+            return 0;
+
+        // The counters are read-only, since they are derived from the cycle
+        case CSR_MCYCLE:
+        case CSR_MINSTRET:
+        case CSR_MCYCLEH:
+        case CSR_MINSTRETH:
+        case CSR_CYCLE:
+        case CSR_TIME:
+        case CSR_INSTRET:
+        case CSR_CYCLEH:
+        case CSR_TIMEH:
+        case CSR_INSTRETH:
+        case CSR_MHARTID:
+            return -EPERM;
+    }
+
+    return -ENOENT;
+}
@@ -35,6 +35,7 @@
 // Standard Includes
 #include <stdio.h>              // Printf and related functions
 #include <stdbool.h>            // Boolean type and definitions
+#include <errno.h>              // Error codes
 
 // 18-447 Simulator Includes
 #include <riscv_isa.h>          // Definition of RISC-V opcodes, ISA registers
@@ -42,6 +43,203 @@
 #include <sim.h>                // Definitions for the simulator
 #include <memory.h>             // Interface to the processor memory
 #include <register_file.h>      // Interface to the register file
+#include <trap.h>               // Interface to traps and CSRs
+
+/**
+ * Simulates a privileged system instruction (ECALL, EBREAK, MRET, or WFI).
+ **/
+static void process_priv(cpu_state_t *cpu_state, uint32_t instr,
+        itype_funct12_t sys_funct12)
+{
+    switch (sys_funct12)
+    {
+        /* 12-bit function code for ECALL. An argument of 0xa in a0 halts the
+         * simulator. Any other call traps to the kernel's handler, if there is
+         * one, and otherwise does nothing. */
+        case FUNCT12_ECALL: {
+            uint32_t a0_value = register_read(cpu_state,
+                    (riscv_isa_reg_t)REG_A0);
+            if (a0_value == ECALL_ARG_HALT) {
+                fprintf(stdout, "ECALL invoked with halt argument, "
+                        "halting the simulator.\n");
+                cpu_state->halted = true;
+            } else if (!trap_raise(cpu_state, CAUSE_ECALL_M, 0)) {
+                cpu_state->pc = cpu_state->pc + sizeof(instr);
+            }
+            break;
+        }
+
+        // 12-bit function code for EBREAK
+        case FUNCT12_EBREAK: {
+            if (!trap_raise(cpu_state, CAUSE_BREAKPOINT, cpu_state->pc)) {
+                fprintf(stderr, "Encountered EBREAK at 0x%08x. Halting "
+                        "simulation.\n", cpu_state->pc);
+                cpu_state->halted = true;
+            }
+            break;
+        }
+
+        // 12-bit function code for MRET, which returns from a trap handler
+        case FUNCT12_MRET: {
+            trap_return(cpu_state);
+            break;
+        }
+
+        /* 12-bit function code for WFI. Interrupts are checked between
+         * batches, so waiting for one is the same as doing nothing. */
+        case FUNCT12_WFI: {
+            cpu_state->pc = cpu_state->pc + sizeof(instr);
+            break;
+        }
+
+        default: {
+            if (!trap_raise(cpu_state, CAUSE_ILLEGAL_INSTRUCTION, instr)) {
+                fprintf(stderr, "Encountered unknown/unimplemented 12-bit "
+                        "system function code 0x%03x. Halting "
+                        "simulation.\n", sys_funct12);
+                cpu_state->halted = true;
+            }
+            break;
+        }
+    }
+
+    return;
+}
+
+/**
+ * Simulates a CSR instruction, which atomically reads the old value of a CSR
+ * into rd, and writes, sets bits, or clears bits in the CSR.
+ *
+ * CSRRS and CSRRC do not write the CSR if their operand is x0 (or an immediate
+ * of 0), so read-only CSRs can be read with them. Accessing a CSR that does not
+ * exist, or writing to a read-only CSR, is an illegal instruction.
+ **/
+static void process_csr(cpu_state_t *cpu_state, uint32_t instr,
+        itype_sys_funct3_t sys_funct3, riscv_isa_reg_t rd,
+        riscv_isa_reg_t rs1, uint32_t csr_num)
+{
+    // The immediate variants use the rs1 field as a 5-bit unsigned immediate
+    bool immediate = (sys_funct3 & 0x4) != 0;
+    uint32_t operand = immediate ? rs1 : register_read(cpu_state, rs1);
+
+    uint32_t old_value;
+    int rc = csr_read(cpu_state, csr_num, &old_value);
+    if (rc >= 0) {
+        switch (sys_funct3)
+        {
+            case FUNCT3_CSRRW:
+            case FUNCT3_CSRRWI:
+                rc = csr_write(cpu_state, csr_num, operand);
+                break;
+
+            case FUNCT3_CSRRS:
+            case FUNCT3_CSRRSI:
+                if (rs1 != 0) {
+                    rc = csr_write(cpu_state, csr_num, old_value | operand);
+                }
+                break;
+
+            case FUNCT3_CSRRC:
+            case FUNCT3_CSRRCI:
+                if (rs1 != 0) {
+                    rc = csr_write(cpu_state, csr_num, old_value & ~operand);
+                }
+                break;
+
+            default:
+                rc = -EINVAL;
+                break;
+        }
+    }
+
+    // An invalid CSR access is an illegal instruction
+    if (rc < 0) {
+        if (!trap_raise(cpu_state, CAUSE_ILLEGAL_INSTRUCTION, instr)) {
+            fprintf(stderr, "Encountered invalid access to CSR 0x%03x. "
+                    "Halting simulation.\n", csr_num);
+            cpu_state->halted = true;
+        }
+        return;
+    }
+
+    register_write(cpu_state, rd, old_value);
+    cpu_state->pc = cpu_state->pc + sizeof(instr);
+    return;
+}
+
+/**
+ * Simulates an atomic memory operation (LR.W, SC.W, or one of the AMO*.W
+ * instructions). The destination register is only written if the memory
+ * access succeeds.
+ **/
+static void process_amo(cpu_state_t *cpu_state, uint32_t instr,
+        riscv_isa_reg_t rd, riscv_isa_reg_t rs1, riscv_isa_reg_t rs2)
+{
+    amo_funct3_t amo_funct3 = (instr >> 12) & 0x7;
+    amo_funct5_t amo_funct5 = (instr >> 27) & 0x1F;
+    uint32_t addr = register_read(cpu_state, rs1);
+    uint32_t value = register_read(cpu_state, rs2);
+
+    // Only word-sized atomic operations are supported
+    if (amo_funct3 != FUNCT3_AMO_W) {
+        if (!trap_raise(cpu_state, CAUSE_ILLEGAL_INSTRUCTION, instr)) {
+            fprintf(stderr, "Encountered unknown/unimplemented 3-bit atomic "
+                    "function code 0x%01x. Halting simulation.\n",
+                    amo_funct3);
+            cpu_state->halted = true;
+        }
+        return;
+    }
+
+    uint32_t result;
+    switch (amo_funct5)
+    {
+        // 5-bit function code for LR.W
+        case FUNCT5_LR: {
+            result = mem_load_reserved32(cpu_state, addr);
+            break;
+        }
+
+        // 5-bit function code for SC.W, which writes 0 to rd on success
+        case FUNCT5_SC: {
+            result = mem_store_conditional32(cpu_state, addr, value) ? 0 : 1;
+            break;
+        }
+
+        // 5-bit function codes for the read-modify-write operations
+        case FUNCT5_AMOSWAP:
+        case FUNCT5_AMOADD:
+        case FUNCT5_AMOXOR:
+        case FUNCT5_AMOAND:
+        case FUNCT5_AMOOR:
+        case FUNCT5_AMOMIN:
+        case FUNCT5_AMOMAX:
+        case FUNCT5_AMOMINU:
+        case FUNCT5_AMOMAXU: {
+            result = mem_amo32(cpu_state, addr, amo_funct5, value);
+            break;
+        }
+
+        default: {
+            if (!trap_raise(cpu_state, CAUSE_ILLEGAL_INSTRUCTION, instr)) {
+                fprintf(stderr, "Encountered unknown/unimplemented 5-bit "
+                        "atomic function code 0x%02x. Halting "
+                        "simulation.\n", amo_funct5);
+                cpu_state->halted = true;
+            }
+            return;
+        }
+    }
+
+    // If the memory access faulted, the instruction has no effect
+    if (cpu_state->halted || cpu_state->csr.trap_pending) {
+        return;
+    }
+
+    register_write(cpu_state, rd, result);
+    cpu_state->pc = cpu_state->pc + sizeof(instr);
+    return;
+}
 
 /**
  * Simulates a single cycle on the CPU, updating the CPU's state as needed.
@@ -63,7 +261,10 @@
 void process_instruction(cpu_state_t *cpu_state)
 {
     // Fetch the 4-bytes for the current instruction
-    uint32_t instr = mem_read32(cpu_state, cpu_state->pc);
+    uint32_t instr = mem_fetch32(cpu_state, cpu_state->pc);
+    if (cpu_state->halted || cpu_state->csr.trap_pending) {
+        return;
+    }
 
     // Decode the opcode, 7-bit function code, and registers
     opcode_t opcode = instr & 0x7F;
@@ -80,8 +281,10 @@ void process_instruction(cpu_state_t *cpu_state)
     // Decode the instruction as an R-type instruction
     rtype_funct3_t rtype_funct3 = (instr >> 12) & 0x7;
 
-    // Decode the 12-bit function code for system instructions
+    // Decode the 12-bit function code and CSR number for system instructions
+    itype_sys_funct3_t sys_funct3 = (instr >> 12) & 0x7;
     itype_funct12_t sys_funct12 = (instr >> 20) & 0xFFF;
+    uint32_t csr_num = (instr >> 20) & 0xFFF;
 
     switch (opcode)
     {
@@ -103,10 +306,14 @@ void process_instruction(cpu_state_t *cpu_state)
                         }
 
                         default: {
-                            fprintf(stderr, "Encountered unknown/unimplemented "
-                                    "7-bit function code 0x%01x. Halting "
-                                    "simulation.\n", funct7);
-                            cpu_state->halted = true;
+                            if (!trap_raise(cpu_state,
+                                    CAUSE_ILLEGAL_INSTRUCTION, instr)) {
+                                fprintf(stderr, "Encountered unknown/"
+                                        "unimplemented 7-bit function code "
+                                        "0x%01x. Halting simulation.\n",
+                                        funct7);
+                                cpu_state->halted = true;
+                            }
                             break;
                         }
                     }
@@ -114,11 +321,14 @@ void process_instruction(cpu_state_t *cpu_state)
                 }
 
                 default: {
-                    fprintf(stderr, "Encountered unknown/unimplemented "
-                            "3-bit rtype function code 0x%01x. Halting "
-                            "simulation.\n",
-                            rtype_funct3);
-                    cpu_state->halted = true;
+                    if (!trap_raise(cpu_state, CAUSE_ILLEGAL_INSTRUCTION,
+                            instr)) {
+                        fprintf(stderr, "Encountered unknown/unimplemented "
+                                "3-bit rtype function code 0x%01x. Halting "
+                                "simulation.\n",
+                                rtype_funct3);
+                        cpu_state->halted = true;
+                    }
                     break;
                 }
             }
@@ -138,10 +348,13 @@ void process_instruction(cpu_state_t *cpu_state)
                 }
 
                 default: {
-                    fprintf(stderr, "Encountered unknown/unimplemented 3-bit "
-                            "itype function code 0x%01x. Halting simulation.\n",
-                            rtype_funct3);
-                    cpu_state->halted = true;
+                    if (!trap_raise(cpu_state, CAUSE_ILLEGAL_INSTRUCTION,
+                            instr)) {
+                        fprintf(stderr, "Encountered unknown/unimplemented "
+                                "3-bit itype function code 0x%01x. Halting "
+                                "simulation.\n", rtype_funct3);
+                        cpu_state->halted = true;
+                    }
                     break;
                 }
             }
@@ -150,37 +363,35 @@ void process_instruction(cpu_state_t *cpu_state)
 
         // General system operation
         case OP_SYSTEM: {
-            switch (sys_funct12)
+            switch (sys_funct3)
             {
-                // 12-bit function code for ECALL
-                case FUNCT12_ECALL: {
-                    /* FIXME: To actually support syscalls, the argument
-                     * register a0 must be read from the register value, and its
-                     * value must equal 0xa to terminate simulation. */
-                    uint32_t a0_value = ECALL_ARG_HALT;
-                    if (a0_value == ECALL_ARG_HALT) {
-                        fprintf(stdout, "ECALL invoked with halt argument, "
-                                "halting the simulator.\n");
-                        cpu_state->halted = true;
-                    }
+                // Privileged instructions, distinguished by the 12-bit code
+                case FUNCT3_PRIV: {
+                    process_priv(cpu_state, instr, sys_funct12);
                     break;
                 }
 
+                // CSR instructions, with a register or immediate operand
                 default: {
-                    fprintf(stderr, "Encountered unknown/unimplemented 12-bit "
-                            "system function code 0x%03x. Halting "
-                            "simulation.\n", sys_funct12);
-                    cpu_state->halted = true;
+                    process_csr(cpu_state, instr, sys_funct3, rd, rs1, csr_num);
                     break;
                 }
             }
             break;
         }
 
+        // Atomic memory operation
+        case OP_AMO: {
+            process_amo(cpu_state, instr, rd, rs1, rs2);
+            break;
+        }
+
         default: {
-            fprintf(stderr, "Encountered unknown opcode 0x%02x. Halting "
-                    "simulation.\n", opcode);
-            cpu_state->halted = true;
+            if (!trap_raise(cpu_state, CAUSE_ILLEGAL_INSTRUCTION, instr)) {
+                fprintf(stderr, "Encountered unknown opcode 0x%02x. Halting "
+                        "simulation.\n", opcode);
+                cpu_state->halted = true;
+            }
             break;
         }
     }